@@ -0,0 +1,95 @@
+#include <ctime>
+#include <cinttypes>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "config.h"
+#include "adaptive_poller.h"
+
+
+// Upper bounds (seconds) of latency histogram buckets. The last bucket is open-ended.
+static const int LATENCY_BUCKETS[POLL_LATENCY_BUCKET_CNT - 1] = {1, 2, 5, 10, 30, 60, 300};
+
+
+AdaptivePoller::AdaptivePoller(int fastInterval, int idleInterval) {
+    setBounds(fastInterval, idleInterval, idleInterval, 0, 0);
+    this->interval = this->fastInterval;
+    this->startTick = xTaskGetTickCount();
+}
+
+void AdaptivePoller::setBounds(int fastInterval, int dayIdleInterval, int nightIdleInterval, int nightStart, int nightEnd) {
+    if (fastInterval < GET_STATUS_INTERVAL)
+        fastInterval = GET_STATUS_INTERVAL;
+    if (dayIdleInterval < fastInterval)
+        dayIdleInterval = fastInterval;
+    if (nightIdleInterval < fastInterval)
+        nightIdleInterval = fastInterval;
+    this->fastInterval      = fastInterval;
+    this->dayIdleInterval   = dayIdleInterval;
+    this->nightIdleInterval = nightIdleInterval;
+    this->nightStart        = nightStart;
+    this->nightEnd          = nightEnd;
+}
+
+// Falls back to the day profile until the clock is synchronized.
+int AdaptivePoller::idleInterval() {
+    time_t now = time(NULL);
+    struct tm local;
+    if (now < TIME_SYNCED_EPOCH || nightStart == nightEnd)
+        return dayIdleInterval;
+    localtime_r(&now, &local);
+    if (nightStart < nightEnd) {
+        if (local.tm_hour >= nightStart && local.tm_hour < nightEnd)
+            return nightIdleInterval;
+    } else if (local.tm_hour >= nightStart || local.tm_hour < nightEnd) {
+        return nightIdleInterval;
+    }
+    return dayIdleInterval;
+}
+
+bool AdaptivePoller::isDue(TickType_t now) {
+    return (int32_t)(now - nextPoll) >= 0;
+}
+
+void AdaptivePoller::onPolled(TickType_t now, bool changed) {
+    int maxInterval = idleInterval();
+
+    polls++;
+    if (changed) {
+        changes++;
+        interval = fastInterval;
+    } else if (interval < maxInterval / 2) {
+        interval *= 2;
+    } else {
+        interval = maxInterval;
+    }
+    nextPoll = now + pdMS_TO_TICKS(interval);
+    ESP_LOGD("AdaptivePoller", "Next poll after %dms.", interval);
+}
+
+void AdaptivePoller::recordLatency(time_t commandTime) {
+    time_t now = time(NULL);
+    int latency, bucket;
+    if (now < TIME_SYNCED_EPOCH || commandTime <= 0)
+        return;
+
+    latency = now - commandTime;
+    for (bucket = 0; bucket < POLL_LATENCY_BUCKET_CNT - 1 && latency >= LATENCY_BUCKETS[bucket]; bucket++);
+    latencyHistogram[bucket]++;
+    ESP_LOGI("AdaptivePoller", "Command-to-actuation latency: %ds", latency);
+}
+
+void AdaptivePoller::logStats() {
+    uint32_t elapsed = pdTICKS_TO_MS(xTaskGetTickCount() - startTick);
+    ESP_LOGI(
+        "AdaptivePoller",
+        "polls=%" PRIu32 " (fixed: %" PRIu32 ") changes=%" PRIu32 " interval=%dms "
+        "latency(<1s/<2s/<5s/<10s/<30s/<60s/<300s/more)=%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32
+        "/%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32,
+        polls, elapsed / GET_STATUS_INTERVAL, changes, interval,
+        latencyHistogram[0], latencyHistogram[1], latencyHistogram[2], latencyHistogram[3],
+        latencyHistogram[4], latencyHistogram[5], latencyHistogram[6], latencyHistogram[7]
+    );
+}
@@ -0,0 +1,72 @@
+#include <cstdlib>
+
+#include "esp_log.h"
+
+#include "config.h"
+#include "adaptive_sampler.h"
+
+
+AdaptiveSampler::AdaptiveSampler(int minInterval, int maxInterval) {
+    setLimits(minInterval, maxInterval);
+    this->interval = this->minInterval;
+}
+
+// A sample weighs at most SAMPLE_WINDOW in the averages, so longer intervals would skew them.
+void AdaptiveSampler::setLimits(int minInterval, int maxInterval) {
+    if (minInterval < GET_SENSOR_TASK_DELAY_MIN)
+        minInterval = GET_SENSOR_TASK_DELAY_MIN;
+    if (minInterval > SAMPLE_WINDOW)
+        minInterval = SAMPLE_WINDOW;
+    if (maxInterval > SAMPLE_WINDOW)
+        maxInterval = SAMPLE_WINDOW;
+    if (maxInterval < minInterval)
+        maxInterval = minInterval;
+    this->minInterval = minInterval;
+    this->maxInterval = maxInterval;
+}
+
+void AdaptiveSampler::setThreshold(int channel, int threshold) {
+    this->thresholds[channel] = threshold;
+}
+
+void AdaptiveSampler::update(int channel, int value) {
+    if (hasLast[channel] && thresholds[channel] > 0) {
+        if (
+            abs(value - lastValues[channel]) >= thresholds[channel]
+            || abs(value - means[channel]) >= thresholds[channel]
+        )
+            triggered = true;
+        means[channel] += (value - means[channel]) / 4;
+    } else {
+        means[channel] = value;
+    }
+    lastValues[channel] = value;
+    hasLast[channel] = true;
+}
+
+// Invalid reading. Next valid value is compared against nothing.
+void AdaptiveSampler::skip(int channel) {
+    hasLast[channel] = false;
+}
+
+TickType_t AdaptiveSampler::nextDelay() {
+    int newInterval;
+    if (triggered)
+        newInterval = minInterval;
+    else if (interval < maxInterval - interval / 2)
+        newInterval = interval + interval / 2;
+    else
+        newInterval = maxInterval;
+    if (newInterval < minInterval)
+        newInterval = minInterval;
+
+    if (newInterval != interval)
+        ESP_LOGI("AdaptiveSampler", "Sampling interval: %dms -> %dms", interval, newInterval);
+    interval = newInterval;
+    triggered = false;
+    return pdMS_TO_TICKS(interval);
+}
+
+int AdaptiveSampler::getInterval() {
+    return interval;
+}
@@ -0,0 +1,215 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cinttypes>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "cJSON.h"
+
+#include "config.h"
+#include "benchmark.h"
+#include "io.h"
+#include "sample_array.h"
+#include "sensor_registry.h"
+#include "derived_metrics.h"
+#include "quantile_sketch.h"
+#include "smartthings/request.h"
+
+#ifdef ENABLE_BENCHMARK
+
+// Preferences of the device profile with every field get_device_config() reads
+#define BENCH_PREFERENCE(name, value) "\"" name "\":{\"value\":" #value "},"
+#define BENCH_CONFIG_JSON "{\"values\":{"\
+    BENCH_PREFERENCE("tempHigh", 27) BENCH_PREFERENCE("tempLow", 18)\
+    BENCH_PREFERENCE("humiHigh", 60) BENCH_PREFERENCE("humiLow", 40)\
+    BENCH_PREFERENCE("fineDustVeryBad", 150) BENCH_PREFERENCE("fineDustBad", 100)\
+    BENCH_PREFERENCE("fineDustWarning", 50) BENCH_PREFERENCE("fineDustNormal", 15)\
+    BENCH_PREFERENCE("illuminanceHigh", 5) BENCH_PREFERENCE("illuminanceLow", 3)\
+    BENCH_PREFERENCE("temperatureOffset", -1.5) BENCH_PREFERENCE("humidityOffset", 3)\
+    BENCH_PREFERENCE("tvocOffset", 0) BENCH_PREFERENCE("temperature2Offset", -2.0)\
+    BENCH_PREFERENCE("pressureOffset", 0.0) BENCH_PREFERENCE("samplingIntervalMin", 2000)\
+    "\"samplingIntervalMax\":{\"value\":30000}}}"
+#define BENCH_STATUS_JSON "{"\
+    "\"switchLevel\":{\"level\":{\"value\":80,\"unit\":\"%\",\"timestamp\":\"2024-05-01T10:00:00.000Z\"}},"\
+    "\"fanSpeed\":{\"fanSpeed\":{\"value\":2,\"timestamp\":\"2024-05-01T09:58:12.345Z\"}},"\
+    "\"switch\":{\"switch\":{\"value\":\"on\",\"timestamp\":\"2024-05-01T09:00:00.000Z\"}}}"
+
+typedef struct {
+    const char *name;
+    benchmark_fn fn;
+    void *arg;
+} _benchmark;
+
+static _benchmark _benchmarks[BENCHMARK_MAX_CNT];
+static int _benchmark_cnt = 0;
+static TickType_t _tick = 0;
+static volatile float _float_sink;
+static volatile int _int_sink;
+static const char *volatile _ptr_sink;
+static uint32_t _allocs = 0, _alloc_bytes = 0;
+
+#ifdef CONFIG_HEAP_USE_HOOKS
+extern "C" void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) {
+    _allocs++;
+    _alloc_bytes += size;
+}
+#endif
+
+
+void benchmark_add(const char *name, benchmark_fn fn, void *arg) {
+    if (_benchmark_cnt >= BENCHMARK_MAX_CNT) {
+        ESP_LOGE("Benchmark:benchmark_add", "Too many benchmarks. Rebooting...");
+        abort();
+    }
+    _benchmarks[_benchmark_cnt].name = name;
+    _benchmarks[_benchmark_cnt].fn   = fn;
+    _benchmarks[_benchmark_cnt].arg  = arg;
+    _benchmark_cnt++;
+}
+
+void _bench_sample_array_write(void *arg) {
+    ((SampleArray*)arg)->writeValue(23.4f, _tick += pdMS_TO_TICKS(GET_SENSOR_TASK_DELAY_MIN));
+}
+
+void _bench_sample_array_average(void *arg) {
+    _float_sink = ((SampleArray*)arg)->getAverage();
+}
+
+void _bench_int_sample_array_write(void *arg) {
+    ((IntSampleArray*)arg)->writeValue(42, _tick += pdMS_TO_TICKS(GET_SENSOR_TASK_DELAY_MIN));
+}
+
+void _bench_int_sample_array_average(void *arg) {
+    _int_sink = ((IntSampleArray*)arg)->getAverage();
+}
+
+void _bench_status_body(void *) {
+    static const derived_metrics derived = {.aqi = 117, .dew_point = 109, .absolute_humidity = 95, .tvoc_index = 2};
+    static const sensor_values values = {
+        .fine_dust = 42, .temperature = 23.4f, .humidity = 45,
+        .temperature2 = 23.9f, .pressure = 1013.2f, .tvoc = 120, .fan = FAN_STATE_READY
+    };
+    _ptr_sink = build_status_body(&values, &derived);
+}
+
+void _bench_derived_metrics(void *) {
+    derived_metrics derived;
+    compute_derived_metrics(42, 23.4f, 45, 120, &derived);
+    _int_sink = derived.dew_point;
+}
+
+void _bench_parse_status(void *) {
+    STStatus status;
+    cJSON *json = cJSON_Parse(BENCH_STATUS_JSON);
+    parse_device_status(json, &status);
+    cJSON_Delete(json);
+    _int_sink = status.switchLevel;
+}
+
+void _bench_parse_config(void *) {
+    DeviceConfig config;
+    cJSON *json = cJSON_Parse(BENCH_CONFIG_JSON);
+    parse_device_config(json, &config);
+    cJSON_Delete(json);
+    _int_sink = config.tempHigh;
+}
+
+void _bench_quantile_add(void *arg) {
+    ((QuantileSketch*)arg)->add(_tick++ % 500);
+}
+
+void _bench_quantile_get(void *arg) {
+    _int_sink = ((QuantileSketch*)arg)->getQuantile(0.95f);
+}
+
+void _bench_strip_pixels(void *arg) {
+    fill_strip_pixels((led_pixel*)arg);
+}
+
+int64_t _bench_loop(const _benchmark *benchmark, uint32_t iterations) {
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+        benchmark->fn(benchmark->arg);
+    return esp_timer_get_time() - start;
+}
+
+// Prints one CSV row. The best of BENCHMARK_REPEAT runs is reported.
+void _bench_run(const _benchmark *benchmark) {
+    uint32_t iterations = 1, cycles, allocs, bytes;
+    uint32_t bestCycles = UINT32_MAX, bestAllocs = 0, bestBytes = 0;
+    int64_t elapsed, bestElapsed = INT64_MAX;
+
+    // Calibrate, so that each run takes at least BENCHMARK_MIN_TIME_US
+    while (_bench_loop(benchmark, iterations) < BENCHMARK_MIN_TIME_US && iterations < (1 << 24))
+        iterations *= 2;
+
+    for (int i = 0; i < BENCHMARK_REPEAT; i++) {
+        allocs = _allocs;
+        bytes  = _alloc_bytes;
+        cycles = esp_cpu_get_cycle_count();
+        elapsed = _bench_loop(benchmark, iterations);
+        cycles = esp_cpu_get_cycle_count() - cycles;
+        if (elapsed < bestElapsed) {
+            bestElapsed = elapsed;
+            bestCycles  = cycles;
+            bestAllocs  = _allocs - allocs;
+            bestBytes   = _alloc_bytes - bytes;
+        }
+    }
+
+    float allocsPerOp = (float)bestAllocs / iterations, bytesPerOp = (float)bestBytes / iterations;
+#ifndef CONFIG_HEAP_USE_HOOKS
+    allocsPerOp = bytesPerOp = -1;  // Not counted
+#endif
+    printf(
+        "BENCH,%s,%" PRIu32 ",%.1f,%" PRIu32 ",%.2f,%.1f\n",
+        benchmark->name, iterations, (double)bestElapsed * 1000 / iterations, bestCycles / iterations,
+        allocsPerOp, bytesPerOp
+    );
+}
+
+void benchmark_task(void *) {
+    SampleArray sampleArray(SAMPLE_ARRAY_SIZE, SAMPLE_PER_UPDATE_STATUS, pdMS_TO_TICKS(SAMPLE_WINDOW));
+    IntSampleArray intSampleArray(SAMPLE_ARRAY_SIZE, SAMPLE_PER_UPDATE_STATUS, pdMS_TO_TICKS(SAMPLE_WINDOW));
+    static QuantileSketch sketch;
+    led_pixel pixels[8];
+    for (int i = 0; i < 8; i++)
+        pixels[i] = {.bright = 6, .r = 255, .g = 165, .b = 0};
+
+    // Fill the arrays, so that averages run over full windows
+    for (int i = 0; i < SAMPLE_ARRAY_SIZE; i++) {
+        _bench_sample_array_write(&sampleArray);
+        _bench_int_sample_array_write(&intSampleArray);
+    }
+    for (int i = 0; i < 1800; i++)  // An hour at the fastest sampling
+        _bench_quantile_add(&sketch);
+
+    benchmark_add("SampleArray::writeValue", _bench_sample_array_write, &sampleArray);
+    benchmark_add("SampleArray::getAverage", _bench_sample_array_average, &sampleArray);
+    benchmark_add("IntSampleArray::writeValue", _bench_int_sample_array_write, &intSampleArray);
+    benchmark_add("IntSampleArray::getAverage", _bench_int_sample_array_average, &intSampleArray);
+    benchmark_add("build_status_body", _bench_status_body, NULL);
+    benchmark_add("compute_derived_metrics", _bench_derived_metrics, NULL);
+    benchmark_add("parse_device_status", _bench_parse_status, NULL);
+    benchmark_add("parse_device_config", _bench_parse_config, NULL);
+    benchmark_add("fill_strip_pixels", _bench_strip_pixels, pixels);
+    benchmark_add("QuantileSketch::add", _bench_quantile_add, &sketch);
+    benchmark_add("QuantileSketch::getQuantile", _bench_quantile_get, &sketch);
+
+#ifndef CONFIG_HEAP_USE_HOOKS
+    ESP_LOGW("Benchmark:benchmark_task", "CONFIG_HEAP_USE_HOOKS is not set. Allocations are reported as -1.");
+#endif
+    printf("BENCH,name,iterations,ns_per_op,cycles_per_op,allocs_per_op,bytes_per_op\n");
+    for (int i = 0; i < _benchmark_cnt; i++)
+        _bench_run(&_benchmarks[i]);
+    printf("BENCH,done\n");
+
+    vTaskDelete(NULL);
+}
+
+#endif
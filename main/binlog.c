@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+
+#include "config.h"
+#include "binlog.h"
+
+
+typedef struct {
+    esp_log_level_t level;
+    const char *tag;
+    const char *format;
+} _binlog_format;
+
+// Slot of the ring buffer. `seq` tells whether the slot is free (== position)
+// or holds a committed record (== position + 1).
+typedef struct {
+    uint32_t seq;
+    uint16_t id;
+    uint16_t reserved;
+    uint32_t tick;
+    uint32_t args[BINLOG_MAX_ARGS];
+} _binlog_record;
+
+#define BINLOG_FORMAT_ENTRY(id, level, tag, format) {level, tag, format},
+static const _binlog_format _formats[BINLOG_FORMAT_CNT] = {
+    BINLOG_FORMATS(BINLOG_FORMAT_ENTRY)
+};
+
+static binlog_stats _stats;
+
+#ifdef ENABLE_BINLOG
+_Static_assert((BINLOG_RING_SIZE & (BINLOG_RING_SIZE - 1)) == 0, "BINLOG_RING_SIZE must be a power of 2.");
+static _binlog_record _ring[BINLOG_RING_SIZE];
+static uint32_t _head = 0, _tail = 0;
+#endif
+
+
+// Formats a record with its printf format. Each conversion is formatted
+// separately, as the argument types are only known from the format string.
+void _binlog_format_record(const _binlog_record *record, char *buf, size_t size) {
+    const char *fmt = _formats[record->id].format;
+    char spec[16];
+    size_t pos = 0, spec_len;
+    int arg = 0, written;
+
+    while (*fmt && pos + 1 < size) {
+        if (*fmt != '%') {
+            buf[pos++] = *fmt++;
+            continue;
+        }
+        if (fmt[1] == '%') {
+            buf[pos++] = '%';
+            fmt += 2;
+            continue;
+        }
+
+        spec_len = strcspn(fmt + 1, "diouxXcfFeEgG") + 2;
+        if (spec_len >= sizeof(spec) || fmt[spec_len - 1] == '\0' || arg >= BINLOG_MAX_ARGS)
+            break;
+        memcpy(spec, fmt, spec_len);
+        spec[spec_len] = '\0';
+        fmt += spec_len;
+
+        switch (spec[spec_len - 1]) {
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+                union { uint32_t u; float f; } conv = {.u = record->args[arg++]};
+                written = snprintf(buf + pos, size - pos, spec, (double)conv.f);
+                break;
+            }
+            default:
+                written = snprintf(buf + pos, size - pos, spec, (int)record->args[arg++]);
+                break;
+        }
+        if (written < 0)
+            break;
+        pos += (size_t)written < size - pos ? (size_t)written : size - pos - 1;
+    }
+    buf[pos] = '\0';
+}
+
+void _binlog_emit(const _binlog_record *record) {
+    const _binlog_format *format = &_formats[record->id];
+#ifdef BINLOG_RAW_OUTPUT
+    // Frame: magic (2) | id (2) | tick (4) | args (4 * BINLOG_MAX_ARGS), little endian
+    static const uint16_t magic = BINLOG_RAW_MAGIC;
+    (void)format;
+    fwrite(&magic, sizeof(magic), 1, stdout);
+    fwrite(&record->id, sizeof(record->id), 1, stdout);
+    fwrite(&record->tick, sizeof(record->tick), 1, stdout);
+    fwrite(record->args, sizeof(record->args), 1, stdout);
+#else
+    char line[BINLOG_LINE_SIZE];
+    if (esp_log_level_get(format->tag) < format->level)
+        return;
+    _binlog_format_record(record, line, sizeof(line));
+    ESP_LOG_LEVEL(format->level, format->tag, "(%" PRIu32 ") %s", (uint32_t)pdTICKS_TO_MS(record->tick), line);
+#endif
+}
+
+#ifdef ENABLE_BINLOG
+// Multi-producer ring buffer without locks. A full ring drops the new record.
+void binlog_write(binlog_id id, uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    uint32_t start_cycle = esp_cpu_get_cycle_count();
+    uint32_t pos = __atomic_load_n(&_head, __ATOMIC_RELAXED), seq;
+    _binlog_record *record;
+
+    while (1) {
+        record = &_ring[pos & (BINLOG_RING_SIZE - 1)];
+        seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&_head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if ((int32_t)(seq - pos) < 0) {
+            __atomic_fetch_add(&_stats.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    record->id      = id;
+    record->tick    = xTaskGetTickCount();
+    record->args[0] = arg0;
+    record->args[1] = arg1;
+    record->args[2] = arg2;
+    __atomic_store_n(&record->seq, pos + 1, __ATOMIC_RELEASE);
+
+    __atomic_fetch_add(&_stats.writes, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&_stats.cycles, esp_cpu_get_cycle_count() - start_cycle, __ATOMIC_RELAXED);
+}
+
+// Single consumer
+void _binlog_drain_task(void *arg) {
+    _binlog_record *record, copy;
+
+    while (1) {
+        record = &_ring[_tail & (BINLOG_RING_SIZE - 1)];
+        if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != _tail + 1) {
+            vTaskDelay(pdMS_TO_TICKS(BINLOG_DRAIN_INTERVAL));
+            continue;
+        }
+        copy = *record;
+        __atomic_store_n(&record->seq, _tail + BINLOG_RING_SIZE, __ATOMIC_RELEASE);
+        _tail++;
+        _binlog_emit(&copy);
+    }
+}
+
+void binlog_init(void) {
+    for (uint32_t i = 0; i < BINLOG_RING_SIZE; i++)
+        _ring[i].seq = i;
+    xTaskCreate(_binlog_drain_task, "binlog_drain", BINLOG_DRAIN_STACK_SIZE, NULL, BINLOG_DRAIN_PRIORITY, NULL);
+}
+#else
+// Synchronous fallback, formats in the caller like ESP_LOGx.
+void binlog_write(binlog_id id, uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    uint32_t start_cycle = esp_cpu_get_cycle_count();
+    _binlog_record record = {
+        .id   = id,
+        .tick = xTaskGetTickCount(),
+        .args = {arg0, arg1, arg2}
+    };
+    _binlog_emit(&record);
+    _stats.writes++;
+    _stats.cycles += esp_cpu_get_cycle_count() - start_cycle;
+}
+
+void binlog_init(void) {}
+#endif
+
+void binlog_get_stats(binlog_stats *result) {
+    *result = _stats;
+}
+
+// Cost of call sites, to compare deferred and synchronous mode.
+void binlog_log_stats(void) {
+    ESP_LOGI(
+        "Binlog", "writes=%" PRIu32 " dropped=%" PRIu32 " cycles/write=%" PRIu32,
+        _stats.writes, _stats.dropped, _stats.writes ? _stats.cycles / _stats.writes : 0
+    );
+}
@@ -0,0 +1,42 @@
+#include <cmath>
+#include <cstdint>
+
+#include "config.h"
+#include "change_detector.h"
+
+
+bool ChangeDetector::add(int value) {
+    float x = (float)value, deviation, sigma, z;
+
+    if (samples++ == 0) {
+        mean = x;
+        return false;
+    }
+    deviation = x - mean;
+    sigma = sqrtf(variance);
+    if (sigma < minSigma)
+        sigma = minSigma;
+    z = deviation / sigma;
+
+    if (samples > CHANGE_DETECT_WARMUP) {
+        cusum += z - CHANGE_DETECT_K;
+        if (cusum < 0.0f)
+            cusum = 0.0f;
+        if (cusum > CHANGE_DETECT_H) {
+            // Follow the new level instead of triggering on every sample of it
+            cusum = 0.0f;
+            mean  = x;
+            triggers++;
+            return true;
+        }
+    }
+
+    // Outliers are clipped, so that a spike does not inflate the variance
+    if (z > CHANGE_DETECT_CLIP)
+        deviation = CHANGE_DETECT_CLIP * sigma;
+    else if (z < -CHANGE_DETECT_CLIP)
+        deviation = -CHANGE_DETECT_CLIP * sigma;
+    mean += CHANGE_DETECT_ALPHA * deviation;
+    variance = (1.0f - CHANGE_DETECT_ALPHA) * (variance + CHANGE_DETECT_ALPHA * deviation * deviation);
+    return false;
+}
@@ -8,15 +8,165 @@
 #include "driver/i2c.h"
 
 // SmartThings
-#define SET_DEVICE_STATUS_BUF_SIZE   2048
+// #define ST_API_BASE_URL "http://192.168.0.10:8090"  // Local stand-in instead of the cloud. See tools/st_standin.py.
 #define GET_STATUS_INTERVAL          5000
 #define GET_CONFIG_PER_GET_STATUS    2
 #define UPDATE_STATUS_PER_GET_STATUS 3
+#define SENSOR_HEALTH_LOG_PER_GET_STATUS 60  // Also I2C stats and request budget
+
+// Request budget
+// Token bucket shared by every SmartThings call, and backoff after failed calls.
+// Calls over the budget or during backoff fail without a request.
+#define ST_BUDGET_CAPACITY        6     // Burst
+#define ST_BUDGET_REFILL_INTERVAL 2000  // Per token, i.e. 30 calls per minute sustained
+#define ST_BACKOFF_MIN            5000
+#define ST_BACKOFF_MAX            300000
+#define ST_START_JITTER           5000  // Random delay before the first call, so that units powered up together spread
+
+// API client
+// Every call is a new connection, whose TLS session is resumed, also after a reboot. See st_client.c.
+#define ST_CLIENT_TIMEOUT            10000     // TCP connect, send and each receive (ms). Not DNS.
+#define ST_CLIENT_MAX_RESPONSE       16384     // Header and body
+#define ST_CLIENT_HOST_MAX_LEN       64
+#define ST_TLS_SESSION_LIFETIME      86400     // s. Older sessions are not offered. The server may expire them earlier.
+#define ST_TLS_SESSION_NVS_NAMESPACE "st_tls"
+
+// Adaptive status polling (Defaults, overridden by preferences)
+// GET_STATUS_INTERVAL is the fast interval.
+#define POLL_INTERVAL_IDLE  60000
+#define POLL_INTERVAL_NIGHT 300000
+#define POLL_NIGHT_START    0  // Hour, local time
+#define POLL_NIGHT_END      7
+#define POLL_STATS_LOG_PER_GET_STATUS 720
+
+// Binary logging
+#define ENABLE_BINLOG  // Comment out to format hot-path logs synchronously
+// #define BINLOG_RAW_OUTPUT  // Stream raw frames for tools/binlog_decode.py instead of formatting on device
+#define BINLOG_RING_SIZE        64  // Power of 2
+#define BINLOG_LINE_SIZE        128
+#define BINLOG_RAW_MAGIC        0xB10C
+#define BINLOG_DRAIN_INTERVAL   100
+#define BINLOG_DRAIN_STACK_SIZE 3072
+#define BINLOG_DRAIN_PRIORITY   1
+
+// Derived metrics
+// AQI, dew point, absolute humidity and TVOC index are computed from every average.
+// Reporting them needs custom capabilities of ST_CAPABILITY_NAMESPACE in the device profile.
+// They share the POST of the raw values, which a profile without them rejects as a whole. Then no
+// status is uploaded, and a new OTA image is never confirmed and rolls back.
+// #define ENABLE_DERIVED_METRICS_REPORT  // Only with the custom capabilities in the profile
+
+// Quantile sketches
+// p50/p95/p99 of raw PM2.5 and TVOC samples per hour and day, from boot. Logged at every hour,
+// and streamed as "quantiles" events with ENABLE_SSE_SERVER. See quantile_sketch.h.
+#define ENABLE_QUANTILE_SKETCH  // Comment out to save 2.3KB
+#define QUANTILE_SKETCH_ACCURACY 0.02f  // Relative error
+#define QUANTILE_SKETCH_KEYS     280    // Buckets, up to about 70000 at QUANTILE_SKETCH_ACCURACY
+#define QUANTILE_HOUR            3600000
+#define QUANTILE_HOURS_PER_DAY   24
+
+// Change detection
+// Upward steps of raw PM2.5 and TVOC samples upload the triggering sample right away,
+// outside of UPDATE_STATUS_PER_GET_STATUS. See change_detector.h and tools/change_eval.py.
+#define ENABLE_CHANGE_ALERT  // Comment out to report on the regular schedule only
+#define CHANGE_DETECT_ALPHA      0.05f  // Baseline EWMA weight, i.e. about 20 samples
+#define CHANGE_DETECT_K          1.0f   // Sigmas of drift allowed per sample
+#define CHANGE_DETECT_H          8.0f   // Sigmas of CUSUM to trigger
+#define CHANGE_DETECT_CLIP       3.0f   // Sigmas of deviation taken into the baseline
+#define CHANGE_DETECT_WARMUP     10     // Samples before triggering
+#define CHANGE_DETECT_MIN_SIGMA_FINE_DUST 3.0f
+#define CHANGE_DETECT_MIN_SIGMA_TVOC      25.0f
+#define CHANGE_ALERT_MIN_INTERVAL 60000  // Between alert uploads. Triggers in between are sent once it has passed.
+
+// Local rules
+// Compiled from the "localRules" preference. See rule_engine.h for the syntax.
+// notify actions send ST_CAPABILITY_NAMESPACE.localRule events.
+#define RULE_MAX_CNT          8
+#define RULE_SOURCE_MAX_LEN   128
+#define RULE_LED_BLINK_PERIOD 500
+
+// Task monitor
+#define TASK_MONITOR_MAX_TASKS            16
+#define TASK_MONITOR_PUBLISH_PER_GET_STATUS 60  // Also job executor stats
+
+// Job executor
+// Status LED and WS2812 jobs run as coroutines on one task. See job_executor.h.
+#define JOB_EXECUTOR_STACK_SIZE 3072
+#define JOB_EXECUTOR_PRIORITY   10
+#define JOB_EXECUTOR_MAX_JOBS   4
+#define JOB_FRAME_SIZE          256  // Bytes per coroutine frame. Multiple of 16.
+#define JOB_FRAME_POOL_SIZE     2
+#define JOB_REPLACED_STACKS     (2048 + 4096)  // Stacks of led_task and ws2812_task, for the saved RAM in stats
+
+// OTA
+// Set OTA_MANIFEST_URL in secrets.h. Serve it with tools/ota_server.py for local tests, which is plain HTTP.
+// Images are checked against the SHA-256 of the manifest, so over plain HTTP the manifest is the weak spot.
+// Signed images close it and are opt-in: generate a key once with
+//     espsecure.py generate_signing_key --version 2 --scheme rsa3072 secure_boot_signing_key.pem
+// and enable "Require signed app images" (CONFIG_SECURE_SIGNED_APPS_NO_SECURE_BOOT) in menuconfig.
+// Keep the key out of the repository; every later image must be signed with it.
+#define ENABLE_DELTA_OTA  // Comment out to disable updates. Rollback of new images works without it.
+#define OTA_CHECK_INTERVAL    21600000  // 6 hours
+#define OTA_VALIDATE_TIMEOUT  1800000   // Roll back when a new image can not upload status in time
+#define OTA_HTTP_TIMEOUT      10000
+#define OTA_URL_MAX_LEN       256
+#define OTA_BUFFER_SIZE       2048      // Also the size limit of the manifest
+#define OTA_TASK_STACK_SIZE   6144
+#define OTA_TASK_PRIORITY     2
+
+// Time
+#define SNTP_SERVER       "pool.ntp.org"
+#define LOCAL_TIMEZONE    "KST-9"
+#define TIME_SYNCED_EPOCH 1577836800  // 2020-01-01, earlier time means not synchronized yet
+
+// Wi-Fi
+#define WIFI_RECONNECT_BACKOFF_MIN 250
+#define WIFI_RECONNECT_BACKOFF_MAX 60000
+#define WIFI_CACHE_MAX_FAILURES    2  // Failed connects to the cached AP before full scan
+#define WIFI_CACHE_NVS_NAMESPACE   "wifi_cache"
 
 // Semaphore
 #define SEMAPHORE_MAX_WAIT               pdMS_TO_TICKS(5000)
 #define CONFIG_SEMAPHORE_MAX_VALUE       3
-#define LAST_AVERAGE_SEMAPHORE_MAX_VALUE 3
+
+// Data bus
+#define DATA_BUS_POOL_SIZE        8
+#define DATA_BUS_MAX_SUBSCRIBERS  4
+
+// Live stream
+// Server-Sent Events on http://<device>:SSE_PORT/events, and /events?raw=1 for raw readings too.
+// See tools/sse_load_test.py.
+#define ENABLE_SSE_SERVER  // Comment out to disable the stream
+#define SSE_PORT               8080
+#define SSE_MAX_CLIENTS        4     // Each takes one of CONFIG_LWIP_MAX_SOCKETS
+#define SSE_CLIENT_BUFFER_SIZE 1536  // Unsent bytes per client. Clients falling further behind are dropped.
+#define SSE_BUS_DEPTH          2     // Data bus snapshots reserved for the stream
+#define SSE_SAMPLE_QUEUE_LEN   4
+#define SSE_RETRY_INTERVAL     1000  // After a failed select()
+#define SSE_KEEPALIVE_INTERVAL 15000
+#define SSE_TASK_STACK_SIZE    4096
+#define SSE_TASK_PRIORITY      3
+
+// Benchmark
+// #define ENABLE_BENCHMARK  // Run benchmarks at boot instead of normal operation
+#define BENCHMARK_MIN_TIME_US 200000  // Per run
+#define BENCHMARK_REPEAT      5
+#define BENCHMARK_MAX_CNT     16
+#define BENCHMARK_STACK_SIZE  8192
+
+// Sensor trace
+// #define ENABLE_TRACE_RECORD  // Record raw readings and averages
+// #define ENABLE_TRACE_REPLAY  // Replay the recorded trace instead of reading sensors
+#define TRACE_SINK_FLASH  // Comment out to stream frames to UART (Recording only)
+#define TRACE_PARTITION_LABEL "trace"  // Data partition of partitions.csv
+#define TRACE_FRAME_MAGIC     0x7ACE
+
+// Warm start
+// Windows, the last average, fan speed and config are kept in RTC memory, which survives
+// every reset except power-on. Fresh state skips the startup delays after a crash or update.
+#define ENABLE_WARM_START  // Comment out to always cold start
+#define WARM_START_MAX_AGE 60000  // Older state is discarded
+#define WARM_START_MAGIC   0x57A2
 
 // Status LED
 #define STATUS_LED_BRIGHT 8
@@ -33,6 +183,16 @@
 #define GET_SENSOR_TASK_DELAY_MIN 2000
 #define SAMPLE_PER_UPDATE_STATUS  3
 
+// Adaptive sampling (Defaults, overridden by preferences)
+#define SAMPLING_INTERVAL_MAX        15000  // At most SAMPLE_WINDOW, which the preference is clamped to as well
+#define SAMPLING_FINE_DUST_THRESHOLD 5   // µg/m^3
+#define SAMPLING_TVOC_THRESHOLD      50  // ppb
+
+// Sensor circuit breaker
+#define SENSOR_BREAKER_THRESHOLD   3       // Consecutive failures before skipping a sensor
+#define SENSOR_BREAKER_BACKOFF_MIN 10000
+#define SENSOR_BREAKER_BACKOFF_MAX 300000
+
 // PM1006
 #define PM1006_TIMEOUT     5000
 #define PM1006_TX_BUF_SIZE 256
@@ -40,8 +200,20 @@
 #define PM1006_THRESHOLD   199
 #define PM1006_FAN_STARTUP_DELAY 5000
 
+// PM1006 Fan
+#define FAN_PWM_FREQUENCY 25000
+#define FAN_SPEED_DUTY    {0, 40, 60, 80, 100}  // Duty (%) of each fanSpeed level, 0 to FAN_SPEED_MAX
+#define FAN_SPEED_MAX     4
+#define FAN_AUTO_PERIOD   60000                 // Start-to-start time of measurement windows in auto mode
+
 // I2C
+// Each sensor is assigned to a bus with its *_I2C_NUM. Buses are swept concurrently.
+// e.g. AHT20 and BMP280 on I2C_NUM_0 at 400k, and the slow AGS02MA alone on I2C_NUM_1 at 20k.
 #define I2C_NUM0_CLOCK_SPEED 20000  // 20k
+// #define I2C_NUM1_CLOCK_SPEED 20000  // Uncomment to use I2C_NUM_1 (PIN_I2C_NUM1_*)
+#define I2C_BUS_CLEAR_HALF_PERIOD_US 25
+#define I2C_SWEEP_STACK_SIZE 3072
+#define I2C_SWEEP_PRIORITY   12  // Same as get_sensor_value_task
 
 // AHT20
 #define AHT20_I2C_NUM  I2C_NUM_0
@@ -51,6 +223,15 @@
 #define BMP280_I2C_NUM  I2C_NUM_0
 #define BMP280_I2C_ADDR 0x77
 #define BMP280_TIMEOUT  1000
+// Hardware IIR filter replaces the software window of temperature2 and pressure.
+// The sensor measures about once a second by itself, and the filter (Coefficient 16)
+// averages over a time similar to SAMPLE_WINDOW. So it is read only once per report.
+#define BMP280_HW_FILTER  // Comment out to average in software
+#ifdef BMP280_HW_FILTER
+#define BMP280_READ_INTERVAL (GET_STATUS_INTERVAL * UPDATE_STATUS_PER_GET_STATUS)
+#else
+#define BMP280_READ_INTERVAL 0
+#endif
 
 // AGS02MA
 #define AGS02MA_I2C_NUM  I2C_NUM_0
@@ -62,6 +243,8 @@
 #define PIN_PM1006_FAN   GPIO_NUM_18
 #define PIN_I2C_NUM0_SDA GPIO_NUM_17
 #define PIN_I2C_NUM0_SCL GPIO_NUM_21
+#define PIN_I2C_NUM1_SDA GPIO_NUM_11  // Free pins of the default wiring
+#define PIN_I2C_NUM1_SCL GPIO_NUM_12
 #define PIN_WS2812       GPIO_NUM_34
 #define PIN_PM1006_TX    GPIO_NUM_33
 #define PIN_PM1006_RX    GPIO_NUM_35
@@ -72,5 +255,10 @@
 #if GET_SENSOR_TASK_DELAY < GET_SENSOR_TASK_DELAY_MIN
 #error Too small SAMPLE_PER_UPDATE_STATUS
 #endif
+#define SAMPLE_WINDOW     ((GET_SENSOR_TASK_DELAY) * SAMPLE_PER_UPDATE_STATUS)
+#define SAMPLE_ARRAY_SIZE (SAMPLE_WINDOW / GET_SENSOR_TASK_DELAY_MIN + 1)
+#if SAMPLING_INTERVAL_MAX > SAMPLE_WINDOW
+#error SAMPLING_INTERVAL_MAX must not exceed SAMPLE_WINDOW
+#endif
 
 #endif
@@ -8,5 +8,9 @@
 // SmartThings
 #define ST_ACCESS_TOKEN "[[ACCESS_TOKEN]]"
 #define ST_DEVICE_ID    "[[DEVICE_ID]]"
+#define ST_CAPABILITY_NAMESPACE "[[CAPABILITY_NAMESPACE]]"  // Of custom capabilities
+
+// OTA
+#define OTA_MANIFEST_URL "[[OTA_MANIFEST_URL]]"  // e.g. "https://example.com/vindriktning/manifest.json"
 
 #endif
@@ -0,0 +1,198 @@
+#include <cstdlib>
+#include <cinttypes>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+
+#include "config.h"
+#include "data_bus.h"
+
+// Snapshots which are never queued: latest, previous latest still held by
+// data_bus_acquire_latest() and the one being published.
+#define RESERVED_SNAPSHOTS 3
+
+
+typedef struct {
+    QueueHandle_t queue;
+    data_bus_drop_policy policy;
+    TaskHandle_t notifyTask;
+    uint32_t notifyBits;
+    data_bus_wake_fn wake;
+    data_bus_subscriber_stats stats;
+} _subscriber;
+
+static data_bus_snapshot _pool[DATA_BUS_POOL_SIZE];
+static QueueHandle_t _free;
+static _subscriber _subscribers[DATA_BUS_MAX_SUBSCRIBERS];
+static int _subscriber_cnt = 0;
+static UBaseType_t _pool_reserved = RESERVED_SNAPSHOTS;
+static data_bus_snapshot *_latest = NULL;
+static uint32_t _seq = 0;
+static uint32_t _pool_exhausted = 0;
+static portMUX_TYPE _latest_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+void init_data_bus(void) {
+    _free = xQueueCreate(DATA_BUS_POOL_SIZE, sizeof(data_bus_snapshot*));
+    if (_free == NULL) {
+        ESP_LOGE("DataBus:init_data_bus", "Failed to create pool queue. Rebooting...");
+        abort();
+    }
+    for (int i = 0; i < DATA_BUS_POOL_SIZE; i++) {
+        data_bus_snapshot *snapshot = &_pool[i];
+        xQueueSend(_free, &snapshot, 0);
+    }
+}
+
+// Call before the producer starts. Each subscriber reserves `depth` queued
+// snapshots plus the one it is processing, so the pool can never run dry
+// as long as consumers release before receiving the next one.
+int data_bus_subscribe(const char *name, UBaseType_t depth, data_bus_drop_policy policy) {
+    if (_subscriber_cnt >= DATA_BUS_MAX_SUBSCRIBERS || _pool_reserved + depth + 1 > DATA_BUS_POOL_SIZE) {
+        ESP_LOGE("DataBus:data_bus_subscribe", "No room for subscriber %s. Rebooting...", name);
+        abort();
+    }
+    _subscriber *subscriber = &_subscribers[_subscriber_cnt];
+    subscriber->queue = xQueueCreate(depth, sizeof(data_bus_snapshot*));
+    if (subscriber->queue == NULL) {
+        ESP_LOGE("DataBus:data_bus_subscribe", "Failed to create queue of %s. Rebooting...", name);
+        abort();
+    }
+    subscriber->policy     = policy;
+    subscriber->notifyTask = NULL;
+    subscriber->wake       = NULL;
+    subscriber->stats      = {};
+    subscriber->stats.name = name;
+    _pool_reserved += depth + 1;
+    return _subscriber_cnt++;
+}
+
+// For consumers which wait on more than the subscription, e.g. jobs of JobExecutor.
+// Sets bits of the task notification of `task` whenever a snapshot is queued.
+// Receive with zero timeout after the notification.
+void data_bus_notify(int id, TaskHandle_t task, uint32_t bits) {
+    _subscribers[id].notifyBits = bits;
+    __atomic_store_n(&_subscribers[id].notifyTask, task, __ATOMIC_RELEASE);
+}
+
+// For consumers which wait in select(), where a task notification does not reach.
+// `wake` runs on the producer whenever a snapshot is queued, so it must not block.
+void data_bus_wake(int id, data_bus_wake_fn wake) {
+    __atomic_store_n(&_subscribers[id].wake, wake, __ATOMIC_RELEASE);
+}
+
+void data_bus_release(const data_bus_snapshot *snapshot) {
+    data_bus_snapshot *owned = const_cast<data_bus_snapshot*>(snapshot);
+    if (__atomic_sub_fetch(&owned->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        xQueueSend(_free, &owned, 0);
+}
+
+// Never blocks. Slow subscribers lose snapshots according to their drop policy.
+esp_err_t data_bus_publish(const sensor_values *values, const derived_metrics *derived) {
+    data_bus_snapshot *snapshot, *old;
+
+    if (xQueueReceive(_free, &snapshot, 0) != pdTRUE) {
+        _pool_exhausted++;
+        ESP_LOGW("DataBus:data_bus_publish", "Snapshot pool exhausted.");
+        return ESP_ERR_NO_MEM;
+    }
+    snapshot->seq     = ++_seq;
+    snapshot->tick    = xTaskGetTickCount();
+    snapshot->values  = *values;
+    snapshot->derived = *derived;
+    // One for each subscriber, one for _latest and one held until the fan-out is done
+    __atomic_store_n(&snapshot->refs, _subscriber_cnt + 2, __ATOMIC_RELEASE);
+
+    for (int i = 0; i < _subscriber_cnt; i++) {
+        _subscriber *subscriber = &_subscribers[i];
+        if (xQueueSend(subscriber->queue, &snapshot, 0) != pdTRUE) {
+            subscriber->stats.dropped++;
+            if (
+                subscriber->policy == DATA_BUS_DROP_NEWEST
+                || xQueueReceive(subscriber->queue, &old, 0) != pdTRUE
+            ) {
+                data_bus_release(snapshot);
+                continue;
+            }
+            data_bus_release(old);
+            if (xQueueSend(subscriber->queue, &snapshot, 0) != pdTRUE) {
+                data_bus_release(snapshot);
+                continue;
+            }
+        }
+        TaskHandle_t notifyTask = __atomic_load_n(&subscriber->notifyTask, __ATOMIC_ACQUIRE);
+        if (notifyTask != NULL)
+            xTaskNotify(notifyTask, subscriber->notifyBits, eSetBits);
+        data_bus_wake_fn wake = __atomic_load_n(&subscriber->wake, __ATOMIC_ACQUIRE);
+        if (wake != NULL)
+            wake();
+        UBaseType_t queued = uxQueueMessagesWaiting(subscriber->queue);
+        if (queued > subscriber->stats.max_queued)
+            subscriber->stats.max_queued = queued;
+    }
+
+    taskENTER_CRITICAL(&_latest_lock);
+    old = _latest;
+    _latest = snapshot;
+    taskEXIT_CRITICAL(&_latest_lock);
+    if (old != NULL)
+        data_bus_release(old);
+
+    data_bus_release(snapshot);
+    return ESP_OK;
+}
+
+const data_bus_snapshot *data_bus_receive(int id, TickType_t xTicksToWait) {
+    _subscriber *subscriber = &_subscribers[id];
+    data_bus_snapshot *snapshot;
+    uint32_t lag;
+    TickType_t latency;
+
+    if (xQueueReceive(subscriber->queue, &snapshot, xTicksToWait) != pdTRUE)
+        return NULL;
+
+    lag = __atomic_load_n(&_seq, __ATOMIC_RELAXED) - snapshot->seq;
+    latency = xTaskGetTickCount() - snapshot->tick;
+    subscriber->stats.delivered++;
+    subscriber->stats.last_seq = snapshot->seq;
+    if (lag > subscriber->stats.max_lag)
+        subscriber->stats.max_lag = lag;
+    if (latency > subscriber->stats.max_latency)
+        subscriber->stats.max_latency = latency;
+    return snapshot;
+}
+
+// For consumers which only need the newest value. Returns NULL before the first publish.
+const data_bus_snapshot *data_bus_acquire_latest(void) {
+    data_bus_snapshot *snapshot;
+
+    taskENTER_CRITICAL(&_latest_lock);
+    snapshot = _latest;
+    if (snapshot != NULL)
+        __atomic_add_fetch(&snapshot->refs, 1, __ATOMIC_ACQ_REL);
+    taskEXIT_CRITICAL(&_latest_lock);
+    return snapshot;
+}
+
+void data_bus_get_stats(int id, data_bus_subscriber_stats *result) {
+    *result = _subscribers[id].stats;
+}
+
+void log_data_bus_stats(void) {
+    ESP_LOGI(
+        "DataBus:stats", "seq=%" PRIu32 " free=%u exhausted=%" PRIu32,
+        _seq, (unsigned int)uxQueueMessagesWaiting(_free), _pool_exhausted
+    );
+    for (int i = 0; i < _subscriber_cnt; i++) {
+        const data_bus_subscriber_stats *stats = &_subscribers[i].stats;
+        ESP_LOGI(
+            "DataBus:stats",
+            "%s: delivered=%" PRIu32 " dropped=%" PRIu32 " lag=%" PRIu32 " max_lag=%" PRIu32
+            " max_latency=%" PRIu32 "ms max_queued=%u",
+            stats->name, stats->delivered, stats->dropped, _seq - stats->last_seq, stats->max_lag,
+            (uint32_t)pdTICKS_TO_MS(stats->max_latency), (unsigned int)stats->max_queued
+        );
+    }
+}
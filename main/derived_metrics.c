@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include <limits.h>
+#include <float.h>
+
+#include "derived_metrics.h"
+
+#define ARRAY_LEN(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+typedef struct {
+    int16_t c_low, c_high;
+    int16_t i_low, i_high;
+} _breakpoint;
+
+// US EPA PM2.5 AQI (2024 revision). Concentration in 0.1 µg/m^3.
+static const _breakpoint _pm25_aqi[] = {
+    {0,    90,   0,   50},
+    {91,   354,  51,  100},
+    {355,  554,  101, 150},
+    {555,  1254, 151, 200},
+    {1255, 2254, 201, 300},
+    {2255, 3254, 301, 500}
+};
+
+// Upper bounds of UBA TVOC levels 1 - 4 (0.3, 1, 3, 10 mg/m^3) in ppb,
+// converted with 4.5 µg/m^3 per ppb of the AGS02MA reference gas mixture.
+static const int16_t _tvoc_levels[] = {67, 222, 667, 2222};
+
+// Saturation vapor pressure over water in Pa, from SVP_T_MIN by SVP_T_STEP.
+// Magnus form of Buck (1996): 611.21 * exp((18.678 - T / 234.5) * (T / (257.14 + T)))
+#define SVP_T_MIN  -400  // 0.1 °C
+#define SVP_T_STEP 10
+static const uint16_t _svp[] = {
+    19,    21,    23,    26,    28,    31,    35,    38,    42,    46,     // -40 °C
+    51,    56,    61,    67,    74,    81,    88,    97,    106,   115,    // -30 °C
+    126,   137,   149,   162,   176,   191,   208,   225,   244,   265,    // -20 °C
+    287,   310,   335,   362,   391,   422,   455,   490,   528,   568,    // -10 °C
+    611,   657,   706,   758,   813,   872,   935,   1002,  1073,  1148,   //   0 °C
+    1228,  1313,  1402,  1498,  1598,  1705,  1818,  1938,  2064,  2197,   //  10 °C
+    2338,  2487,  2644,  2810,  2984,  3169,  3362,  3567,  3781,  4007,   //  20 °C
+    4245,  4495,  4758,  5033,  5323,  5627,  5946,  6280,  6630,  6998,   //  30 °C
+    7382,  7785,  8207,  8648,  9110,  9592,  10097, 10624, 11174, 11749,  //  40 °C
+    12349, 12976, 13629, 14310, 15020, 15760, 16531, 17334, 18170, 19040,  //  50 °C
+    19945                                                                  //  60 °C
+};
+#define SVP_T_MAX (SVP_T_MIN + SVP_T_STEP * ((int)ARRAY_LEN(_svp) - 1))
+
+#define ZERO_CELSIUS_KELVIN 2732  // 0.1 K
+
+
+// Divisor must be positive
+int _div_round(int dividend, int divisor) {
+    return dividend >= 0 ? (dividend + divisor / 2) / divisor : (dividend - divisor / 2) / divisor;
+}
+
+int _piecewise_linear(const _breakpoint *table, int len, int value) {
+    if (value <= table[0].c_low)
+        return table[0].i_low;
+    for (int i = 0; i < len; i++) {
+        if (value > table[i].c_high)
+            continue;
+        if (value < table[i].c_low)  // Between two rows
+            value = table[i].c_low;
+        return table[i].i_low + _div_round(
+            (table[i].i_high - table[i].i_low) * (value - table[i].c_low), table[i].c_high - table[i].c_low
+        );
+    }
+    return table[len - 1].i_high;
+}
+
+// In Pa. temperature is in 0.1 °C.
+int _saturation_vapor_pressure(int temperature) {
+    if (temperature <= SVP_T_MIN)
+        return _svp[0];
+    if (temperature >= SVP_T_MAX)
+        return _svp[ARRAY_LEN(_svp) - 1];
+    int i = (temperature - SVP_T_MIN) / SVP_T_STEP;
+    int frac = (temperature - SVP_T_MIN) % SVP_T_STEP;
+    return _svp[i] + _div_round((_svp[i + 1] - _svp[i]) * frac, SVP_T_STEP);
+}
+
+// Inverse of _saturation_vapor_pressure(). Returns 0.1 °C.
+int _dew_point(int vapor_pressure) {
+    int low = 0, high = ARRAY_LEN(_svp) - 1, mid;
+
+    if (vapor_pressure <= _svp[low])
+        return SVP_T_MIN;
+    if (vapor_pressure >= _svp[high])
+        return SVP_T_MAX;
+    while (high - low > 1) {  // _svp[low] < vapor_pressure <= _svp[high]
+        mid = (low + high) / 2;
+        if (_svp[mid] < vapor_pressure)
+            low = mid;
+        else
+            high = mid;
+    }
+    return SVP_T_MIN + low * SVP_T_STEP + _div_round(
+        (vapor_pressure - _svp[low]) * SVP_T_STEP, _svp[high] - _svp[low]
+    );
+}
+
+void compute_derived_metrics(int fine_dust, float temperature, int humidity, int tvoc, derived_metrics *result) {
+    if (fine_dust == INT_MIN)
+        result->aqi = INT_MIN;
+    else if (fine_dust > _pm25_aqi[ARRAY_LEN(_pm25_aqi) - 1].c_high / 10)  // Also INT_MAX of too high readings
+        result->aqi = _pm25_aqi[ARRAY_LEN(_pm25_aqi) - 1].i_high;
+    else
+        result->aqi = _piecewise_linear(_pm25_aqi, ARRAY_LEN(_pm25_aqi), fine_dust * 10);
+
+    if (temperature == FLT_MIN || humidity == INT_MIN) {
+        result->dew_point         = INT_MIN;
+        result->absolute_humidity = INT_MIN;
+    } else {
+        int temperature10 = (int)(temperature * 10.0f + (temperature < 0 ? -0.5f : 0.5f));
+        int relative_humidity = humidity < 0 ? 0 : humidity > 100 ? 100 : humidity;
+        int vapor_pressure = _div_round(_saturation_vapor_pressure(temperature10) * relative_humidity, 100);
+
+        result->dew_point = _dew_point(vapor_pressure);
+        if (result->dew_point > temperature10)  // Rounding at saturation
+            result->dew_point = temperature10;
+        // 1000 / 461.5 (Specific gas constant of water vapor) = 2.167 g·K/J
+        result->absolute_humidity = _div_round(vapor_pressure * 2167, (temperature10 + ZERO_CELSIUS_KELVIN) * 10);
+    }
+
+    if (tvoc == INT_MIN) {
+        result->tvoc_index = INT_MIN;
+    } else {
+        result->tvoc_index = 1;
+        for (int i = 0; i < (int)ARRAY_LEN(_tvoc_levels) && tvoc > _tvoc_levels[i]; i++)
+            result->tvoc_index++;
+    }
+}
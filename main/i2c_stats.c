@@ -0,0 +1,113 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "driver/i2c.h"
+#include "esp_log.h"
+
+#include "i2c_stats.h"
+
+static i2c_stats _stats;
+static i2c_stats _last_logged;
+static uint32_t _last_reports = 0;
+
+esp_err_t __real_i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait);
+esp_err_t __real_i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en);
+esp_err_t __real_i2c_master_write(i2c_cmd_handle_t cmd_handle, const uint8_t *data, size_t data_len, bool ack_en);
+esp_err_t __real_i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t ack);
+esp_err_t __real_i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, i2c_ack_type_t ack);
+esp_err_t __real_i2c_master_write_to_device(
+    i2c_port_t i2c_num, uint8_t device_address, const uint8_t *write_buffer, size_t write_size, TickType_t ticks_to_wait
+);
+esp_err_t __real_i2c_master_read_from_device(
+    i2c_port_t i2c_num, uint8_t device_address, uint8_t *read_buffer, size_t read_size, TickType_t ticks_to_wait
+);
+esp_err_t __real_i2c_master_write_read_device(
+    i2c_port_t i2c_num, uint8_t device_address, const uint8_t *write_buffer, size_t write_size,
+    uint8_t *read_buffer, size_t read_size, TickType_t ticks_to_wait
+);
+
+
+void _count(uint32_t transactions, uint32_t bytes) {
+    __atomic_fetch_add(&_stats.transactions, transactions, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&_stats.bytes, bytes, __ATOMIC_RELAXED);
+}
+
+// Bytes of command links are counted when queued, transactions when executed.
+esp_err_t __wrap_i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait) {
+    _count(1, 0);
+    return __real_i2c_master_cmd_begin(i2c_num, cmd_handle, ticks_to_wait);
+}
+
+esp_err_t __wrap_i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en) {
+    _count(0, 1);
+    return __real_i2c_master_write_byte(cmd_handle, data, ack_en);
+}
+
+esp_err_t __wrap_i2c_master_write(i2c_cmd_handle_t cmd_handle, const uint8_t *data, size_t data_len, bool ack_en) {
+    _count(0, data_len);
+    return __real_i2c_master_write(cmd_handle, data, data_len, ack_en);
+}
+
+esp_err_t __wrap_i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t ack) {
+    _count(0, 1);
+    return __real_i2c_master_read_byte(cmd_handle, data, ack);
+}
+
+esp_err_t __wrap_i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, i2c_ack_type_t ack) {
+    _count(0, data_len);
+    return __real_i2c_master_read(cmd_handle, data, data_len, ack);
+}
+
+// Helpers build their command links inside the driver, which are not wrapped.
+esp_err_t __wrap_i2c_master_write_to_device(
+    i2c_port_t i2c_num, uint8_t device_address, const uint8_t *write_buffer, size_t write_size, TickType_t ticks_to_wait
+) {
+    _count(1, 1 + write_size);
+    return __real_i2c_master_write_to_device(i2c_num, device_address, write_buffer, write_size, ticks_to_wait);
+}
+
+esp_err_t __wrap_i2c_master_read_from_device(
+    i2c_port_t i2c_num, uint8_t device_address, uint8_t *read_buffer, size_t read_size, TickType_t ticks_to_wait
+) {
+    _count(1, 1 + read_size);
+    return __real_i2c_master_read_from_device(i2c_num, device_address, read_buffer, read_size, ticks_to_wait);
+}
+
+esp_err_t __wrap_i2c_master_write_read_device(
+    i2c_port_t i2c_num, uint8_t device_address, const uint8_t *write_buffer, size_t write_size,
+    uint8_t *read_buffer, size_t read_size, TickType_t ticks_to_wait
+) {
+    _count(1, 2 + write_size + read_size);
+    return __real_i2c_master_write_read_device(
+        i2c_num, device_address, write_buffer, write_size, read_buffer, read_size, ticks_to_wait
+    );
+}
+
+void get_i2c_stats(i2c_stats *result) {
+    result->transactions = __atomic_load_n(&_stats.transactions, __ATOMIC_RELAXED);
+    result->bytes        = __atomic_load_n(&_stats.bytes, __ATOMIC_RELAXED);
+}
+
+// reports is the number of status reports so far. Logs totals, and averages since the last call.
+void log_i2c_stats(uint32_t reports) {
+    i2c_stats stats;
+    get_i2c_stats(&stats);
+
+    uint32_t new_reports = reports - _last_reports;
+    if (new_reports) {
+        ESP_LOGI(
+            "I2CStats:log_i2c_stats",
+            "%" PRIu32 " transactions, %" PRIu32 " bytes (%" PRIu32 " transactions, %" PRIu32 " bytes per report).",
+            stats.transactions, stats.bytes,
+            (stats.transactions - _last_logged.transactions) / new_reports, (stats.bytes - _last_logged.bytes) / new_reports
+        );
+    } else {
+        ESP_LOGI(
+            "I2CStats:log_i2c_stats", "%" PRIu32 " transactions, %" PRIu32 " bytes (No report yet).",
+            stats.transactions, stats.bytes
+        );
+    }
+    _last_logged  = stats;
+    _last_reports = reports;
+}
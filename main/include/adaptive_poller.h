@@ -0,0 +1,30 @@
+#ifndef __VINDRIKTNING_ADAPTIVE_POLLER_H_INCLUDED__
+#define __VINDRIKTNING_ADAPTIVE_POLLER_H_INCLUDED__
+
+#include <ctime>
+#include <cstdint>
+
+#include "freertos/FreeRTOS.h"
+
+#define POLL_LATENCY_BUCKET_CNT 8
+
+// Decides when the device status is polled.
+// Polls at the fast interval after a change, then doubles the interval per
+// unchanged poll up to the idle interval of the current time-of-day profile.
+class AdaptivePoller {
+    public:
+        AdaptivePoller(int fastInterval, int idleInterval);
+        void setBounds(int fastInterval, int dayIdleInterval, int nightIdleInterval, int nightStart, int nightEnd);
+        bool isDue(TickType_t now);
+        void onPolled(TickType_t now, bool changed);
+        void recordLatency(time_t commandTime);
+        void logStats();
+    private:
+        int fastInterval, dayIdleInterval, nightIdleInterval, nightStart, nightEnd, interval;
+        TickType_t nextPoll = 0, startTick = 0;
+        uint32_t polls = 0, changes = 0;
+        uint32_t latencyHistogram[POLL_LATENCY_BUCKET_CNT] = {};
+        int idleInterval();
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef __VINDRIKTNING_ADAPTIVE_SAMPLER_H_INCLUDED__
+#define __VINDRIKTNING_ADAPTIVE_SAMPLER_H_INCLUDED__
+
+#include "freertos/FreeRTOS.h"
+
+#define ADAPTIVE_SAMPLER_MAX_CHANNELS 4
+
+// Chooses the next sampling interval.
+// Drops to the minimum when a channel changes by at least its threshold
+// (against the previous sample or its moving average), otherwise backs off by 1.5x up to the maximum.
+class AdaptiveSampler {
+    public:
+        AdaptiveSampler(int minInterval, int maxInterval);
+        void setLimits(int minInterval, int maxInterval);
+        void setThreshold(int channel, int threshold);
+        void update(int channel, int value);
+        void skip(int channel);
+        TickType_t nextDelay();
+        int getInterval();
+    private:
+        int minInterval, maxInterval, interval;
+        int thresholds[ADAPTIVE_SAMPLER_MAX_CHANNELS] = {};
+        int lastValues[ADAPTIVE_SAMPLER_MAX_CHANNELS] = {};
+        int means[ADAPTIVE_SAMPLER_MAX_CHANNELS] = {};
+        bool hasLast[ADAPTIVE_SAMPLER_MAX_CHANNELS] = {};
+        bool triggered = false;
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __VINDRIKTNING_BENCHMARK_H_INCLUDED__
+#define __VINDRIKTNING_BENCHMARK_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One operation of a benchmark. Must not block.
+typedef void (*benchmark_fn)(void *arg);
+
+void benchmark_add(const char *name, benchmark_fn fn, void *arg);
+void benchmark_task(void *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
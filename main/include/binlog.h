@@ -0,0 +1,72 @@
+#ifndef __VINDRIKTNING_BINLOG_H_INCLUDED__
+#define __VINDRIKTNING_BINLOG_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "esp_log.h"
+
+#include "config.h"
+
+// Log formats of hot paths. tools/binlog_decode.py parses this table, so keep one entry per line.
+// X(id, level, tag, format)
+#define BINLOG_FORMATS(X)\
+    X(BL_PM1006_VALUE,     ESP_LOG_INFO,  "IO:get_pm1006_value",   "PM2.5: %dµg/m^3")\
+    X(BL_TEMPHUMI,         ESP_LOG_INFO,  "IO:get_temphumi",       "Temperature: %.01f°C | Humidity: %d%%")\
+    X(BL_TEMPPRESS,        ESP_LOG_INFO,  "IO:get_temppress",      "Temperature: %.01f°C | Air Pressure: %.02fhPa")\
+    X(BL_TVOC,             ESP_LOG_INFO,  "IO:get_tvoc",           "TVOC: %dppb")\
+    X(BL_SEM_TAKE_START,   ESP_LOG_DEBUG, "Main:xSemaphoreTakeN",  "Semaphore Count (Start): %d")\
+    X(BL_SEM_TAKE_BEFORE,  ESP_LOG_DEBUG, "Main:xSemaphoreTakeN",  "Semaphore Count (Before call): %d")\
+    X(BL_SEM_TAKE_AFTER,   ESP_LOG_DEBUG, "Main:xSemaphoreTakeN",  "Semaphore Count (After call): %d")\
+    X(BL_SEM_TAKE_DONE,    ESP_LOG_DEBUG, "Main:xSemaphoreTakeN",  "Successfully taken %d times.")\
+    X(BL_SEM_GIVE_START,   ESP_LOG_DEBUG, "Main:xSemaphoreGiveN",  "Semaphore Count (Start): %d")\
+    X(BL_SEM_GIVE_BEFORE,  ESP_LOG_DEBUG, "Main:xSemaphoreGiveN",  "Semaphore Count (Before call): %d")\
+    X(BL_SEM_GIVE_AFTER,   ESP_LOG_DEBUG, "Main:xSemaphoreGiveN",  "Semaphore Count (After call): %d")\
+    X(BL_SEM_GIVE_DONE,    ESP_LOG_DEBUG, "Main:xSemaphoreGiveN",  "Successfully given %d times.")
+
+#define BINLOG_ID(id, level, tag, format) id,
+#define BINLOG_LEVEL(id, level, tag, format) id##_LEVEL = level,
+typedef enum {
+    BINLOG_FORMATS(BINLOG_ID)
+    BINLOG_FORMAT_CNT
+} binlog_id;
+enum {
+    BINLOG_FORMATS(BINLOG_LEVEL)
+};
+#undef BINLOG_ID
+#undef BINLOG_LEVEL
+
+#define BINLOG_MAX_ARGS 3
+
+typedef struct {
+    uint32_t writes;
+    uint32_t dropped;
+    uint32_t cycles;  // Total cycles spent in call sites
+} binlog_stats;
+
+// Float arguments must go through binlog_float(). Integers are cast to uint32_t.
+#define _BINLOG_ARGS(a, b, c, ...) (uint32_t)(a), (uint32_t)(b), (uint32_t)(c)
+#define BINLOG(id, ...) do {\
+    if (id##_LEVEL <= CONFIG_LOG_MAXIMUM_LEVEL)\
+        binlog_write(id, _BINLOG_ARGS(__VA_ARGS__, 0, 0, 0));\
+} while (0)
+
+static inline uint32_t binlog_float(float value) {
+    union { float f; uint32_t u; } conv;
+    conv.f = value;
+    return conv.u;
+}
+
+void binlog_init(void);
+void binlog_write(binlog_id id, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+void binlog_get_stats(binlog_stats *result);
+void binlog_log_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
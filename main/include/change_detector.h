@@ -0,0 +1,26 @@
+#ifndef __VINDRIKTNING_CHANGE_DETECTOR_H_INCLUDED__
+#define __VINDRIKTNING_CHANGE_DETECTOR_H_INCLUDED__
+
+#include <cstdint>
+
+#include "config.h"
+
+// Online detector of upward steps on one channel of raw samples.
+// The baseline is an EWMA of the mean and variance with weight CHANGE_DETECT_ALPHA.
+// Each sample adds its deviation in baseline sigmas, minus CHANGE_DETECT_K, to a one-sided CUSUM.
+// The detector triggers when the CUSUM exceeds CHANGE_DETECT_H, and restarts from the new level.
+// Sigma is at least minSigma, so that quantized, flat readings do not trigger on one count.
+// Must be kept in sync with tools/change_eval.py.
+class ChangeDetector {
+    public:
+        explicit ChangeDetector(float minSigma) : minSigma(minSigma) {}
+        bool add(int value);  // true when a change is detected
+        int getBaseline() { return (int)mean; }
+        uint32_t getTriggers() { return triggers; }
+    private:
+        float minSigma;
+        float mean = 0.0f, variance = 0.0f, cusum = 0.0f;
+        uint32_t samples = 0, triggers = 0;
+};
+
+#endif
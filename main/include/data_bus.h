@@ -0,0 +1,58 @@
+#ifndef __VINDRIKTNING_DATA_BUS_H_INCLUDED__
+#define __VINDRIKTNING_DATA_BUS_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+#include "io.h"
+#include "derived_metrics.h"
+
+// Immutable once published. Consumers must hand every snapshot back with data_bus_release().
+typedef struct {
+    uint32_t seq;
+    TickType_t tick;
+    sensor_values values;
+    derived_metrics derived;
+    uint32_t refs;
+} data_bus_snapshot;
+
+typedef enum {
+    DATA_BUS_DROP_OLDEST,  // Queue full: discard the oldest queued snapshot
+    DATA_BUS_DROP_NEWEST   // Queue full: discard the snapshot being published
+} data_bus_drop_policy;
+
+typedef struct {
+    const char *name;
+    uint32_t delivered;
+    uint32_t dropped;
+    uint32_t last_seq;      // Last received
+    uint32_t max_lag;       // Snapshots published but not received yet, worst case
+    TickType_t max_latency; // Publish to receive
+    UBaseType_t max_queued;
+} data_bus_subscriber_stats;
+
+typedef void (*data_bus_wake_fn)(void);
+
+void init_data_bus(void);
+int data_bus_subscribe(const char *name, UBaseType_t depth, data_bus_drop_policy policy);
+void data_bus_notify(int id, TaskHandle_t task, uint32_t bits);
+void data_bus_wake(int id, data_bus_wake_fn wake);
+esp_err_t data_bus_publish(const sensor_values *values, const derived_metrics *derived);
+const data_bus_snapshot *data_bus_receive(int id, TickType_t xTicksToWait);
+const data_bus_snapshot *data_bus_acquire_latest(void);
+void data_bus_release(const data_bus_snapshot *snapshot);
+void data_bus_get_stats(int id, data_bus_subscriber_stats *result);
+void log_data_bus_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
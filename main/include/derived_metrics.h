@@ -0,0 +1,26 @@
+#ifndef __VINDRIKTNING_DERIVED_METRICS_H_INCLUDED__
+#define __VINDRIKTNING_DERIVED_METRICS_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// INT_MIN when an input is invalid
+typedef struct {
+    int aqi;                // US EPA AQI of PM2.5, 0 - 500
+    int dew_point;          // 0.1 °C
+    int absolute_humidity;  // 0.1 g/m^3
+    int tvoc_index;         // UBA TVOC level, 1 (Very good) - 5 (Unacceptable)
+} derived_metrics;
+
+// Takes averages with the invalid markers of sensor_values (INT_MIN, FLT_MIN).
+// Integer arithmetic only, after one conversion of temperature to fixed point.
+// Dew point against the Magnus formula: within 0.1 °C above 0 °C, 0.23 °C from -25 to 0 °C,
+// and 0.54 °C from -40 to -25 °C. Lower dew points are reported as -40 °C.
+void compute_derived_metrics(int fine_dust, float temperature, int humidity, int tvoc, derived_metrics *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __VINDRIKTNING_I2C_STATS_H_INCLUDED__
+#define __VINDRIKTNING_I2C_STATS_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// Counted by wrapping the legacy I2C driver at link time (See CMakeLists.txt),
+// so that transfers inside the sensor libraries are included.
+typedef struct {
+    uint32_t transactions;
+    uint32_t bytes;  // Including address bytes
+} i2c_stats;
+
+void get_i2c_stats(i2c_stats *result);
+void log_i2c_stats(uint32_t reports);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
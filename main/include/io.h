@@ -5,12 +5,20 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
 #include "esp_err.h"
 #include "colors.h"
 
 #include "pwm_led.h"
 #include "ws2812.h"
 
+typedef enum {
+    FAN_STATE_OFF,
+    FAN_STATE_WARMUP,  // PM1006 reading is not valid yet
+    FAN_STATE_READY
+} fan_state;
+
 typedef struct {
     int fine_dust;
     float temperature;
@@ -18,15 +26,48 @@ typedef struct {
     float temperature2;
     float pressure;
     int tvoc;
+    fan_state fan;  // Fan state when fine_dust was read
 } sensor_values;
 
+typedef enum {
+    SENSOR_PM1006,
+    SENSOR_AHT20,
+    SENSOR_BMP280,
+    SENSOR_AGS02MA,
+    SENSOR_CNT
+} sensor_id;
+
+typedef enum {
+    SENSOR_HEALTH_CLOSED,
+    SENSOR_HEALTH_OPEN,
+    SENSOR_HEALTH_HALF_OPEN
+} sensor_health_state;
+
+typedef struct {
+    sensor_health_state state;
+    uint32_t failures;  // Consecutive
+    uint32_t backoff_ms;
+    uint32_t retry_tick;
+    uint32_t total_reads;
+    uint32_t cached_reads;  // Served from the cache of read_interval
+    uint32_t total_failures;
+    uint32_t skipped_reads;
+    uint32_t opened;
+    uint32_t reinits;
+    uint32_t bus_recoveries;
+} sensor_health;
+
 void init_gpio(void);
 void init_modules(PWMLed **statusLED, WS2812Strip **strip);
 esp_err_t init_sensors(void);
 
-esp_err_t get_sensor_values(sensor_values *result);
+esp_err_t get_sensor_values(sensor_values *result, esp_err_t errors[SENSOR_CNT]);
+void get_sensor_health(sensor_health result[SENSOR_CNT]);
+void log_sensor_health(void);
+esp_err_t fill_strip_pixels(led_pixel *pixels);
 esp_err_t set_strip_pixels(led_pixel *pixels);
 
+esp_err_t fan_set_speed(int level);
 esp_err_t fan_off(void);
 esp_err_t fan_on(void);
 
@@ -0,0 +1,101 @@
+#ifndef __VINDRIKTNING_JOB_EXECUTOR_H_INCLUDED__
+#define __VINDRIKTNING_JOB_EXECUTOR_H_INCLUDED__
+
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <coroutine>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "config.h"
+#include "task_monitor.h"
+
+// Cooperative jobs on one FreeRTOS task. A job is a coroutine returning Job, which suspends with
+// co_await executor->delay() or executor->wait() instead of blocking its task.
+// Frames come from a fixed pool of JOB_FRAME_POOL_SIZE blocks of JOB_FRAME_SIZE bytes.
+// Everything between two co_await runs on the executor stack and delays the other jobs,
+// so jobs must not block on I/O.
+class Job {
+    public:
+        struct promise_type {
+            static void *operator new(std::size_t size);
+            static void operator delete(void *frame, std::size_t size);
+            Job get_return_object() { return Job(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { abort(); }
+        };
+
+        Job(Job &&other) : handle(other.handle) { other.handle = nullptr; }
+        Job(const Job&) = delete;
+        ~Job() {
+            if (handle)
+                handle.destroy();
+        }
+        std::coroutine_handle<> release() {
+            std::coroutine_handle<> result = handle;
+            handle = nullptr;
+            return result;
+        }
+    private:
+        explicit Job(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+        std::coroutine_handle<promise_type> handle;
+};
+
+typedef struct {
+    const char *name;
+    std::coroutine_handle<> handle;
+    bool timed;
+    TickType_t wakeTick;
+    uint32_t waitBits, receivedBits;
+    uint32_t resumes;
+    TickType_t maxLatency;
+    uint32_t latency[TASK_MONITOR_JITTER_BUCKETS];  // Same buckets as the loops of task_monitor
+} _job_slot;
+
+class JobExecutor {
+    public:
+        class Wait {
+            public:
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<>) noexcept { executor->suspend(bits, timeout); }
+                uint32_t await_resume() noexcept { return executor->jobs[executor->current].receivedBits; }
+            private:
+                friend class JobExecutor;
+                Wait(JobExecutor *executor, uint32_t bits, TickType_t timeout) :
+                    executor(executor), bits(bits), timeout(timeout) {}
+                JobExecutor *executor;
+                uint32_t bits;
+                TickType_t timeout;
+        };
+
+        JobExecutor(const char *name, uint32_t stackSize, UBaseType_t priority);
+        void spawn(const char *name, Job job);
+        void start();
+        TaskHandle_t getTask() { return task; }
+
+        // Resumes the job after ticks. 0 yields to the other jobs.
+        Wait delay(TickType_t ticks) { return Wait(this, 0, ticks); }
+        // Resumes the job once any of bits is set on the task notification, e.g. by data_bus_notify().
+        // Bits set before the wait are kept. Returns the bits received, or 0 after timeout.
+        Wait wait(uint32_t bits, TickType_t timeout) { return Wait(this, bits, timeout); }
+
+        void logStats();
+    private:
+        const char *name;
+        uint32_t stackSize;
+        UBaseType_t priority;
+        TaskHandle_t task = NULL;
+        _job_slot jobs[JOB_EXECUTOR_MAX_JOBS] = {};
+        int jobCnt = 0, current = -1;
+        uint32_t pendingBits = 0;
+        void suspend(uint32_t bits, TickType_t timeout);
+        void resume(_job_slot *job, uint32_t bits);
+        void run();
+        static void runTask(void *executorV);
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __VINDRIKTNING_DELTA_OTA_H_INCLUDED__
+#define __VINDRIKTNING_DELTA_OTA_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esp_err.h"
+
+void init_delta_ota(void);
+void delta_ota_confirm(void);
+esp_err_t delta_ota_check(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef __VINDRIKTNING_QUANTILE_SKETCH_H_INCLUDED__
+#define __VINDRIKTNING_QUANTILE_SKETCH_H_INCLUDED__
+
+#include <climits>
+#include <cstdint>
+
+#include "config.h"
+
+// Counts of one day must fit the buckets
+static_assert(86400000 / GET_SENSOR_TASK_DELAY_MIN < UINT16_MAX, "Too many samples per day for 16 bit buckets.");
+
+typedef struct {
+    uint32_t count;
+    int p50, p95, p99;  // INT_MIN when empty
+} quantile_summary;
+
+// DDSketch over non-negative integers with fixed buckets. Quantiles are within
+// QUANTILE_SKETCH_ACCURACY of a sample value before rounding. Sketches are merged by adding buckets.
+// Values beyond the last bucket (about 70000 by default) are counted in it.
+// Memory: 8 + 2 * QUANTILE_SKETCH_KEYS bytes (568 bytes by default). add() costs one logf().
+class QuantileSketch {
+    public:
+        void add(int value);
+        void merge(const QuantileSketch *other);
+        void clear();
+        uint32_t getCount();
+        int getQuantile(float q);  // INT_MIN when empty
+        void summarize(quantile_summary *result);
+    private:
+        uint32_t count = 0;
+        uint16_t zeroCount = 0;
+        uint16_t buckets[QUANTILE_SKETCH_KEYS] = {};
+};
+
+// Sketch of the running hour, which is merged into the running day when the hour closes.
+// Summaries of the last closed hour and day are kept.
+class RollingQuantiles {
+    public:
+        void add(int value);
+        void closeHour(bool closeDay);
+        void getHour(quantile_summary *result) { *result = lastHour; }
+        void getToday(quantile_summary *result) { today.summarize(result); }
+        void getDay(quantile_summary *result) { *result = lastDay; }
+    private:
+        QuantileSketch hour, today;
+        quantile_summary lastHour = {0, INT_MIN, INT_MIN, INT_MIN};
+        quantile_summary lastDay = {0, INT_MIN, INT_MIN, INT_MIN};
+};
+
+#endif
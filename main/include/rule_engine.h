@@ -0,0 +1,81 @@
+#ifndef __VINDRIKTNING_RULE_ENGINE_H_INCLUDED__
+#define __VINDRIKTNING_RULE_ENGINE_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "config.h"
+#include "io.h"
+
+// Rules are compiled from the "localRules" preference. Rules are separated by ';'.
+//   <metric><'>'|'<'><threshold>[~<hysteresis>][x<samples>][!]:<action>
+//   metric: pm, temp, humi, tvoc, temp2, press
+//   action: fan=<fanSpeed> | led=blink | notify
+// e.g. "pm>100~20x3:fan=3;humi>70~5:notify;tvoc>660x2!:led=blink"
+// A rule activates after `samples` consecutive readings beyond the threshold (Default 1),
+// and releases on the first reading back beyond threshold -/+ hysteresis.
+// Rules earlier in the table win. With '!', a fan rule also wins over cloud commands.
+// pm rules can not use fan=0, since PM is not read while the fan is off.
+#define RULE_FAN_NONE INT8_MIN
+
+typedef enum {
+    RULE_METRIC_FINE_DUST,
+    RULE_METRIC_TEMPERATURE,
+    RULE_METRIC_HUMIDITY,
+    RULE_METRIC_TVOC,
+    RULE_METRIC_TEMPERATURE2,
+    RULE_METRIC_PRESSURE
+} rule_metric;
+
+typedef enum {
+    RULE_ACTION_FAN,
+    RULE_ACTION_LED,
+    RULE_ACTION_NOTIFY
+} rule_action;
+
+typedef enum {
+    RULE_LED_NONE,
+    RULE_LED_BLINK  // Sensor pixels blink
+} rule_led_pattern;
+
+// Thresholds are in 0.1 units of the metric
+typedef struct {
+    int32_t enter;
+    int32_t release;
+    uint8_t metric;
+    uint8_t action;
+    int8_t arg;      // fanSpeed or rule_led_pattern
+    uint8_t samples;
+    uint8_t above : 1;
+    uint8_t overrides_cloud : 1;
+    // State
+    uint8_t active : 1;
+    uint8_t count;
+} rule;
+
+typedef struct {
+    rule rules[RULE_MAX_CNT];
+    int cnt;
+} rule_table;
+
+typedef struct {
+    int fan_speed;  // RULE_FAN_NONE without an active fan rule
+    bool fan_overrides_cloud;
+    rule_led_pattern led;
+    uint32_t notify;  // Bit of each notify rule activated by this reading
+} rule_outputs;
+
+esp_err_t rule_compile(const char *source, rule_table *table);
+void rule_evaluate(rule_table *table, const sensor_values *values, rule_outputs *outputs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
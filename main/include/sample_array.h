@@ -1,32 +1,63 @@
 #ifndef __ST_COMMON_REST_CLIENT_H_INCLUDED__
 #define __ST_COMMON_REST_CLIENT_H_INCLUDED__
 
+#include "freertos/FreeRTOS.h"
+
+#include "config.h"
+
+// Window of a sample array, for keeping it across reboots.
+// `age` is ticks between the last sample and the export.
+typedef struct {
+    float values[SAMPLE_ARRAY_SIZE];
+    TickType_t weights[SAMPLE_ARRAY_SIZE];
+    TickType_t age;
+    int pos, item_cnt;
+} sample_array_state;
+
+typedef struct {
+    int values[SAMPLE_ARRAY_SIZE];
+    TickType_t weights[SAMPLE_ARRAY_SIZE];
+    TickType_t age;
+    int pos, item_cnt;
+} int_sample_array_state;
+
+// Samples are weighted by the time since the previous sample, so the average
+// stays time-correct when the sampling interval changes.
+// Valid after `minSamples` samples. The average covers at most `window` ticks.
 class SampleArray {
     public:
-        SampleArray(int size);
+        SampleArray(int size, int minSamples, TickType_t window);
         ~SampleArray();
         void setOffset(float offset);
-        void writeValue(float value);
+        void writeValue(float value, TickType_t tick);
         bool isValid();
         void invalidate();
         float getAverage();
+        float getLatest();  // For channels averaged by sensor hardware
+        // Only arrays of SAMPLE_ARRAY_SIZE can be exported
+        bool exportState(sample_array_state *state, TickType_t now);
+        bool importState(const sample_array_state *state, TickType_t now);
     private:
         float *arr, offset = 0.0f;
-        int size, pos = 0, item_cnt = 0;
+        TickType_t *weights, window, lastTick = 0;
+        int size, minSamples, pos = 0, item_cnt = 0;
 };
 
 class IntSampleArray {
     public:
-        IntSampleArray(int size);
+        IntSampleArray(int size, int minSamples, TickType_t window);
         ~IntSampleArray();
         void setOffset(int offset);
-        void writeValue(int value);
+        void writeValue(int value, TickType_t tick);
         bool isValid();
         void invalidate();
         int getAverage();
+        bool exportState(int_sample_array_state *state, TickType_t now);
+        bool importState(const int_sample_array_state *state, TickType_t now);
     private:
         int *arr, offset = 0;
-        int size, pos = 0, item_cnt = 0;
+        TickType_t *weights, window, lastTick = 0;
+        int size, minSamples, pos = 0, item_cnt = 0;
 };
 
 #endif
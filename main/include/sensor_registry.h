@@ -0,0 +1,250 @@
+#ifndef __VINDRIKTNING_SENSOR_REGISTRY_H_INCLUDED__
+#define __VINDRIKTNING_SENSOR_REGISTRY_H_INCLUDED__
+
+#include <climits>
+#include <cfloat>
+#include <type_traits>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "config.h"
+#include "io.h"
+#include "sample_array.h"
+#include "adaptive_sampler.h"
+#include "derived_metrics.h"
+#include "smartthings/request.h"
+
+// Sensor channels are types, and the registry expands every per-channel step
+// (sampling, averaging, validity, warm state, status body) with fold expressions at compile time.
+// Adding a channel: a field of sensor_values and its driver in io.cpp, an event in ST_STATUS_EVENTS,
+// and a line in Sensors below.
+
+#define SAMPLER_FINE_DUST 0
+#define SAMPLER_TVOC      1
+
+using device_offsets = decltype(DeviceConfig::offsets);
+
+// Per reading state shared by the channels of get_sensor_value_task.
+typedef struct {
+    AdaptiveSampler *sampler;
+    bool keepFineDust;     // Keep the fine dust window while the fan is not ready
+    int fanWindowSamples;  // Incremented by valid fine dust samples
+} sample_context;
+
+template <typename T> struct _sample_traits;
+template <> struct _sample_traits<int> {
+    using array = IntSampleArray;
+    using state = int_sample_array_state;
+    static constexpr int invalid = INT_MIN;
+};
+template <> struct _sample_traits<float> {
+    using array = SampleArray;
+    using state = sample_array_state;
+    static constexpr float invalid = FLT_MIN;
+};
+
+// Rounds to `decimals` places without float formatting.
+template <int Decimals> int _to_fixed(float value) {
+    float scale = 1.0f;
+    for (int i = 0; i < Decimals; i++)
+        scale *= 10.0f;
+    return (int)(value * scale + (value < 0 ? -0.5f : 0.5f));
+}
+
+// One field of sensor_values, averaged in its own window and reported as one status event.
+//   Event:    Slot of the status body. Units are in ST_STATUS_EVENTS.
+//   Decimals: Digits reported after the point. The value is divided by Scale first (e.g. hPa to kPa).
+//   Offset:   Member of DeviceConfig::offsets, or nullptr
+//   Sampler:  Channel of AdaptiveSampler, or -1
+//   Latest:   Report the latest sample instead of the average, for channels filtered by sensor hardware
+template <
+    typename T, T sensor_values::*Field, st_status_event Event, int Decimals = 0, int Scale = 1,
+    T device_offsets::*Offset = nullptr, int Sampler = -1, bool Latest = false
+>
+struct SensorChannel {
+    using value_type = T;
+    using array_type = typename _sample_traits<T>::array;
+    using state_type = typename _sample_traits<T>::state;
+    static constexpr T INVALID = _sample_traits<T>::invalid;
+    static_assert(Sampler < ADAPTIVE_SAMPLER_MAX_CHANNELS, "Sampler channel out of range.");
+    static_assert(!Latest || std::is_floating_point_v<T>, "Only float channels keep the latest sample.");
+
+    static inline array_type *array;
+
+    static void init() {
+        array = new array_type(SAMPLE_ARRAY_SIZE, SAMPLE_PER_UPDATE_STATUS, pdMS_TO_TICKS(SAMPLE_WINDOW));
+    }
+
+    static void applyConfig(const DeviceConfig *config) {
+        if constexpr (Offset != nullptr)
+            array->setOffset(config->offsets.*Offset);
+    }
+
+    static void write(const sensor_values *values, TickType_t tick, sample_context *context) {
+        writeValue(values->*Field, tick, context);
+    }
+
+    static void writeValue(T value, TickType_t tick, sample_context *context) {
+        if (value == INVALID) {
+            array->invalidate();
+            if constexpr (Sampler >= 0)
+                context->sampler->skip(Sampler);
+            return;
+        }
+        array->writeValue(value, tick);
+        if constexpr (Sampler >= 0)
+            context->sampler->update(Sampler, value);
+    }
+
+    static void getAverage(sensor_values *result) {
+        if constexpr (Latest)
+            result->*Field = array->getLatest();
+        else
+            result->*Field = array->getAverage();
+    }
+
+    static void patch(const sensor_values *values) {
+        T value = values->*Field;
+        if constexpr (std::is_floating_point_v<T>) {
+            patch_device_status(Event, value == INVALID ? INT_MIN : _to_fixed<Decimals>(value / Scale), Decimals);
+        } else {
+            static_assert(Decimals == 0 && Scale == 1, "Integer channels are reported as is.");
+            patch_device_status(Event, value, 0);  // INVALID is INT_MIN
+        }
+    }
+};
+
+// PM1006 readings are valid only while the fan is ready. Readings above PM1006_THRESHOLD are kept as INT_MAX.
+struct FineDustChannel : SensorChannel<
+    int, &sensor_values::fine_dust, ST_STATUS_FINE_DUST, 0, 1, nullptr, SAMPLER_FINE_DUST
+> {
+    static void write(const sensor_values *values, TickType_t tick, sample_context *context) {
+        if (values->fan != FAN_STATE_READY && context->keepFineDust)
+            return;  // Between measurement windows of fan auto mode, or warmup after warm start
+        if (values->fan != FAN_STATE_READY || values->fine_dust == INVALID) {
+            // Reading of PM1006 is invalid when fan is turned off or on just now
+            writeValue(INVALID, tick, context);
+            return;
+        }
+        if (values->fine_dust > PM1006_THRESHOLD) {
+            ESP_LOGI("SensorRegistry:FineDustChannel", "Too high PM1006 value (%dµg/m^3) detected.", values->fine_dust);
+            array->writeValue(INT_MAX, tick);
+            context->sampler->update(SAMPLER_FINE_DUST, values->fine_dust);
+        } else {
+            writeValue(values->fine_dust, tick, context);
+        }
+        context->fanWindowSamples++;
+    }
+};
+
+// Value of derived_metrics, which is computed from the averages and only reported.
+template <int derived_metrics::*Field, st_status_event Event, int Decimals = 0>
+struct DerivedField {
+    static void patch(const derived_metrics *derived) {
+        patch_device_status(Event, derived->*Field, Decimals);  // INT_MIN when not computable
+    }
+};
+
+// Standard layout, so that it can be kept in RTC memory.
+template <typename... Channels> struct _channel_states {};
+template <typename Channel, typename... Rest>
+struct _channel_states<Channel, Rest...> {
+    using channel = Channel;
+    typename Channel::state_type window;
+    _channel_states<Rest...> rest;
+};
+
+template <typename Channel, typename States>
+auto *_window_of(States *states) {
+    if constexpr (std::is_same_v<Channel, typename std::remove_const_t<States>::channel>)
+        return &states->window;
+    else
+        return _window_of<Channel>(&states->rest);
+}
+
+template <typename... Channels>
+struct SensorRegistry {
+    static constexpr int CHANNEL_CNT = sizeof...(Channels);
+
+    // Windows of every channel, for keeping them across soft resets
+    using state = _channel_states<Channels...>;
+
+    static void init() {
+        (Channels::init(), ...);
+    }
+
+    static void applyConfig(const DeviceConfig *config) {
+        (Channels::applyConfig(config), ...);
+    }
+
+    // Writes one reading to the windows of every channel.
+    static void writeSamples(const sensor_values *values, TickType_t tick, sample_context *context) {
+        (Channels::write(values, tick, context), ...);
+    }
+
+    // fan is left untouched.
+    static void getAverages(sensor_values *result) {
+        (Channels::getAverage(result), ...);
+    }
+
+    static void invalidate() {
+        (Channels::array->invalidate(), ...);
+    }
+
+    static void exportState(state *result, TickType_t now) {
+        (Channels::array->exportState(_window_of<Channels>(result), now), ...);
+    }
+
+    // Stops at the first invalid window. Invalidate all on failure.
+    static bool importState(const state *saved, TickType_t now) {
+        return (Channels::array->importState(_window_of<Channels>(saved), now) && ...);
+    }
+
+    static void patchStatus(const sensor_values *values) {
+        (Channels::patch(values), ...);
+    }
+};
+
+template <typename... Fields>
+struct DerivedReport {
+    static void patchStatus(const derived_metrics *derived) {
+        (Fields::patch(derived), ...);
+    }
+};
+
+
+// Channels of this device
+using Sensors = SensorRegistry<
+    FineDustChannel,
+    SensorChannel<float, &sensor_values::temperature, ST_STATUS_TEMPERATURE, 1, 1, &device_offsets::temperature>,
+    SensorChannel<int, &sensor_values::humidity, ST_STATUS_HUMIDITY, 0, 1, &device_offsets::humidity>,
+#ifdef BMP280_HW_FILTER
+    SensorChannel<float, &sensor_values::temperature2, ST_STATUS_TEMPERATURE2, 1, 1, &device_offsets::temperature2, -1, true>,
+    SensorChannel<float, &sensor_values::pressure, ST_STATUS_PRESSURE, 1, 10, &device_offsets::pressure, -1, true>,
+#else
+    SensorChannel<float, &sensor_values::temperature2, ST_STATUS_TEMPERATURE2, 1, 1, &device_offsets::temperature2>,
+    SensorChannel<float, &sensor_values::pressure, ST_STATUS_PRESSURE, 1, 10, &device_offsets::pressure>,
+#endif
+    SensorChannel<int, &sensor_values::tvoc, ST_STATUS_TVOC, 0, 1, &device_offsets::tvoc, SAMPLER_TVOC>
+>;
+
+#ifdef ENABLE_DERIVED_METRICS_REPORT
+using DerivedMetrics = DerivedReport<
+    DerivedField<&derived_metrics::aqi, ST_STATUS_AQI>,
+    DerivedField<&derived_metrics::dew_point, ST_STATUS_DEW_POINT, 1>,
+    DerivedField<&derived_metrics::absolute_humidity, ST_STATUS_ABSOLUTE_HUMIDITY, 1>,
+    DerivedField<&derived_metrics::tvoc_index, ST_STATUS_TVOC_INDEX>
+>;
+#else
+using DerivedMetrics = DerivedReport<>;
+#endif
+
+// Patches the status body. Returns NULL when no value is valid.
+inline const char *build_status_body(const sensor_values *values, const derived_metrics *derived) {
+    Sensors::patchStatus(values);
+    DerivedMetrics::patchStatus(derived);
+    return finish_device_status_body();
+}
+
+#endif
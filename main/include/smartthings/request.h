@@ -5,9 +5,49 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+#include "config.h"
+
+
+// Events of the status body. Values are patched in by the sensor registry (See sensor_registry.h).
+// X(name, component, capability, attribute, unit)
+#define ST_STATUS_EVENTS(X)\
+    X(FINE_DUST,    "airQuality",  "fineDustSensor",                 "fineDustLevel",       "μg/m^3")\
+    X(TEMPERATURE,  "airQuality",  "temperatureMeasurement",         "temperature",         "C")\
+    X(HUMIDITY,     "airQuality",  "relativeHumidityMeasurement",    "humidity",            "%")\
+    X(TVOC,         "airQuality",  "tvocMeasurement",                "tvocLevel",           "ppb")\
+    X(TEMPERATURE2, "airPressure", "temperatureMeasurement",         "temperature",         "C")\
+    X(PRESSURE,     "airPressure", "atmosphericPressureMeasurement", "atmosphericPressure", "kPa")\
+    ST_DERIVED_EVENTS(X)
+
+#ifdef ENABLE_DERIVED_METRICS_REPORT
+#define ST_CUSTOM_CAPABILITY(name) ST_CAPABILITY_NAMESPACE "." name
+#define ST_DERIVED_EVENTS(X)\
+    X(AQI,               "airQuality", ST_CUSTOM_CAPABILITY("airQualityIndex"),  "airQualityIndex",  "AQI")\
+    X(DEW_POINT,         "airQuality", ST_CUSTOM_CAPABILITY("dewPoint"),         "dewPoint",         "C")\
+    X(ABSOLUTE_HUMIDITY, "airQuality", ST_CUSTOM_CAPABILITY("absoluteHumidity"), "absoluteHumidity", "g/m^3")\
+    X(TVOC_INDEX,        "airQuality", ST_CUSTOM_CAPABILITY("tvocIndex"),        "tvocIndex",        "UBA")
+#else
+#define ST_DERIVED_EVENTS(X)
+#endif
+
+#define ST_EVENT_INDEX(name, component, capability, attribute, unit) ST_STATUS_##name,
+typedef enum {
+    ST_STATUS_EVENTS(ST_EVENT_INDEX)
+    ST_STATUS_EVENT_CNT
+} st_status_event;
+
 typedef struct {
     int switchLevel;
     int fanSpeed;
+    time_t switchLevelTimestamp;  // 0 when unknown
+    time_t fanSpeedTimestamp;
 } STStatus;
 
 
@@ -29,18 +69,43 @@ typedef struct {
         float temperature2;
         float pressure;
     } offsets;
+    struct {
+        int intervalMin;
+        int intervalMax;
+        int fineDustThreshold;
+        int tvocThreshold;
+    } sampling;
+    struct {
+        int fastInterval;
+        int dayIdleInterval;
+        int nightIdleInterval;
+        int nightStart;  // Hour
+        int nightEnd;
+    } polling;
+    bool fanAutoMode;  // Runs the fan only for measurement windows, at fanSpeed
+    char rules[RULE_SOURCE_MAX_LEN];  // Source of the local rule table
 } DeviceConfig;
 
+typedef struct {
+    uint32_t allowed;
+    uint32_t rejected_budget;   // No token left
+    uint32_t rejected_backoff;  // During backoff after a failed call
+    uint32_t failures;
+    uint32_t rate_limited;      // 429 responses, of failures
+    uint32_t max_used;          // Tokens in use at the worst time, of ST_BUDGET_CAPACITY
+    uint32_t backoff;           // Current backoff (ms), 0 after a successful call
+} st_request_stats;
+
+void parse_device_status(cJSON *response_json, STStatus *result);
+void parse_device_config(cJSON *response_json, DeviceConfig *result);
 esp_err_t get_device_status(STStatus *result);
 esp_err_t get_device_config(DeviceConfig *result);
-esp_err_t set_device_status(
-    int fine_dust,
-    float temperature,
-    int humidity,
-    int tvoc,
-    float temperature2,
-    float pressure
-);
+void patch_device_status(st_status_event event, int value, int decimals);
+const char *finish_device_status_body(void);
+esp_err_t send_rule_event(int rule);
+esp_err_t set_device_status(void);
+void get_st_request_stats(st_request_stats *result);
+void log_st_request_stats(void);
 
 #ifdef __cplusplus
 }
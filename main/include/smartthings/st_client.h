@@ -0,0 +1,51 @@
+#ifndef __ST_COMMON_ST_CLIENT_H_INCLUDED__
+#define __ST_COMMON_ST_CLIENT_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+// Part of a request body. Chunks are written to the connection as they are, without copying.
+typedef struct {
+    const char *data;
+    size_t len;
+} st_client_chunk;
+
+// Of the response, for the backoff of the caller
+typedef struct {
+    int status;            // HTTP status, 0 when there was no response
+    uint32_t retry_after;  // Seconds of Retry-After, 0 when there was none. HTTP dates are not parsed.
+} st_client_result;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t failures;           // No response, or not 2xx
+    uint32_t full_handshakes;
+    uint32_t resumed_handshakes;
+    uint32_t rejected_sessions;  // Offered, but the server made a full handshake
+    uint32_t expired_sessions;   // Dropped over ST_TLS_SESSION_LIFETIME
+    uint32_t session_saves;      // Writes to NVS
+    uint64_t full_handshake_ms;  // Total
+    uint64_t resumed_handshake_ms;
+    int last_status;             // HTTP status, 0 when there was no response
+} st_client_stats;
+
+void init_st_client(void);
+esp_err_t st_client_request(
+    const char *method, const char *url, const char *token,
+    const st_client_chunk *body, int body_cnt, cJSON **response_json, st_client_result *result
+);
+void get_st_client_stats(st_client_stats *result);
+void log_st_client_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef __VINDRIKTNING_SSE_SERVER_H_INCLUDED__
+#define __VINDRIKTNING_SSE_SERVER_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#include "io.h"
+
+// Server-Sent Events on GET /events. Every average published on the data bus is pushed as an
+// "average" event. With /events?raw=1, readings of get_sensor_value_task are pushed as "sample" events too.
+// Percentiles of quantile sketches are pushed as "quantiles" events.
+// Each client has a bounded send buffer. Clients which fall behind further are disconnected.
+typedef struct {
+    uint32_t clients;       // Connected now
+    uint32_t accepted;
+    uint32_t rejected;      // Over SSE_MAX_CLIENTS, or not GET /events
+    uint32_t dropped_slow;  // Disconnected on a full buffer
+    uint32_t events;        // Formatted, once for all clients
+    uint32_t samples_lost;  // Sample queue full
+    uint32_t wakeups;       // Returns of select(), with or without clients
+} sse_stats;
+
+esp_err_t init_sse_server(void);
+void sse_publish_sample(const sensor_values *values, TickType_t tick);
+void sse_publish_quantiles(const char *data);
+void get_sse_stats(sse_stats *result);
+void log_sse_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __VINDRIKTNING_TASK_MONITOR_H_INCLUDED__
+#define __VINDRIKTNING_TASK_MONITOR_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TASK_MONITOR_MAX_LOOPS      4
+#define TASK_MONITOR_JITTER_BUCKETS 5  // 0, 1, 2-4, 5-9, 10+ ticks
+
+int task_monitor_register(const char *name);
+BaseType_t task_monitor_delay_until(int id, TickType_t *previousWakeTime, TickType_t period);
+BaseType_t task_monitor_wait_until(int id, TickType_t *previousWakeTime, TickType_t period);
+void task_monitor_publish(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
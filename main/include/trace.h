@@ -0,0 +1,38 @@
+#ifndef __VINDRIKTNING_TRACE_H_INCLUDED__
+#define __VINDRIKTNING_TRACE_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#include "io.h"
+
+typedef enum {
+    TRACE_SAMPLE  = 1,  // Raw reading of get_sensor_values()
+    TRACE_AVERAGE = 2,  // Average published after the reading, for comparing replays
+    TRACE_OFFSETS = 3   // DeviceConfig::offsets for the following records, in the fields of values
+} trace_entry_type;
+
+typedef struct {
+    trace_entry_type type;
+    TickType_t tick;
+    bool keepFineDust;  // Argument of write_samples()
+    sensor_values values;
+    esp_err_t errors[SENSOR_CNT];  // TRACE_SAMPLE only
+} trace_entry;
+
+esp_err_t init_trace(void);
+void trace_write(const trace_entry *record);
+esp_err_t trace_read(trace_entry *record);
+void log_trace_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
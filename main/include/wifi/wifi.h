@@ -5,13 +5,26 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
 #include "esp_err.h"
 
+typedef struct {
+    uint32_t attempts;
+    uint32_t successes;
+    uint32_t disconnects;
+    uint32_t last_ms;
+    uint32_t min_ms;
+    uint32_t max_ms;
+    uint64_t total_ms;
+} wifi_connect_stats;
+
 void register_wifi_status_handler(void);
 esp_err_t init_wifi(void);
-esp_err_t chech_and_reconnect_wifi(void);
+void init_time_sync(void);
 esp_err_t pause_wifi(void);
 esp_err_t resume_wifi(void);
+void get_wifi_connect_stats(wifi_connect_stats *result);
 
 #ifdef __cplusplus
 }
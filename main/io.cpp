@@ -2,6 +2,7 @@
 #include <cstring>
 #include <climits>
 #include <cfloat>
+#include <cinttypes>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -10,12 +11,15 @@
 #include "driver/i2c.h"
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
 #include "esp_adc/adc_oneshot.h"
 
 #include "led_strip.h"
 
 #include "config.h"
 #include "io.h"
+#include "binlog.h"
 
 #include "pwm_led.h"
 #include "ws2812.h"
@@ -29,32 +33,112 @@
 
 #define STATUS_LED_LEDC_CHANNEL LEDC_CHANNEL_0
 #define FAN_LEDC_CHANNEL LEDC_CHANNEL_1
+#define FAN_LEDC_TIMER LEDC_TIMER_1
+#define FAN_LEDC_RESOLUTION LEDC_TIMER_10_BIT
+#define FAN_LEDC_MAX_DUTY ((1 << FAN_LEDC_RESOLUTION) - 1)
 
+static const uint8_t FAN_DUTY[] = FAN_SPEED_DUTY;
 
-aht20_dev_handle_t aht20;
+
+aht20_dev_handle_t aht20 = NULL;
 led_strip_handle_t ws2812;
-pm1006_handle_t    pm1006;
+pm1006_handle_t    pm1006 = NULL;
 
-AGS02MA *ags02ma;
-BMP280  *bmp280;
+AGS02MA *ags02ma = NULL;
+BMP280  *bmp280  = NULL;
 
 esp_err_t get_pm1006_value(int *fine_dust);
 esp_err_t get_temphumi(float *temperature, int *humidity);
 esp_err_t get_temppress(float *temperature, float *pressure);
 esp_err_t get_tvoc(int *tvoc);
 
+esp_err_t init_pm1006(void);
+esp_err_t init_i2c_bus(i2c_port_t port);
+esp_err_t init_aht20(void);
+esp_err_t init_bmp280(void);
+esp_err_t init_ags02ma(void);
+
+esp_err_t read_pm1006(sensor_values *result);
+esp_err_t read_aht20(sensor_values *result);
+esp_err_t read_bmp280(sensor_values *result);
+esp_err_t read_ags02ma(sensor_values *result);
+void invalidate_pm1006(sensor_values *result);
+void invalidate_aht20(sensor_values *result);
+void invalidate_bmp280(sensor_values *result);
+void invalidate_ags02ma(sensor_values *result);
+void i2c_sweep_task(void *portV);
+
+typedef struct {
+    const char *name;
+    esp_err_t (*read)(sensor_values *result);
+    void (*invalidate)(sensor_values *result);
+    esp_err_t (*reinit)(void);
+    int i2c_port;            // -1 when the sensor is not on I2C
+    uint32_t read_interval;  // ms. Readings in between are served from the cache. 0 to read every time.
+} sensor_driver;
+
+// AHT20, AGS02MA and PM1006 have no configurable oversampling or filter.
+static const sensor_driver SENSOR_DRIVERS[SENSOR_CNT] = {
+    {"PM1006",  read_pm1006,  invalidate_pm1006,  init_pm1006,  -1,              0},
+    {"AHT20",   read_aht20,   invalidate_aht20,   init_aht20,   AHT20_I2C_NUM,   0},
+    {"BMP280",  read_bmp280,  invalidate_bmp280,  init_bmp280,  BMP280_I2C_NUM,  BMP280_READ_INTERVAL},
+    {"AGS02MA", read_ags02ma, invalidate_ags02ma, init_ags02ma, AGS02MA_I2C_NUM, 0}
+};
+static sensor_health sensorHealth[SENSOR_CNT];
+static sensor_values sensorCache;  // Last reading of each sensor
+static TickType_t nextReadTick[SENSOR_CNT];
+static bool isCached[SENSOR_CNT];
+
+typedef struct {
+    gpio_num_t sda;
+    gpio_num_t scl;
+    uint32_t clk_speed;
+} i2c_bus_config;
+
+// Indexed by port
+static const i2c_bus_config I2C_BUSES[] = {
+    {PIN_I2C_NUM0_SDA, PIN_I2C_NUM0_SCL, I2C_NUM0_CLOCK_SPEED},
+#ifdef I2C_NUM1_CLOCK_SPEED
+    {PIN_I2C_NUM1_SDA, PIN_I2C_NUM1_SCL, I2C_NUM1_CLOCK_SPEED},
+#endif
+};
+#define I2C_BUS_CNT ((int)(sizeof(I2C_BUSES) / sizeof(I2C_BUSES[0])))
+
+static_assert(AHT20_I2C_NUM < I2C_BUS_CNT, "Bus of AHT20 is not configured.");
+static_assert(BMP280_I2C_NUM < I2C_BUS_CNT, "Bus of BMP280 is not configured.");
+static_assert(AGS02MA_I2C_NUM < I2C_BUS_CNT, "Bus of AGS02MA is not configured.");
+
+// Sweeps of buses other than I2C_NUM_0 run on their own tasks, while the caller sweeps the rest.
+typedef struct {
+    TaskHandle_t task;
+    TaskHandle_t requester;
+    TickType_t now;
+    esp_err_t *errors;
+    int64_t last_us, max_us, total_us;
+    uint32_t sweeps;
+} i2c_sweep;
+
+static i2c_sweep i2cSweeps[I2C_BUS_CNT];
+
 
 void init_gpio(void) {
-    // PM1006 Fan
-    gpio_config_t cfg = {
-        .pin_bit_mask = 1ll << PIN_PM1006_FAN,
-        .mode         = GPIO_MODE_OUTPUT,
-        .pull_up_en   = GPIO_PULLUP_DISABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type    = GPIO_INTR_DISABLE
-    };
-    gpio_config(&cfg);
-    gpio_set_level(PIN_PM1006_FAN, 1);
+    // PM1006 Fan - LEDC
+    ledc_timer_config_t timer_cfg = {};
+        timer_cfg.speed_mode      = LEDC_LOW_SPEED_MODE;
+        timer_cfg.duty_resolution = FAN_LEDC_RESOLUTION;
+        timer_cfg.timer_num       = FAN_LEDC_TIMER;
+        timer_cfg.freq_hz         = FAN_PWM_FREQUENCY;
+        timer_cfg.clk_cfg         = LEDC_AUTO_CLK;
+    ESP_ERROR_CHECK(ledc_timer_config(&timer_cfg));
+    ledc_channel_config_t channel_cfg = {};
+        channel_cfg.gpio_num   = PIN_PM1006_FAN;
+        channel_cfg.speed_mode = LEDC_LOW_SPEED_MODE;
+        channel_cfg.channel    = FAN_LEDC_CHANNEL;
+        channel_cfg.intr_type  = LEDC_INTR_DISABLE;
+        channel_cfg.timer_sel  = FAN_LEDC_TIMER;
+        channel_cfg.duty       = FAN_LEDC_MAX_DUTY;
+        channel_cfg.hpoint     = 0;
+    ESP_ERROR_CHECK(ledc_channel_config(&channel_cfg));
 }
 
 void init_modules(PWMLed **statusLEDPtr, WS2812Strip **stripPtr) {
@@ -76,8 +160,37 @@ void init_modules(PWMLed **statusLEDPtr, WS2812Strip **stripPtr) {
 }
 
 esp_err_t init_sensors(void) {
+    ESP_RETURN_ON_ERROR(init_pm1006(), "IO:init_sensors", "Failed to init PM1006.");
+    for (int port = 0; port < I2C_BUS_CNT; port++)
+        ESP_RETURN_ON_ERROR(init_i2c_bus(port), "IO:init_sensors", "Failed to init I2C.");
+    for (int port = 1; port < I2C_BUS_CNT; port++) {
+        ESP_RETURN_ON_FALSE(
+            xTaskCreate(
+                i2c_sweep_task, "i2c_sweep_task", I2C_SWEEP_STACK_SIZE, (void*)(intptr_t)port, I2C_SWEEP_PRIORITY,
+                &i2cSweeps[port].task
+            ) == pdPASS,
+            ESP_ERR_NO_MEM, "IO:init_sensors", "Failed to create sweep task of I2C port %d.", port
+        );
+    }
+
+    ESP_RETURN_ON_ERROR(init_aht20(), "IO:init_sensors", "Failed to init AHT20.");
+    ESP_RETURN_ON_ERROR(init_bmp280(), "IO:init_sensors", "Failed to init BMP280.");
+    ESP_RETURN_ON_ERROR(init_ags02ma(), "IO:init_sensors", "Failed to init AGS02MA.");
+
+    ESP_LOGI("IO:init_sensors", "Successfully initialized all sensors.");
+    return ESP_OK;
+}
+
+esp_err_t init_pm1006(void) {
     // PM1006 - UART
-    ESP_LOGI("IO:init_sensors", "Initializing PM1006...");
+    ESP_LOGI("IO:init_pm1006", "Initializing PM1006...");
+    // Re-installing the UART driver drops a stuck RX FIFO and a frame cut off by an overflow
+    if (pm1006 != NULL) {
+        pm1006_delete(pm1006);
+        pm1006 = NULL;
+    }
+    if (uart_is_driver_installed(UART_NUM_1))
+        uart_driver_delete(UART_NUM_1);
     pm1006_config_t pm1006_cfg = {};
         pm1006_cfg.uart_num    = UART_NUM_1;
         pm1006_cfg.tx_pin      = PIN_PM1006_TX;
@@ -87,99 +200,304 @@ esp_err_t init_sensors(void) {
         pm1006_cfg.timeout     = PM1006_TIMEOUT;
     ESP_RETURN_ON_ERROR(
         pm1006_create(&pm1006_cfg, &pm1006),
-        "IO:init_sensors", "Failed to init PM1006."
+        "IO:init_pm1006", "Failed to init PM1006."
     );
+    return ESP_OK;
+}
 
-    // I2C Num0
-    ESP_LOGI("IO:init_sensors", "Initializing I2C...");
-    i2c_config_t i2c_num0_conf = {};
-        i2c_num0_conf.mode             = I2C_MODE_MASTER;
-        i2c_num0_conf.sda_io_num       = PIN_I2C_NUM0_SDA;
-        i2c_num0_conf.scl_io_num       = PIN_I2C_NUM0_SCL;
-        i2c_num0_conf.sda_pullup_en    = GPIO_PULLUP_DISABLE;
-        i2c_num0_conf.scl_pullup_en    = GPIO_PULLUP_DISABLE;
-        i2c_num0_conf.master.clk_speed = I2C_NUM0_CLOCK_SPEED;
+esp_err_t init_i2c_bus(i2c_port_t port) {
+    ESP_LOGI("IO:init_i2c_bus", "Initializing I2C (Port: %d)...", port);
+    ESP_RETURN_ON_FALSE(
+        port < I2C_BUS_CNT, ESP_ERR_NOT_SUPPORTED,
+        "IO:init_i2c_bus", "I2C port %d is not configured.", port
+    );
+    i2c_config_t i2c_conf = {};
+        i2c_conf.mode             = I2C_MODE_MASTER;
+        i2c_conf.sda_io_num       = I2C_BUSES[port].sda;
+        i2c_conf.scl_io_num       = I2C_BUSES[port].scl;
+        i2c_conf.sda_pullup_en    = GPIO_PULLUP_DISABLE;
+        i2c_conf.scl_pullup_en    = GPIO_PULLUP_DISABLE;
+        i2c_conf.master.clk_speed = I2C_BUSES[port].clk_speed;
     ESP_RETURN_ON_ERROR(
-        i2c_param_config(I2C_NUM_0, &i2c_num0_conf),
-        "IO:init_sensors", "Failed to init I2C."
+        i2c_param_config(port, &i2c_conf),
+        "IO:init_i2c_bus", "Failed to init I2C."
     );
     ESP_RETURN_ON_ERROR(
-        i2c_driver_install(I2C_NUM_0, i2c_num0_conf.mode, 0, 0, 0),
-        "IO:init_sensors", "Failed to init I2C."
+        i2c_driver_install(port, i2c_conf.mode, 0, 0, 0),
+        "IO:init_i2c_bus", "Failed to init I2C."
     );
+    return ESP_OK;
+}
 
-#ifdef I2C_NUM1_CLOCK_SPEED
-#error I2C NUM1 is not implemented.
-#endif
+// Releases a slave holding SDA low by clocking SCL manually, then re-installs the driver.
+esp_err_t recover_i2c_bus(i2c_port_t port) {
+    ESP_RETURN_ON_FALSE(
+        port < I2C_BUS_CNT, ESP_ERR_NOT_SUPPORTED,
+        "IO:recover_i2c_bus", "I2C port %d is not configured.", port
+    );
+    gpio_num_t sda = I2C_BUSES[port].sda, scl = I2C_BUSES[port].scl;
+
+    ESP_LOGW("IO:recover_i2c_bus", "Recovering I2C bus (Port: %d)...", port);
+    i2c_driver_delete(port);
+
+    gpio_config_t cfg = {
+        .pin_bit_mask = (1ull << sda) | (1ull << scl),
+        .mode         = GPIO_MODE_INPUT_OUTPUT_OD,
+        .pull_up_en   = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type    = GPIO_INTR_DISABLE
+    };
+    ESP_RETURN_ON_ERROR(gpio_config(&cfg), "IO:recover_i2c_bus", "Failed to take over I2C pins.");
+    gpio_set_level(sda, 1);
+    gpio_set_level(scl, 1);
+    for (int i = 0; i < 9 && !gpio_get_level(sda); i++) {
+        gpio_set_level(scl, 0);
+        esp_rom_delay_us(I2C_BUS_CLEAR_HALF_PERIOD_US);
+        gpio_set_level(scl, 1);
+        esp_rom_delay_us(I2C_BUS_CLEAR_HALF_PERIOD_US);
+    }
+    // STOP condition
+    gpio_set_level(scl, 0);
+    gpio_set_level(sda, 0);
+    esp_rom_delay_us(I2C_BUS_CLEAR_HALF_PERIOD_US);
+    gpio_set_level(scl, 1);
+    esp_rom_delay_us(I2C_BUS_CLEAR_HALF_PERIOD_US);
+    gpio_set_level(sda, 1);
 
+    return init_i2c_bus(port);
+}
+
+esp_err_t init_aht20(void) {
     // AHT20 - espressif/aht20 (I2C)
-    ESP_LOGI("IO:init_sensors", "Initializing AHT20...");
+    ESP_LOGI("IO:init_aht20", "Initializing AHT20...");
+    if (aht20 != NULL) {
+        aht20_del_sensor(aht20);
+        aht20 = NULL;
+    }
     aht20_i2c_config_t aht20_i2c_cfg = {
         .i2c_port = AHT20_I2C_NUM,
         .i2c_addr = (AHT20_I2C_ADDR << 1) // The library needs this
     };
     ESP_RETURN_ON_ERROR(
         aht20_new_sensor(&aht20_i2c_cfg, &aht20),
-        "IO:init_sensors", "Failed to init AHT20."
+        "IO:init_aht20", "Failed to init AHT20."
     );
+    return ESP_OK;
+}
 
+esp_err_t init_bmp280(void) {
     // BMP280 - I2C
-    ESP_LOGI("IO:init_sensors", "Initializing BMP280...");
+    ESP_LOGI("IO:init_bmp280", "Initializing BMP280...");
+    delete bmp280;
     bmp280 = new BMP280(BMP280_I2C_NUM, BMP280_I2C_ADDR, BMP280_TIMEOUT);
+#ifdef BMP280_HW_FILTER
+    // Oversampling is lowered, as the filter removes the noise (Bosch: indoor monitoring)
+    ESP_RETURN_ON_ERROR(
+        bmp280->begin(BMP280::PM_NORMAL, BMP280::P_STANDARD, BMP280::T_ULOW, BMP280::FILTER_16, BMP280::STBY_1s),
+        "IO:init_bmp280", "Failed to init BMP280."
+    );
+#else
     ESP_RETURN_ON_ERROR(
         bmp280->begin(BMP280::PM_NORMAL, BMP280::P_UHIGH, BMP280::T_STANDARD, BMP280::FILTER_OFF, BMP280::STBY_1s),
-        "IO:init_sensors", "Failed to init BMP280."
+        "IO:init_bmp280", "Failed to init BMP280."
     );
+#endif
+    return ESP_OK;
+}
 
+esp_err_t init_ags02ma(void) {
     // AGS02MA - I2C
-    ESP_LOGI("IO:init_sensors", "Initializing AGS02MA...");
+    ESP_LOGI("IO:init_ags02ma", "Initializing AGS02MA...");
+    delete ags02ma;
     ags02ma = new AGS02MA(AGS02MA_I2C_NUM, AGS02MA_I2C_ADDR, AGS02MA_TIMEOUT);
     ESP_RETURN_ON_ERROR(
         ags02ma->begin(),
-        "IO:init_sensors", "Failed to init AGS02MA."
+        "IO:init_ags02ma", "Failed to init AGS02MA."
     );
-
-    ESP_LOGI("IO:init_sensors", "Successfully initialized all sensors.");
     return ESP_OK;
 }
 
-esp_err_t get_sensor_values(sensor_values *result) {
+esp_err_t read_pm1006(sensor_values *result) {
+    return get_pm1006_value(&result->fine_dust);
+}
+
+void invalidate_pm1006(sensor_values *result) {
+    result->fine_dust = INT_MIN;
+}
+
+esp_err_t read_aht20(sensor_values *result) {
+    return get_temphumi(&result->temperature, &result->humidity);
+}
+
+void invalidate_aht20(sensor_values *result) {
+    result->temperature = FLT_MIN;
+    result->humidity    = INT_MIN;
+}
+
+esp_err_t read_bmp280(sensor_values *result) {
+    return get_temppress(&result->temperature2, &result->pressure);
+}
+
+void invalidate_bmp280(sensor_values *result) {
+    result->temperature2 = FLT_MIN;
+    result->pressure     = FLT_MIN;
+}
+
+esp_err_t read_ags02ma(sensor_values *result) {
+    return get_tvoc(&result->tvoc);
+}
+
+void invalidate_ags02ma(sensor_values *result) {
+    result->tvoc = INT_MIN;
+}
+
+// Circuit breaker of a sensor.
+// CLOSED: read every cycle. OPEN: skip reading until backoff expires.
+// HALF_OPEN: re-init (and recover the bus) once, then probe with a single read.
+esp_err_t read_guarded(sensor_id id, sensor_values *result) {
+    const sensor_driver *driver = &SENSOR_DRIVERS[id];
+    sensor_health *health = &sensorHealth[id];
+    TickType_t now = xTaskGetTickCount();
     esp_err_t err;
-    if ((err = get_pm1006_value(&result->fine_dust)) != ESP_OK) {
-        ESP_LOGW(
-            "IO:get_sensor_values:get_pm1006_value",
-            "Failed to get PM1006 value (Error: %s).",
-            esp_err_to_name(err)
-        );
-        result->fine_dust = INT_MIN;
+
+    if (health->state == SENSOR_HEALTH_OPEN) {
+        if ((int32_t)(now - health->retry_tick) < 0) {
+            health->skipped_reads++;
+            driver->invalidate(result);
+            return ESP_ERR_INVALID_STATE;
+        }
+        health->state = SENSOR_HEALTH_HALF_OPEN;
+        ESP_LOGI("IO:read_guarded", "%s: Probing after %" PRIu32 "ms backoff.", driver->name, health->backoff_ms);
+        if (driver->i2c_port >= 0 && recover_i2c_bus(driver->i2c_port) == ESP_OK)
+            health->bus_recoveries++;
+        if (driver->reinit != NULL) {
+            health->reinits++;
+            if (driver->reinit() != ESP_OK)
+                ESP_LOGW("IO:read_guarded", "%s: Re-init failed.", driver->name);
+        }
     }
-    if ((err = get_temphumi(&result->temperature, &result->humidity)) != ESP_OK) {
+
+    health->total_reads++;
+    if ((err = driver->read(result)) == ESP_OK) {
+        if (health->state != SENSOR_HEALTH_CLOSED)
+            ESP_LOGI("IO:read_guarded", "%s: Recovered.", driver->name);
+        health->state      = SENSOR_HEALTH_CLOSED;
+        health->failures   = 0;
+        health->backoff_ms = 0;
+        return ESP_OK;
+    }
+
+    health->total_failures++;
+    health->failures++;
+    driver->invalidate(result);
+    if (health->state == SENSOR_HEALTH_HALF_OPEN || health->failures >= SENSOR_BREAKER_THRESHOLD) {
+        if (health->backoff_ms == 0)
+            health->backoff_ms = SENSOR_BREAKER_BACKOFF_MIN;
+        else if (health->backoff_ms < SENSOR_BREAKER_BACKOFF_MAX / 2)
+            health->backoff_ms *= 2;
+        else
+            health->backoff_ms = SENSOR_BREAKER_BACKOFF_MAX;
+        health->state      = SENSOR_HEALTH_OPEN;
+        health->retry_tick = now + pdMS_TO_TICKS(health->backoff_ms);
+        health->opened++;
         ESP_LOGW(
-            "IO:get_sensor_values:get_temphumi",
-            "Failed to get temperature or humidity (Error: %s).",
-            esp_err_to_name(err)
+            "IO:read_guarded", "%s: Circuit opened after %" PRIu32 " failures (Retry in %" PRIu32 "ms).",
+            driver->name, health->failures, health->backoff_ms
         );
-        result->temperature = FLT_MIN;
-        result->humidity    = INT_MIN;
     }
-    if ((err = get_temppress(&result->temperature2, &result->pressure)) != ESP_OK) {
-        ESP_LOGW(
-            "IO:get_sensor_values:get_temppress",
-            "Failed to get temperature or pressure (Error: %s).",
-            esp_err_to_name(err)
+    return err;
+}
+
+// Sensors with read_interval are read only when their cached reading is due.
+// Each sensor only touches its own fields of sensorCache, so buses can be swept concurrently.
+void _sweep_sensors(int port, TickType_t now, esp_err_t *errors) {
+    esp_err_t err;
+    for (int i = 0; i < SENSOR_CNT; i++) {
+        if (SENSOR_DRIVERS[i].i2c_port != port)
+            continue;
+        if (isCached[i] && (int32_t)(now - nextReadTick[i]) < 0) {
+            sensorHealth[i].cached_reads++;
+            if (errors != NULL)
+                errors[i] = ESP_OK;
+            continue;
+        }
+        err = read_guarded((sensor_id)i, &sensorCache);
+        isCached[i]     = err == ESP_OK && SENSOR_DRIVERS[i].read_interval;
+        nextReadTick[i] = now + pdMS_TO_TICKS(SENSOR_DRIVERS[i].read_interval);
+        if (errors != NULL)
+            errors[i] = err;
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+            ESP_LOGW(
+                "IO:get_sensor_values",
+                "Failed to get %s value (Error: %s).",
+                SENSOR_DRIVERS[i].name, esp_err_to_name(err)
+            );
+        }
+    }
+}
+
+void _sweep_i2c_bus(int port, TickType_t now, esp_err_t *errors) {
+    i2c_sweep *sweep = &i2cSweeps[port];
+    int64_t start = esp_timer_get_time();
+    _sweep_sensors(port, now, errors);
+    sweep->last_us = esp_timer_get_time() - start;
+    if (sweep->last_us > sweep->max_us)
+        sweep->max_us = sweep->last_us;
+    sweep->total_us += sweep->last_us;
+    sweep->sweeps++;
+}
+
+void i2c_sweep_task(void *portV) {
+    int port = (intptr_t)portV;
+    i2c_sweep *sweep = &i2cSweeps[port];
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        _sweep_i2c_bus(port, sweep->now, sweep->errors);
+        xTaskNotifyGive(sweep->requester);
+    }
+}
+
+// errors may be NULL. Otherwise it receives the result of each sensor read.
+esp_err_t get_sensor_values(sensor_values *result, esp_err_t *errors) {
+    TickType_t now = xTaskGetTickCount();
+
+    for (int port = 1; port < I2C_BUS_CNT; port++) {
+        i2cSweeps[port].requester = xTaskGetCurrentTaskHandle();
+        i2cSweeps[port].now       = now;
+        i2cSweeps[port].errors    = errors;
+        xTaskNotifyGive(i2cSweeps[port].task);
+    }
+    _sweep_sensors(-1, now, errors);  // Not on I2C
+    _sweep_i2c_bus(I2C_NUM_0, now, errors);
+    for (int port = 1; port < I2C_BUS_CNT; port++)
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+
+    *result = sensorCache;
+    return ESP_OK;
+}
+
+void get_sensor_health(sensor_health *result) {
+    memcpy(result, sensorHealth, sizeof(sensorHealth));
+}
+
+void log_sensor_health(void) {
+    for (int i = 0; i < SENSOR_CNT; i++) {
+        const sensor_health *health = &sensorHealth[i];
+        ESP_LOGI(
+            "IO:sensor_health",
+            "%s: state=%d reads=%" PRIu32 " cached=%" PRIu32 " failures=%" PRIu32 " skipped=%" PRIu32
+            " opened=%" PRIu32 " reinits=%" PRIu32 " bus_recoveries=%" PRIu32,
+            SENSOR_DRIVERS[i].name, health->state, health->total_reads, health->cached_reads, health->total_failures,
+            health->skipped_reads, health->opened, health->reinits, health->bus_recoveries
         );
-        result->temperature2 = FLT_MIN;
-        result->pressure     = FLT_MIN;
     }
-    if ((err = get_tvoc(&result->tvoc)) != ESP_OK) {
-        ESP_LOGW(
-            "IO:get_sensor_values:get_tvoc",
-            "Failed to get TVOC (Error: %s).",
-            esp_err_to_name(err)
+    for (int port = 0; port < I2C_BUS_CNT; port++) {
+        const i2c_sweep *sweep = &i2cSweeps[port];
+        ESP_LOGI(
+            "IO:sensor_health", "I2C%d sweep: last=%" PRId64 "us max=%" PRId64 "us avg=%" PRId64 "us",
+            port, sweep->last_us, sweep->max_us, sweep->sweeps ? sweep->total_us / sweep->sweeps : 0
         );
-        result->tvoc = INT_MIN;
     }
-    return ESP_OK;
 }
 
 esp_err_t get_pm1006_value(int *fine_dust) {
@@ -187,7 +505,7 @@ esp_err_t get_pm1006_value(int *fine_dust) {
         pm1006_get_value(pm1006, fine_dust),
         "IO:get_pm1006_value", "Failed to get PM2.5."
     );
-    ESP_LOGI("IO:get_pm1006_value", "PM2.5: %dµg/m^3", *fine_dust);
+    BINLOG(BL_PM1006_VALUE, *fine_dust);
     return ESP_OK;
 }
 
@@ -200,7 +518,7 @@ esp_err_t get_temphumi(float *temperature, int *humidity) {
     );
     *temperature = decimal_temperature;
     *humidity = (int)(decimal_humidity);
-    ESP_LOGI("IO:get_temphumi", "Temperature: %.01f°C | Humidity: %d%%", *temperature, *humidity);
+    BINLOG(BL_TEMPHUMI, binlog_float(*temperature), *humidity);
     return ESP_OK;
 }
 
@@ -212,7 +530,7 @@ esp_err_t get_temppress(float *temperature, float *pressure) {
     );
     *temperature = result.temperature;
     *pressure = result.pressure;
-    ESP_LOGI("IO:get_temppress", "Temperature: %.01f°C | Air Pressure: %.02fhPa", *temperature, *pressure);
+    BINLOG(BL_TEMPPRESS, binlog_float(*temperature), binlog_float(*pressure));
     return ESP_OK;
 }
 
@@ -223,12 +541,12 @@ esp_err_t get_tvoc(int *tvoc) {
         "IO:get_tvoc", "Failed to get TVOC."
     );
     *tvoc = result;
-    ESP_LOGI("IO:get_tvoc", "TVOC: %dppb", *tvoc);
+    BINLOG(BL_TVOC, *tvoc);
     return ESP_OK;
 }
 
-esp_err_t set_strip_pixels(led_pixel *pixels) {
-    ESP_LOGD("IO:set_strip_pixels", "Starting set...");
+// Scales pixels into the strip buffer without sending them.
+esp_err_t fill_strip_pixels(led_pixel *pixels) {
     led_pixel pixel;
     int bright;
     for (int i = 0; i < 8; i++) {
@@ -238,15 +556,33 @@ esp_err_t set_strip_pixels(led_pixel *pixels) {
             ws2812, i, pixel.r >> bright, pixel.g >> bright, pixel.b >> bright
         ), "set_strip_pixels", "");
     }
+    return ESP_OK;
+}
+
+esp_err_t set_strip_pixels(led_pixel *pixels) {
+    ESP_LOGD("IO:set_strip_pixels", "Starting set...");
+    ESP_RETURN_ON_ERROR(fill_strip_pixels(pixels), "set_strip_pixels", "Failed to fill.");
     ESP_RETURN_ON_ERROR(led_strip_refresh(ws2812), "set_strip_pixels", "Failed to set.");
     ESP_LOGD("IO:set_strip_pixels", "Done");
     return ESP_OK;
 }
 
+esp_err_t fan_set_speed(int level) {
+    if (level < 0)
+        level = 0;
+    else if (level >= (int)sizeof(FAN_DUTY))
+        level = sizeof(FAN_DUTY) - 1;
+    ESP_RETURN_ON_ERROR(
+        ledc_set_duty(LEDC_LOW_SPEED_MODE, FAN_LEDC_CHANNEL, FAN_DUTY[level] * FAN_LEDC_MAX_DUTY / 100),
+        "IO:fan_set_speed", "Failed to set duty."
+    );
+    return ledc_update_duty(LEDC_LOW_SPEED_MODE, FAN_LEDC_CHANNEL);
+}
+
 esp_err_t fan_off(void) {
-    return gpio_set_level(PIN_PM1006_FAN, 0);
+    return fan_set_speed(0);
 }
 
 esp_err_t fan_on(void) {
-    return gpio_set_level(PIN_PM1006_FAN, 1);
+    return fan_set_speed(sizeof(FAN_DUTY) - 1);
 }
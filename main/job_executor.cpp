@@ -0,0 +1,190 @@
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cinttypes>
+#include <coroutine>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "config.h"
+#include "job_executor.h"
+
+static_assert(JOB_FRAME_POOL_SIZE <= 32, "Frames are tracked in a 32 bit mask.");
+static_assert(JOB_FRAME_SIZE % alignof(std::max_align_t) == 0, "Frames must stay aligned.");
+
+alignas(std::max_align_t) static uint8_t _frames[JOB_FRAME_POOL_SIZE][JOB_FRAME_SIZE];
+static uint32_t _frames_used = 0;
+static int _frames_peak = 0;
+static std::size_t _largest_frame = 0;
+static portMUX_TYPE _frames_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+void *Job::promise_type::operator new(std::size_t size) {
+    void *frame = NULL;
+    int used = 0;
+
+    if (size > JOB_FRAME_SIZE) {
+        ESP_LOGE("JobExecutor:alloc", "Frame of %u bytes is over JOB_FRAME_SIZE. Rebooting...", (unsigned int)size);
+        abort();
+    }
+    taskENTER_CRITICAL(&_frames_lock);
+    for (int i = 0; i < JOB_FRAME_POOL_SIZE; i++) {
+        if (_frames_used & (1UL << i)) {
+            used++;
+        } else if (frame == NULL) {
+            _frames_used |= 1UL << i;
+            frame = _frames[i];
+            used++;
+        }
+    }
+    if (used > _frames_peak)
+        _frames_peak = used;
+    if (size > _largest_frame)
+        _largest_frame = size;
+    taskEXIT_CRITICAL(&_frames_lock);
+
+    if (frame == NULL) {
+        ESP_LOGE("JobExecutor:alloc", "Frame pool exhausted. Rebooting...");
+        abort();
+    }
+    return frame;
+}
+
+void Job::promise_type::operator delete(void *frame, std::size_t) {
+    int i = ((uint8_t*)frame - &_frames[0][0]) / JOB_FRAME_SIZE;
+    taskENTER_CRITICAL(&_frames_lock);
+    _frames_used &= ~(1UL << i);
+    taskEXIT_CRITICAL(&_frames_lock);
+}
+
+
+JobExecutor::JobExecutor(const char *name, uint32_t stackSize, UBaseType_t priority) {
+    this->name      = name;
+    this->stackSize = stackSize;
+    this->priority  = priority;
+}
+
+// Call before start(). The job runs until its first co_await once the executor starts.
+void JobExecutor::spawn(const char *name, Job job) {
+    if (jobCnt >= JOB_EXECUTOR_MAX_JOBS) {
+        ESP_LOGE("JobExecutor:spawn", "Too many jobs. Rebooting...");
+        abort();
+    }
+    _job_slot *slot = &jobs[jobCnt++];
+    slot->name   = name;
+    slot->handle = job.release();
+    slot->timed  = true;
+    slot->wakeTick = xTaskGetTickCount();
+}
+
+void JobExecutor::start() {
+    if (xTaskCreate(runTask, name, stackSize, this, priority, &task) != pdPASS) {
+        ESP_LOGE("JobExecutor:start", "Failed to create %s. Rebooting...", name);
+        abort();
+    }
+}
+
+// Called by Wait of the current job, right before it suspends.
+void JobExecutor::suspend(uint32_t bits, TickType_t timeout) {
+    _job_slot *job = &jobs[current];
+    job->waitBits = bits;
+    job->timed    = timeout != portMAX_DELAY;
+    job->wakeTick = xTaskGetTickCount() + timeout;
+}
+
+void JobExecutor::resume(_job_slot *job, uint32_t bits) {
+    TickType_t latency;
+
+    if (!bits) {
+        // Ticks between the deadline and the resume, while other jobs ran
+        latency = xTaskGetTickCount() - job->wakeTick;
+        if (latency > job->maxLatency)
+            job->maxLatency = latency;
+        if (latency == 0)
+            job->latency[0]++;
+        else if (latency == 1)
+            job->latency[1]++;
+        else if (latency < 5)
+            job->latency[2]++;
+        else if (latency < 10)
+            job->latency[3]++;
+        else
+            job->latency[4]++;
+    }
+    job->receivedBits = bits;
+    job->waitBits     = 0;
+    job->timed        = false;
+    job->resumes++;
+
+    current = job - jobs;
+    job->handle.resume();
+    current = -1;
+    if (job->handle.done()) {
+        ESP_LOGI("JobExecutor:resume", "Job %s finished.", job->name);
+        job->handle.destroy();
+        job->handle = nullptr;
+    }
+}
+
+void JobExecutor::run() {
+    TickType_t now, timeout;
+    uint32_t bits;
+
+    while (1) {
+        for (int i = 0; i < jobCnt; i++) {
+            _job_slot *job = &jobs[i];
+            if (!job->handle)
+                continue;
+            bits = pendingBits & job->waitBits;
+            if (bits)
+                pendingBits &= ~bits;
+            else if (!job->timed || (int32_t)(xTaskGetTickCount() - job->wakeTick) < 0)
+                continue;
+            resume(job, bits);
+        }
+
+        // Sleep until the earliest deadline or a notification
+        now = xTaskGetTickCount();
+        timeout = portMAX_DELAY;
+        for (int i = 0; i < jobCnt; i++) {
+            _job_slot *job = &jobs[i];
+            if (!job->handle || !job->timed)
+                continue;
+            if ((int32_t)(job->wakeTick - now) <= 0) {
+                timeout = 0;
+                break;
+            }
+            if (job->wakeTick - now < timeout)
+                timeout = job->wakeTick - now;
+        }
+        if (xTaskNotifyWait(0, UINT32_MAX, &bits, timeout) == pdTRUE)
+            pendingBits |= bits;
+    }
+}
+
+void JobExecutor::runTask(void *executorV) {
+    ((JobExecutor*)executorV)->run();
+}
+
+// Replaced stacks are JOB_REPLACED_STACKS, which the jobs ran on as separate tasks.
+void JobExecutor::logStats() {
+    for (int i = 0; i < jobCnt; i++) {
+        _job_slot *job = &jobs[i];
+        ESP_LOGI(
+            "JobExecutor",
+            "J|%s|res=%" PRIu32 "|lat=%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32 "|max=%" PRIu32,
+            job->name, job->resumes,
+            job->latency[0], job->latency[1], job->latency[2], job->latency[3], job->latency[4],
+            (uint32_t)job->maxLatency
+        );
+    }
+    ESP_LOGI(
+        "JobExecutor",
+        "%s: frames=%d/%d peak=%d largest=%u/%d stack_free=%" PRIu32 " saved=%d bytes",
+        name, __builtin_popcount(_frames_used), JOB_FRAME_POOL_SIZE, _frames_peak,
+        (unsigned int)_largest_frame, JOB_FRAME_SIZE, (uint32_t)uxTaskGetStackHighWaterMark(task),
+        JOB_REPLACED_STACKS - (int)stackSize - (int)sizeof(_frames)
+    );
+}
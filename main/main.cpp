@@ -4,21 +4,46 @@
 #include <cstdint>
 #include <climits>
 #include <cfloat>
+#include <cinttypes>
+#include <cstddef>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 #include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_random.h"
+#include "esp_rtc_time.h"
+#include "esp_rom_crc.h"
 #include "esp_check.h"
 #include "esp_log.h"
 
 #include "config.h"
 #include "wifi/wifi.h"
+#include "ota/delta_ota.h"
 #include "smartthings/request.h"
+#include "smartthings/st_client.h"
 #include "io.h"
 #include "colors.h"
 #include "sample_array.h"
+#include "sensor_registry.h"
+#include "adaptive_sampler.h"
+#include "adaptive_poller.h"
 #include "semaphore.h"
+#include "task_monitor.h"
+#include "job_executor.h"
+#include "binlog.h"
+#include "data_bus.h"
+#include "sse_server.h"
+#include "derived_metrics.h"
+#include "rule_engine.h"
+#include "quantile_sketch.h"
+#include "change_detector.h"
+#include "i2c_stats.h"
+#include "trace.h"
+#include "benchmark.h"
 
 #if defined(CONFIG_HEAP_TRACING) && CONFIG_LOG_DEFAULT_LEVEL >= 4  // When default log level is verbose than DEBUG
 #include "esp_heap_trace.h"
@@ -30,32 +55,73 @@ static heap_trace_record_t trace_record[NUM_RECORDS];
 
 #define DEVICE_STATUS_TASK_STARTED (1 << 0)
 #define GET_SENSOR_VALUE_TASK_STARTED (1 << 1)
-#define WS2812_HELLO_TASK_ENDED (1 << 2)
 #define ALL_TASK_STARTED (\
     DEVICE_STATUS_TASK_STARTED\
     | GET_SENSOR_VALUE_TASK_STARTED\
 )
 #define IS_ALL_TASK_STARTED ((taskStatusFlags & ALL_TASK_STARTED) == ALL_TASK_STARTED)
-#define IS_WS2812_HELLO_TASK_ENDED ((taskStatusFlags & WS2812_HELLO_TASK_ENDED) == WS2812_HELLO_TASK_ENDED)
 
+#define JOB_SIGNAL_DATA_BUS (1 << 0)
 
-static IntSampleArray
-    *fine_dust_array,
-    *humidity_array,
-    *tvoc_array;
-static SampleArray
-    *temperature_array,
-    *temperature2_array,
-    *pressure_array;
+#if defined(ENABLE_TRACE_RECORD) && defined(ENABLE_TRACE_REPLAY)
+#error "ENABLE_TRACE_RECORD and ENABLE_TRACE_REPLAY can not be used together."
+#endif
+
+
+static AdaptiveSampler *sampler;
+static AdaptivePoller *poller;
+static JobExecutor *jobs;
 static DeviceConfig deviceConfig;
-static SemaphoreHandle_t configSemaphore, lastAverageSemaphore;
-static sensor_values lastAverage;
+static SemaphoreHandle_t configSemaphore, fanSemaphore;
+static rule_table rules;  // Guarded by configSemaphore
+static char rulesSource[RULE_SOURCE_MAX_LEN];
+static rule_led_pattern ledPattern;
+static uint32_t pendingRuleEvents, reportCnt;
+static int ws2812Subscription;
 static uint_fast8_t taskStatusFlags, isSensorInitFailed;
-static TickType_t fanStartedTime;
+static TickType_t fanStartedTime, fanAutoNextWindow;
+static bool fanAutoMode, fanAutoPreference, isWarmStarted;  // fanAutoPreference is guarded by fanSemaphore
+static int fanSpeed = INT_MIN, fanAutoWindowSamples;
+static int cloudFanSpeed = INT_MIN, ruleFanSpeed = RULE_FAN_NONE;
+static bool ruleFanOverridesCloud, cloudOverridesRule;
 
 PWMLed *statusLED;
 WS2812Strip *strip;
 
+#ifdef ENABLE_QUANTILE_SKETCH
+static RollingQuantiles fineDustQuantiles, tvocQuantiles;
+static TickType_t quantileHourStart;
+static int quantileHours = -1;  // Closed hours of the running day, -1 before the first sample
+#endif
+
+#ifdef ENABLE_CHANGE_ALERT
+#define CHANGE_CHANNEL_FINE_DUST (1 << 0)
+#define CHANGE_CHANNEL_TVOC      (1 << 1)
+
+static ChangeDetector fineDustDetector(CHANGE_DETECT_MIN_SIGMA_FINE_DUST), tvocDetector(CHANGE_DETECT_MIN_SIGMA_TVOC);
+static TaskHandle_t deviceStatusTask;  // Set once device_status_task takes alerts
+static portMUX_TYPE alertLock = portMUX_INITIALIZER_UNLOCKED;
+static sensor_values alertValues;  // Guarded by alertLock. Latest raw sample of each pending channel.
+static uint32_t alertChannels;     // Guarded by alertLock. Pending until send_change_alert() takes them.
+static TickType_t alertTick, lastAlertTick = (TickType_t)-pdMS_TO_TICKS(CHANGE_ALERT_MIN_INTERVAL);  // First alert is not limited
+static uint32_t alertCnt, alertDeferredCnt, alertFailedCnt;
+static TickType_t alertMaxDelay;
+#endif
+
+#ifdef ENABLE_WARM_START
+typedef struct {
+    uint16_t magic;
+    uint16_t size;      // sizeof(warm_state), so that layout changes are not restored
+    uint32_t crc;       // From savedTime to the end
+    int64_t savedTime;  // esp_rtc_get_time_us(), which runs through soft resets
+    Sensors::state windows;
+    sensor_values average;
+    DeviceConfig config;
+    int fanSpeed;
+} warm_state;
+
+static RTC_NOINIT_ATTR warm_state warmState;
+#endif
 
 
 void init_variables(void) {
@@ -64,12 +130,15 @@ void init_variables(void) {
         ESP_LOGE("Main:init_variables", "Failed to create configReadSemaphore. Rebooting...");
         abort();
     }
-    lastAverageSemaphore = xSemaphoreCreateCounting(CONFIG_SEMAPHORE_MAX_VALUE, CONFIG_SEMAPHORE_MAX_VALUE);
-    if (lastAverageSemaphore == NULL) {
-        ESP_LOGE("Main:init_variables", "Failed to create lastAverageReadSemaphore. Rebooting...");
+    fanSemaphore = xSemaphoreCreateMutex();
+    if (fanSemaphore == NULL) {
+        ESP_LOGE("Main:init_variables", "Failed to create fanSemaphore. Rebooting...");
         abort();
     }
 
+    init_data_bus();
+    ws2812Subscription = data_bus_subscribe("ws2812", 1, DATA_BUS_DROP_OLDEST);
+
     // Set default config
     deviceConfig.tempHigh        = 27;
     deviceConfig.tempLow         = 18;
@@ -86,28 +155,190 @@ void init_variables(void) {
     deviceConfig.offsets.tvoc         = 0;
     deviceConfig.offsets.temperature2 = 0;
     deviceConfig.offsets.pressure     = 0;
+    deviceConfig.sampling.intervalMin       = GET_SENSOR_TASK_DELAY_MIN;
+    deviceConfig.sampling.intervalMax       = SAMPLING_INTERVAL_MAX;
+    deviceConfig.sampling.fineDustThreshold = SAMPLING_FINE_DUST_THRESHOLD;
+    deviceConfig.sampling.tvocThreshold     = SAMPLING_TVOC_THRESHOLD;
+    deviceConfig.polling.fastInterval      = GET_STATUS_INTERVAL;
+    deviceConfig.polling.dayIdleInterval   = POLL_INTERVAL_IDLE;
+    deviceConfig.polling.nightIdleInterval = POLL_INTERVAL_NIGHT;
+    deviceConfig.polling.nightStart        = POLL_NIGHT_START;
+    deviceConfig.polling.nightEnd          = POLL_NIGHT_END;
+    deviceConfig.fanAutoMode = false;
+    deviceConfig.rules[0] = '\0';
+
+    Sensors::init();
+
+    sampler = new AdaptiveSampler(GET_SENSOR_TASK_DELAY_MIN, SAMPLING_INTERVAL_MAX);
+    sampler->setThreshold(SAMPLER_FINE_DUST, SAMPLING_FINE_DUST_THRESHOLD);
+    sampler->setThreshold(SAMPLER_TVOC, SAMPLING_TVOC_THRESHOLD);
+
+    poller = new AdaptivePoller(GET_STATUS_INTERVAL, POLL_INTERVAL_IDLE);
+    poller->setBounds(
+        GET_STATUS_INTERVAL, POLL_INTERVAL_IDLE, POLL_INTERVAL_NIGHT, POLL_NIGHT_START, POLL_NIGHT_END
+    );
+}
+
+// Applies fanSpeed of SmartThings.
+// With the fanAutoMode preference, get_sensor_value_task runs the fan at speed only for measurement windows.
+void set_fan_speed(int speed) {
+    bool wasRunning = fanStartedTime != portMAX_DELAY;
+    bool autoMode = fanAutoPreference && speed > 0;
+
+    if (likely(speed == fanSpeed && autoMode == fanAutoMode))
+        return;
+    fanSpeed = speed;
+
+    if (autoMode) {
+        if (!fanAutoMode) {
+            ESP_LOGI("Main:set_fan_speed", "Fan auto mode.");
+            fanAutoNextWindow    = xTaskGetTickCount();
+            fanAutoWindowSamples = 0;
+            fanAutoMode          = true;
+        } else if (wasRunning && unlikely(fan_set_speed(speed) != ESP_OK)) {
+            ESP_LOGE("Main:set_fan_speed", "Failed to set fan speed.");
+        }
+        return;
+    }
+    fanAutoMode = false;
+    if (likely(fan_set_speed(speed) == ESP_OK)) {
+        if (!speed)
+            fanStartedTime = portMAX_DELAY;
+        else if (!wasRunning)
+            fanStartedTime = xTaskGetTickCount();
+    } else {
+        ESP_LOGE("Main:set_fan_speed", "Failed to set fan speed.");
+    }
+}
 
-    fine_dust_array    = new IntSampleArray(SAMPLE_PER_UPDATE_STATUS);
-    temperature_array  = new SampleArray(SAMPLE_PER_UPDATE_STATUS);
-    humidity_array     = new IntSampleArray(SAMPLE_PER_UPDATE_STATUS);
-    temperature2_array = new SampleArray(SAMPLE_PER_UPDATE_STATUS);
-    pressure_array     = new SampleArray(SAMPLE_PER_UPDATE_STATUS);
-    tvoc_array         = new IntSampleArray(SAMPLE_PER_UPDATE_STATUS);
+// Applies fanSpeed of the winning source. Called with fanSemaphore.
+void _arbitrate_fan_speed() {
+    int speed = ruleFanSpeed != RULE_FAN_NONE && !cloudOverridesRule ? ruleFanSpeed : cloudFanSpeed;
+    if (speed != INT_MIN)
+        set_fan_speed(speed);
 }
 
-void get_device_status() {
+// A cloud command while a fan rule is active wins until the rule releases,
+// unless the rule overrides cloud commands.
+void set_cloud_fan_speed(int speed) {
+    if (!xSemaphoreTake(fanSemaphore, SEMAPHORE_MAX_WAIT)) {
+        ESP_LOGE("Main:set_cloud_fan_speed", "fanSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
+        abort();
+    }
+    if (speed != cloudFanSpeed) {
+        if (cloudFanSpeed != INT_MIN && ruleFanSpeed != RULE_FAN_NONE && !ruleFanOverridesCloud) {
+            ESP_LOGI("Main:set_cloud_fan_speed", "Cloud command overrides local rule.");
+            cloudOverridesRule = true;
+        }
+        cloudFanSpeed = speed;
+    }
+    _arbitrate_fan_speed();
+    xSemaphoreGive(fanSemaphore);
+}
+
+// Applies the fanAutoMode preference to the current fanSpeed.
+void set_fan_auto_mode(bool enabled) {
+    if (!xSemaphoreTake(fanSemaphore, SEMAPHORE_MAX_WAIT)) {
+        ESP_LOGE("Main:set_fan_auto_mode", "fanSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
+        abort();
+    }
+    fanAutoPreference = enabled;
+    if (fanSpeed != INT_MIN)
+        set_fan_speed(fanSpeed);
+    xSemaphoreGive(fanSemaphore);
+}
+
+// speed is RULE_FAN_NONE when no fan rule is active.
+void set_rule_fan_speed(int speed, bool overridesCloud) {
+    if (!xSemaphoreTake(fanSemaphore, SEMAPHORE_MAX_WAIT)) {
+        ESP_LOGE("Main:set_rule_fan_speed", "fanSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
+        abort();
+    }
+    if (speed != ruleFanSpeed) {
+        ESP_LOGI("Main:set_rule_fan_speed", "Local rule fanSpeed: %d", speed);
+        ruleFanSpeed       = speed;
+        cloudOverridesRule = false;
+    }
+    ruleFanOverridesCloud = overridesCloud;
+    _arbitrate_fan_speed();
+    xSemaphoreGive(fanSemaphore);
+}
+
+// Starts and stops measurement windows in fan auto mode. Called with fanSemaphore.
+// Returns ticks until the fan needs attention again, or portMAX_DELAY when not in auto mode.
+TickType_t _run_fan_auto_mode(TickType_t now) {
+    if (!fanAutoMode)
+        return portMAX_DELAY;
+
+    if (fanStartedTime == portMAX_DELAY) {
+        if ((int32_t)(now - fanAutoNextWindow) < 0)
+            return fanAutoNextWindow - now;
+        if (likely(fan_set_speed(fanSpeed) == ESP_OK)) {
+            ESP_LOGD("Main:run_fan_auto_mode", "Measurement window started.");
+            fanStartedTime       = now;
+            fanAutoNextWindow    = now + pdMS_TO_TICKS(FAN_AUTO_PERIOD);
+            fanAutoWindowSamples = 0;
+        }
+        return pdMS_TO_TICKS(PM1006_FAN_STARTUP_DELAY);
+    }
+    if (fanAutoWindowSamples >= SAMPLE_PER_UPDATE_STATUS) {
+        if (likely(fan_off() == ESP_OK)) {
+            ESP_LOGD("Main:run_fan_auto_mode", "Measurement window ended.");
+            fanStartedTime = portMAX_DELAY;
+        }
+        return fanAutoNextWindow - now;
+    }
+    return pdMS_TO_TICKS(GET_SENSOR_TASK_DELAY_MIN);
+}
+
+// Against set_fan_speed() of the cloud and rule tasks, which share the fan state.
+TickType_t run_fan_auto_mode(TickType_t now) {
+    TickType_t delay;
+
+    if (!xSemaphoreTake(fanSemaphore, SEMAPHORE_MAX_WAIT)) {
+        ESP_LOGE("Main:run_fan_auto_mode", "fanSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
+        abort();
+    }
+    delay = _run_fan_auto_mode(now);
+    xSemaphoreGive(fanSemaphore);
+    return delay;
+}
+
+// startedTime is a snapshot of fanStartedTime.
+fan_state get_fan_state(TickType_t tick, TickType_t startedTime) {
+    if (startedTime == portMAX_DELAY || tick < startedTime)
+        return FAN_STATE_OFF;
+    if (tick - startedTime < pdMS_TO_TICKS(PM1006_FAN_STARTUP_DELAY))
+        return FAN_STATE_WARMUP;
+    return FAN_STATE_READY;
+}
+
+// Returns true when switchLevel or fanSpeed changed since the last poll.
+bool get_device_status() {
     STStatus status;
     uint_fast8_t bright;
-    static uint_fast8_t lastFanState = 1;
+    bool changed = false;
+    static int lastSwitchLevel = INT_MIN, lastFanSpeed = INT_MIN;
 
     // Front WS2812 bright
     if (get_device_status(&status) != ESP_OK) {
         ESP_LOGE("Main:get_device_status", "Failed to get status.");
         ESP_ERROR_CHECK(strip->setColor(BOTTOM_LED, WS2812_RED));
-        return;
+        return false;
     }
     ESP_ERROR_CHECK(strip->setColor(BOTTOM_LED, WS2812_OFF));
 
+    if (lastSwitchLevel != INT_MIN && status.switchLevel != lastSwitchLevel) {
+        poller->recordLatency(status.switchLevelTimestamp);
+        changed = true;
+    }
+    if (lastFanSpeed != INT_MIN && status.fanSpeed != lastFanSpeed) {
+        poller->recordLatency(status.fanSpeedTimestamp);
+        changed = true;
+    }
+    lastSwitchLevel = status.switchLevel;
+    lastFanSpeed    = status.fanSpeed;
+
 
     if (!xSemaphoreTake(configSemaphore, SEMAPHORE_MAX_WAIT)) {
         ESP_LOGE("Main:get_device_status", "configSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
@@ -127,19 +358,41 @@ void get_device_status() {
 
     ESP_ERROR_CHECK(strip->setBright(bright));
 
-    if (unlikely(lastFanState != !!status.fanSpeed)) {
-        if (status.fanSpeed) {
-            if (likely(fan_on() == ESP_OK))
-                fanStartedTime = xTaskGetTickCount();
-            else
-                ESP_LOGE("Main:get_device_status", "Failed to turn on fan.");
-        } else {
-            if (likely(fan_off() == ESP_OK))
-                fanStartedTime = portMAX_DELAY;
-            else
-                ESP_LOGE("Main:get_device_status", "Failed to turn off fan.");
+    set_cloud_fan_speed(status.fanSpeed);
+    return changed;
+}
+
+bool is_valid_device_config(const DeviceConfig *config) {
+    return config->offsets.temperature <= 100 && config->offsets.temperature >= -100
+        && config->offsets.temperature2 <= 100 && config->offsets.temperature2 >= -100;
+}
+
+// Applies deviceConfig to the arrays, the sampler, the poller and the fan.
+void apply_device_config() {
+    Sensors::applyConfig(&deviceConfig);
+
+    sampler->setLimits(deviceConfig.sampling.intervalMin, deviceConfig.sampling.intervalMax);
+    sampler->setThreshold(SAMPLER_FINE_DUST, deviceConfig.sampling.fineDustThreshold);
+    sampler->setThreshold(SAMPLER_TVOC, deviceConfig.sampling.tvocThreshold);
+
+    poller->setBounds(
+        deviceConfig.polling.fastInterval, deviceConfig.polling.dayIdleInterval,
+        deviceConfig.polling.nightIdleInterval, deviceConfig.polling.nightStart, deviceConfig.polling.nightEnd
+    );
+    set_fan_auto_mode(deviceConfig.fanAutoMode);
+
+    // Recompile only on change, which keeps the state of active rules
+    if (strcmp(deviceConfig.rules, rulesSource)) {
+        rule_table newRules;
+        if (rule_compile(deviceConfig.rules, &newRules) != ESP_OK)
+            ESP_LOGE("Main:apply_device_config", "Invalid localRules. Local rules disabled.");
+        strcpy(rulesSource, deviceConfig.rules);
+        if (!xSemaphoreTakeN(configSemaphore, CONFIG_SEMAPHORE_MAX_VALUE, SEMAPHORE_MAX_WAIT)) {
+            ESP_LOGE("Main:apply_device_config", "configSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
+            abort();
         }
-        lastFanState = !!status.fanSpeed;
+        rules = newRules;
+        xSemaphoreGiveN(configSemaphore, CONFIG_SEMAPHORE_MAX_VALUE);
     }
 }
 
@@ -158,37 +411,29 @@ void get_device_config() {
     deviceConfig = newConfig;
     xSemaphoreGiveN(configSemaphore, CONFIG_SEMAPHORE_MAX_VALUE);
 
-    if (deviceConfig.offsets.temperature > 100 || deviceConfig.offsets.temperature < -100)
-        abort();
-    if (deviceConfig.offsets.temperature2 > 100 || deviceConfig.offsets.temperature2 < -100)
+    if (!is_valid_device_config(&deviceConfig))
         abort();
 
-    temperature_array->setOffset(deviceConfig.offsets.temperature);
-    humidity_array->setOffset(deviceConfig.offsets.humidity);
-    tvoc_array->setOffset(deviceConfig.offsets.tvoc);
-    temperature2_array->setOffset(deviceConfig.offsets.temperature2);
-    pressure_array->setOffset(deviceConfig.offsets.pressure);
+    apply_device_config();
 }
 
 void update_device_status() {
     ESP_LOGD("Main:update_device_status", "Update start...");
 
-    if (!xSemaphoreTake(lastAverageSemaphore, SEMAPHORE_MAX_WAIT)) {
-        ESP_LOGE("Main:update_device_status", "lastAverageSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
-        abort();
+    const data_bus_snapshot *snapshot = data_bus_acquire_latest();
+    if (snapshot == NULL) {
+        ESP_LOGW("Main:update_device_status", "No sensor values published yet.");
+        return;
     }
-    sensor_values average = lastAverage;
-    xSemaphoreGive(lastAverageSemaphore);
-
-    if (set_device_status(
-        average.fine_dust,
-        average.temperature,
-        average.humidity,
-        average.tvoc,
-        average.temperature2,
-        average.pressure / 10.0f  // hPa to kPa
-    ) == ESP_OK) {
+    sensor_values average = snapshot->values;
+    derived_metrics derived = snapshot->derived;
+    data_bus_release(snapshot);
+
+    build_status_body(&average, &derived);
+    if (set_device_status() == ESP_OK) {
         ESP_LOGI("Main:update_device_status", "Successfully update current status.");
+        reportCnt++;
+        delta_ota_confirm();
         ESP_ERROR_CHECK(strip->setColor(BOTTOM_LED, WS2812_OFF));
     } else {
         ESP_LOGE("Main:update_device_status", "Failed to update current status.");
@@ -199,15 +444,11 @@ void update_device_status() {
 }
 
 
-void set_ws2812_color() {
+// Without refresh, colors are only written to the strip buffer.
+void set_ws2812_color(const sensor_values *values, bool refresh = true) {
     ESP_LOGD("Main:set_ws2812_color", "Start set...");
 
-    if (!xSemaphoreTake(lastAverageSemaphore, SEMAPHORE_MAX_WAIT)) {
-        ESP_LOGE("Main:set_ws2812_color", "lastAverageSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
-        abort();
-    }
-    sensor_values average = lastAverage;
-    xSemaphoreGive(lastAverageSemaphore);
+    sensor_values average = *values;
     if (!xSemaphoreTake(configSemaphore, SEMAPHORE_MAX_WAIT)) {
         ESP_LOGE("Main:set_ws2812_color", "configSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
         abort();
@@ -251,27 +492,28 @@ void set_ws2812_color() {
     else
         ESP_ERROR_CHECK(strip->setColor(FINEDUST_LED, WS2812_BLUE, false));
 
-    ESP_ERROR_CHECK(strip->refresh());
+    if (refresh)
+        ESP_ERROR_CHECK(strip->refresh());
 
     ESP_LOGD("Main:set_ws2812_color", "Done...");
 }
 
-void led_task(void *) {
+Job led_job(JobExecutor *executor) {
     while (1) {
         statusLED->toggle();
         if (unlikely(isSensorInitFailed))
-            vTaskDelay(pdMS_TO_TICKS(500));
+            co_await executor->delay(pdMS_TO_TICKS(500));
         else
-            vTaskDelay(pdMS_TO_TICKS(1000));
+            co_await executor->delay(pdMS_TO_TICKS(1000));
     }
 }
 
-void ws2812_hello_task(void *) {
+Job ws2812_job(JobExecutor *executor) {
     // Until another task started
     while (!IS_ALL_TASK_STARTED && !isSensorInitFailed) {
         for (int i = 0; i < 7 && !IS_ALL_TASK_STARTED && !isSensorInitFailed; i++) {
             ESP_ERROR_CHECK(strip->setColor(i, WS2812_BLUE));
-            vTaskDelay(pdMS_TO_TICKS(100));
+            co_await executor->delay(pdMS_TO_TICKS(100));
             ESP_ERROR_CHECK(strip->setColor(i, WS2812_OFF, false));
         }
     }
@@ -280,104 +522,471 @@ void ws2812_hello_task(void *) {
         while (1) {  // Display error
             for (int i = 0; i < 7; i++)
                 ESP_ERROR_CHECK(strip->setColor(i, WS2812_RED));
-            vTaskDelay(pdMS_TO_TICKS(500));
+            co_await executor->delay(pdMS_TO_TICKS(500));
             for (int i = 0; i < 7; i++)
                 ESP_ERROR_CHECK(strip->setColor(i, WS2812_OFF));
-            vTaskDelay(pdMS_TO_TICKS(500));
+            co_await executor->delay(pdMS_TO_TICKS(500));
         }
 
-    set_ws2812_color();
-    taskStatusFlags |= WS2812_HELLO_TASK_ENDED;
-    vTaskDelete(NULL);
+    // Follow averages published by get_sensor_value_task, and blink for local rules
+    sensor_values average;
+    bool hasAverage = false, blinkOff = false;
+    while (1) {
+        const data_bus_snapshot *snapshot;
+        TickType_t timeout = ledPattern == RULE_LED_BLINK ? pdMS_TO_TICKS(RULE_LED_BLINK_PERIOD) : portMAX_DELAY;
+        while ((snapshot = data_bus_receive(ws2812Subscription, 0)) == NULL) {
+            if (!co_await executor->wait(JOB_SIGNAL_DATA_BUS, timeout))
+                break;
+        }
+        if (snapshot != NULL) {
+            average    = snapshot->values;
+            hasAverage = true;
+            blinkOff   = false;
+            data_bus_release(snapshot);
+        } else {
+            blinkOff = ledPattern == RULE_LED_BLINK && !blinkOff;
+        }
+        if (!hasAverage)
+            continue;
+
+        if (blinkOff) {
+            ESP_ERROR_CHECK(strip->setColor(TEMPERATURE_LED, WS2812_OFF, false));
+            ESP_ERROR_CHECK(strip->setColor(HUMIDITY_LED, WS2812_OFF, false));
+            ESP_ERROR_CHECK(strip->setColor(FINEDUST_LED, WS2812_OFF, false));
+            ESP_ERROR_CHECK(strip->refresh());
+        } else {
+            set_ws2812_color(&average);
+        }
+    }
 }
 
-void get_sensor_value_task(void *sensorStartupTickPtrV) {
-    TickType_t tmpTick;
+// Writes one reading to the average arrays.
+// With keepFineDust, the last fine dust window is kept while the fan is not ready.
+void write_samples(const sensor_values *values, TickType_t tick, bool keepFineDust) {
+    sample_context context = {.sampler = sampler, .keepFineDust = keepFineDust, .fanWindowSamples = 0};
+    Sensors::writeSamples(values, tick, &context);
+    if (context.fanWindowSamples == 0)
+        return;
+    if (!xSemaphoreTake(fanSemaphore, SEMAPHORE_MAX_WAIT)) {
+        ESP_LOGE("Main:write_samples", "fanSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
+        abort();
+    }
+    fanAutoWindowSamples += context.fanWindowSamples;
+    xSemaphoreGive(fanSemaphore);
+}
+
+// Evaluates local rules on every reading, so that actions follow within the cycle.
+void run_rules(const sensor_values *values) {
+    rule_outputs outputs;
+
+    if (!xSemaphoreTake(configSemaphore, SEMAPHORE_MAX_WAIT)) {
+        ESP_LOGE("Main:run_rules", "configSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
+        abort();
+    }
+    rule_evaluate(&rules, values, &outputs);
+    xSemaphoreGive(configSemaphore);
+
+    ledPattern = outputs.led;
+    if (outputs.notify)
+        __atomic_fetch_or(&pendingRuleEvents, outputs.notify, __ATOMIC_RELAXED);
+    set_rule_fan_speed(outputs.fan_speed, outputs.fan_overrides_cloud);
+}
+
+// Derived metrics stage, which runs on every average before it is published
+void publish_average(const sensor_values *average) {
+    derived_metrics derived;
+    compute_derived_metrics(average->fine_dust, average->temperature, average->humidity, average->tvoc, &derived);
+    data_bus_publish(average, &derived);
+}
+
+#ifdef ENABLE_QUANTILE_SKETCH
+int _format_quantile_summary(char *buf, size_t size, const char *name, const quantile_summary *summary) {
+    if (summary->count == 0)
+        return snprintf(buf, size, "\"%s\":null", name);
+    return snprintf(
+        buf, size, "\"%s\":{\"n\":%" PRIu32 ",\"p50\":%d,\"p95\":%d,\"p99\":%d}",
+        name, summary->count, summary->p50, summary->p95, summary->p99
+    );
+}
+
+// {"hour":{"fine_dust":..,"tvoc":..},"today":..,"day":..}
+// today covers the closed hours of the running day, day the last closed day.
+void report_quantiles(TickType_t tick, bool dayClosed) {
+    quantile_summary fineDust[3], tvoc[3];
+
+    fineDustQuantiles.getHour(&fineDust[0]);
+    fineDustQuantiles.getToday(&fineDust[1]);
+    fineDustQuantiles.getDay(&fineDust[2]);
+    tvocQuantiles.getHour(&tvoc[0]);
+    tvocQuantiles.getToday(&tvoc[1]);
+    tvocQuantiles.getDay(&tvoc[2]);
+
+    ESP_LOGI(
+        "Main:report_quantiles", "Hour: PM2.5 p50/p95/p99=%d/%d/%d (n=%" PRIu32 "), TVOC p50/p95/p99=%d/%d/%d (n=%" PRIu32 ")",
+        fineDust[0].p50, fineDust[0].p95, fineDust[0].p99, fineDust[0].count, tvoc[0].p50, tvoc[0].p95, tvoc[0].p99, tvoc[0].count
+    );
+    if (dayClosed)
+        ESP_LOGI(
+            "Main:report_quantiles", "Day: PM2.5 p50/p95/p99=%d/%d/%d (n=%" PRIu32 "), TVOC p50/p95/p99=%d/%d/%d (n=%" PRIu32 ")",
+            fineDust[2].p50, fineDust[2].p95, fineDust[2].p99, fineDust[2].count, tvoc[2].p50, tvoc[2].p95, tvoc[2].p99, tvoc[2].count
+        );
+
+#ifdef ENABLE_SSE_SERVER
+    const char *windows[3] = {"hour", "today", "day"};
+    char json[400];
+    int len = snprintf(json, sizeof(json), "{\"tick\":%" PRIu32, (uint32_t)tick);
+    for (int i = 0; i < 3 && len < (int)sizeof(json); i++) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"%s\":{", windows[i]);
+        if (len < (int)sizeof(json))
+            len += _format_quantile_summary(json + len, sizeof(json) - len, "fine_dust", &fineDust[i]);
+        if (len < (int)sizeof(json))
+            len += snprintf(json + len, sizeof(json) - len, ",");
+        if (len < (int)sizeof(json))
+            len += _format_quantile_summary(json + len, sizeof(json) - len, "tvoc", &tvoc[i]);
+        if (len < (int)sizeof(json))
+            len += snprintf(json + len, sizeof(json) - len, "}");
+    }
+    if (len < (int)sizeof(json))
+        len += snprintf(json + len, sizeof(json) - len, "}");
+    if (len < (int)sizeof(json))
+        sse_publish_quantiles(json);
+#endif
+}
+
+// Feeds every valid raw sample to the sketches. Hours are counted in ticks from the first sample.
+void update_quantiles(const sensor_values *values, TickType_t tick) {
+    bool dayClosed;
+
+    if (quantileHours < 0) {
+        quantileHourStart = tick;
+        quantileHours     = 0;
+    }
+    if (tick - quantileHourStart >= pdMS_TO_TICKS(QUANTILE_HOUR)) {
+        quantileHourStart += pdMS_TO_TICKS(QUANTILE_HOUR);
+        if (tick - quantileHourStart >= pdMS_TO_TICKS(QUANTILE_HOUR))
+            quantileHourStart = tick;  // Samples stopped for more than an hour
+        quantileHours = (quantileHours + 1) % QUANTILE_HOURS_PER_DAY;
+        dayClosed = quantileHours == 0;
+        fineDustQuantiles.closeHour(dayClosed);
+        tvocQuantiles.closeHour(dayClosed);
+        report_quantiles(tick, dayClosed);
+    }
+
+    if (values->fan == FAN_STATE_READY && values->fine_dust != INT_MIN)
+        fineDustQuantiles.add(values->fine_dust);
+    if (values->tvoc != INT_MIN)
+        tvocQuantiles.add(values->tvoc);
+}
+#endif
+
+#ifdef ENABLE_CHANGE_ALERT
+// Feeds every valid raw sample to the change detectors, and hands changed channels
+// to device_status_task. Alerts are at least CHANGE_ALERT_MIN_INTERVAL apart. Channels which
+// change in between stay pending with their latest sample, and go with the first sample after it.
+void detect_changes(const sensor_values *values, TickType_t tick) {
+    bool fineDustValid = values->fan == FAN_STATE_READY && values->fine_dust != INT_MIN;
+    uint32_t channels = 0, pending;
+
+    if (fineDustValid && fineDustDetector.add(values->fine_dust))
+        channels |= CHANGE_CHANNEL_FINE_DUST;
+    if (values->tvoc != INT_MIN && tvocDetector.add(values->tvoc))
+        channels |= CHANGE_CHANNEL_TVOC;
+    if (channels) {
+        ESP_LOGI(
+            "Main:detect_changes", "Change detected:%s%s",
+            channels & CHANGE_CHANNEL_FINE_DUST ? " PM2.5" : "", channels & CHANGE_CHANNEL_TVOC ? " TVOC" : ""
+        );
+    }
+
+    taskENTER_CRITICAL(&alertLock);
+    if (channels && !alertChannels)
+        alertTick = tick;  // Delay of an alert counts from its first change
+    alertChannels |= channels;
+    if (alertChannels & CHANGE_CHANNEL_FINE_DUST && fineDustValid)
+        alertValues.fine_dust = values->fine_dust;
+    if (alertChannels & CHANGE_CHANNEL_TVOC && values->tvoc != INT_MIN)
+        alertValues.tvoc = values->tvoc;
+    pending = alertChannels;
+    taskEXIT_CRITICAL(&alertLock);
+
+    if (!pending)
+        return;
+    if (deviceStatusTask == NULL || tick - lastAlertTick < pdMS_TO_TICKS(CHANGE_ALERT_MIN_INTERVAL)) {
+        if (channels)
+            alertDeferredCnt++;
+        return;
+    }
+    lastAlertTick = tick;
+    xTaskNotifyGive(deviceStatusTask);
+}
+
+// Uploads the raw value of each changed channel, and the latest average of the others.
+// Runs on device_status_task, ahead of the regular schedule.
+void send_change_alert() {
     sensor_values values;
+    derived_metrics derived;
+    uint32_t channels;
+    TickType_t tick, delay;
+
+    taskENTER_CRITICAL(&alertLock);
+    values   = alertValues;
+    channels = alertChannels;
+    tick     = alertTick;
+    alertChannels = 0;
+    taskEXIT_CRITICAL(&alertLock);
+    if (!channels)
+        return;
+
+    const data_bus_snapshot *snapshot = data_bus_acquire_latest();
+    if (snapshot == NULL)
+        return;
+    sensor_values report = snapshot->values;
+    data_bus_release(snapshot);
+
+    if (channels & CHANGE_CHANNEL_FINE_DUST)
+        report.fine_dust = values.fine_dust;
+    if (channels & CHANGE_CHANNEL_TVOC)
+        report.tvoc = values.tvoc;
+    compute_derived_metrics(report.fine_dust, report.temperature, report.humidity, report.tvoc, &derived);
+    build_status_body(&report, &derived);
+    if (set_device_status() != ESP_OK) {
+        ESP_LOGE("Main:send_change_alert", "Failed to send change alert.");
+        alertFailedCnt++;
+        return;
+    }
+    delay = xTaskGetTickCount() - tick;
+    if (delay > alertMaxDelay)
+        alertMaxDelay = delay;
+    alertCnt++;
+    reportCnt++;
+    ESP_LOGI(
+        "Main:send_change_alert", "Sent change alert (PM2.5 %d, TVOC %d) %" PRIu32 "ms after the change.",
+        report.fine_dust, report.tvoc, (uint32_t)pdTICKS_TO_MS(delay)
+    );
+}
+
+void log_change_alert_stats() {
+    ESP_LOGI(
+        "Main:log_change_alert_stats",
+        "Changes PM2.5=%" PRIu32 " (baseline %d), TVOC=%" PRIu32 " (baseline %d), alerts=%" PRIu32 " deferred=%" PRIu32 " failed=%" PRIu32 " max_delay=%" PRIu32 "ms",
+        fineDustDetector.getTriggers(), fineDustDetector.getBaseline(), tvocDetector.getTriggers(), tvocDetector.getBaseline(),
+        alertCnt, alertDeferredCnt, alertFailedCnt, (uint32_t)pdTICKS_TO_MS(alertMaxDelay)
+    );
+}
+#endif
+
+void get_averages(sensor_values *result) {
+    Sensors::getAverages(result);
+}
+
+#ifdef ENABLE_WARM_START
+uint32_t _warm_state_crc() {
+    const size_t offset = offsetof(warm_state, savedTime);
+    return esp_rom_crc32_le(0, (const uint8_t*)&warmState + offset, sizeof(warm_state) - offset);
+}
+
+void save_warm_state(const sensor_values *average) {
+    TickType_t now = xTaskGetTickCount();
+
+    warmState.magic = 0;  // Invalid while writing
+    Sensors::exportState(&warmState.windows, now);
+    warmState.average = *average;
+    if (!xSemaphoreTake(configSemaphore, SEMAPHORE_MAX_WAIT)) {
+        ESP_LOGE("Main:save_warm_state", "configSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
+        abort();
+    }
+    warmState.config = deviceConfig;
+    xSemaphoreGive(configSemaphore);
+    warmState.fanSpeed  = fanSpeed;
+    warmState.savedTime = (int64_t)esp_rtc_get_time_us();
+    warmState.crc       = _warm_state_crc();
+    warmState.size      = sizeof(warm_state);
+    warmState.magic     = WARM_START_MAGIC;
+}
+
+// Restores the state saved before a soft reset, and publishes the saved average.
+// Must be called before get_sensor_value_task starts. Returns true on warm start.
+bool restore_warm_state() {
+    esp_reset_reason_t reason = esp_reset_reason();
+    int64_t age = (int64_t)esp_rtc_get_time_us() - warmState.savedTime;
+
+    if (
+        reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT
+        || warmState.magic != WARM_START_MAGIC || warmState.size != sizeof(warm_state)
+        || warmState.crc != _warm_state_crc()
+    ) {
+        ESP_LOGI("Main:restore_warm_state", "No saved state. Cold start.");
+        return false;
+    }
+    warmState.magic = 0;  // Restore only once
+    if (age < 0 || age > (int64_t)WARM_START_MAX_AGE * 1000) {
+        ESP_LOGI("Main:restore_warm_state", "Saved state is too old (%" PRId64 "ms). Cold start.", age / 1000);
+        return false;
+    }
+
+    // Ticks restarted at boot, so the state was saved before tick 0
+    TickType_t savedTick = xTaskGetTickCount() - pdMS_TO_TICKS(age / 1000);
+    if (!Sensors::importState(&warmState.windows, savedTick)) {
+        ESP_LOGW("Main:restore_warm_state", "Invalid saved windows. Cold start.");
+        Sensors::invalidate();
+        return false;
+    }
+
+    if (is_valid_device_config(&warmState.config)) {
+        if (!xSemaphoreTakeN(configSemaphore, CONFIG_SEMAPHORE_MAX_VALUE, SEMAPHORE_MAX_WAIT)) {
+            ESP_LOGE("Main:restore_warm_state", "configSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
+            abort();
+        }
+        deviceConfig = warmState.config;
+        xSemaphoreGiveN(configSemaphore, CONFIG_SEMAPHORE_MAX_VALUE);
+        apply_device_config();
+    }
+    if (warmState.fanSpeed != INT_MIN)
+        set_fan_speed(warmState.fanSpeed);
+
+    publish_average(&warmState.average);
+    taskStatusFlags |= GET_SENSOR_VALUE_TASK_STARTED;
+    ESP_LOGI(
+        "Main:restore_warm_state", "Warm start with state of %" PRId64 "ms ago (Reset reason: %d).",
+        age / 1000, reason
+    );
+    return true;
+}
+#endif
+
+#ifdef ENABLE_TRACE_RECORD
+// Records the offsets at the start and after every change, as the averages of later records include them.
+void trace_offsets(trace_entry *record, TickType_t tick) {
+    static bool recorded = false;
+    static device_offsets last;
+    device_offsets offsets;
+
+    if (!xSemaphoreTake(configSemaphore, SEMAPHORE_MAX_WAIT)) {
+        ESP_LOGE("Main:trace_offsets", "configSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
+        abort();
+    }
+    offsets = deviceConfig.offsets;
+    xSemaphoreGive(configSemaphore);
+    if (recorded && !memcmp(&offsets, &last, sizeof(offsets)))
+        return;
+
+    record->type                = TRACE_OFFSETS;
+    record->tick                = tick;
+    record->keepFineDust        = false;
+    record->values              = {};
+    record->values.temperature  = offsets.temperature;
+    record->values.humidity     = offsets.humidity;
+    record->values.tvoc         = offsets.tvoc;
+    record->values.temperature2 = offsets.temperature2;
+    record->values.pressure     = offsets.pressure;
+    trace_write(record);
+    last     = offsets;
+    recorded = true;
+}
+#endif
+
+void get_sensor_value_task(void *sensorStartupTickPtrV) {
+    TickType_t tmpTick, delay, fanDelay, startedTime;
+    sensor_values values, average;
+#ifdef ENABLE_TRACE_RECORD
+    trace_entry traceRecord;
+#endif
     int startupCnt = SAMPLE_PER_UPDATE_STATUS;
+    bool keepFineDust, autoMode;
 
-    // Wait until sensor prepaired
-    TickType_t sensorStartupTick = *((TickType_t*)sensorStartupTickPtrV);
-    ESP_LOGI("Main:get_sensor_value_task", "Wait for sensors init.");
-    vTaskDelayUntil(&sensorStartupTick, pdMS_TO_TICKS(SENSOR_STARTUP_DELAY));
+    if (isWarmStarted) {
+        // Sensors stayed powered through the reset, and restored windows are valid already.
+        // The first reading completes the startup. Fine dust window is kept during fan warmup.
+        startupCnt = 1;
+    } else {
+        // Wait until sensor prepaired
+        TickType_t sensorStartupTick = *((TickType_t*)sensorStartupTickPtrV);
+        ESP_LOGI("Main:get_sensor_value_task", "Wait for sensors init.");
+        vTaskDelayUntil(&sensorStartupTick, pdMS_TO_TICKS(SENSOR_STARTUP_DELAY));
 
-    // Wait until PM1006 reading valid
-    ESP_LOGI("Main:get_sensor_value_task", "Wait for PM1006 fan.");
-    tmpTick = fanStartedTime;
-    vTaskDelayUntil(&tmpTick, pdMS_TO_TICKS(PM1006_FAN_STARTUP_DELAY));
+        // Wait until PM1006 reading valid
+        ESP_LOGI("Main:get_sensor_value_task", "Wait for PM1006 fan.");
+        if (!xSemaphoreTake(fanSemaphore, SEMAPHORE_MAX_WAIT)) {
+            ESP_LOGE("Main:get_sensor_value_task", "fanSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
+            abort();
+        }
+        tmpTick = fanStartedTime;
+        xSemaphoreGive(fanSemaphore);
+        vTaskDelayUntil(&tmpTick, pdMS_TO_TICKS(PM1006_FAN_STARTUP_DELAY));
+    }
 
+    int monitorId = task_monitor_register("sensor");
     TickType_t lastTick = xTaskGetTickCount();
     while (1) {
         ESP_LOGD("Main:get_sensor_value_task", "Start update sensor...");
 
         // Read sensor values
-        get_sensor_values(&values);
+#ifdef ENABLE_TRACE_RECORD
+        get_sensor_values(&values, traceRecord.errors);
+#else
+        get_sensor_values(&values, NULL);
+#endif
         // Write values to average arrays
+        if (!xSemaphoreTake(fanSemaphore, SEMAPHORE_MAX_WAIT)) {
+            ESP_LOGE("Main:get_sensor_value_task", "fanSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...");
+            abort();
+        }
+        startedTime = fanStartedTime;
+        autoMode    = fanAutoMode;
+        xSemaphoreGive(fanSemaphore);
         tmpTick = xTaskGetTickCount();
-        if (
-            tmpTick < fanStartedTime
-            || tmpTick - fanStartedTime < pdMS_TO_TICKS(PM1006_FAN_STARTUP_DELAY)
-            || values.fine_dust == INT_MIN
-        )  // Reading of PM1006 is invalid when fan is turned off or on just now
-            fine_dust_array->invalidate();
-        else if (values.fine_dust > PM1006_THRESHOLD) {
-            ESP_LOGI("Main:set_ws2812_color", "Too high PM1006 value (%dµg/m^3) detected.", values.fine_dust);
-            fine_dust_array->writeValue(INT_MAX);
-        } else
-            fine_dust_array->writeValue(values.fine_dust);
-        if (values.temperature == FLT_MIN)
-            temperature_array->invalidate();
-        else
-            temperature_array->writeValue(values.temperature);
-        if (values.humidity == INT_MIN)
-            humidity_array->invalidate();
-        else
-            humidity_array->writeValue(values.humidity);
-        if (values.temperature2 == FLT_MIN)
-            temperature2_array->invalidate();
-        else
-            temperature2_array->writeValue(values.temperature2);
-        if (values.pressure == FLT_MIN)
-            pressure_array->invalidate();
-        else
-            pressure_array->writeValue(values.pressure);
-        if (values.tvoc == INT_MIN)
-            tvoc_array->invalidate();
-        else
-            tvoc_array->writeValue(values.tvoc);
+        values.fan = get_fan_state(tmpTick, startedTime);
+        if (values.fan == FAN_STATE_READY)
+            isWarmStarted = false;
+        keepFineDust = (autoMode && values.fan != FAN_STATE_READY) || (isWarmStarted && values.fan == FAN_STATE_WARMUP);
+        write_samples(&values, tmpTick, keepFineDust);
+        run_rules(&values);
+#ifdef ENABLE_QUANTILE_SKETCH
+        update_quantiles(&values, tmpTick);
+#endif
+#ifdef ENABLE_CHANGE_ALERT
+        detect_changes(&values, tmpTick);
+#endif
+#ifdef ENABLE_SSE_SERVER
+        sse_publish_sample(&values, tmpTick);
+#endif
+#ifdef ENABLE_TRACE_RECORD
+        trace_offsets(&traceRecord, tmpTick);
+        traceRecord.type         = TRACE_SAMPLE;
+        traceRecord.tick         = tmpTick;
+        traceRecord.keepFineDust = keepFineDust;
+        traceRecord.values      = values;
+        trace_write(&traceRecord);
+#endif
 
         switch (startupCnt) {
             case 0:
             case 1:
-                if (!xSemaphoreTakeN(lastAverageSemaphore, LAST_AVERAGE_SEMAPHORE_MAX_VALUE, SEMAPHORE_MAX_WAIT)) {
-                    ESP_LOGE("Main:get_sensor_value_task", "lastAverageSemaphore not released after SEMAPHORE_MAX_WAIT. Rebooting...", );
-                    abort();
-                }
                 // Calculate new average
-                lastAverage.fine_dust    = fine_dust_array->getAverage();
-                lastAverage.temperature  = temperature_array->getAverage();
-                lastAverage.humidity     = humidity_array->getAverage();
-                lastAverage.temperature2 = temperature2_array->getAverage();
-                lastAverage.pressure     = pressure_array->getAverage();
-                lastAverage.tvoc         = tvoc_array->getAverage();
-                xSemaphoreGiveN(lastAverageSemaphore, LAST_AVERAGE_SEMAPHORE_MAX_VALUE);
-
-                // Update WS2812 Color
-                if (likely(IS_WS2812_HELLO_TASK_ENDED)) {
-                    ESP_LOGD("Main:get_sensor_value_task", "Update WS2812...");
-                    set_ws2812_color();
-                } else {
-                    ESP_LOGD("Main:get_sensor_value_task", "Skipping update WS2812...");
-                }
+                get_averages(&average);
+                average.fan = values.fan;
+                publish_average(&average);
+#ifdef ENABLE_WARM_START
+                save_warm_state(&average);
+#endif
+#ifdef ENABLE_TRACE_RECORD
+                traceRecord.type   = TRACE_AVERAGE;
+                traceRecord.values = average;
+                trace_write(&traceRecord);
+#endif
 
                 ESP_LOGD("Main:get_sensor_value_task", "Done update sensor.");
-                vTaskDelayUntil(&lastTick, pdMS_TO_TICKS(GET_SENSOR_TASK_DELAY));
+                delay = sampler->nextDelay();
+                fanDelay = run_fan_auto_mode(xTaskGetTickCount());
+                if (fanDelay < delay)
+                    delay = fanDelay < pdMS_TO_TICKS(GET_SENSOR_TASK_DELAY_MIN) ? pdMS_TO_TICKS(GET_SENSOR_TASK_DELAY_MIN) : fanDelay;
+                task_monitor_delay_until(monitorId, &lastTick, delay);
                 break;
             case 2:
             case 3:
                 startupCnt--;
                 ESP_LOGI("Main:get_sensor_value_task", "(Startup) Wait for sensors ready for next reading.");
-                vTaskDelayUntil(&lastTick, pdMS_TO_TICKS(GET_SENSOR_TASK_DELAY_MIN));
+                task_monitor_delay_until(monitorId, &lastTick, pdMS_TO_TICKS(GET_SENSOR_TASK_DELAY_MIN));
                 break;
             default:
                 abort();
@@ -390,54 +999,203 @@ void get_sensor_value_task(void *sensorStartupTickPtrV) {
 }
 
 void device_status_task(void *) {
+    vTaskDelay(pdMS_TO_TICKS(esp_random() % (ST_START_JITTER + 1)));
     get_device_config();
-    get_device_status();
+    poller->onPolled(xTaskGetTickCount(), get_device_status());
     while (!(taskStatusFlags & GET_SENSOR_VALUE_TASK_STARTED))
         vTaskDelay(pdMS_TO_TICKS(250));
     taskStatusFlags |= DEVICE_STATUS_TASK_STARTED;
     update_device_status();
 
+    int monitorId = task_monitor_register("device_status");
     TickType_t lastTick = xTaskGetTickCount();
+#ifdef ENABLE_CHANGE_ALERT
+    deviceStatusTask = xTaskGetCurrentTaskHandle();
+#endif
     for (unsigned int i = 0; ; i++) {
         ESP_LOGI("device_status_task", "==========Free Mem: %u==========", heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
-        get_device_status();
+        if (poller->isDue(lastTick))
+            poller->onPolled(lastTick, get_device_status());
         if (!(i % GET_CONFIG_PER_GET_STATUS))
             get_device_config();
         if (!(i % UPDATE_STATUS_PER_GET_STATUS))
             update_device_status();
-        vTaskDelayUntil(&lastTick, pdMS_TO_TICKS(GET_STATUS_INTERVAL));
+        uint32_t ruleEvents = __atomic_exchange_n(&pendingRuleEvents, 0, __ATOMIC_RELAXED);
+        for (int rule = 0; ruleEvents; rule++, ruleEvents >>= 1) {
+            if (!(ruleEvents & 1))
+                continue;
+            ESP_LOGI("Main:device_status_task", "Local rule %d triggered.", rule + 1);
+            if (send_rule_event(rule + 1) != ESP_OK)
+                ESP_LOGE("Main:device_status_task", "Failed to send rule event.");
+        }
+        if (!(i % SENSOR_HEALTH_LOG_PER_GET_STATUS)) {
+            log_sensor_health();
+            log_i2c_stats(reportCnt);
+            log_st_request_stats();
+#ifdef ENABLE_CHANGE_ALERT
+            log_change_alert_stats();
+#endif
+        }
+        if (!(i % POLL_STATS_LOG_PER_GET_STATUS))
+            poller->logStats();
+        if (!(i % TASK_MONITOR_PUBLISH_PER_GET_STATUS)) {
+            task_monitor_publish();
+            binlog_log_stats();
+            log_data_bus_stats();
+            jobs->logStats();
+#ifdef ENABLE_SSE_SERVER
+            log_sse_stats();
+#endif
+#ifdef ENABLE_TRACE_RECORD
+            log_trace_stats();
+#endif
+        }
+#ifdef ENABLE_CHANGE_ALERT
+        while (task_monitor_wait_until(monitorId, &lastTick, pdMS_TO_TICKS(GET_STATUS_INTERVAL)))
+            send_change_alert();
+#else
+        task_monitor_delay_until(monitorId, &lastTick, pdMS_TO_TICKS(GET_STATUS_INTERVAL));
+#endif
     }
 }
 
-void monitor_wifi_task(void *) {
-    while (1) {
-        chech_and_reconnect_wifi();
-        vTaskDelay(pdMS_TO_TICKS(2000));
+#ifdef ENABLE_TRACE_REPLAY
+// Feeds the recorded trace through the average arrays, the data bus and the status body
+// as fast as possible, and compares the averages with the recorded ones.
+// Recorded offsets are applied to the arrays only, so deviceConfig keeps the live ones.
+void trace_replay_task(void *) {
+    trace_entry record;
+    sensor_values average;
+    derived_metrics derived;
+    DeviceConfig replayConfig = {};
+    uint32_t samples = 0, averages = 0, mismatches = 0, bodies = 0;
+#ifdef ENABLE_CHANGE_ALERT
+    ChangeDetector fineDust(CHANGE_DETECT_MIN_SIGMA_FINE_DUST), tvoc(CHANGE_DETECT_MIN_SIGMA_TVOC);
+    TickType_t firstTick = 0, lastTick = 0;
+#endif
+
+    taskStatusFlags |= ALL_TASK_STARTED;
+    int64_t startTime = esp_timer_get_time();
+    while (trace_read(&record) == ESP_OK) {
+        if (record.type == TRACE_OFFSETS) {
+            replayConfig.offsets.temperature  = record.values.temperature;
+            replayConfig.offsets.humidity     = record.values.humidity;
+            replayConfig.offsets.tvoc         = record.values.tvoc;
+            replayConfig.offsets.temperature2 = record.values.temperature2;
+            replayConfig.offsets.pressure     = record.values.pressure;
+            Sensors::applyConfig(&replayConfig);
+            continue;
+        }
+        if (record.type == TRACE_SAMPLE) {
+            write_samples(&record.values, record.tick, record.keepFineDust);
+#ifdef ENABLE_CHANGE_ALERT
+            if (record.values.fan == FAN_STATE_READY && record.values.fine_dust != INT_MIN && fineDust.add(record.values.fine_dust))
+                ESP_LOGI("Main:trace_replay_task", "PM2.5 change at tick %" PRIu32 ": %d", (uint32_t)record.tick, record.values.fine_dust);
+            if (record.values.tvoc != INT_MIN && tvoc.add(record.values.tvoc))
+                ESP_LOGI("Main:trace_replay_task", "TVOC change at tick %" PRIu32 ": %d", (uint32_t)record.tick, record.values.tvoc);
+            if (!samples)
+                firstTick = record.tick;
+            lastTick = record.tick;
+#endif
+            samples++;
+            continue;
+        }
+        get_averages(&average);
+        average.fan = record.values.fan;
+        if (memcmp(&average, &record.values, sizeof(average))) {
+            mismatches++;
+            ESP_LOGW(
+                "Main:trace_replay_task", "Mismatch at tick %" PRIu32 ": PM2.5 %d/%d, TVOC %d/%d",
+                (uint32_t)record.tick, average.fine_dust, record.values.fine_dust, average.tvoc, record.values.tvoc
+            );
+        }
+        compute_derived_metrics(average.fine_dust, average.temperature, average.humidity, average.tvoc, &derived);
+        data_bus_publish(&average, &derived);
+        if (build_status_body(&average, &derived) != NULL)
+            bodies++;
+        averages++;
     }
+    int64_t elapsed = esp_timer_get_time() - startTime;
+
+    ESP_LOGI(
+        "Main:trace_replay_task",
+        "Replayed %" PRIu32 " samples, %" PRIu32 " averages (%" PRIu32 " mismatches, %" PRIu32 " bodies) in %" PRId64 "us (%" PRId64 " samples/s).",
+        samples, averages, mismatches, bodies, elapsed, elapsed ? (int64_t)samples * 1000000 / elapsed : 0
+    );
+#ifdef ENABLE_CHANGE_ALERT
+    // Every change of a quiet trace is a false positive. See tools/change_eval.py for detection delays.
+    ESP_LOGI(
+        "Main:trace_replay_task", "Changes over %" PRIu32 "min of trace: PM2.5=%" PRIu32 ", TVOC=%" PRIu32 ".",
+        (uint32_t)(pdTICKS_TO_MS(lastTick - firstTick) / 60000), fineDust.getTriggers(), tvoc.getTriggers()
+    );
+#endif
+    vTaskDelete(NULL);
 }
+#endif
+
+#ifdef ENABLE_BENCHMARK
+void _bench_ws2812_color(void *arg) {
+    set_ws2812_color((const sensor_values*)arg, false);
+}
+#endif
 
 extern "C" void app_main(void) {
+    binlog_init();
     init_gpio();
     fanStartedTime = xTaskGetTickCount();
 
     init_modules(&statusLED, &strip);
-    xTaskCreate(led_task, "led_task", 2048, NULL, 10, NULL);
-    xTaskCreate(ws2812_hello_task, "ws2812_hello_task", 4096, NULL, 10, NULL);
+#ifdef ENABLE_BENCHMARK
+    static sensor_values benchValues = {
+        .fine_dust = 42, .temperature = 23.4f, .humidity = 45,
+        .temperature2 = 23.9f, .pressure = 1013.2f, .tvoc = 120, .fan = FAN_STATE_READY
+    };
+    init_variables();
+    benchmark_add("set_ws2812_color", _bench_ws2812_color, &benchValues);
+    xTaskCreate(benchmark_task, "benchmark_task", BENCHMARK_STACK_SIZE, NULL, 5, NULL);
+    return;
+#endif
+    jobs = new JobExecutor("led_jobs", JOB_EXECUTOR_STACK_SIZE, JOB_EXECUTOR_PRIORITY);
+    jobs->spawn("led", led_job(jobs));
+    jobs->spawn("ws2812", ws2812_job(jobs));
+    jobs->start();
     if (init_sensors() != ESP_OK) {
         // Display error, and stop futher operation
         isSensorInitFailed = 1;
         return;
     }
     init_sensors();
+#ifndef ENABLE_TRACE_REPLAY
     TickType_t sensorStartupTime = xTaskGetTickCount();
+#endif
     init_wifi();
+    init_st_client();
+    init_time_sync();
+    init_delta_ota();
     init_variables();
+    data_bus_notify(ws2812Subscription, jobs->getTask(), JOB_SIGNAL_DATA_BUS);
 
 #if defined(CONFIG_HEAP_TRACING) && CONFIG_LOG_DEFAULT_LEVEL >= 4  // When default log level is verbose than DEBUG
     ESP_ERROR_CHECK(heap_trace_init_standalone(trace_record, NUM_RECORDS));
 #endif
 
+#ifdef ENABLE_TRACE_REPLAY
+    if (init_trace() != ESP_OK)
+        abort();
+    xTaskCreate(trace_replay_task, "trace_replay_task", 4096, NULL, 12, NULL);
+#else
+#ifdef ENABLE_TRACE_RECORD
+    if (init_trace() != ESP_OK)
+        ESP_LOGW("Main:app_main", "Trace sink unavailable. Recording disabled.");
+#endif
+#ifdef ENABLE_SSE_SERVER
+    if (init_sse_server() != ESP_OK)
+        ESP_LOGW("Main:app_main", "SSE server unavailable.");
+#endif
+#ifdef ENABLE_WARM_START
+    isWarmStarted = restore_warm_state();
+#endif
     xTaskCreate(get_sensor_value_task, "get_sensor_value_task", 4096, &sensorStartupTime, 12, NULL);
     xTaskCreate(device_status_task, "device_status_task", 4096, NULL, 14, NULL);
-    xTaskCreate(monitor_wifi_task, "monitor_wifi_task", 4096, NULL, 16, NULL);
+#endif
 }
\ No newline at end of file
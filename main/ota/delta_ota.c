@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_app_desc.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_http_client.h"
+#include "esp_crt_bundle.h"
+#include "esp_delta_ota.h"
+#include "mbedtls/sha256.h"
+#include "cJSON.h"
+
+#include "config.h"
+#include "ota/delta_ota.h"
+
+#if defined(ENABLE_DELTA_OTA) && !defined(OTA_MANIFEST_URL)
+#error "Define OTA_MANIFEST_URL in secrets.h, or comment out ENABLE_DELTA_OTA."
+#endif
+
+// Header written by esp_delta_ota_patch_gen.py: magic (4) | SHA-256 of the base image (32) | reserved
+#define PATCH_HEADER_SIZE 64
+#define PATCH_MAGIC       0xfccdde10
+#define SHA256_SIZE       32
+
+
+typedef struct {
+    char url[OTA_URL_MAX_LEN];
+    uint32_t size;
+    uint8_t sha256[SHA256_SIZE];
+} _ota_file;
+
+// {"version": "...", "image": {"url", "size", "sha256"}, "patch": {"url", "size", "sha256"}}
+// "patch" is optional. Hashes are hex strings of the files as served.
+typedef struct {
+    char version[32];
+    _ota_file image;
+    _ota_file patch;
+    bool has_patch;
+} _ota_manifest;
+
+typedef struct {
+    esp_ota_handle_t handle;
+    mbedtls_sha256_context image_sha256;
+    uint32_t written;
+    // Patch only
+    esp_delta_ota_handle_t delta;
+    uint8_t header[PATCH_HEADER_SIZE];
+    int header_len;
+} _ota_writer;
+
+typedef esp_err_t (*_ota_chunk_cb)(_ota_writer *writer, const uint8_t *buf, int len);
+
+static const esp_partition_t *_running;
+static bool _confirmed = false;
+static esp_timer_handle_t _validate_timer = NULL;
+static char _buf[OTA_BUFFER_SIZE];
+
+
+// Called after every successful upload. The first call of a new image cancels the rollback.
+void delta_ota_confirm(void) {
+    esp_ota_img_states_t state;
+
+    if (_confirmed)
+        return;
+    _confirmed = true;
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) != ESP_OK || state != ESP_OTA_IMG_PENDING_VERIFY)
+        return;
+    if (_validate_timer != NULL)
+        esp_timer_stop(_validate_timer);
+    if (esp_ota_mark_app_valid_cancel_rollback() == ESP_OK)
+        ESP_LOGI("OTA:delta_ota_confirm", "New image confirmed.");
+    else
+        ESP_LOGE("OTA:delta_ota_confirm", "Failed to confirm new image.");
+}
+
+void _validate_timer_callback(void *arg) {
+    if (!_confirmed) {
+        ESP_LOGE("OTA:validate", "No successful upload after update. Rolling back...");
+        esp_ota_mark_app_invalid_rollback_and_reboot();
+    }
+}
+
+esp_err_t _parse_hex(const char *hex, uint8_t *result, size_t len) {
+    if (hex == NULL || strlen(hex) != len * 2)
+        return ESP_ERR_INVALID_ARG;
+    for (size_t i = 0; i < len; i++)
+        if (sscanf(hex + i * 2, "%2hhx", &result[i]) != 1)
+            return ESP_ERR_INVALID_ARG;
+    return ESP_OK;
+}
+
+esp_err_t _parse_ota_file(cJSON *json, _ota_file *result) {
+    cJSON *url = cJSON_GetObjectItemCaseSensitive(json, "url");
+    cJSON *size = cJSON_GetObjectItemCaseSensitive(json, "size");
+    cJSON *sha256 = cJSON_GetObjectItemCaseSensitive(json, "sha256");
+
+    ESP_RETURN_ON_FALSE(
+        cJSON_IsString(url) && strlen(url->valuestring) < sizeof(result->url) && cJSON_IsNumber(size),
+        ESP_ERR_INVALID_RESPONSE, "OTA:manifest", "Invalid file entry."
+    );
+    strcpy(result->url, url->valuestring);
+    result->size = size->valueint;
+    return _parse_hex(cJSON_GetStringValue(sha256), result->sha256, SHA256_SIZE);
+}
+
+esp_err_t _open(esp_http_client_handle_t *client, const char *url, int64_t *length) {
+    esp_http_client_config_t config = {
+        .url = url,
+        .timeout_ms = OTA_HTTP_TIMEOUT,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .keep_alive_enable = true,
+    };
+    esp_err_t ret = ESP_OK;
+
+    *client = esp_http_client_init(&config);
+    ESP_RETURN_ON_FALSE(*client != NULL, ESP_ERR_NO_MEM, "OTA:open", "Failed to init HTTP client.");
+    ESP_GOTO_ON_ERROR(esp_http_client_open(*client, 0), CLEANUP, "OTA:open", "Failed to open %s.", url);
+    *length = esp_http_client_fetch_headers(*client);
+    ESP_GOTO_ON_FALSE(
+        esp_http_client_get_status_code(*client) == 200, ESP_ERR_INVALID_RESPONSE, CLEANUP,
+        "OTA:open", "HTTP %d from %s.", esp_http_client_get_status_code(*client), url
+    );
+    return ESP_OK;
+
+CLEANUP:
+    esp_http_client_cleanup(*client);
+    return ret;
+}
+
+esp_err_t _fetch_manifest(_ota_manifest *result) {
+    esp_http_client_handle_t client;
+    int64_t length;
+    int len;
+    cJSON *json = NULL, *patch;
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_ERROR(_open(&client, OTA_MANIFEST_URL, &length), "OTA:manifest", "Failed to request manifest.");
+    len = esp_http_client_read_response(client, _buf, sizeof(_buf) - 1);
+    ESP_GOTO_ON_FALSE(len > 0, ESP_ERR_INVALID_RESPONSE, CLEANUP, "OTA:manifest", "Empty manifest.");
+    _buf[len] = '\0';
+
+    json = cJSON_Parse(_buf);
+    cJSON *version = cJSON_GetObjectItemCaseSensitive(json, "version");
+    ESP_GOTO_ON_FALSE(
+        cJSON_IsString(version) && strlen(version->valuestring) < sizeof(result->version),
+        ESP_ERR_INVALID_RESPONSE, CLEANUP, "OTA:manifest", "Invalid version."
+    );
+    strcpy(result->version, version->valuestring);
+    ESP_GOTO_ON_ERROR(
+        _parse_ota_file(cJSON_GetObjectItemCaseSensitive(json, "image"), &result->image), CLEANUP,
+        "OTA:manifest", "Invalid image."
+    );
+    patch = cJSON_GetObjectItemCaseSensitive(json, "patch");
+    result->has_patch = patch != NULL && _parse_ota_file(patch, &result->patch) == ESP_OK;
+
+CLEANUP:
+    if (json != NULL)
+        cJSON_Delete(json);
+    esp_http_client_cleanup(client);
+    return ret;
+}
+
+// Streams `file` into `cb` without buffering it, and checks its size and hash.
+esp_err_t _download(const _ota_file *file, _ota_chunk_cb cb, _ota_writer *writer) {
+    esp_http_client_handle_t client;
+    mbedtls_sha256_context sha256;
+    uint8_t digest[SHA256_SIZE];
+    uint32_t received = 0;
+    int64_t length;
+    int len;
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_ERROR(_open(&client, file->url, &length), "OTA:download", "Failed to request file.");
+    mbedtls_sha256_init(&sha256);
+    mbedtls_sha256_starts(&sha256, 0);
+    while ((len = esp_http_client_read(client, _buf, sizeof(_buf))) > 0) {
+        mbedtls_sha256_update(&sha256, (const uint8_t *)_buf, len);
+        received += len;
+        ESP_GOTO_ON_ERROR(cb(writer, (const uint8_t *)_buf, len), CLEANUP, "OTA:download", "Failed to write.");
+    }
+    mbedtls_sha256_finish(&sha256, digest);
+
+    ESP_GOTO_ON_FALSE(
+        len == 0 && received == file->size, ESP_ERR_INVALID_SIZE, CLEANUP,
+        "OTA:download", "Received %" PRIu32 " of %" PRIu32 " bytes.", received, file->size
+    );
+    ESP_GOTO_ON_FALSE(
+        !memcmp(digest, file->sha256, SHA256_SIZE), ESP_ERR_INVALID_CRC, CLEANUP,
+        "OTA:download", "Hash mismatch."
+    );
+
+CLEANUP:
+    mbedtls_sha256_free(&sha256);
+    esp_http_client_cleanup(client);
+    return ret;
+}
+
+esp_err_t _write_image(_ota_writer *writer, const uint8_t *buf, int len) {
+    mbedtls_sha256_update(&writer->image_sha256, buf, len);
+    writer->written += len;
+    return esp_ota_write(writer->handle, buf, len);
+}
+
+esp_err_t _delta_write_cb(const uint8_t *buf, size_t size, void *user_data) {
+    return _write_image((_ota_writer *)user_data, buf, size);
+}
+
+esp_err_t _delta_read_cb(uint8_t *buf, size_t size, int src_offset) {
+    return esp_partition_read(_running, src_offset, buf, size);
+}
+
+esp_err_t _write_patch(_ota_writer *writer, const uint8_t *buf, int len) {
+    uint8_t base_sha256[SHA256_SIZE];
+    uint32_t magic;
+
+    if (writer->header_len < PATCH_HEADER_SIZE) {
+        int header_part = PATCH_HEADER_SIZE - writer->header_len;
+        if (header_part > len)
+            header_part = len;
+        memcpy(writer->header + writer->header_len, buf, header_part);
+        writer->header_len += header_part;
+        buf += header_part;
+        len -= header_part;
+        if (writer->header_len < PATCH_HEADER_SIZE)
+            return ESP_OK;
+
+        memcpy(&magic, writer->header, sizeof(magic));
+        ESP_RETURN_ON_FALSE(magic == PATCH_MAGIC, ESP_ERR_INVALID_VERSION, "OTA:patch", "Invalid patch magic.");
+        ESP_RETURN_ON_ERROR(esp_partition_get_sha256(_running, base_sha256), "OTA:patch", "Failed to hash running image.");
+        ESP_RETURN_ON_FALSE(
+            !memcmp(base_sha256, writer->header + sizeof(magic), SHA256_SIZE), ESP_ERR_INVALID_VERSION,
+            "OTA:patch", "Patch is not for the running image."
+        );
+    }
+    if (len <= 0)
+        return ESP_OK;
+    return esp_delta_ota_feed_patch(writer->delta, buf, len);
+}
+
+esp_err_t _begin(const esp_partition_t *target, _ota_writer *writer) {
+    memset(writer, 0, sizeof(*writer));
+    mbedtls_sha256_init(&writer->image_sha256);
+    mbedtls_sha256_starts(&writer->image_sha256, 0);
+    return esp_ota_begin(target, OTA_WITH_SEQUENTIAL_WRITES, &writer->handle);
+}
+
+esp_err_t _apply_patch(const _ota_manifest *manifest, _ota_writer *writer) {
+    esp_delta_ota_cfg_t config = {
+        .read_cb = _delta_read_cb,
+        .write_cb = _delta_write_cb,
+        .user_data = writer,
+    };
+    esp_err_t ret = ESP_OK;
+
+    writer->delta = esp_delta_ota_init(&config);
+    ESP_RETURN_ON_FALSE(writer->delta != NULL, ESP_ERR_NO_MEM, "OTA:patch", "Failed to init delta OTA.");
+    ESP_GOTO_ON_ERROR(_download(&manifest->patch, _write_patch, writer), CLEANUP, "OTA:patch", "Failed to apply patch.");
+    ESP_GOTO_ON_ERROR(esp_delta_ota_finalize(writer->delta), CLEANUP, "OTA:patch", "Failed to finalize patch.");
+
+CLEANUP:
+    esp_delta_ota_deinit(writer->delta);
+    return ret;
+}
+
+// Checks the manifest, and installs a newer image. Reboots on success.
+esp_err_t delta_ota_check(void) {
+    _ota_manifest manifest;
+    _ota_writer writer;
+    const esp_partition_t *target, *invalid;
+    esp_app_desc_t invalid_desc;
+    uint8_t digest[SHA256_SIZE];
+    bool delta = false;
+    int64_t start;
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(_confirmed, ESP_ERR_INVALID_STATE, "OTA:check", "Running image is not confirmed yet.");
+    ESP_RETURN_ON_ERROR(_fetch_manifest(&manifest), "OTA:check", "Failed to get manifest.");
+    if (!strcmp(manifest.version, esp_app_get_description()->version)) {
+        ESP_LOGI("OTA:check", "Up to date (%s).", manifest.version);
+        return ESP_OK;
+    }
+    // A rolled back image stays marked invalid in its slot. Flashing it again would only roll back again.
+    invalid = esp_ota_get_last_invalid_partition();
+    if (
+        invalid != NULL && esp_ota_get_partition_description(invalid, &invalid_desc) == ESP_OK
+        && !strcmp(manifest.version, invalid_desc.version)
+    ) {
+        ESP_LOGW("OTA:check", "%s was rolled back. Waiting for another version.", manifest.version);
+        return ESP_OK;
+    }
+    target = esp_ota_get_next_update_partition(NULL);
+    ESP_RETURN_ON_FALSE(target != NULL, ESP_ERR_NOT_FOUND, "OTA:check", "No OTA partition.");
+    ESP_LOGI(
+        "OTA:check", "Updating %s -> %s into %s.",
+        esp_app_get_description()->version, manifest.version, target->label
+    );
+
+    start = esp_timer_get_time();
+    if (manifest.has_patch) {
+        ESP_RETURN_ON_ERROR(_begin(target, &writer), "OTA:check", "Failed to begin OTA.");
+        if ((ret = _apply_patch(&manifest, &writer)) == ESP_OK) {
+            delta = true;
+        } else {
+            ESP_LOGW("OTA:check", "Patch failed (%s). Falling back to full image.", esp_err_to_name(ret));
+            esp_ota_abort(writer.handle);
+            mbedtls_sha256_free(&writer.image_sha256);
+        }
+    }
+    if (!delta) {
+        ESP_RETURN_ON_ERROR(_begin(target, &writer), "OTA:check", "Failed to begin OTA.");
+        ESP_GOTO_ON_ERROR(_download(&manifest.image, _write_image, &writer), ABORT, "OTA:check", "Failed to download image.");
+    }
+
+    mbedtls_sha256_finish(&writer.image_sha256, digest);
+    ESP_GOTO_ON_FALSE(
+        writer.written == manifest.image.size && !memcmp(digest, manifest.image.sha256, SHA256_SIZE),
+        ESP_ERR_INVALID_CRC, ABORT, "OTA:check", "Written image does not match the manifest."
+    );
+    // Verifies the image, and its signature when signed apps are enabled
+    ret = esp_ota_end(writer.handle);
+    mbedtls_sha256_free(&writer.image_sha256);
+    ESP_RETURN_ON_ERROR(ret, "OTA:check", "Image verification failed.");
+    ESP_RETURN_ON_ERROR(esp_ota_set_boot_partition(target), "OTA:check", "Failed to set boot partition.");
+
+    ESP_LOGI(
+        "OTA:check", "%s update done. Downloaded %" PRIu32 " bytes for a %" PRIu32 " bytes image (%" PRIu32 "%%), %" PRIu32 "ms. Rebooting...",
+        delta ? "Delta" : "Full", delta ? manifest.patch.size : manifest.image.size, manifest.image.size,
+        (delta ? manifest.patch.size : manifest.image.size) * 100 / manifest.image.size,
+        (uint32_t)((esp_timer_get_time() - start) / 1000)
+    );
+    esp_restart();
+    return ESP_OK;
+
+ABORT:
+    esp_ota_abort(writer.handle);
+    mbedtls_sha256_free(&writer.image_sha256);
+    return ret;
+}
+
+void _delta_ota_task(void *arg) {
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(OTA_CHECK_INTERVAL));
+        if (_confirmed)
+            delta_ota_check();
+    }
+}
+
+void init_delta_ota(void) {
+    esp_ota_img_states_t state;
+    esp_timer_create_args_t timer_args = {
+        .callback = _validate_timer_callback,
+        .name = "ota_validate"
+    };
+
+    _running = esp_ota_get_running_partition();
+    if (esp_ota_get_state_partition(_running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY && !_confirmed) {
+        ESP_LOGI("OTA:init_delta_ota", "New image. Waiting for the first successful upload.");
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &_validate_timer));
+        ESP_ERROR_CHECK(esp_timer_start_once(_validate_timer, (uint64_t)OTA_VALIDATE_TIMEOUT * 1000));
+    } else {
+        _confirmed = true;
+    }
+
+#ifdef ENABLE_DELTA_OTA
+    xTaskCreate(_delta_ota_task, "delta_ota_task", OTA_TASK_STACK_SIZE, NULL, OTA_TASK_PRIORITY, NULL);
+#endif
+}
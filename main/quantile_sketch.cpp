@@ -0,0 +1,77 @@
+#include <cmath>
+#include <climits>
+#include <cstdint>
+
+#include "config.h"
+#include "quantile_sketch.h"
+
+static const float GAMMA = (1.0f + QUANTILE_SKETCH_ACCURACY) / (1.0f - QUANTILE_SKETCH_ACCURACY);
+static const float INV_LOG_GAMMA = 1.0f / logf(GAMMA);
+
+
+void QuantileSketch::add(int value) {
+    int key;
+
+    if (value <= 0) {
+        zeroCount++;
+    } else {
+        key = (int)ceilf(logf((float)value) * INV_LOG_GAMMA);
+        buckets[key < QUANTILE_SKETCH_KEYS ? key : QUANTILE_SKETCH_KEYS - 1]++;
+    }
+    count++;
+}
+
+void QuantileSketch::merge(const QuantileSketch *other) {
+    zeroCount += other->zeroCount;
+    for (int i = 0; i < QUANTILE_SKETCH_KEYS; i++)
+        buckets[i] += other->buckets[i];
+    count += other->count;
+}
+
+void QuantileSketch::clear() {
+    *this = QuantileSketch();
+}
+
+uint32_t QuantileSketch::getCount() {
+    return count;
+}
+
+// Value of the bucket holding the sample of rank q * (count - 1), from the lowest.
+int QuantileSketch::getQuantile(float q) {
+    uint32_t rank, seen;
+
+    if (count == 0)
+        return INT_MIN;
+    rank = (uint32_t)(q * (count - 1));
+    seen = zeroCount;
+    if (seen > rank)
+        return 0;
+    for (int i = 0; i < QUANTILE_SKETCH_KEYS; i++) {
+        seen += buckets[i];
+        if (seen > rank)
+            return (int)lroundf(2.0f * powf(GAMMA, (float)i) / (GAMMA + 1.0f));
+    }
+    return INT_MIN;
+}
+
+void QuantileSketch::summarize(quantile_summary *result) {
+    result->count = count;
+    result->p50   = getQuantile(0.50f);
+    result->p95   = getQuantile(0.95f);
+    result->p99   = getQuantile(0.99f);
+}
+
+
+void RollingQuantiles::add(int value) {
+    hour.add(value);
+}
+
+void RollingQuantiles::closeHour(bool closeDay) {
+    hour.summarize(&lastHour);
+    today.merge(&hour);
+    hour.clear();
+    if (closeDay) {
+        today.summarize(&lastDay);
+        today.clear();
+    }
+}
@@ -0,0 +1,215 @@
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cfloat>
+
+#include "esp_log.h"
+#include "esp_check.h"
+
+#include "config.h"
+#include "rule_engine.h"
+
+#define RULE_VALUE_MAX (INT32_MAX / 10)
+
+static const char *const _metric_names[] = {"pm", "temp", "humi", "tvoc", "temp2", "press"};
+
+
+// Metric of the reading in 0.1 units. Returns false when the reading is invalid.
+bool _metric_value(const sensor_values *values, uint8_t metric, int32_t *result) {
+    float value;
+
+    switch (metric) {
+        case RULE_METRIC_FINE_DUST:
+            if (values->fine_dust == INT_MIN || values->fan != FAN_STATE_READY)
+                return false;
+            *result = values->fine_dust > RULE_VALUE_MAX ? INT32_MAX : values->fine_dust * 10;
+            return true;
+        case RULE_METRIC_HUMIDITY:
+            if (values->humidity == INT_MIN)
+                return false;
+            *result = values->humidity * 10;
+            return true;
+        case RULE_METRIC_TVOC:
+            if (values->tvoc == INT_MIN)
+                return false;
+            *result = values->tvoc > RULE_VALUE_MAX ? INT32_MAX : values->tvoc * 10;
+            return true;
+        case RULE_METRIC_TEMPERATURE:
+            value = values->temperature;
+            break;
+        case RULE_METRIC_TEMPERATURE2:
+            value = values->temperature2;
+            break;
+        case RULE_METRIC_PRESSURE:
+            value = values->pressure;
+            break;
+        default:
+            return false;
+    }
+    if (value == FLT_MIN)
+        return false;
+    *result = (int32_t)(value * 10.0f + (value < 0 ? -0.5f : 0.5f));
+    return true;
+}
+
+// Parses a number into 0.1 units
+esp_err_t _parse_tenths(const char **pos, int32_t *result) {
+    char *end;
+    float value = strtof(*pos, &end);
+    ESP_RETURN_ON_FALSE(
+        end != *pos && value < RULE_VALUE_MAX && value > -RULE_VALUE_MAX,
+        ESP_ERR_INVALID_ARG, "RuleEngine:_parse_tenths", "Invalid number at \"%s\".", *pos
+    );
+    *pos = end;
+    *result = (int32_t)(value * 10.0f + (value < 0 ? -0.5f : 0.5f));
+    return ESP_OK;
+}
+
+esp_err_t _parse_rule(const char **pos, rule *result) {
+    const char *p = *pos;
+    int32_t hysteresis = 0;
+    char *end;
+    long number;
+    size_t len;
+
+    memset(result, 0, sizeof(rule));
+    result->samples = 1;
+
+    result->metric = UINT8_MAX;
+    for (uint8_t i = 0; i < sizeof(_metric_names) / sizeof(_metric_names[0]); i++) {
+        len = strlen(_metric_names[i]);
+        if (!strncmp(p, _metric_names[i], len) && (p[len] == '>' || p[len] == '<')) {
+            result->metric = i;
+            p += len;
+            break;
+        }
+    }
+    ESP_RETURN_ON_FALSE(
+        result->metric != UINT8_MAX, ESP_ERR_INVALID_ARG, "RuleEngine:_parse_rule", "Unknown metric at \"%s\".", p
+    );
+    result->above = *p++ == '>';
+    ESP_RETURN_ON_ERROR(_parse_tenths(&p, &result->enter), "RuleEngine:_parse_rule", "Invalid threshold.");
+
+    if (*p == '~') {
+        p++;
+        ESP_RETURN_ON_ERROR(_parse_tenths(&p, &hysteresis), "RuleEngine:_parse_rule", "Invalid hysteresis.");
+        ESP_RETURN_ON_FALSE(
+            hysteresis >= 0, ESP_ERR_INVALID_ARG, "RuleEngine:_parse_rule", "Negative hysteresis."
+        );
+    }
+    result->release = result->above ? result->enter - hysteresis : result->enter + hysteresis;
+
+    if (*p == 'x') {
+        number = strtol(p + 1, &end, 10);
+        ESP_RETURN_ON_FALSE(
+            end != p + 1 && number >= 1 && number <= UINT8_MAX,
+            ESP_ERR_INVALID_ARG, "RuleEngine:_parse_rule", "Invalid sample count at \"%s\".", p
+        );
+        result->samples = number;
+        p = end;
+    }
+    if (*p == '!') {
+        result->overrides_cloud = 1;
+        p++;
+    }
+    ESP_RETURN_ON_FALSE(*p++ == ':', ESP_ERR_INVALID_ARG, "RuleEngine:_parse_rule", "Missing ':' before action.");
+
+    if (!strncmp(p, "fan=", 4)) {
+        number = strtol(p + 4, &end, 10);
+        ESP_RETURN_ON_FALSE(
+            end != p + 4 && number >= 0 && number <= FAN_SPEED_MAX,
+            ESP_ERR_INVALID_ARG, "RuleEngine:_parse_rule", "Invalid fanSpeed at \"%s\".", p
+        );
+        result->action = RULE_ACTION_FAN;
+        result->arg    = number;
+        p = end;
+    } else if (!strncmp(p, "led=blink", 9)) {
+        result->action = RULE_ACTION_LED;
+        result->arg    = RULE_LED_BLINK;
+        p += 9;
+    } else if (!strncmp(p, "notify", 6)) {
+        result->action = RULE_ACTION_NOTIFY;
+        p += 6;
+    } else {
+        ESP_LOGE("RuleEngine:_parse_rule", "Unknown action at \"%s\".", p);
+        return ESP_ERR_INVALID_ARG;
+    }
+    // PM is invalid while the fan is off, so such a rule would never release
+    ESP_RETURN_ON_FALSE(
+        result->metric != RULE_METRIC_FINE_DUST || result->action != RULE_ACTION_FAN || result->arg != 0,
+        ESP_ERR_INVALID_ARG, "RuleEngine:_parse_rule", "A pm rule can not stop the fan."
+    );
+    ESP_RETURN_ON_FALSE(
+        *p == ';' || *p == '\0', ESP_ERR_INVALID_ARG, "RuleEngine:_parse_rule", "Trailing characters at \"%s\".", p
+    );
+
+    *pos = p;
+    return ESP_OK;
+}
+
+// On error, the table is left empty.
+esp_err_t rule_compile(const char *source, rule_table *table) {
+    const char *pos = source;
+    esp_err_t ret = ESP_OK;
+
+    table->cnt = 0;
+    while (*pos) {
+        if (*pos == ';' || *pos == ' ') {
+            pos++;
+            continue;
+        }
+        ESP_GOTO_ON_FALSE(
+            table->cnt < RULE_MAX_CNT, ESP_ERR_NO_MEM, CLEANUP, "RuleEngine:rule_compile", "Too many rules."
+        );
+        ESP_GOTO_ON_ERROR(
+            _parse_rule(&pos, &table->rules[table->cnt]), CLEANUP,
+            "RuleEngine:rule_compile", "Invalid rule %d.", table->cnt + 1
+        );
+        table->cnt++;
+    }
+    ESP_LOGI("RuleEngine:rule_compile", "%d rules compiled.", table->cnt);
+    return ESP_OK;
+
+CLEANUP:
+    table->cnt = 0;
+    return ret;
+}
+
+// Called once per reading.
+void rule_evaluate(rule_table *table, const sensor_values *values, rule_outputs *outputs) {
+    int32_t value;
+
+    outputs->fan_speed           = RULE_FAN_NONE;
+    outputs->fan_overrides_cloud = false;
+    outputs->led                 = RULE_LED_NONE;
+    outputs->notify              = 0;
+
+    for (int i = 0; i < table->cnt; i++) {
+        rule *r = &table->rules[i];
+        if (_metric_value(values, r->metric, &value)) {  // Invalid readings keep the state
+            if (!r->active) {
+                if (r->above ? value > r->enter : value < r->enter) {
+                    if (++r->count >= r->samples) {
+                        r->active = 1;
+                        r->count  = 0;
+                        if (r->action == RULE_ACTION_NOTIFY)
+                            outputs->notify |= 1 << i;
+                    }
+                } else {
+                    r->count = 0;
+                }
+            } else if (r->above ? value <= r->release : value >= r->release) {
+                r->active = 0;
+            }
+        }
+        if (!r->active)
+            continue;
+
+        if (r->action == RULE_ACTION_FAN && outputs->fan_speed == RULE_FAN_NONE) {
+            outputs->fan_speed           = r->arg;
+            outputs->fan_overrides_cloud = r->overrides_cloud;
+        } else if (r->action == RULE_ACTION_LED && outputs->led == RULE_LED_NONE) {
+            outputs->led = (rule_led_pattern)r->arg;
+        }
+    }
+}
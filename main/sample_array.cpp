@@ -1,6 +1,7 @@
 #include <cstdlib>
 #include <climits>
 #include <cfloat>
+#include <cstring>
 
 #include "esp_log.h"
 
@@ -9,10 +10,13 @@
 
 
 // SampleArray
-SampleArray::SampleArray(int size) {
+SampleArray::SampleArray(int size, int minSamples, TickType_t window) {
     this->size = size;
+    this->minSamples = minSamples;
+    this->window = window;
     this->arr = (float *)malloc(sizeof(float) * size);
-    if (arr == NULL) {
+    this->weights = (TickType_t *)malloc(sizeof(TickType_t) * size);
+    if (arr == NULL || weights == NULL) {
         ESP_LOGE("SampleArray", "Insufficient memory to create internal array. Rebooting...");
         abort();
     }
@@ -20,21 +24,32 @@ SampleArray::SampleArray(int size) {
 
 SampleArray::~SampleArray() {
     free(arr);
+    free(weights);
 }
 
 void SampleArray::setOffset(float offset) {
     this->offset = offset;
 };
 
-void SampleArray::writeValue(float value) {
-    this->arr[this->pos++] = value;
+void SampleArray::writeValue(float value, TickType_t tick) {
+    TickType_t weight = 0;
+    if (item_cnt) {
+        weight = tick - lastTick;
+        if (weight > window)
+            weight = window;
+        if (item_cnt == 1)  // Weight of the first sample is unknown until now
+            this->weights[(pos + size - 1) % size] = weight;
+    }
+    this->lastTick = tick;
+    this->arr[this->pos] = value;
+    this->weights[this->pos++] = weight;
     this->pos %= size;
     if (item_cnt < size)
         item_cnt++; 
 }
 
 bool SampleArray::isValid() {
-    return item_cnt == size;
+    return item_cnt >= minSamples;
 }
 
 void SampleArray::invalidate() {
@@ -45,19 +60,62 @@ float SampleArray::getAverage() {
     if (!isValid())
         return FLT_MIN;
 
-    float result = arr[0];
-    for (int i = 1; i < size; i++) {
-        result += this->arr[i];
+    float result = 0.0f;
+    TickType_t remaining = window, weight;
+    int i = (pos + size - 1) % size;
+    for (int cnt = 0; cnt < item_cnt && remaining; cnt++) {
+        weight = weights[i] < remaining ? weights[i] : remaining;
+        result += this->arr[i] * weight;
+        remaining -= weight;
+        i = (i + size - 1) % size;
     }
-    return result / size + offset;
+    if (remaining == window)  // Only one sample
+        return arr[(pos + size - 1) % size] + offset;
+    return result / (window - remaining) + offset;
+}
+
+float SampleArray::getLatest() {
+    if (!item_cnt)
+        return FLT_MIN;
+    return arr[(pos + size - 1) % size] + offset;
+}
+
+bool SampleArray::exportState(sample_array_state *state, TickType_t now) {
+    if (size != SAMPLE_ARRAY_SIZE)
+        return false;
+    memcpy(state->values, arr, sizeof(state->values));
+    memcpy(state->weights, weights, sizeof(state->weights));
+    state->age      = item_cnt ? now - lastTick : 0;
+    state->pos      = pos;
+    state->item_cnt = item_cnt;
+    return true;
+}
+
+// `now` is the tick that corresponds to the time of the export.
+bool SampleArray::importState(const sample_array_state *state, TickType_t now) {
+    if (
+        size != SAMPLE_ARRAY_SIZE
+        || state->pos < 0 || state->pos >= size
+        || state->item_cnt < 0 || state->item_cnt > size
+    )
+        return false;
+    memcpy(arr, state->values, sizeof(state->values));
+    memcpy(weights, state->weights, sizeof(state->weights));
+    lastTick = now - state->age;
+    pos      = state->pos;
+    item_cnt = state->item_cnt;
+    return true;
 }
 // End SampleArray
 
 // IntSampleArray
-IntSampleArray::IntSampleArray(int size) {
+IntSampleArray::IntSampleArray(int size, int minSamples, TickType_t window) {
     this->size = size;
+    this->minSamples = minSamples;
+    this->window = window;
     this->arr = (int *)malloc(sizeof(int) * size);
-    if (arr == NULL) {
+    this->weights = (TickType_t *)malloc(sizeof(TickType_t) * size);
+    if (arr == NULL || weights == NULL) {
         ESP_LOGE("IntSampleArray", "Insufficient memory to create internal array. Rebooting...");
         abort();
     }
@@ -65,21 +123,32 @@ IntSampleArray::IntSampleArray(int size) {
 
 IntSampleArray::~IntSampleArray() {
     free(arr);
+    free(weights);
 }
 
 void IntSampleArray::setOffset(int offset) {
     this->offset = offset;
 };
 
-void IntSampleArray::writeValue(int value) {
-    this->arr[this->pos++] = value;
+void IntSampleArray::writeValue(int value, TickType_t tick) {
+    TickType_t weight = 0;
+    if (item_cnt) {
+        weight = tick - lastTick;
+        if (weight > window)
+            weight = window;
+        if (item_cnt == 1)  // Weight of the first sample is unknown until now
+            this->weights[(pos + size - 1) % size] = weight;
+    }
+    this->lastTick = tick;
+    this->arr[this->pos] = value;
+    this->weights[this->pos++] = weight;
     this->pos %= size;
     if (item_cnt < size)
         item_cnt++; 
 }
 
 bool IntSampleArray::isValid() {
-    return item_cnt == size;
+    return item_cnt >= minSamples;
 }
 
 void IntSampleArray::invalidate() {
@@ -90,10 +159,43 @@ int IntSampleArray::getAverage() {
     if (!isValid())
         return INT_MIN;
 
-    long long sum = arr[0];
-    for (int i = 1; i < size; i++) {
-        sum += this->arr[i];
+    long long sum = 0;
+    TickType_t remaining = window, weight;
+    int i = (pos + size - 1) % size;
+    for (int cnt = 0; cnt < item_cnt && remaining; cnt++) {
+        weight = weights[i] < remaining ? weights[i] : remaining;
+        sum += (long long)this->arr[i] * weight;
+        remaining -= weight;
+        i = (i + size - 1) % size;
     }
-    return (int)((float)sum / size + 0.5f) + offset;
+    if (remaining == window)  // Only one sample
+        return arr[(pos + size - 1) % size] + offset;
+    return (int)((float)sum / (window - remaining) + 0.5f) + offset;
+}
+
+bool IntSampleArray::exportState(int_sample_array_state *state, TickType_t now) {
+    if (size != SAMPLE_ARRAY_SIZE)
+        return false;
+    memcpy(state->values, arr, sizeof(state->values));
+    memcpy(state->weights, weights, sizeof(state->weights));
+    state->age      = item_cnt ? now - lastTick : 0;
+    state->pos      = pos;
+    state->item_cnt = item_cnt;
+    return true;
+}
+
+bool IntSampleArray::importState(const int_sample_array_state *state, TickType_t now) {
+    if (
+        size != SAMPLE_ARRAY_SIZE
+        || state->pos < 0 || state->pos >= size
+        || state->item_cnt < 0 || state->item_cnt > size
+    )
+        return false;
+    memcpy(arr, state->values, sizeof(state->values));
+    memcpy(weights, state->weights, sizeof(state->weights));
+    lastTick = now - state->age;
+    pos      = state->pos;
+    item_cnt = state->item_cnt;
+    return true;
 }
 // End IntSampleArray
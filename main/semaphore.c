@@ -3,30 +3,31 @@
 #include "esp_log.h"
 
 #include "semaphore.h"
+#include "binlog.h"
 
 
 BaseType_t xSemaphoreTakeN(QueueHandle_t xSemaphore, int uCount, TickType_t xTicksToWaitEach) {
-    ESP_LOGD("Main:xSemaphoreTakeN", "Semaphore Count (Start): %d", uxSemaphoreGetCount(xSemaphore));
+    BINLOG(BL_SEM_TAKE_START, uxSemaphoreGetCount(xSemaphore));
     for (int i = 0; i < uCount; i++) {
-        ESP_LOGD("Main:xSemaphoreTakeN", "Semaphore Count (Before call): %d", uxSemaphoreGetCount(xSemaphore));
+        BINLOG(BL_SEM_TAKE_BEFORE, uxSemaphoreGetCount(xSemaphore));
         if (!xSemaphoreTake(xSemaphore, xTicksToWaitEach)) {
-            ESP_LOGD("Main:xSemaphoreTakeN", "Semaphore Count (After call): %d", uxSemaphoreGetCount(xSemaphore));
+            BINLOG(BL_SEM_TAKE_AFTER, uxSemaphoreGetCount(xSemaphore));
             return pdFALSE;
         }
     }
-    ESP_LOGD("Main:xSemaphoreTakeN", "Successfully taken %d times.", uCount);
+    BINLOG(BL_SEM_TAKE_DONE, uCount);
     return pdTRUE;
 }
 
 BaseType_t xSemaphoreGiveN(QueueHandle_t xSemaphore, int uCount) {
-    ESP_LOGD("Main:xSemaphoreGiveN", "Semaphore Count (Start): %d", uxSemaphoreGetCount(xSemaphore));
+    BINLOG(BL_SEM_GIVE_START, uxSemaphoreGetCount(xSemaphore));
     for (int i = 0; i < uCount; i++) {
-        ESP_LOGD("Main:xSemaphoreGiveN", "Semaphore Count (Before call): %d", uxSemaphoreGetCount(xSemaphore));
+        BINLOG(BL_SEM_GIVE_BEFORE, uxSemaphoreGetCount(xSemaphore));
         if (!xSemaphoreGive(xSemaphore)) {
-            ESP_LOGD("Main:xSemaphoreGiveN", "Semaphore Count (After call): %d", uxSemaphoreGetCount(xSemaphore));
+            BINLOG(BL_SEM_GIVE_AFTER, uxSemaphoreGetCount(xSemaphore));
             return pdFALSE;
         }
     }
-    ESP_LOGD("Main:xSemaphoreGiveN", "Successfully given %d times.", uCount);
+    BINLOG(BL_SEM_GIVE_DONE, uCount);
     return pdTRUE;
 }
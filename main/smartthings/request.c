@@ -1,101 +1,254 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <float.h>
+#include <stddef.h>
+#include <string.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_cpu.h"
+#include "esp_random.h"
 #include "cJSON.h"
 
 #include "config.h"
-#include "smartthings/rest.h"
+#include "smartthings/rest.h"  // URLs
 #include "smartthings/request.h"
+#include "smartthings/st_client.h"
+
+#ifdef ST_API_BASE_URL
+#undef DEVICE_MAIN_COMPONENT_STATUS_URL
+#undef DEVICE_PREFERENCES_URL
+#undef VIRTUALDEVICE_EVENT_URL
+#define DEVICE_MAIN_COMPONENT_STATUS_URL(device_id) ST_API_BASE_URL "/v1/devices/" device_id "/components/main/status"
+#define DEVICE_PREFERENCES_URL(device_id)           ST_API_BASE_URL "/v1/devices/" device_id "/preferences"
+#define VIRTUALDEVICE_EVENT_URL(device_id)          ST_API_BASE_URL "/v1/virtualdevices/" device_id "/events"
+#endif
 
 #if defined(CONFIG_HEAP_TRACING) && CONFIG_LOG_DEFAULT_LEVEL >= 4  // When default log level is verbose than DEBUG
 #include "esp_heap_trace.h"
 #endif
 
 
-#define DEVICE_STATUS_TO_STR(component, capability, attribute, value, unit)\
-    "{\"component\":\""component"\",\"capability\":\""capability"\",\"attribute\":\""attribute"\",\"value\":"value",\"unit\":\""unit"\"}"
+// Body of set_device_status() is built at compile time. Each event has a fixed
+// width value slot, which is patched in place before every report.
+// Padding with spaces keeps the body valid JSON.
+#define ST_VALUE_SLOT_LEN 12
+#define ST_VALUE_SLOT     "            "
+
+#define ST_BODY_HEAD "{\"deviceEvents\":["
+#define ST_BODY_TAIL "]}"
+#define ST_EVENT_HEAD(component, capability, attribute)\
+    ",{\"component\":\""component"\",\"capability\":\""capability"\",\"attribute\":\""attribute"\",\"value\":"
+#define ST_EVENT_TAIL(unit) ",\"unit\":\""unit"\"}"
+
+#define ST_EVENT_STR(name, component, capability, attribute, unit)\
+    ST_EVENT_HEAD(component, capability, attribute) ST_VALUE_SLOT ST_EVENT_TAIL(unit)
+#define ST_EVENT_LAYOUT(name, component, capability, attribute, unit)\
+    char name##_head[sizeof(ST_EVENT_HEAD(component, capability, attribute)) - 1];\
+    char name##_value[ST_VALUE_SLOT_LEN];\
+    char name##_tail[sizeof(ST_EVENT_TAIL(unit)) - 1];
+#define ST_EVENT_SLOT(name, component, capability, attribute, unit) {\
+    .start = offsetof(_st_status_layout, name##_head),\
+    .value = offsetof(_st_status_layout, name##_value),\
+    .end   = offsetof(_st_status_layout, name##_tail) + sizeof(((_st_status_layout *)0)->name##_tail)\
+},
 
 typedef struct {
-    char *component;
-    char *capability;
-    char *attribute;
-    char *value;
-    char *unit;
-} st_item;
+    char head[sizeof(ST_BODY_HEAD) - 1];
+    ST_STATUS_EVENTS(ST_EVENT_LAYOUT)
+    char tail[sizeof(ST_BODY_TAIL)];
+} _st_status_layout;
 
-esp_err_t get_device_status(STStatus *result) {
-#if CONFIG_LOG_DEFAULT_LEVEL >= 4  // When default log level is verbose than DEBUG
-        ESP_LOGD("ST_Request:get_device_status", "*****Free Mem (Start): %u*****", heap_caps_get_free_size(MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT));
-#ifdef CONFIG_HEAP_TRACING
-        ESP_ERROR_CHECK(heap_trace_start(HEAP_TRACE_LEAKS));
-#endif
-#endif
-    cJSON *response_json = NULL;
+typedef struct {
+    uint16_t start;
+    uint16_t value;
+    uint16_t end;
+} _st_status_slot;
 
+static const char _status_template[] = ST_BODY_HEAD ST_STATUS_EVENTS(ST_EVENT_STR) ST_BODY_TAIL;
+_Static_assert(sizeof(_status_template) == sizeof(_st_status_layout), "Body template layout mismatch.");
+
+_Static_assert(ST_STATUS_EVENT_CNT <= 32, "Too many status events for _status_enabled.");
+
+static const _st_status_slot _status_slots[ST_STATUS_EVENT_CNT] = {
+    ST_STATUS_EVENTS(ST_EVENT_SLOT)
+};
+
+// Only touched by set_device_status(), which is called from a single task.
+static char _status_body[] = ST_BODY_HEAD ST_STATUS_EVENTS(ST_EVENT_STR) ST_BODY_TAIL;
+static uint32_t _status_enabled = (1 << ST_STATUS_EVENT_CNT) - 1;
+
+// Body of send_rule_event()
+#define ST_RULE_EVENT_FORMAT ST_BODY_HEAD\
+    "{\"component\":\"main\",\"capability\":\"" ST_CAPABILITY_NAMESPACE ".localRule\",\"attribute\":\"triggered\",\"value\":%d}"\
+    ST_BODY_TAIL
+
+static st_request_stats _request_stats;
+static uint32_t _budget_millitokens = ST_BUDGET_CAPACITY * 1000;
+static TickType_t _budget_tick = 0, _backoff_until = 0;
+static portMUX_TYPE _budget_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Takes a token of the request budget. Fails during backoff, or when no token is left.
+static esp_err_t _acquire_request(void) {
+    TickType_t now = xTaskGetTickCount(), elapsed;
     esp_err_t ret = ESP_OK;
-    ESP_LOGI("ST-REQUEST get_device_status", "Sending response...");
-    ESP_GOTO_ON_ERROR(
-        get(ST_ACCESS_TOKEN, DEVICE_MAIN_COMPONENT_STATUS_URL(ST_DEVICE_ID), &response_json),
-        CLEANUP, "ST-REQUEST", "Get status failed."
-    );
-    ESP_LOGI("ST-REQUEST get_device_status", "Successfully sent.");
+    uint32_t used;
 
-    if (esp_log_level_get("ST-REQUEST get_device_status") >= ESP_LOG_DEBUG) {
-        char *json_str = cJSON_Print(response_json);
-        puts(json_str);
-        free(json_str);
+    taskENTER_CRITICAL(&_budget_lock);
+    // Over a full refill, the bucket is full anyway. The clamp keeps milliseconds * 1000 in 32 bits,
+    // which overflows after about 71 minutes without a call.
+    elapsed = now - _budget_tick;
+    if (elapsed > pdMS_TO_TICKS(ST_BUDGET_CAPACITY * ST_BUDGET_REFILL_INTERVAL))
+        elapsed = pdMS_TO_TICKS(ST_BUDGET_CAPACITY * ST_BUDGET_REFILL_INTERVAL);
+    _budget_millitokens += pdTICKS_TO_MS(elapsed) * 1000 / ST_BUDGET_REFILL_INTERVAL;
+    if (_budget_millitokens > ST_BUDGET_CAPACITY * 1000)
+        _budget_millitokens = ST_BUDGET_CAPACITY * 1000;
+    _budget_tick = now;
+
+    if (_request_stats.backoff && (int32_t)(now - _backoff_until) < 0) {
+        _request_stats.rejected_backoff++;
+        ret = ESP_ERR_NOT_ALLOWED;
+    } else if (_budget_millitokens < 1000) {
+        _request_stats.rejected_budget++;
+        ret = ESP_ERR_NOT_ALLOWED;
+    } else {
+        _budget_millitokens -= 1000;
+        _request_stats.allowed++;
+        used = ST_BUDGET_CAPACITY - _budget_millitokens / 1000;
+        if (used > _request_stats.max_used)
+            _request_stats.max_used = used;
     }
-    ESP_LOGD("ST-REQUEST get_device_status", "Result printed.");
+    taskEXIT_CRITICAL(&_budget_lock);
+    return ret;
+}
 
-    cJSON *switch_obj = cJSON_GetObjectItemCaseSensitive(response_json, "switchLevel");
-    cJSON *switch_level_obj = cJSON_GetObjectItemCaseSensitive(switch_obj, "level");
-    result->switchLevel = cJSON_GetObjectItemCaseSensitive(switch_level_obj, "value")->valueint;
+// Backoff after failed calls, by the kind of failure:
+//   - 429 waits Retry-After, up to ST_BACKOFF_MAX, and backs off as below without one.
+//   - 5xx and transport errors back off exponentially with jitter, so units behind one
+//     account do not retry at once.
+//   - Other 4xx (401, 404, 422, ...) would fail the same way again, and do not back off.
+static void _record_request_result(esp_err_t ret, const st_client_result *result) {
+    uint32_t backoff, delay_ms;
 
-    cJSON *fanSpeed_obj = cJSON_GetObjectItemCaseSensitive(response_json, "fanSpeed");
-    cJSON *fanSpeed_fanSpeed_obj = cJSON_GetObjectItemCaseSensitive(fanSpeed_obj, "fanSpeed");
-    result->fanSpeed = cJSON_GetObjectItemCaseSensitive(fanSpeed_fanSpeed_obj, "value")->valueint;
+    taskENTER_CRITICAL(&_budget_lock);
+    if (ret == ESP_OK) {
+        _request_stats.backoff = 0;
+        taskEXIT_CRITICAL(&_budget_lock);
+        return;
+    }
+    _request_stats.failures++;
+    if (result->status >= 400 && result->status < 500 && result->status != 429) {
+        taskEXIT_CRITICAL(&_budget_lock);
+        ESP_LOGW("ST-REQUEST", "Request failed with HTTP %d. No backoff.", result->status);
+        return;
+    }
+    if (result->status == 429) {
+        _request_stats.rate_limited++;
+        if (result->retry_after > 0) {
+            delay_ms = result->retry_after < ST_BACKOFF_MAX / 1000 ? result->retry_after * 1000 : ST_BACKOFF_MAX;
+            _request_stats.backoff = delay_ms;
+            _backoff_until = xTaskGetTickCount() + pdMS_TO_TICKS(delay_ms);
+            taskEXIT_CRITICAL(&_budget_lock);
+            ESP_LOGW("ST-REQUEST", "Rate limited. Next request after %" PRIu32 "ms.", delay_ms);
+            return;
+        }
+    }
+    if (_request_stats.backoff == 0)
+        backoff = ST_BACKOFF_MIN;
+    else if (_request_stats.backoff < ST_BACKOFF_MAX / 2)
+        backoff = _request_stats.backoff * 2;
+    else
+        backoff = ST_BACKOFF_MAX;
+    _request_stats.backoff = backoff;
+    delay_ms = backoff / 2 + esp_random() % (backoff / 2 + 1);
+    _backoff_until = xTaskGetTickCount() + pdMS_TO_TICKS(delay_ms);
+    taskEXIT_CRITICAL(&_budget_lock);
+    ESP_LOGW("ST-REQUEST", "Request failed. Next request after %" PRIu32 "ms.", delay_ms);
+}
 
-CLEANUP:
-    if (response_json != NULL)
-        cJSON_Delete(response_json);
-#if CONFIG_LOG_DEFAULT_LEVEL >= 4  // When default log level is verbose than DEBUG
-        ESP_LOGD("ST_Request:get_device_status", "*****Free Mem ( End ): %u*****", heap_caps_get_free_size(MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT));
-#ifdef CONFIG_HEAP_TRACING
-        ESP_ERROR_CHECK(heap_trace_stop());
-        heap_trace_dump();
-#endif
-#endif
+static esp_err_t _budgeted_get(const char *url, cJSON **response_json) {
+    st_client_result result;
+
+    ESP_RETURN_ON_ERROR(_acquire_request(), "ST-REQUEST", "Over request budget or backing off.");
+    esp_err_t ret = st_client_request("GET", url, ST_ACCESS_TOKEN, NULL, 0, response_json, &result);
+    _record_request_result(ret, &result);
     return ret;
 }
 
-esp_err_t get_device_config(DeviceConfig *result) {
-#if CONFIG_LOG_DEFAULT_LEVEL >= 4  // When default log level is verbose than DEBUG
-#ifdef CONFIG_HEAP_TRACING
-        ESP_ERROR_CHECK(heap_trace_start(HEAP_TRACE_LEAKS));
-#endif
-        ESP_LOGD("ST_Request:get_device_config", "*****Free Mem (Start): %u*****", heap_caps_get_free_size(MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT));
-#endif
-    cJSON *response_json = NULL;
+static esp_err_t _budgeted_post(const char *url, const st_client_chunk *body, int body_cnt) {
+    st_client_result result;
 
-    esp_err_t ret = ESP_OK;
-    ESP_LOGI("ST-REQUEST get_device_config", "Sending response...");
-    ESP_GOTO_ON_ERROR(
-        get(ST_ACCESS_TOKEN, DEVICE_PREFERENCES_URL(ST_DEVICE_ID), &response_json),
-        CLEANUP, "ST-REQUEST", "Get config failed."
+    ESP_RETURN_ON_ERROR(_acquire_request(), "ST-REQUEST", "Over request budget or backing off.");
+    esp_err_t ret = st_client_request("POST", url, ST_ACCESS_TOKEN, body, body_cnt, NULL, &result);
+    _record_request_result(ret, &result);
+    return ret;
+}
+
+// For optional preferences, which may be missing on older device profiles.
+static int _get_int_preference(cJSON *values, const char *name, int default_value) {
+    cJSON *value = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetObjectItemCaseSensitive(values, name), "value"
     );
-    ESP_LOGI("ST-REQUEST get_device_config", "Successfully sent.");
+    return cJSON_IsNumber(value) ? value->valueint : default_value;
+}
 
-    if (esp_log_level_get("ST-REQUEST get_device_config") >= ESP_LOG_DEBUG) {
-        char *json_str = cJSON_Print(response_json);
-        puts(json_str);
-        free(json_str);
-    }
-    ESP_LOGD("ST-REQUEST get_device_config", "Result printed.");
+static bool _get_bool_preference(cJSON *values, const char *name, bool default_value) {
+    cJSON *value = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetObjectItemCaseSensitive(values, name), "value"
+    );
+    return cJSON_IsBool(value) ? cJSON_IsTrue(value) : default_value;
+}
+
+static void _get_string_preference(cJSON *values, const char *name, char *result, size_t size) {
+    cJSON *value = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetObjectItemCaseSensitive(values, name), "value"
+    );
+    const char *str = cJSON_GetStringValue(value);
+    if (str == NULL)
+        str = "";
+    else if (strlen(str) >= size)
+        ESP_LOGW("ST-REQUEST", "Preference %s is truncated to %d characters.", name, (int)size - 1);
+    strlcpy(result, str, size);
+}
+
+// Converts an ISO 8601 UTC timestamp (e.g. "2024-01-02T03:04:05.678Z") to epoch seconds.
+static time_t _parse_timestamp(cJSON *timestamp) {
+    int year, month, day, hour, minute, second;
+    if (!cJSON_IsString(timestamp) || sscanf(
+        timestamp->valuestring, "%d-%d-%dT%d:%d:%d",
+        &year, &month, &day, &hour, &minute, &second
+    ) != 6)
+        return 0;
+
+    // Days from civil (proleptic Gregorian calendar)
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int year_of_era = year - era * 400;
+    int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    long long days = (long long)era * 146097 + day_of_era - 719468;
+    return (time_t)(days * 86400 + hour * 3600 + minute * 60 + second);
+}
+
+// Response of DEVICE_MAIN_COMPONENT_STATUS_URL
+void parse_device_status(cJSON *response_json, STStatus *result) {
+    cJSON *switch_obj = cJSON_GetObjectItemCaseSensitive(response_json, "switchLevel");
+    cJSON *switch_level_obj = cJSON_GetObjectItemCaseSensitive(switch_obj, "level");
+    result->switchLevel = cJSON_GetObjectItemCaseSensitive(switch_level_obj, "value")->valueint;
+    result->switchLevelTimestamp = _parse_timestamp(cJSON_GetObjectItemCaseSensitive(switch_level_obj, "timestamp"));
 
+    cJSON *fanSpeed_obj = cJSON_GetObjectItemCaseSensitive(response_json, "fanSpeed");
+    cJSON *fanSpeed_fanSpeed_obj = cJSON_GetObjectItemCaseSensitive(fanSpeed_obj, "fanSpeed");
+    result->fanSpeed = cJSON_GetObjectItemCaseSensitive(fanSpeed_fanSpeed_obj, "value")->valueint;
+    result->fanSpeedTimestamp = _parse_timestamp(cJSON_GetObjectItemCaseSensitive(fanSpeed_fanSpeed_obj, "timestamp"));
+}
+
+// Response of the device preferences
+void parse_device_config(cJSON *response_json, DeviceConfig *result) {
     cJSON *values = cJSON_GetObjectItemCaseSensitive(response_json, "values");
     result->tempHigh        = cJSON_GetObjectItemCaseSensitive(
         cJSON_GetObjectItemCaseSensitive(values, "tempHigh"), "value"
@@ -144,6 +297,87 @@ esp_err_t get_device_config(DeviceConfig *result) {
         cJSON_GetObjectItemCaseSensitive(values, "pressureOffset"), "value"
     )->valuedouble;
 
+    result->sampling.intervalMin       = _get_int_preference(values, "samplingIntervalMin", GET_SENSOR_TASK_DELAY_MIN);
+    result->sampling.intervalMax       = _get_int_preference(values, "samplingIntervalMax", SAMPLING_INTERVAL_MAX);
+    result->sampling.fineDustThreshold = _get_int_preference(values, "fineDustChangeThreshold", SAMPLING_FINE_DUST_THRESHOLD);
+    result->sampling.tvocThreshold     = _get_int_preference(values, "tvocChangeThreshold", SAMPLING_TVOC_THRESHOLD);
+
+    result->polling.fastInterval      = _get_int_preference(values, "pollIntervalFast", GET_STATUS_INTERVAL);
+    result->polling.dayIdleInterval   = _get_int_preference(values, "pollIntervalIdle", POLL_INTERVAL_IDLE);
+    result->polling.nightIdleInterval = _get_int_preference(values, "pollIntervalNight", POLL_INTERVAL_NIGHT);
+    result->polling.nightStart        = _get_int_preference(values, "pollNightStart", POLL_NIGHT_START);
+    result->polling.nightEnd          = _get_int_preference(values, "pollNightEnd", POLL_NIGHT_END);
+
+    result->fanAutoMode = _get_bool_preference(values, "fanAutoMode", false);
+
+    _get_string_preference(values, "localRules", result->rules, sizeof(result->rules));
+}
+
+esp_err_t get_device_status(STStatus *result) {
+#if CONFIG_LOG_DEFAULT_LEVEL >= 4  // When default log level is verbose than DEBUG
+        ESP_LOGD("ST_Request:get_device_status", "*****Free Mem (Start): %u*****", heap_caps_get_free_size(MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT));
+#ifdef CONFIG_HEAP_TRACING
+        ESP_ERROR_CHECK(heap_trace_start(HEAP_TRACE_LEAKS));
+#endif
+#endif
+    cJSON *response_json = NULL;
+
+    esp_err_t ret = ESP_OK;
+    ESP_LOGI("ST-REQUEST get_device_status", "Sending response...");
+    ESP_GOTO_ON_ERROR(
+        _budgeted_get(DEVICE_MAIN_COMPONENT_STATUS_URL(ST_DEVICE_ID), &response_json),
+        CLEANUP, "ST-REQUEST", "Get status failed."
+    );
+    ESP_LOGI("ST-REQUEST get_device_status", "Successfully sent.");
+
+    if (esp_log_level_get("ST-REQUEST get_device_status") >= ESP_LOG_DEBUG) {
+        char *json_str = cJSON_Print(response_json);
+        puts(json_str);
+        free(json_str);
+    }
+    ESP_LOGD("ST-REQUEST get_device_status", "Result printed.");
+
+    parse_device_status(response_json, result);
+
+CLEANUP:
+    if (response_json != NULL)
+        cJSON_Delete(response_json);
+#if CONFIG_LOG_DEFAULT_LEVEL >= 4  // When default log level is verbose than DEBUG
+        ESP_LOGD("ST_Request:get_device_status", "*****Free Mem ( End ): %u*****", heap_caps_get_free_size(MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT));
+#ifdef CONFIG_HEAP_TRACING
+        ESP_ERROR_CHECK(heap_trace_stop());
+        heap_trace_dump();
+#endif
+#endif
+    return ret;
+}
+
+esp_err_t get_device_config(DeviceConfig *result) {
+#if CONFIG_LOG_DEFAULT_LEVEL >= 4  // When default log level is verbose than DEBUG
+#ifdef CONFIG_HEAP_TRACING
+        ESP_ERROR_CHECK(heap_trace_start(HEAP_TRACE_LEAKS));
+#endif
+        ESP_LOGD("ST_Request:get_device_config", "*****Free Mem (Start): %u*****", heap_caps_get_free_size(MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT));
+#endif
+    cJSON *response_json = NULL;
+
+    esp_err_t ret = ESP_OK;
+    ESP_LOGI("ST-REQUEST get_device_config", "Sending response...");
+    ESP_GOTO_ON_ERROR(
+        _budgeted_get(DEVICE_PREFERENCES_URL(ST_DEVICE_ID), &response_json),
+        CLEANUP, "ST-REQUEST", "Get config failed."
+    );
+    ESP_LOGI("ST-REQUEST get_device_config", "Successfully sent.");
+
+    if (esp_log_level_get("ST-REQUEST get_device_config") >= ESP_LOG_DEBUG) {
+        char *json_str = cJSON_Print(response_json);
+        puts(json_str);
+        free(json_str);
+    }
+    ESP_LOGD("ST-REQUEST get_device_config", "Result printed.");
+
+    parse_device_config(response_json, result);
+
 CLEANUP:
     if (response_json != NULL)
         cJSON_Delete(response_json);
@@ -157,158 +391,133 @@ CLEANUP:
     return ret;
 }
 
-esp_err_t _create_request_body(st_item *items, int item_cnt, char *buf, int buf_size) {
-    int buf_pos = 18, item_str_len;
-    strcpy(buf, "{\"deviceEvents\": [");
-    for (int i = 0; i < item_cnt; i++) {
-        if (
-            items[i].value[0] == '\0'
-            || items[i].value == NULL
-            || items[i].component == NULL
-            || items[i].capability == NULL
-            || items[i].attribute == NULL
-            || items[i].unit == NULL
-        ) {
-            ESP_LOGI("ST-REQUEST create_request_body", "Invalid value detected @ item[%d]. Skipping...", i);
-            continue;
+static void _enable_status_slot(int idx) {
+    const _st_status_slot *slot = &_status_slots[idx];
+    if (!(_status_enabled & (1 << idx))) {
+        memcpy(_status_body + slot->start, _status_template + slot->start, slot->end - slot->start);
+        _status_enabled |= 1 << idx;
+    }
+}
+
+static void _disable_status_slot(int idx) {
+    const _st_status_slot *slot = &_status_slots[idx];
+    memset(_status_body + slot->start, ' ', slot->end - slot->start);
+    _status_enabled &= ~(1 << idx);
+}
+
+// Writes value right-aligned into the slot, with `decimals` digits after the point.
+static void _patch_status_slot(int idx, int value, int decimals) {
+    char *slot = _status_body + _status_slots[idx].value;
+    char *pos = slot + ST_VALUE_SLOT_LEN;
+    unsigned int abs_value = value < 0 ? -(unsigned int)value : (unsigned int)value;
+
+    _enable_status_slot(idx);
+    do {
+        *--pos = '0' + abs_value % 10;
+        abs_value /= 10;
+        if (--decimals == 0)
+            *--pos = '.';
+    } while (abs_value || decimals >= 0);
+    if (value < 0)
+        *--pos = '-';
+    memset(slot, ' ', pos - slot);
+}
+
+// value is INT_MIN for an invalid reading, which leaves the event out of the body.
+void patch_device_status(st_status_event event, int value, int decimals) {
+    if (value == INT_MIN)
+        _disable_status_slot(event);
+    else
+        _patch_status_slot(event, value, decimals);
+}
+
+// The first enabled event must not be preceded by a separator.
+static esp_err_t _fix_status_separators(void) {
+    char separator = ' ';
+    for (int i = 0; i < ST_STATUS_EVENT_CNT; i++) {
+        if (_status_enabled & (1 << i)) {
+            _status_body[_status_slots[i].start] = separator;
+            separator = ',';
         }
+    }
+    return separator == ',' ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+// Returns the body with the values patched so far, or NULL when every event is left out.
+// The body stays owned by this module and is overwritten by the next patch.
+const char *finish_device_status_body(void) {
+    return _fix_status_separators() == ESP_OK ? _status_body : NULL;
+}
 
-        ESP_LOGD("ST-REQUEST create_request_body", "Formatting item[%d]...", i);
-        item_str_len = snprintf(
-            buf + buf_pos, buf_size - buf_pos - 3,
-            "{\"component\":\"%s\",\"capability\":\"%s\",\"attribute\":\"%s\",\"value\":%s,\"unit\":\"%s\"},",
-            items[i].component, items[i].capability, items[i].attribute, items[i].value, items[i].unit
-        );
-        if (buf_pos + item_str_len > buf_size - 2) {
-            ESP_LOGW(
-                "ST-REQUEST create_request_body",
-                "Buffer is to small (buf_size: %d | buf_pos: %d | item_no: %d | item_str_len: %d)",
-                buf_size, buf_pos, i, item_str_len
-            );
-            return ESP_ERR_NO_MEM;
+// Splits the body into the runs of enabled events, so left out events are not sent.
+// Chunks point into _status_body. Returns the number of chunks.
+static int _status_body_chunks(st_client_chunk chunks[ST_STATUS_EVENT_CNT + 1]) {
+    const char *start = _status_body;
+    int cnt = 0;
+
+    for (int i = 0; i < ST_STATUS_EVENT_CNT; i++) {
+        if (_status_enabled & (1 << i))
+            continue;
+        if (_status_body + _status_slots[i].start > start) {
+            chunks[cnt].data = start;
+            chunks[cnt++].len = _status_body + _status_slots[i].start - start;
         }
-        buf_pos += item_str_len;
+        start = _status_body + _status_slots[i].end;
     }
-    strcpy(buf + buf_pos - 1, "]}");
+    chunks[cnt].data = start;
+    chunks[cnt++].len = _status_body + sizeof(_status_body) - 1 - start;
+    return cnt;
+}
+
+// Notifies activation of a local rule, which is numbered from 1 as in the preference.
+esp_err_t send_rule_event(int rule) {
+    char body[sizeof(ST_RULE_EVENT_FORMAT) + 8];
+
+    st_client_chunk chunk = {body, snprintf(body, sizeof(body), ST_RULE_EVENT_FORMAT, rule)};
+    ESP_RETURN_ON_ERROR(
+        _budgeted_post(VIRTUALDEVICE_EVENT_URL(ST_DEVICE_ID), &chunk, 1),
+        "ST-REQUEST", "Error occured while sending rule event."
+    );
     return ESP_OK;
 }
 
-esp_err_t set_device_status(
-    int fine_dust,
-    float temperature,
-    int humidity,
-    int tvoc,
-    float temperature2,
-    float pressure
-) {
+// Sends the values patched with patch_device_status().
+esp_err_t set_device_status(void) {
 #if CONFIG_LOG_DEFAULT_LEVEL >= 4  // When default log level is verbose than DEBUG
 #ifdef CONFIG_HEAP_TRACING
         ESP_ERROR_CHECK(heap_trace_start(HEAP_TRACE_LEAKS));
 #endif
         ESP_LOGD("ST_Request:set_device_status", "*****Free Mem (Start): %u*****", heap_caps_get_free_size(MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT));
 #endif
-    char *body_buf;
-    char fine_dust_str[12], temperature_str[12], humidity_str[12], tvoc_str[12], temperature2_str[12], pressure_str[12];
-
-    // For indicate invalid value
-    if (fine_dust == INT_MIN) {
-        fine_dust_str[0] = '\0';
-    } else {
-        sprintf(fine_dust_str, "%d", fine_dust);
-    }
-    if (temperature == FLT_MIN) {
-        temperature_str[0] = '\0';
-    } else {
-        sprintf(temperature_str, "%.1f", temperature);
-    }
-    if (humidity == INT_MIN) {
-        humidity_str[0] = '\0';
-    } else {
-        sprintf(humidity_str, "%d", humidity);
-    }
-    if (tvoc == INT_MIN) {
-        tvoc_str[0] = '\0';
-    } else {
-        sprintf(tvoc_str, "%d", tvoc);
-    }
-    if (temperature2 == FLT_MIN) {
-        temperature2_str[0] = '\0';
-    } else {
-        sprintf(temperature2_str, "%.1f", temperature2);
-    }
-    if (pressure == FLT_MIN) {
-        pressure_str[0] = '\0';
-    } else {
-        sprintf(pressure_str, "%.1f", pressure);
-    }
-    st_item items[6] = {
-        {
-            .component  = "airQuality",
-            .capability = "fineDustSensor",
-            .attribute  = "fineDustLevel",
-            .value      = fine_dust_str,
-            .unit       = "μg/m^3"
-        },
-        {
-            .component  = "airQuality",
-            .capability = "temperatureMeasurement",
-            .attribute  = "temperature",
-            .value      = temperature_str,
-            .unit       = "C"
-        },
-        {
-            .component  = "airQuality",
-            .capability = "relativeHumidityMeasurement",
-            .attribute  = "humidity",
-            .value      = humidity_str,
-            .unit       = "%"
-        },
-        {
-            .component  = "airQuality",
-            .capability = "tvocMeasurement",
-            .attribute  = "tvocLevel",
-            .value      = tvoc_str,
-            .unit       = "ppb"
-        },
-        {
-            .component  = "airPressure",
-            .capability = "temperatureMeasurement",
-            .attribute  = "temperature",
-            .value      = temperature2_str,
-            .unit       = "C"
-        },
-        {
-            .component  = "airPressure",
-            .capability = "atmosphericPressureMeasurement",
-            .attribute  = "atmosphericPressure",
-            .value      = pressure_str,
-            .unit       = "kPa"
-        }
-    };
-
+    st_client_chunk chunks[ST_STATUS_EVENT_CNT + 1];
+    int chunk_cnt;
+    size_t body_len = 0;
+    uint32_t start_cycle = esp_cpu_get_cycle_count();
     esp_err_t ret = ESP_OK;
-    body_buf = malloc(sizeof(char) * SET_DEVICE_STATUS_BUF_SIZE);
     ESP_GOTO_ON_FALSE(
-        body_buf != NULL, ESP_ERR_NO_MEM, CLEANUP,
-        "ST-REQUEST", "Insufficient memory for body_buf."
+        finish_device_status_body() != NULL,
+        ESP_ERR_INVALID_STATE, CLEANUP,
+        "ST-REQUEST", "No valid value to send."
     );
+    chunk_cnt = _status_body_chunks(chunks);
+    for (int i = 0; i < chunk_cnt; i++)
+        body_len += chunks[i].len;
 
-    ESP_GOTO_ON_ERROR(
-        _create_request_body(items, 6, body_buf, SET_DEVICE_STATUS_BUF_SIZE), CLEANUP,
-        "ST-REQUEST", "Error occured while create request body."
+    ESP_LOGD(
+        "ST-REQUEST set_device_status",
+        "Successfully formatted body (%" PRIu32 " cycles, 0 bytes allocated, %d bytes in %d chunks). body:",
+        esp_cpu_get_cycle_count() - start_cycle, (int)body_len, chunk_cnt
     );
-
-    ESP_LOGD("ST-REQUEST set_device_status", "Successfully formatted body. body:");
     if (esp_log_level_get("ST-REQUEST set_device_status") >= ESP_LOG_DEBUG)
-        puts(body_buf);
+        for (int i = 0; i < chunk_cnt; i++)
+            printf("%.*s%s", (int)chunks[i].len, chunks[i].data, i == chunk_cnt - 1 ? "\n" : "");
 
     ESP_GOTO_ON_ERROR(
-        post(ST_ACCESS_TOKEN, VIRTUALDEVICE_EVENT_URL(ST_DEVICE_ID), body_buf, NULL), CLEANUP,
+        _budgeted_post(VIRTUALDEVICE_EVENT_URL(ST_DEVICE_ID), chunks, chunk_cnt), CLEANUP,
         "ST-REQUEST", "Error occured while sending events."
     );
 
 CLEANUP:
-    free(body_buf);
 #if CONFIG_LOG_DEFAULT_LEVEL >= 4  // When default log level is verbose than DEBUG
         ESP_LOGD("ST_Request:set_device_status", "*****Free Mem ( End ): %u*****", heap_caps_get_free_size(MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT));
 #ifdef CONFIG_HEAP_TRACING
@@ -318,3 +527,22 @@ CLEANUP:
 #endif
     return ret;
 }
+
+void get_st_request_stats(st_request_stats *result) {
+    taskENTER_CRITICAL(&_budget_lock);
+    *result = _request_stats;
+    taskEXIT_CRITICAL(&_budget_lock);
+}
+
+void log_st_request_stats(void) {
+    st_request_stats stats;
+    get_st_request_stats(&stats);
+    ESP_LOGI(
+        "ST-REQUEST:stats",
+        "allowed=%" PRIu32 " rejected(budget/backoff)=%" PRIu32 "/%" PRIu32 " failures=%" PRIu32
+        " rate_limited=%" PRIu32 " max_used=%" PRIu32 "/%d backoff=%" PRIu32 "ms",
+        stats.allowed, stats.rejected_budget, stats.rejected_backoff, stats.failures,
+        stats.rate_limited, stats.max_used, ST_BUDGET_CAPACITY, stats.backoff
+    );
+    log_st_client_stats();
+}
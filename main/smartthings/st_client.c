@@ -0,0 +1,593 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_crt_bundle.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/sha256.h"
+#include "nvs.h"
+#include "cJSON.h"
+
+#include "config.h"
+#include "smartthings/st_client.h"
+
+// HTTP/1.1 client of the SmartThings API, with TLS session resumption.
+//
+// Every request opens a connection and closes it after the response, like the REST component did.
+// The session of the last full handshake is kept in RAM and in NVS, so the next connection,
+// also after a reboot, offers its ticket (or ID) and the server can skip the certificate
+// exchange and the ECDHE key agreement. Only TLS 1.2 sessions are cached.
+//
+// Resumption is detected by the master secret, which stays the same on an abbreviated handshake.
+// Only its SHA-256 is kept.
+
+#define SESSION_MAGIC   0x53544c53  // "STLS"
+#define SESSION_NVS_KEY "session"
+#define HEADER_MAX_LEN  512
+#define FINGERPRINT_LEN 32
+
+
+typedef struct {
+    uint32_t magic;
+    uint32_t len;                          // of the mbedtls_ssl_session_save() output which follows
+    int64_t saved_time;                    // Epoch seconds, 0 when the clock was not synchronized
+    uint8_t fingerprint[FINGERPRINT_LEN];  // SHA-256 of the master secret
+} _session_header;
+
+typedef struct {
+    bool tls;
+    char host[ST_CLIENT_HOST_MAX_LEN];
+    char port[6];
+    const char *path;
+} _url;
+
+typedef struct {
+    bool tls;
+    bool established;  // Handshake done
+    mbedtls_net_context net;
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    bool fingerprinted;
+    uint8_t fingerprint[FINGERPRINT_LEN];
+} _connection;
+
+// Session cache, under _session_lock
+static SemaphoreHandle_t _session_lock;
+static mbedtls_ssl_session _session;
+static bool _session_valid = false, _session_loaded = false;
+static uint8_t _session_fingerprint[FINGERPRINT_LEN];
+static int64_t _session_saved_us = -1;  // esp_timer, -1 for a session loaded from NVS
+static time_t _session_saved_time = 0;
+
+static st_client_stats _stats;
+static portMUX_TYPE _stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+void init_st_client(void) {
+    _session_lock = xSemaphoreCreateMutex();
+    if (_session_lock == NULL) {
+        ESP_LOGE("ST-CLIENT:init", "Failed to create session lock. Rebooting...");
+        abort();
+    }
+    mbedtls_ssl_session_init(&_session);
+}
+
+// The hardware RNG is a true RNG while Wi-Fi is on, which it is whenever a connection is made.
+static int _random(void *ctx, unsigned char *buf, size_t len) {
+    esp_fill_random(buf, len);
+    return 0;
+}
+
+static esp_err_t _parse_url(const char *url, _url *result) {
+    const char *host, *host_end, *colon;
+
+    if (strncmp(url, "https://", 8) == 0) {
+        result->tls = true;
+        host = url + 8;
+        strcpy(result->port, "443");
+    } else if (strncmp(url, "http://", 7) == 0) {
+        result->tls = false;
+        host = url + 7;
+        strcpy(result->port, "80");
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+    result->path = strchr(host, '/');
+    host_end = result->path != NULL ? result->path : host + strlen(host);
+    if (result->path == NULL)
+        result->path = "/";
+
+    colon = memchr(host, ':', host_end - host);
+    if (colon != NULL) {
+        if (host_end - colon - 1 < 1 || host_end - colon - 1 >= (int)sizeof(result->port))
+            return ESP_ERR_INVALID_ARG;
+        memcpy(result->port, colon + 1, host_end - colon - 1);
+        result->port[host_end - colon - 1] = '\0';
+        host_end = colon;
+    }
+    if (host_end == host || host_end - host >= (int)sizeof(result->host))
+        return ESP_ERR_INVALID_ARG;
+    memcpy(result->host, host, host_end - host);
+    result->host[host_end - host] = '\0';
+    return ESP_OK;
+}
+
+// Called with _session_lock held
+static void _load_session(void) {
+    _session_header header;
+    nvs_handle_t handle;
+    uint8_t *buf = NULL;
+    size_t len = 0;
+
+    _session_loaded = true;
+    if (nvs_open(ST_TLS_SESSION_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return;
+    if (
+        nvs_get_blob(handle, SESSION_NVS_KEY, NULL, &len) == ESP_OK && len > sizeof(header)
+        && (buf = malloc(len)) != NULL && nvs_get_blob(handle, SESSION_NVS_KEY, buf, &len) == ESP_OK
+    ) {
+        memcpy(&header, buf, sizeof(header));
+        if (
+            header.magic == SESSION_MAGIC && header.len == len - sizeof(header)
+            && mbedtls_ssl_session_load(&_session, buf + sizeof(header), header.len) == 0
+        ) {
+            memcpy(_session_fingerprint, header.fingerprint, FINGERPRINT_LEN);
+            _session_saved_time = header.saved_time;
+            _session_saved_us   = -1;
+            _session_valid      = true;
+            ESP_LOGI("ST-CLIENT:load_session", "Loaded TLS session (%u bytes).", (unsigned int)header.len);
+        } else {
+            mbedtls_ssl_session_free(&_session);
+            mbedtls_ssl_session_init(&_session);
+            ESP_LOGW("ST-CLIENT:load_session", "Stored TLS session is invalid.");
+        }
+    }
+    free(buf);
+    nvs_close(handle);
+}
+
+// Called with _session_lock held, after full handshakes only. Tickets renewed on
+// resumption stay in RAM, so flash is written about once per ST_TLS_SESSION_LIFETIME.
+static void _save_session(void) {
+    _session_header header = {
+        .magic      = SESSION_MAGIC,
+        .saved_time = _session_saved_time
+    };
+    nvs_handle_t handle;
+    uint8_t *buf;
+    size_t len = 0;
+
+    if (mbedtls_ssl_session_save(&_session, NULL, 0, &len) != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL)
+        return;
+    if ((buf = malloc(sizeof(header) + len)) == NULL)
+        return;
+    header.len = len;
+    memcpy(header.fingerprint, _session_fingerprint, FINGERPRINT_LEN);
+    memcpy(buf, &header, sizeof(header));
+    if (
+        mbedtls_ssl_session_save(&_session, buf + sizeof(header), len, &len) == 0
+        && nvs_open(ST_TLS_SESSION_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK
+    ) {
+        if (nvs_set_blob(handle, SESSION_NVS_KEY, buf, sizeof(header) + len) == ESP_OK && nvs_commit(handle) == ESP_OK) {
+            taskENTER_CRITICAL(&_stats_lock);
+            _stats.session_saves++;
+            taskEXIT_CRITICAL(&_stats_lock);
+        }
+        nvs_close(handle);
+    }
+    free(buf);
+}
+
+static void _drop_session(void) {
+    mbedtls_ssl_session_free(&_session);
+    mbedtls_ssl_session_init(&_session);
+    _session_valid = false;
+}
+
+// A session loaded from NVS has an unknown age until the clock is synchronized.
+// It is offered anyway, as the server rejects an expired ticket with a full handshake.
+static bool _session_expired(void) {
+    time_t now;
+
+    if (_session_saved_us >= 0)
+        return esp_timer_get_time() - _session_saved_us > (int64_t)ST_TLS_SESSION_LIFETIME * 1000000;
+    now = time(NULL);
+    if (_session_saved_time == 0 || now < TIME_SYNCED_EPOCH)
+        return false;
+    return now < _session_saved_time || now - _session_saved_time > ST_TLS_SESSION_LIFETIME;
+}
+
+static void _export_keys(
+    void *arg, mbedtls_ssl_key_export_type type, const unsigned char *secret, size_t secret_len,
+    const unsigned char client_random[32], const unsigned char server_random[32], mbedtls_tls_prf_types prf_type
+) {
+    _connection *conn = (_connection*)arg;
+
+    if (type != MBEDTLS_SSL_KEY_EXPORT_TLS12_MASTER_SECRET)
+        return;
+    conn->fingerprinted = mbedtls_sha256(secret, secret_len, conn->fingerprint, 0) == 0;
+}
+
+// Offers the cached session, then caches the one of a full handshake.
+static esp_err_t _handshake(_connection *conn) {
+    bool offered = false, resumed;
+    int64_t start;
+    uint32_t elapsed_ms;
+    int err;
+
+    xSemaphoreTake(_session_lock, portMAX_DELAY);
+    if (!_session_loaded)
+        _load_session();
+    if (_session_valid && _session_expired()) {
+        _drop_session();
+        taskENTER_CRITICAL(&_stats_lock);
+        _stats.expired_sessions++;
+        taskEXIT_CRITICAL(&_stats_lock);
+    }
+    if (_session_valid)
+        offered = mbedtls_ssl_set_session(&conn->ssl, &_session) == 0;
+    xSemaphoreGive(_session_lock);
+
+    start = esp_timer_get_time();
+    while ((err = mbedtls_ssl_handshake(&conn->ssl)) != 0) {
+        if (err != MBEDTLS_ERR_SSL_WANT_READ && err != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            ESP_LOGW("ST-CLIENT:handshake", "Handshake failed (-0x%04x).", -err);
+            // A session the server chokes on would fail every connection
+            if (offered) {
+                xSemaphoreTake(_session_lock, portMAX_DELAY);
+                _drop_session();
+                xSemaphoreGive(_session_lock);
+            }
+            return ESP_FAIL;
+        }
+    }
+    elapsed_ms = (esp_timer_get_time() - start) / 1000;
+    conn->established = true;
+
+    xSemaphoreTake(_session_lock, portMAX_DELAY);
+    resumed = offered && conn->fingerprinted && _session_valid
+        && memcmp(conn->fingerprint, _session_fingerprint, FINGERPRINT_LEN) == 0;
+    if (conn->fingerprinted) {
+        // Also takes a ticket renewed on resumption
+        _drop_session();
+        if (mbedtls_ssl_get_session(&conn->ssl, &_session) == 0) {
+            _session_valid = true;
+            if (!resumed) {
+                time_t now = time(NULL);
+                memcpy(_session_fingerprint, conn->fingerprint, FINGERPRINT_LEN);
+                _session_saved_us   = esp_timer_get_time();
+                _session_saved_time = now >= TIME_SYNCED_EPOCH ? now : 0;
+                _save_session();
+            }
+        }
+    }
+    xSemaphoreGive(_session_lock);
+
+    taskENTER_CRITICAL(&_stats_lock);
+    if (resumed) {
+        _stats.resumed_handshakes++;
+        _stats.resumed_handshake_ms += elapsed_ms;
+    } else {
+        _stats.full_handshakes++;
+        _stats.full_handshake_ms += elapsed_ms;
+        if (offered)
+            _stats.rejected_sessions++;
+    }
+    taskEXIT_CRITICAL(&_stats_lock);
+    ESP_LOGD("ST-CLIENT:handshake", "%s handshake in %" PRIu32 "ms.", resumed ? "Resumed" : "Full", elapsed_ms);
+    return ESP_OK;
+}
+
+// mbedtls_net_connect() blocks until lwIP gives up on the SYN, which takes minutes.
+// Connects without blocking instead, and waits up to ST_CLIENT_TIMEOUT for each address.
+// The DNS lookup is bounded by lwIP only.
+static esp_err_t _net_connect(mbedtls_net_context *net, const _url *url) {
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_protocol = IPPROTO_TCP};
+    struct addrinfo *addrs, *addr;
+    struct timeval timeout;
+    fd_set writeFds;
+    socklen_t len;
+    int fd, flags, err;
+
+    if ((err = getaddrinfo(url->host, url->port, &hints, &addrs)) != 0 || addrs == NULL) {
+        ESP_LOGW("ST-CLIENT:connect", "Failed to resolve %s (%d).", url->host, err);
+        return ESP_FAIL;
+    }
+    for (addr = addrs; addr != NULL; addr = addr->ai_next) {
+        if ((fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) < 0)
+            continue;
+        flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        err = connect(fd, addr->ai_addr, addr->ai_addrlen) == 0 ? 0 : errno;
+        if (err == EINPROGRESS) {
+            FD_ZERO(&writeFds);
+            FD_SET(fd, &writeFds);
+            timeout.tv_sec  = ST_CLIENT_TIMEOUT / 1000;
+            timeout.tv_usec = (ST_CLIENT_TIMEOUT % 1000) * 1000;
+            len = sizeof(err);
+            if (select(fd + 1, NULL, &writeFds, NULL, &timeout) != 1)
+                err = ETIMEDOUT;
+            else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0)
+                err = errno;
+        }
+        if (err == 0) {
+            fcntl(fd, F_SETFL, flags);
+            net->fd = fd;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(addrs);
+    if (addr == NULL) {
+        ESP_LOGW("ST-CLIENT:connect", "Failed to connect to %s:%s (errno: %d).", url->host, url->port, err);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t _connect(_connection *conn, const _url *url) {
+    struct timeval timeout = {
+        .tv_sec  = ST_CLIENT_TIMEOUT / 1000,
+        .tv_usec = (ST_CLIENT_TIMEOUT % 1000) * 1000
+    };
+
+    conn->tls = url->tls;
+    mbedtls_net_init(&conn->net);
+    mbedtls_ssl_init(&conn->ssl);
+    mbedtls_ssl_config_init(&conn->conf);
+
+    if (_net_connect(&conn->net, url) != ESP_OK)
+        return ESP_FAIL;
+    setsockopt(conn->net.fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (!conn->tls)
+        return ESP_OK;
+
+    ESP_RETURN_ON_FALSE(
+        mbedtls_ssl_config_defaults(
+            &conn->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT
+        ) == 0,
+        ESP_FAIL, "ST-CLIENT:connect", "Failed to set TLS defaults."
+    );
+    mbedtls_ssl_conf_authmode(&conn->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_rng(&conn->conf, _random, NULL);
+    mbedtls_ssl_conf_read_timeout(&conn->conf, ST_CLIENT_TIMEOUT);
+    mbedtls_ssl_conf_max_tls_version(&conn->conf, MBEDTLS_SSL_VERSION_TLS1_2);
+    ESP_RETURN_ON_ERROR(esp_crt_bundle_attach(&conn->conf), "ST-CLIENT:connect", "Failed to attach certificates.");
+    ESP_RETURN_ON_FALSE(
+        mbedtls_ssl_setup(&conn->ssl, &conn->conf) == 0 && mbedtls_ssl_set_hostname(&conn->ssl, url->host) == 0,
+        ESP_ERR_NO_MEM, "ST-CLIENT:connect", "Failed to set up TLS."
+    );
+    mbedtls_ssl_set_bio(&conn->ssl, &conn->net, mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
+    mbedtls_ssl_set_export_keys_cb(&conn->ssl, _export_keys, conn);
+    return _handshake(conn);
+}
+
+static void _close(_connection *conn) {
+    if (conn->established)
+        mbedtls_ssl_close_notify(&conn->ssl);
+    mbedtls_ssl_free(&conn->ssl);
+    mbedtls_ssl_config_free(&conn->conf);
+    mbedtls_net_free(&conn->net);
+}
+
+static esp_err_t _write(_connection *conn, const char *data, size_t len) {
+    int written;
+
+    while (len > 0) {
+        written = conn->tls
+            ? mbedtls_ssl_write(&conn->ssl, (const unsigned char*)data, len)
+            : mbedtls_net_send(&conn->net, (const unsigned char*)data, len);
+        if (written == MBEDTLS_ERR_SSL_WANT_READ || written == MBEDTLS_ERR_SSL_WANT_WRITE)
+            continue;
+        ESP_RETURN_ON_FALSE(written > 0, ESP_FAIL, "ST-CLIENT:write", "Failed to send (-0x%04x).", -written);
+        data += written;
+        len  -= written;
+    }
+    return ESP_OK;
+}
+
+// Returns the number of bytes read, 0 at the end of the response, or an mbedtls error.
+static int _read(_connection *conn, char *buf, size_t len) {
+    int ret;
+
+    do {
+        ret = conn->tls
+            ? mbedtls_ssl_read(&conn->ssl, (unsigned char*)buf, len)
+            : mbedtls_net_recv_timeout(&conn->net, (unsigned char*)buf, len, ST_CLIENT_TIMEOUT);
+    } while (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE);
+    return ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ? 0 : ret;
+}
+
+// Decodes a chunked body in place. Returns the decoded length, or -1 when it is cut off.
+static int _decode_chunked(char *body, size_t len) {
+    char *read = body, *write = body, *end = body + len, *line_end;
+    unsigned long size;
+
+    while ((line_end = strstr(read, "\r\n")) != NULL) {
+        size = strtoul(read, NULL, 16);  // Chunk extensions are ignored
+        read = line_end + 2;
+        if (size == 0)
+            return write - body;
+        if (size + 2 > (unsigned long)(end - read))
+            return -1;
+        memmove(write, read, size);
+        write += size;
+        read  += size + 2;
+    }
+    return -1;
+}
+
+// Reads until the server closes the connection or Content-Length is reached.
+// The body is left NUL terminated at *body.
+static esp_err_t _read_response(
+    _connection *conn, char *buf, st_client_result *result, char **body, int *body_len
+) {
+    int len = 0, ret, content_length = -1;
+    char *header_end = NULL, *line, *line_end;
+    bool chunked = false, complete = false;
+
+    while (!complete && len < ST_CLIENT_MAX_RESPONSE) {
+        if ((ret = _read(conn, buf + len, ST_CLIENT_MAX_RESPONSE - len)) < 0) {
+            ESP_LOGW("ST-CLIENT:read", "Failed to receive (-0x%04x).", -ret);
+            return ret == MBEDTLS_ERR_SSL_TIMEOUT ? ESP_ERR_TIMEOUT : ESP_FAIL;
+        }
+        complete = ret == 0;
+        len += ret;
+        buf[len] = '\0';
+        if (header_end == NULL && (header_end = strstr(buf, "\r\n\r\n")) != NULL) {
+            header_end[2] = '\0';
+            for (line = strstr(buf, "\r\n") + 2; (line_end = strstr(line, "\r\n")) != NULL; line = line_end + 2) {
+                *line_end = '\0';
+                if (strncasecmp(line, "Content-Length:", 15) == 0)
+                    content_length = atoi(line + 15);
+                else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0)
+                    chunked = strstr(line + 18, "chunked") != NULL;
+                else if (strncasecmp(line, "Retry-After:", 12) == 0)
+                    result->retry_after = strtoul(line + 12, NULL, 10);  // 0 for an HTTP date
+            }
+        }
+        if (header_end != NULL && !chunked && content_length >= 0 && len - (header_end + 4 - buf) >= content_length)
+            complete = true;
+    }
+    ESP_RETURN_ON_FALSE(header_end != NULL, ESP_ERR_INVALID_RESPONSE, "ST-CLIENT:read", "No complete response header.");
+    ESP_RETURN_ON_FALSE(
+        complete, ESP_ERR_INVALID_SIZE,
+        "ST-CLIENT:read", "Response is over ST_CLIENT_MAX_RESPONSE (%d bytes).", ST_CLIENT_MAX_RESPONSE
+    );
+    ESP_RETURN_ON_FALSE(
+        sscanf(buf, "HTTP/%*d.%*d %d", &result->status) == 1,
+        ESP_ERR_INVALID_RESPONSE, "ST-CLIENT:read", "Invalid status line."
+    );
+
+    *body = header_end + 4;
+    *body_len = len - (*body - buf);
+    if (chunked) {
+        *body_len = _decode_chunked(*body, *body_len);
+        ESP_RETURN_ON_FALSE(*body_len >= 0, ESP_ERR_INVALID_RESPONSE, "ST-CLIENT:read", "Chunked body is cut off.");
+    } else if (content_length >= 0) {
+        ESP_RETURN_ON_FALSE(
+            *body_len >= content_length, ESP_ERR_INVALID_RESPONSE,
+            "ST-CLIENT:read", "Body is cut off (%d of %d bytes).", *body_len, content_length
+        );
+        *body_len = content_length;
+    }
+    (*body)[*body_len] = '\0';
+    return ESP_OK;
+}
+
+// Sends the body chunks one after another, with no copy of the whole body.
+// response_json may be NULL when the response is not needed, and result when the status is not.
+esp_err_t st_client_request(
+    const char *method, const char *url, const char *token,
+    const st_client_chunk *body, int body_cnt, cJSON **response_json, st_client_result *result
+) {
+    _url parsed;
+    _connection *conn = NULL;
+    char header[HEADER_MAX_LEN], *buf = NULL, *response_body;
+    size_t content_length = 0;
+    int header_len, body_len;
+    st_client_result response = {0};
+    esp_err_t ret = ESP_OK;
+
+    if (result != NULL)
+        *result = response;
+    ESP_RETURN_ON_ERROR(_parse_url(url, &parsed), "ST-CLIENT:request", "Invalid URL %s.", url);
+    for (int i = 0; i < body_cnt; i++)
+        content_length += body[i].len;
+    header_len = snprintf(
+        header, sizeof(header),
+        "%s %s HTTP/1.1\r\nHost: %s\r\nAuthorization: Bearer %s\r\nAccept: application/json\r\n"
+        "Content-Type: application/json\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+        method, parsed.path, parsed.host, token, (unsigned int)content_length
+    );
+    ESP_RETURN_ON_FALSE(
+        header_len < (int)sizeof(header), ESP_ERR_INVALID_SIZE,
+        "ST-CLIENT:request", "Request header is too long."
+    );
+
+    taskENTER_CRITICAL(&_stats_lock);
+    _stats.requests++;
+    taskEXIT_CRITICAL(&_stats_lock);
+
+    ESP_GOTO_ON_FALSE(
+        (conn = calloc(1, sizeof(_connection))) != NULL && (buf = malloc(ST_CLIENT_MAX_RESPONSE + 1)) != NULL,
+        ESP_ERR_NO_MEM, CLEANUP, "ST-CLIENT:request", "Failed to allocate connection."
+    );
+    ESP_GOTO_ON_ERROR(_connect(conn, &parsed), CLOSE, "ST-CLIENT:request", "Failed to connect.");
+    ESP_GOTO_ON_ERROR(_write(conn, header, header_len), CLOSE, "ST-CLIENT:request", "Failed to send header.");
+    for (int i = 0; i < body_cnt; i++)
+        ESP_GOTO_ON_ERROR(_write(conn, body[i].data, body[i].len), CLOSE, "ST-CLIENT:request", "Failed to send body.");
+    ESP_GOTO_ON_ERROR(
+        _read_response(conn, buf, &response, &response_body, &body_len),
+        CLOSE, "ST-CLIENT:request", "Failed to read response."
+    );
+    ESP_GOTO_ON_FALSE(
+        response.status >= 200 && response.status < 300, ESP_ERR_INVALID_RESPONSE, CLOSE,
+        "ST-CLIENT:request", "HTTP %d: %.*s", response.status, body_len < 200 ? body_len : 200, response_body
+    );
+    if (response_json != NULL) {
+        *response_json = cJSON_ParseWithLength(response_body, body_len);
+        ESP_GOTO_ON_FALSE(
+            *response_json != NULL, ESP_ERR_INVALID_RESPONSE, CLOSE,
+            "ST-CLIENT:request", "Response is not JSON."
+        );
+    }
+
+CLOSE:
+    _close(conn);
+CLEANUP:
+    free(conn);
+    free(buf);
+    taskENTER_CRITICAL(&_stats_lock);
+    _stats.last_status = response.status;
+    if (ret != ESP_OK)
+        _stats.failures++;
+    taskEXIT_CRITICAL(&_stats_lock);
+    if (result != NULL)
+        *result = response;
+    return ret;
+}
+
+void get_st_client_stats(st_client_stats *result) {
+    taskENTER_CRITICAL(&_stats_lock);
+    *result = _stats;
+    taskEXIT_CRITICAL(&_stats_lock);
+}
+
+void log_st_client_stats(void) {
+    st_client_stats stats;
+    uint32_t handshakes, full_avg, resumed_avg;
+
+    get_st_client_stats(&stats);
+    handshakes  = stats.full_handshakes + stats.resumed_handshakes;
+    full_avg    = stats.full_handshakes ? stats.full_handshake_ms / stats.full_handshakes : 0;
+    resumed_avg = stats.resumed_handshakes ? stats.resumed_handshake_ms / stats.resumed_handshakes : 0;
+    ESP_LOGI(
+        "ST-CLIENT:stats",
+        "requests=%" PRIu32 " failures=%" PRIu32 " last_status=%d handshakes(full/resumed)=%" PRIu32 "/%" PRIu32
+        " resumed=%" PRIu32 "%% rejected=%" PRIu32 " expired=%" PRIu32 " saves=%" PRIu32,
+        stats.requests, stats.failures, stats.last_status, stats.full_handshakes, stats.resumed_handshakes,
+        handshakes ? stats.resumed_handshakes * 100 / handshakes : 0,
+        stats.rejected_sessions, stats.expired_sessions, stats.session_saves
+    );
+    if (stats.full_handshakes && stats.resumed_handshakes)
+        ESP_LOGI(
+            "ST-CLIENT:stats", "handshake avg(full/resumed)=%" PRIu32 "/%" PRIu32 "ms, saved %" PRId32 "ms per resumed connection",
+            full_avg, resumed_avg, (int32_t)(full_avg - resumed_avg)
+        );
+}
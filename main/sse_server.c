@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <float.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "lwip/sockets.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_vfs_eventfd.h"
+
+#include "config.h"
+#include "data_bus.h"
+#include "sse_server.h"
+
+#define SSE_RESPONSE_STREAM\
+    "HTTP/1.1 200 OK\r\n"\
+    "Content-Type: text/event-stream\r\n"\
+    "Cache-Control: no-cache\r\n"\
+    "Connection: keep-alive\r\n"\
+    "Access-Control-Allow-Origin: *\r\n"\
+    "\r\n"\
+    "retry: 5000\n\n"
+#define SSE_RESPONSE_NOT_FOUND "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"
+#define SSE_RESPONSE_BUSY      "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"
+#define SSE_KEEPALIVE          ":\n\n"
+#define SSE_EVENT_MAX_LEN      512
+
+
+// Before streaming, buf holds the request. Afterwards it holds bytes not sent yet.
+typedef struct {
+    int fd;  // -1 when free
+    bool streaming;
+    bool raw;
+    uint16_t start, end;
+    char buf[SSE_CLIENT_BUFFER_SIZE];
+} _sse_client;
+
+typedef struct {
+    sensor_values values;
+    TickType_t tick;
+} _sse_sample;
+
+typedef struct {
+    char *buf;
+    size_t size, len;
+} _sse_writer;
+
+static _sse_client _clients[SSE_MAX_CLIENTS];
+static int _listen_fd = -1, _wake_fd = -1, _subscription;
+static QueueHandle_t _samples;
+static uint32_t _raw_clients = 0, _streaming_clients = 0;
+static sse_stats _stats;
+static char _quantiles[SSE_EVENT_MAX_LEN];  // Latest "quantiles" event, empty until published
+static uint32_t _quantiles_seq = 0;
+static portMUX_TYPE _quantiles_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+void _sse_write(_sse_writer *writer, const char *format, ...) {
+    va_list args;
+    int written;
+
+    if (writer->len >= writer->size)
+        return;
+    va_start(args, format);
+    written = vsnprintf(writer->buf + writer->len, writer->size - writer->len, format, args);
+    va_end(args);
+    if (written > 0)
+        writer->len += written;
+}
+
+void _sse_write_int(_sse_writer *writer, const char *key, int value) {
+    if (value == INT_MIN)
+        _sse_write(writer, ",\"%s\":null", key);
+    else
+        _sse_write(writer, ",\"%s\":%d", key, value);
+}
+
+void _sse_write_float(_sse_writer *writer, const char *key, float value, int decimals) {
+    if (value == FLT_MIN)
+        _sse_write(writer, ",\"%s\":null", key);
+    else
+        _sse_write(writer, ",\"%s\":%.*f", key, decimals, (double)value);
+}
+
+void _sse_write_tenths(_sse_writer *writer, const char *key, int value) {
+    if (value == INT_MIN)
+        _sse_write(writer, ",\"%s\":null", key);
+    else
+        _sse_write(writer, ",\"%s\":%s%d.%d", key, value < 0 ? "-" : "", abs(value) / 10, abs(value) % 10);
+}
+
+void _sse_write_values(_sse_writer *writer, const sensor_values *values) {
+    _sse_write_int(writer, "fine_dust", values->fine_dust);
+    _sse_write_float(writer, "temperature", values->temperature, 1);
+    _sse_write_int(writer, "humidity", values->humidity);
+    _sse_write_int(writer, "tvoc", values->tvoc);
+    _sse_write_float(writer, "temperature2", values->temperature2, 1);
+    _sse_write_float(writer, "pressure", values->pressure, 2);
+}
+
+// Returns the length, or 0 when the event does not fit.
+size_t _sse_format_average(char *buf, size_t size, const data_bus_snapshot *snapshot) {
+    _sse_writer writer = {.buf = buf, .size = size, .len = 0};
+
+    _sse_write(
+        &writer, "id: %" PRIu32 "\nevent: average\ndata: {\"seq\":%" PRIu32 ",\"tick\":%" PRIu32,
+        snapshot->seq, snapshot->seq, (uint32_t)snapshot->tick
+    );
+    _sse_write_values(&writer, &snapshot->values);
+    _sse_write_int(&writer, "aqi", snapshot->derived.aqi);
+    _sse_write_tenths(&writer, "dew_point", snapshot->derived.dew_point);
+    _sse_write_tenths(&writer, "absolute_humidity", snapshot->derived.absolute_humidity);
+    _sse_write_int(&writer, "tvoc_index", snapshot->derived.tvoc_index);
+    _sse_write(&writer, "}\n\n");
+    return writer.len < size ? writer.len : 0;
+}
+
+size_t _sse_format_sample(char *buf, size_t size, const _sse_sample *sample) {
+    _sse_writer writer = {.buf = buf, .size = size, .len = 0};
+
+    _sse_write(&writer, "event: sample\ndata: {\"tick\":%" PRIu32, (uint32_t)sample->tick);
+    _sse_write_values(&writer, &sample->values);
+    _sse_write(&writer, ",\"fan\":%d}\n\n", sample->values.fan);
+    return writer.len < size ? writer.len : 0;
+}
+
+// Copies the latest "quantiles" event. Returns the length, 0 before the first one.
+size_t _sse_copy_quantiles(char *buf, uint32_t *seq) {
+    size_t len;
+
+    taskENTER_CRITICAL(&_quantiles_lock);
+    len = strlen(_quantiles);
+    memcpy(buf, _quantiles, len);
+    if (seq != NULL)
+        *seq = _quantiles_seq;
+    taskEXIT_CRITICAL(&_quantiles_lock);
+    return len;
+}
+
+// Wakes sse_server_task out of select() for new data. Called by producers, and never blocks.
+// Without streaming clients, new data waits for the next wake-up instead.
+void _sse_wake(void) {
+    uint64_t one = 1;
+
+    if (__atomic_load_n(&_streaming_clients, __ATOMIC_RELAXED))
+        write(_wake_fd, &one, sizeof(one));
+}
+
+void _sse_close(_sse_client *client) {
+    if (client->streaming)
+        __atomic_sub_fetch(&_streaming_clients, 1, __ATOMIC_RELAXED);
+    if (client->streaming && client->raw)
+        __atomic_sub_fetch(&_raw_clients, 1, __ATOMIC_RELAXED);
+    close(client->fd);
+    client->fd        = -1;
+    client->streaming = false;
+    client->raw       = false;
+    client->start     = 0;
+    client->end       = 0;
+    _stats.clients--;
+}
+
+bool _sse_queue(_sse_client *client, const char *data, size_t len) {
+    if (client->end + len > sizeof(client->buf)) {
+        memmove(client->buf, client->buf + client->start, client->end - client->start);
+        client->end  -= client->start;
+        client->start = 0;
+        if (client->end + len > sizeof(client->buf))
+            return false;
+    }
+    memcpy(client->buf + client->end, data, len);
+    client->end += len;
+    return true;
+}
+
+// Never waits for a client. Clients without room for the data are disconnected.
+void _sse_broadcast(const char *data, size_t len, bool rawOnly) {
+    for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+        _sse_client *client = &_clients[i];
+        if (client->fd < 0 || !client->streaming || (rawOnly && !client->raw))
+            continue;
+        if (!_sse_queue(client, data, len)) {
+            ESP_LOGW("SSE:_sse_broadcast", "Client %d is too slow. Disconnecting...", i);
+            _stats.dropped_slow++;
+            _sse_close(client);
+        }
+    }
+}
+
+void _sse_flush(_sse_client *client) {
+    while (client->start < client->end) {
+        ssize_t sent = send(client->fd, client->buf + client->start, client->end - client->start, MSG_DONTWAIT);
+        if (sent > 0) {
+            client->start += sent;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        } else {
+            _sse_close(client);
+            return;
+        }
+    }
+    client->start = 0;
+    client->end   = 0;
+}
+
+// Responds to a refused connection without waiting. The response may be cut short.
+void _sse_refuse(int fd, const char *response) {
+    send(fd, response, strlen(response), MSG_DONTWAIT);
+    close(fd);
+    _stats.rejected++;
+}
+
+void _sse_refuse_client(_sse_client *client, const char *response) {
+    int fd = client->fd;
+    client->fd  = -1;
+    client->end = 0;
+    _stats.clients--;
+    _sse_refuse(fd, response);
+}
+
+void _sse_accept(void) {
+    int fd = accept(_listen_fd, NULL, NULL);
+    if (fd < 0)
+        return;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (_clients[i].fd < 0) {
+            _clients[i].fd = fd;
+            _stats.accepted++;
+            _stats.clients++;
+            return;
+        }
+    }
+    _sse_refuse(fd, SSE_RESPONSE_BUSY);
+}
+
+// Starts streaming on "GET /events[?raw=1]". The latest average is sent right away.
+void _sse_handle_request(_sse_client *client) {
+    const data_bus_snapshot *snapshot;
+    char event[SSE_EVENT_MAX_LEN];
+    size_t len;
+    char *line_end = strstr(client->buf, "\r\n");
+
+    if (strncmp(client->buf, "GET /events", 11) || (client->buf[11] != ' ' && client->buf[11] != '?')) {
+        _sse_refuse_client(client, SSE_RESPONSE_NOT_FOUND);
+        return;
+    }
+    *line_end = '\0';
+    client->raw       = strstr(client->buf, "raw=1") != NULL;
+    client->streaming = true;
+    client->start     = 0;
+    client->end       = 0;
+    __atomic_add_fetch(&_streaming_clients, 1, __ATOMIC_RELAXED);
+    if (client->raw)
+        __atomic_add_fetch(&_raw_clients, 1, __ATOMIC_RELAXED);
+
+    _sse_queue(client, SSE_RESPONSE_STREAM, sizeof(SSE_RESPONSE_STREAM) - 1);
+    snapshot = data_bus_acquire_latest();
+    if (snapshot != NULL) {
+        len = _sse_format_average(event, sizeof(event), snapshot);
+        data_bus_release(snapshot);
+        if (len)
+            _sse_queue(client, event, len);
+    }
+    len = _sse_copy_quantiles(event, NULL);
+    if (len)
+        _sse_queue(client, event, len);
+}
+
+void _sse_read(_sse_client *client) {
+    char discard[64];
+    ssize_t received;
+
+    if (client->streaming) {  // Only to notice closed connections
+        received = recv(client->fd, discard, sizeof(discard), MSG_DONTWAIT);
+    } else {
+        received = recv(client->fd, client->buf + client->end, sizeof(client->buf) - 1 - client->end, MSG_DONTWAIT);
+        if (received > 0) {
+            client->end += received;
+            client->buf[client->end] = '\0';
+            if (strstr(client->buf, "\r\n\r\n") != NULL) {
+                _sse_handle_request(client);
+                return;
+            }
+            if (client->end >= sizeof(client->buf) - 1) {  // Request too long
+                _sse_refuse_client(client, SSE_RESPONSE_NOT_FOUND);
+                return;
+            }
+        }
+    }
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        _sse_close(client);
+}
+
+// Sleeps in select() until a socket is ready, new data wakes it through _wake_fd,
+// or the next keepalive is due.
+void sse_server_task(void *arg) {
+    fd_set readFds, writeFds;
+    struct timeval timeout;
+    uint64_t wakes;
+    int32_t untilKeepalive;
+    const data_bus_snapshot *snapshot;
+    _sse_sample sample;
+    char event[SSE_EVENT_MAX_LEN];
+    size_t len;
+    int maxFd;
+    uint32_t quantilesSeq = 0, seq;
+    TickType_t nextKeepalive = xTaskGetTickCount() + pdMS_TO_TICKS(SSE_KEEPALIVE_INTERVAL);
+
+    while (1) {
+        FD_ZERO(&readFds);
+        FD_ZERO(&writeFds);
+        FD_SET(_listen_fd, &readFds);
+        FD_SET(_wake_fd, &readFds);
+        maxFd = _listen_fd > _wake_fd ? _listen_fd : _wake_fd;
+        for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+            if (_clients[i].fd < 0)
+                continue;
+            FD_SET(_clients[i].fd, &readFds);
+            if (_clients[i].streaming && _clients[i].start < _clients[i].end)
+                FD_SET(_clients[i].fd, &writeFds);
+            if (_clients[i].fd > maxFd)
+                maxFd = _clients[i].fd;
+        }
+        untilKeepalive = (int32_t)(nextKeepalive - xTaskGetTickCount());
+        untilKeepalive = untilKeepalive > 0 ? pdTICKS_TO_MS(untilKeepalive) : 0;
+        timeout.tv_sec  = untilKeepalive / 1000;
+        timeout.tv_usec = untilKeepalive % 1000 * 1000;
+        if (select(maxFd + 1, &readFds, &writeFds, NULL, &timeout) < 0) {
+            ESP_LOGE("SSE:sse_server_task", "select() failed (errno: %d).", errno);
+            vTaskDelay(pdMS_TO_TICKS(SSE_RETRY_INTERVAL));
+            continue;
+        }
+        _stats.wakeups++;
+        if (FD_ISSET(_wake_fd, &readFds))
+            read(_wake_fd, &wakes, sizeof(wakes));
+
+        for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+            if (_clients[i].fd >= 0 && FD_ISSET(_clients[i].fd, &readFds))
+                _sse_read(&_clients[i]);
+        }
+        if (FD_ISSET(_listen_fd, &readFds))
+            _sse_accept();
+
+        while ((snapshot = data_bus_receive(_subscription, 0)) != NULL) {
+            len = _sse_format_average(event, sizeof(event), snapshot);
+            data_bus_release(snapshot);
+            if (len) {
+                _stats.events++;
+                _sse_broadcast(event, len, false);
+            }
+        }
+        while (xQueueReceive(_samples, &sample, 0) == pdTRUE) {
+            len = _sse_format_sample(event, sizeof(event), &sample);
+            if (len) {
+                _stats.events++;
+                _sse_broadcast(event, len, true);
+            }
+        }
+        if (__atomic_load_n(&_quantiles_seq, __ATOMIC_RELAXED) != quantilesSeq) {
+            len = _sse_copy_quantiles(event, &seq);
+            quantilesSeq = seq;
+            _stats.events++;
+            _sse_broadcast(event, len, false);
+        }
+        if ((int32_t)(xTaskGetTickCount() - nextKeepalive) >= 0) {
+            _sse_broadcast(SSE_KEEPALIVE, sizeof(SSE_KEEPALIVE) - 1, false);
+            nextKeepalive = xTaskGetTickCount() + pdMS_TO_TICKS(SSE_KEEPALIVE_INTERVAL);
+        }
+
+        for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+            if (_clients[i].fd >= 0 && _clients[i].streaming)
+                _sse_flush(&_clients[i]);
+        }
+    }
+}
+
+// Subscribes to the data bus, so it must be called before get_sensor_value_task starts.
+esp_err_t init_sse_server(void) {
+    struct sockaddr_in addr = {};
+    int reuse = 1;
+    esp_err_t ret = ESP_OK;
+
+    for (int i = 0; i < SSE_MAX_CLIENTS; i++)
+        _clients[i].fd = -1;
+    _samples = xQueueCreate(SSE_SAMPLE_QUEUE_LEN, sizeof(_sse_sample));
+    ESP_RETURN_ON_FALSE(_samples != NULL, ESP_ERR_NO_MEM, "SSE:init_sse_server", "Failed to create sample queue.");
+    esp_vfs_eventfd_config_t eventfdConfig = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    ESP_RETURN_ON_ERROR(esp_vfs_eventfd_register(&eventfdConfig), "SSE:init_sse_server", "Failed to register eventfd.");
+    _wake_fd = eventfd(0, 0);
+    ESP_RETURN_ON_FALSE(_wake_fd >= 0, ESP_FAIL, "SSE:init_sse_server", "Failed to create eventfd (errno: %d).", errno);
+
+    _listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ESP_RETURN_ON_FALSE(
+        _listen_fd >= 0, ESP_FAIL, "SSE:init_sse_server", "Failed to create socket (errno: %d).", errno
+    );
+    setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(SSE_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    ESP_GOTO_ON_FALSE(
+        bind(_listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0, ESP_FAIL, CLEANUP,
+        "SSE:init_sse_server", "Failed to bind port %d (errno: %d).", SSE_PORT, errno
+    );
+    ESP_GOTO_ON_FALSE(
+        listen(_listen_fd, SSE_MAX_CLIENTS) == 0, ESP_FAIL, CLEANUP,
+        "SSE:init_sse_server", "Failed to listen (errno: %d).", errno
+    );
+    fcntl(_listen_fd, F_SETFL, fcntl(_listen_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    _subscription = data_bus_subscribe("sse", SSE_BUS_DEPTH, DATA_BUS_DROP_OLDEST);
+    data_bus_wake(_subscription, _sse_wake);
+    ESP_GOTO_ON_FALSE(
+        xTaskCreate(sse_server_task, "sse_server_task", SSE_TASK_STACK_SIZE, NULL, SSE_TASK_PRIORITY, NULL) == pdPASS,
+        ESP_ERR_NO_MEM, CLEANUP, "SSE:init_sse_server", "Failed to create task."
+    );
+    ESP_LOGI("SSE:init_sse_server", "Streaming on port %d.", SSE_PORT);
+    return ESP_OK;
+
+CLEANUP:
+    close(_listen_fd);
+    _listen_fd = -1;
+    return ret;
+}
+
+// Called by get_sensor_value_task. Never blocks, and costs nothing without raw clients.
+void sse_publish_sample(const sensor_values *values, TickType_t tick) {
+    _sse_sample sample;
+
+    if (_samples == NULL || !__atomic_load_n(&_raw_clients, __ATOMIC_RELAXED))
+        return;
+    sample.values = *values;
+    sample.tick   = tick;
+    if (xQueueSend(_samples, &sample, 0) != pdTRUE)
+        __atomic_add_fetch(&_stats.samples_lost, 1, __ATOMIC_RELAXED);
+    else
+        _sse_wake();
+}
+
+// data is a JSON object. Clients get the latest one on connect too.
+void sse_publish_quantiles(const char *data) {
+    char event[SSE_EVENT_MAX_LEN];
+    int len = snprintf(event, sizeof(event), "event: quantiles\ndata: %s\n\n", data);
+
+    if (len < 0 || len >= (int)sizeof(event)) {
+        ESP_LOGW("SSE:sse_publish_quantiles", "Event too long. Skipping...");
+        return;
+    }
+    taskENTER_CRITICAL(&_quantiles_lock);
+    memcpy(_quantiles, event, len + 1);
+    _quantiles_seq++;
+    taskEXIT_CRITICAL(&_quantiles_lock);
+    _sse_wake();
+}
+
+void get_sse_stats(sse_stats *result) {
+    *result = _stats;
+}
+
+void log_sse_stats(void) {
+    ESP_LOGI(
+        "SSE:stats",
+        "clients=%" PRIu32 " accepted=%" PRIu32 " rejected=%" PRIu32 " dropped_slow=%" PRIu32
+        " events=%" PRIu32 " samples_lost=%" PRIu32 " wakeups=%" PRIu32,
+        _stats.clients, _stats.accepted, _stats.rejected, _stats.dropped_slow, _stats.events, _stats.samples_lost,
+        _stats.wakeups
+    );
+}
@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "config.h"
+#include "task_monitor.h"
+
+
+typedef struct {
+    const char *name;
+    uint32_t cycles;
+    uint32_t overruns;
+    TickType_t max_jitter;
+    uint32_t jitter[TASK_MONITOR_JITTER_BUCKETS];
+} _loop_stats;
+
+static _loop_stats _loops[TASK_MONITOR_MAX_LOOPS];
+static int _loop_cnt = 0;
+static uint32_t _last_total_run_time = 0;
+static uint32_t _last_run_time[TASK_MONITOR_MAX_TASKS];
+static TaskHandle_t _last_handle[TASK_MONITOR_MAX_TASKS];
+
+
+// Called once per periodic loop, before the loop starts.
+int task_monitor_register(const char *name) {
+    if (_loop_cnt >= TASK_MONITOR_MAX_LOOPS) {
+        ESP_LOGE("TaskMonitor:register", "Too many loops. Rebooting...");
+        abort();
+    }
+    _loops[_loop_cnt].name = name;
+    return _loop_cnt++;
+}
+
+static void _record_cycle(_loop_stats *loop, TickType_t wakeTime, BaseType_t delayed) {
+    TickType_t jitter;
+
+    loop->cycles++;
+    if (!delayed) {
+        // The cycle took longer than its period. Wake time is already in the past.
+        loop->overruns++;
+        return;
+    }
+
+    jitter = xTaskGetTickCount() - wakeTime;
+    if (jitter > loop->max_jitter)
+        loop->max_jitter = jitter;
+    if (jitter == 0)
+        loop->jitter[0]++;
+    else if (jitter == 1)
+        loop->jitter[1]++;
+    else if (jitter < 5)
+        loop->jitter[2]++;
+    else if (jitter < 10)
+        loop->jitter[3]++;
+    else
+        loop->jitter[4]++;
+}
+
+// Drop-in for vTaskDelayUntil(), which records overruns and wake-up jitter.
+BaseType_t task_monitor_delay_until(int id, TickType_t *previousWakeTime, TickType_t period) {
+    BaseType_t delayed = xTaskDelayUntil(previousWakeTime, period);
+
+    _record_cycle(&_loops[id], *previousWakeTime, delayed);
+    return delayed;
+}
+
+// Same as task_monitor_delay_until(), but returns pdTRUE early when the task is notified
+// with xTaskNotifyGive(). The wake time is kept then, so that the loop stays on its period.
+// Returns pdFALSE once the period ends.
+BaseType_t task_monitor_wait_until(int id, TickType_t *previousWakeTime, TickType_t period) {
+    TickType_t elapsed = xTaskGetTickCount() - *previousWakeTime;
+
+    if (elapsed < period && ulTaskNotifyTake(pdTRUE, period - elapsed))
+        return pdTRUE;
+    *previousWakeTime += period;
+    _record_cycle(&_loops[id], *previousWakeTime, elapsed < period);
+    return pdFALSE;
+}
+
+// Logs one line per loop and per task. CPU share is measured since the last call.
+// Called from device_status_task only.
+void task_monitor_publish(void) {
+    static TaskStatus_t tasks[TASK_MONITOR_MAX_TASKS];  // About 600 bytes, off the task stack
+    uint32_t total_run_time, elapsed, run_time;
+    UBaseType_t task_cnt;
+
+    for (int i = 0; i < _loop_cnt; i++) {
+        _loop_stats *loop = &_loops[i];
+        ESP_LOGI(
+            "TaskMonitor",
+            "L|%s|cyc=%" PRIu32 "|ovr=%" PRIu32 "|jit=%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32 "|max=%" PRIu32,
+            loop->name, loop->cycles, loop->overruns,
+            loop->jitter[0], loop->jitter[1], loop->jitter[2], loop->jitter[3], loop->jitter[4],
+            (uint32_t)loop->max_jitter
+        );
+    }
+
+    task_cnt = uxTaskGetSystemState(tasks, TASK_MONITOR_MAX_TASKS, &total_run_time);
+    if (task_cnt == 0) {
+        ESP_LOGW("TaskMonitor", "More than TASK_MONITOR_MAX_TASKS tasks. Skipping CPU share.");
+        return;
+    }
+    elapsed = total_run_time - _last_total_run_time;
+    _last_total_run_time = total_run_time;
+    if (elapsed == 0)
+        elapsed = 1;
+
+    for (UBaseType_t i = 0; i < task_cnt; i++) {
+        // Find the counter of the previous call by handle, as the order is not stable.
+        run_time = tasks[i].ulRunTimeCounter;
+        for (int j = 0; j < TASK_MONITOR_MAX_TASKS; j++) {
+            if (_last_handle[j] == tasks[i].xHandle) {
+                run_time -= _last_run_time[j];
+                break;
+            }
+        }
+        ESP_LOGI(
+            "TaskMonitor", "T|%s|pri=%u|cpu=%" PRIu32 ".%" PRIu32 "%%|stack_free=%" PRIu32,
+            tasks[i].pcTaskName, (unsigned int)tasks[i].uxCurrentPriority,
+            (uint32_t)((uint64_t)run_time * 100 / elapsed),
+            (uint32_t)((uint64_t)run_time * 1000 / elapsed % 10),
+            (uint32_t)tasks[i].usStackHighWaterMark
+        );
+    }
+    for (UBaseType_t i = 0; i < TASK_MONITOR_MAX_TASKS; i++) {
+        _last_handle[i]   = i < task_cnt ? tasks[i].xHandle : NULL;
+        _last_run_time[i] = i < task_cnt ? tasks[i].ulRunTimeCounter : 0;
+    }
+}
@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <cstdint>
+#include <cinttypes>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_partition.h"
+
+#include "config.h"
+#include "trace.h"
+
+#define TRACE_KEEP_FINE_DUST 0x80
+
+// Little endian. tools/trace_decode.py must follow changes.
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t type;
+    uint8_t fan;  // fan_state | TRACE_KEEP_FINE_DUST
+    uint32_t tick;
+    int32_t fine_dust;
+    float temperature;
+    int32_t humidity;
+    float temperature2;
+    float pressure;
+    int32_t tvoc;
+    int16_t errors[SENSOR_CNT];
+} _trace_frame;
+static_assert(sizeof(_trace_frame) == 40, "Trace frame layout changed");
+
+#ifdef TRACE_SINK_FLASH
+static const esp_partition_t *_partition = NULL;
+static size_t _erased = 0;
+#endif
+static size_t _offset = 0;
+static uint32_t _written = 0, _dropped = 0;
+
+
+esp_err_t init_trace(void) {
+#ifdef TRACE_SINK_FLASH
+    _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, TRACE_PARTITION_LABEL);
+    ESP_RETURN_ON_FALSE(
+        _partition != NULL, ESP_ERR_NOT_FOUND,
+        "Trace:init_trace", "No \"%s\" partition.", TRACE_PARTITION_LABEL
+    );
+    _erased = 0;
+#endif
+    _offset = 0;
+    return ESP_OK;
+}
+
+void _encode_frame(const trace_entry *record, _trace_frame *frame) {
+    frame->magic        = TRACE_FRAME_MAGIC;
+    frame->type         = record->type;
+    frame->fan          = record->values.fan | (record->keepFineDust ? TRACE_KEEP_FINE_DUST : 0);
+    frame->tick         = record->tick;
+    frame->fine_dust    = record->values.fine_dust;
+    frame->temperature  = record->values.temperature;
+    frame->humidity     = record->values.humidity;
+    frame->temperature2 = record->values.temperature2;
+    frame->pressure     = record->values.pressure;
+    frame->tvoc         = record->values.tvoc;
+    for (int i = 0; i < SENSOR_CNT; i++)
+        frame->errors[i] = record->type == TRACE_SAMPLE ? (int16_t)record->errors[i] : ESP_OK;
+}
+
+void _decode_frame(const _trace_frame *frame, trace_entry *record) {
+    record->type                = (trace_entry_type)frame->type;
+    record->tick                = frame->tick;
+    record->keepFineDust        = frame->fan & TRACE_KEEP_FINE_DUST;
+    record->values.fan          = (fan_state)(frame->fan & ~TRACE_KEEP_FINE_DUST);
+    record->values.fine_dust    = frame->fine_dust;
+    record->values.temperature  = frame->temperature;
+    record->values.humidity     = frame->humidity;
+    record->values.temperature2 = frame->temperature2;
+    record->values.pressure     = frame->pressure;
+    record->values.tvoc         = frame->tvoc;
+    for (int i = 0; i < SENSOR_CNT; i++)
+        record->errors[i] = frame->errors[i];
+}
+
+// Called from get_sensor_value_task only.
+void trace_write(const trace_entry *record) {
+    _trace_frame frame;
+    _encode_frame(record, &frame);
+
+#ifdef TRACE_SINK_FLASH
+    if (_partition == NULL || _offset + sizeof(frame) > _partition->size) {
+        if (_dropped++ == 0)
+            ESP_LOGW("Trace:trace_write", "Trace partition is full or missing. Stop recording.");
+        return;
+    }
+    // Erase just ahead of the write position, so recording starts without a long erase
+    if (_offset + sizeof(frame) > _erased) {
+        if (esp_partition_erase_range(_partition, _erased, _partition->erase_size) != ESP_OK) {
+            _dropped++;
+            return;
+        }
+        _erased += _partition->erase_size;
+    }
+    if (esp_partition_write(_partition, _offset, &frame, sizeof(frame)) != ESP_OK) {
+        _dropped++;
+        return;
+    }
+#else
+    fwrite(&frame, sizeof(frame), 1, stdout);
+#endif
+    _offset += sizeof(frame);
+    _written++;
+}
+
+// Reads the next record of the trace partition. Returns ESP_ERR_NOT_FOUND at the end.
+esp_err_t trace_read(trace_entry *record) {
+#ifdef TRACE_SINK_FLASH
+    _trace_frame frame;
+    ESP_RETURN_ON_FALSE(_partition != NULL, ESP_ERR_INVALID_STATE, "Trace:trace_read", "Not initialized.");
+    if (_offset + sizeof(frame) > _partition->size)
+        return ESP_ERR_NOT_FOUND;
+    ESP_RETURN_ON_ERROR(
+        esp_partition_read(_partition, _offset, &frame, sizeof(frame)),
+        "Trace:trace_read", "Failed to read at %u.", (unsigned int)_offset
+    );
+    if (frame.magic != TRACE_FRAME_MAGIC)  // Erased flash after the last frame
+        return ESP_ERR_NOT_FOUND;
+    _decode_frame(&frame, record);
+    _offset += sizeof(frame);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void log_trace_stats(void) {
+    ESP_LOGI(
+        "Trace:stats", "written=%" PRIu32 " dropped=%" PRIu32 " bytes=%u",
+        _written, _dropped, (unsigned int)_offset
+    );
+}
@@ -1,12 +1,22 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "esp_err.h"
 #include "esp_check.h"
 #include "esp_netif.h"
 #include "esp_wifi.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_sntp.h"
 
 #include "config.h"
 #include "wifi/wifi.h"
@@ -17,7 +27,20 @@ typedef union {
     uint8_t digit[4];
 } _ip_addr;
 
-static uint_fast8_t _wifi_status = 0;
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+} _ap_cache;
+
+static uint_fast8_t _wifi_status = 0, _wifi_paused = 0, _cache_failures = 0, _config_changed = 0;
+// The event handler (event loop task), the reconnect timer (esp_timer task) and
+// pause/resume (caller) all change the state below and WIFI_CFG.
+static SemaphoreHandle_t _wifi_lock;
+static esp_timer_handle_t _reconnect_timer;
+static uint32_t _reconnect_backoff_ms = 0;
+static int64_t _connect_start_us = -1;
+static _ap_cache _cached_ap;
+static wifi_connect_stats _stats;
 
 static wifi_config_t WIFI_CFG = {
     .sta = {
@@ -36,12 +59,143 @@ static wifi_country_t WIFI_COUNTRY = {
 };
 
 
+// Call with _wifi_lock held.
+esp_err_t _wifi_connect(void) {
+    // A changed AP cache is applied here, as the STA is disconnected now
+    if (_config_changed) {
+        _config_changed = 0;
+        ESP_RETURN_ON_ERROR(
+            esp_wifi_set_config(WIFI_IF_STA, &WIFI_CFG),
+            "Wi-Fi:connect", "Failed to set wifi config."
+        );
+    }
+    if (_connect_start_us < 0)
+        _connect_start_us = esp_timer_get_time();
+    _stats.attempts++;
+    return esp_wifi_connect();
+}
+
+void _schedule_reconnect(void);
+
+void _reconnect_timer_callback(void *arg) {
+    xSemaphoreTake(_wifi_lock, portMAX_DELAY);
+    if (!_wifi_paused && !(_wifi_status & 0x01)) {
+        ESP_LOGI("Wi-Fi:reconnect", "Trying to reconnect wifi...");
+        if (_wifi_connect() != ESP_OK) {
+            ESP_LOGW("Wi-Fi:reconnect", "Failed to connect wifi.");
+            _schedule_reconnect();
+        }
+    }
+    xSemaphoreGive(_wifi_lock);
+}
+
+// Jittered exponential backoff, so units behind one AP do not reconnect at once.
+// Call with _wifi_lock held.
+void _schedule_reconnect(void) {
+    uint32_t delay_ms;
+
+    if (_reconnect_backoff_ms == 0)
+        _reconnect_backoff_ms = WIFI_RECONNECT_BACKOFF_MIN;
+    else if (_reconnect_backoff_ms < WIFI_RECONNECT_BACKOFF_MAX / 2)
+        _reconnect_backoff_ms *= 2;
+    else
+        _reconnect_backoff_ms = WIFI_RECONNECT_BACKOFF_MAX;
+    delay_ms = _reconnect_backoff_ms / 2 + esp_random() % (_reconnect_backoff_ms / 2 + 1);
+
+    esp_timer_stop(_reconnect_timer);
+    ESP_ERROR_CHECK(esp_timer_start_once(_reconnect_timer, (uint64_t)delay_ms * 1000));
+    ESP_LOGI("Wi-Fi:reconnect", "Reconnect scheduled after %" PRIu32 "ms.", delay_ms);
+}
+
+void _load_ap_cache(void) {
+    nvs_handle_t handle;
+    size_t size = sizeof(_cached_ap);
+
+    if (nvs_open(WIFI_CACHE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return;
+    if (nvs_get_blob(handle, "ap", &_cached_ap, &size) == ESP_OK && size == sizeof(_cached_ap)) {
+        memcpy(WIFI_CFG.sta.bssid, _cached_ap.bssid, sizeof(_cached_ap.bssid));
+        WIFI_CFG.sta.bssid_set = 1;
+        WIFI_CFG.sta.channel   = _cached_ap.channel;
+        ESP_LOGI("Wi-Fi:load_ap_cache", "Using cached AP (Channel: %d).", _cached_ap.channel);
+    } else {
+        memset(&_cached_ap, 0, sizeof(_cached_ap));
+    }
+    nvs_close(handle);
+}
+
+// Flash is only written when the AP changed. The next connect uses the new AP,
+// e.g. after a full scan found it.
+void _save_ap_cache(void) {
+    wifi_ap_record_t ap_info;
+    nvs_handle_t handle;
+
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK)
+        return;
+    if (
+        !memcmp(_cached_ap.bssid, ap_info.bssid, sizeof(_cached_ap.bssid))
+        && _cached_ap.channel == ap_info.primary
+    )
+        return;
+
+    memcpy(_cached_ap.bssid, ap_info.bssid, sizeof(_cached_ap.bssid));
+    _cached_ap.channel = ap_info.primary;
+    memcpy(WIFI_CFG.sta.bssid, _cached_ap.bssid, sizeof(_cached_ap.bssid));
+    WIFI_CFG.sta.bssid_set = 1;
+    WIFI_CFG.sta.channel   = _cached_ap.channel;
+    _config_changed = 1;
+    if (nvs_open(WIFI_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+        return;
+    if (nvs_set_blob(handle, "ap", &_cached_ap, sizeof(_cached_ap)) == ESP_OK)
+        nvs_commit(handle);
+    nvs_close(handle);
+    ESP_LOGI("Wi-Fi:save_ap_cache", "Cached AP updated (Channel: %d).", _cached_ap.channel);
+}
+
+// Falls back to a full scan when the cached AP is gone (e.g. AP moved to another channel).
+void _drop_ap_cache(void) {
+    nvs_handle_t handle;
+
+    ESP_LOGI("Wi-Fi:drop_ap_cache", "Cached AP not reachable. Using full scan.");
+    memset(&_cached_ap, 0, sizeof(_cached_ap));
+    WIFI_CFG.sta.bssid_set = 0;
+    WIFI_CFG.sta.channel   = 0;
+    _config_changed = 1;
+    if (nvs_open(WIFI_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+        return;
+    if (nvs_erase_key(handle, "ap") == ESP_OK)
+        nvs_commit(handle);
+    nvs_close(handle);
+}
+
+void _record_connect_time(void) {
+    uint32_t elapsed_ms;
+
+    if (_connect_start_us < 0)
+        return;
+    elapsed_ms = (esp_timer_get_time() - _connect_start_us) / 1000;
+    _connect_start_us = -1;
+
+    _stats.successes++;
+    _stats.last_ms   = elapsed_ms;
+    _stats.total_ms += elapsed_ms;
+    if (_stats.min_ms == 0 || elapsed_ms < _stats.min_ms)
+        _stats.min_ms = elapsed_ms;
+    if (elapsed_ms > _stats.max_ms)
+        _stats.max_ms = elapsed_ms;
+    ESP_LOGI(
+        "WiFi-Handler", "Connected in %" PRIu32 "ms (min: %" PRIu32 "ms | avg: %" PRIu32 "ms | max: %" PRIu32 "ms | attempts: %" PRIu32 ")",
+        elapsed_ms, _stats.min_ms, (uint32_t)(_stats.total_ms / _stats.successes), _stats.max_ms, _stats.attempts
+    );
+}
+
 void _wifi_handler(
     void *arg,
     esp_event_base_t event_base,
     int32_t event_id,
     void *event_data
 ) {
+    xSemaphoreTake(_wifi_lock, portMAX_DELAY);
     switch (event_id) {
         case WIFI_EVENT_STA_CONNECTED:
             ESP_LOGI("WiFi-Handler", "WiFi Connected");
@@ -52,12 +206,31 @@ void _wifi_handler(
             addr.addr = ((ip_event_got_ip_t *)event_data)->ip_info.ip.addr;
             ESP_LOGI("WiFi-Handler", "Got IP Addr %d.%d.%d.%d", addr.digit[0], addr.digit[1], addr.digit[2], addr.digit[3]);
             _wifi_status |= 0x02;
+            _reconnect_backoff_ms = 0;
+            _cache_failures = 0;
+            _record_connect_time();
+            _save_ap_cache();
             break;
         case WIFI_EVENT_STA_DISCONNECTED:
-            ESP_LOGI("WiFi-Handler", "WiFi Disconnected");
+            ESP_LOGI(
+                "WiFi-Handler", "WiFi Disconnected (Reason: %d)",
+                ((wifi_event_sta_disconnected_t *)event_data)->reason
+            );
+            if (_wifi_paused) {
+                _wifi_status &= ~0x03;
+                break;
+            }
+            _stats.disconnects++;
+            // Only connects which never got an IP count against the cache, not drops of a working link
+            if (!(_wifi_status & 0x02) && WIFI_CFG.sta.bssid_set && ++_cache_failures >= WIFI_CACHE_MAX_FAILURES) {
+                _cache_failures = 0;
+                _drop_ap_cache();
+            }
             _wifi_status &= ~0x03;
+            _schedule_reconnect();
             break;
     }
+    xSemaphoreGive(_wifi_lock);
 }
 
 void register_wifi_status_handler(void) {
@@ -74,10 +247,21 @@ void register_wifi_status_handler(void) {
 
 esp_err_t init_wifi(void) {
     wifi_init_config_t wifi_init_cfg = WIFI_INIT_CONFIG_DEFAULT();
+    esp_err_t err;
 
     ESP_LOGI("init_wifi", "Start init wifi...");
 
+    _wifi_lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(_wifi_lock != NULL, ESP_ERR_NO_MEM, "Wi-Fi:init_wifi", "Failed to create wifi lock.");
+
+    const esp_timer_create_args_t reconnect_timer_args = {
+        .callback = &_reconnect_timer_callback,
+        .name     = "wifi_reconnect"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&reconnect_timer_args, &_reconnect_timer));
+
     ESP_ERROR_CHECK(nvs_flash_init());
+    _load_ap_cache();
 
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
@@ -91,10 +275,10 @@ esp_err_t init_wifi(void) {
     register_wifi_status_handler();
 
     ESP_ERROR_CHECK(esp_wifi_start());
-    ESP_RETURN_ON_ERROR(
-        esp_wifi_connect(),
-        "Wi-Fi:init_wifi", "Failed to connect wifi."
-    );
+    xSemaphoreTake(_wifi_lock, portMAX_DELAY);
+    err = _wifi_connect();
+    xSemaphoreGive(_wifi_lock);
+    ESP_RETURN_ON_ERROR(err, "Wi-Fi:init_wifi", "Failed to connect wifi.");
     for (int i = 0; (_wifi_status & 0x03) != 0x03; i++) {
         if (i == 10) {
             ESP_LOGW("Wi-Fi:init_wifi", "Failed to connect to a Wi-Fi AP.");
@@ -106,6 +290,14 @@ esp_err_t init_wifi(void) {
     return ESP_OK;
 }
 
+void init_time_sync(void) {
+    setenv("TZ", LOCAL_TIMEZONE, 1);
+    tzset();
+    esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, SNTP_SERVER);
+    esp_sntp_init();
+}
+
 #ifdef ENABLE_WIFI_POWERSAVE
 esp_err_t enable_wifi_pm(void) {
     ESP_ERROR_CHECK(esp_wifi_set_inactive_time(WIFI_IF_STA, WIFI_BEACON_TIMEOUT));
@@ -114,41 +306,39 @@ esp_err_t enable_wifi_pm(void) {
 }
 #endif
 
-esp_err_t chech_and_reconnect_wifi(void) {
-    if (!(_wifi_status & 0x01)) {
-        ESP_LOGI("Wi-Fi:reconnect_wifi", "Trying to reconnect wifi...");
-        ESP_RETURN_ON_ERROR(
-            esp_wifi_connect(),
-            "Wi-Fi:reconnect_wifi", "Failed to connect wifi."
-        );
-        for (int i = 0; (_wifi_status & 0x03) != 0x03; i++) {
-            if (i == 10) {
-                ESP_LOGW("Wi-Fi:reconnect_wifi", "WiFi connect timeout");
-                return ESP_ERR_TIMEOUT;
-            }
-            vTaskDelay(pdMS_TO_TICKS(500));
-        }
-    }
-    return ESP_OK;
+void get_wifi_connect_stats(wifi_connect_stats *result) {
+    xSemaphoreTake(_wifi_lock, portMAX_DELAY);
+    *result = _stats;
+    xSemaphoreGive(_wifi_lock);
 }
 
 esp_err_t pause_wifi(void) {
+    xSemaphoreTake(_wifi_lock, portMAX_DELAY);
+    _wifi_paused = 1;
+    esp_timer_stop(_reconnect_timer);
+    xSemaphoreGive(_wifi_lock);
     return esp_wifi_stop();
 }
 
 esp_err_t resume_wifi(void) {
     wifi_init_config_t wifi_init_cfg = WIFI_INIT_CONFIG_DEFAULT();
+    esp_err_t err;
 
+    xSemaphoreTake(_wifi_lock, portMAX_DELAY);
+    _wifi_paused = 0;
+    _reconnect_backoff_ms = 0;
+    _config_changed = 0;  // Set below
+    xSemaphoreGive(_wifi_lock);
     ESP_ERROR_CHECK(esp_wifi_init(&wifi_init_cfg));
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &WIFI_CFG));
     ESP_ERROR_CHECK(esp_wifi_set_protocol(WIFI_IF_STA, WIFI_PROTOCOL_11B|WIFI_PROTOCOL_11G|WIFI_PROTOCOL_11N));
     ESP_ERROR_CHECK(esp_wifi_set_country(&WIFI_COUNTRY));
     ESP_ERROR_CHECK(esp_wifi_start());
-    ESP_RETURN_ON_ERROR(
-        esp_wifi_connect(),
-        "Wi-Fi:resume_wifi", "Failed to connect wifi."
-    );
+    xSemaphoreTake(_wifi_lock, portMAX_DELAY);
+    err = _wifi_connect();
+    xSemaphoreGive(_wifi_lock);
+    ESP_RETURN_ON_ERROR(err, "Wi-Fi:resume_wifi", "Failed to connect wifi.");
     for (int i = 0; (_wifi_status & 0x03) != 0x03; i++) {
         if (i == 25) {
             ESP_LOGW("Wi-Fi:resume_wifi", "WiFi connect timeout (Status: 0x%02x)", _wifi_status);
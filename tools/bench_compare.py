@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""Compare benchmark results of ENABLE_BENCHMARK builds.
+
+Usage:
+    idf.py monitor | tee bench.log                       # Capture a run
+    bench_compare.py bench.log --save baseline.csv       # Store it as a baseline
+    bench_compare.py bench.log baseline.csv [--threshold 10]
+
+make -C tools/host bench runs the same benchmarks on the host and compares them with
+tools/host/bench_baseline.csv, which make -C tools/host bench_baseline stores. Host and
+device results are not comparable with each other; host cycles are 0.
+
+Inputs are serial logs or saved CSV files. Only "BENCH," lines are used, and of a
+benchmark in several runs, the fastest.
+Exits with 1 when any benchmark is slower than the threshold (percent),
+or allocates more per operation than the baseline.
+"""
+import argparse
+import csv
+import sys
+
+FIELDS = ('name', 'iterations', 'ns_per_op', 'cycles_per_op', 'allocs_per_op', 'bytes_per_op')
+
+
+def load(path):
+    results = {}
+    with open(path, encoding='utf-8', errors='replace') as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith('BENCH,'):
+                line = line[len('BENCH,'):]
+            row = next(csv.reader([line]))
+            if len(row) != len(FIELDS) or row[0] == 'name':
+                continue
+            try:
+                result = dict(zip(FIELDS[1:], map(float, row[1:])))
+            except ValueError:
+                continue
+            if row[0] not in results or result['ns_per_op'] < results[row[0]]['ns_per_op']:
+                results[row[0]] = result
+    return results
+
+
+def save(results, path):
+    with open(path, 'w', newline='', encoding='utf-8') as f:
+        out = csv.writer(f, lineterminator='\n')
+        out.writerow(FIELDS)
+        for name, result in results.items():
+            out.writerow((name,) + tuple(result[field] for field in FIELDS[1:]))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('current')
+    parser.add_argument('baseline', nargs='?')
+    parser.add_argument('--save', metavar='PATH', help='store current results as a baseline')
+    parser.add_argument('--threshold', type=float, default=10.0, help='allowed slowdown in percent')
+    args = parser.parse_args()
+
+    current = load(args.current)
+    if not current:
+        sys.exit(f'No benchmark results in {args.current}')
+    if args.save:
+        save(current, args.save)
+    if not args.baseline:
+        return
+
+    baseline = load(args.baseline)
+    regressed = False
+    print(f'{"name":32} {"base ns":>10} {"ns":>10} {"delta":>8} {"base allocs":>12} {"allocs":>8}')
+    for name, result in current.items():
+        base = baseline.get(name)
+        if base is None:
+            print(f'{name:32} {"-":>10} {result["ns_per_op"]:>10.0f} {"new":>8}')
+            continue
+        delta = (result['ns_per_op'] / base['ns_per_op'] - 1) * 100 if base['ns_per_op'] else 0.0
+        more_allocs = 0 <= base['allocs_per_op'] < result['allocs_per_op']
+        mark = ' !' if delta > args.threshold or more_allocs else ''
+        regressed |= bool(mark)
+        print(
+            f'{name:32} {base["ns_per_op"]:>10.0f} {result["ns_per_op"]:>10.0f} {delta:>+7.1f}%'
+            f' {base["allocs_per_op"]:>12.2f} {result["allocs_per_op"]:>8.2f}{mark}'
+        )
+    for name in baseline.keys() - current.keys():
+        print(f'{name:32} missing in current results')
+    sys.exit(1 if regressed else 0)
+
+
+if __name__ == '__main__':
+    main()
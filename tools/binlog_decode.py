@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+"""Decode raw binlog frames (BINLOG_RAW_OUTPUT) into log lines.
+
+Usage: binlog_decode.py [capture.bin]  (reads stdin when omitted)
+
+Formats are taken from BINLOG_FORMATS in main/include/binlog.h, so the decoder
+always matches the firmware built from the same tree.
+"""
+import os
+import re
+import struct
+import sys
+
+HEADER = os.path.join(os.path.dirname(__file__), '..', 'main', 'include', 'binlog.h')
+MAGIC = 0xB10C
+FRAME = struct.Struct('<HHI3I')
+LEVELS = {'ESP_LOG_ERROR': 'E', 'ESP_LOG_WARN': 'W', 'ESP_LOG_INFO': 'I', 'ESP_LOG_DEBUG': 'D', 'ESP_LOG_VERBOSE': 'V'}
+ENTRY = re.compile(r'X\((\w+),\s*(\w+),\s*"([^"]*)",\s*"([^"]*)"\)')
+SPEC = re.compile(r'%[-+ #0-9.]*[a-zA-Z%]')
+TICK_RATE_HZ = 100
+
+
+def load_formats(path):
+    with open(path, encoding='utf-8') as f:
+        text = f.read()
+    table = text[text.index('#define BINLOG_FORMATS'):]
+    return [m.groups() for m in ENTRY.finditer(table[:table.index('\n\n')])]
+
+
+def format_line(fmt, args):
+    args = iter(args)
+
+    def convert(m):
+        spec = m.group(0)
+        if spec == '%%':
+            return '%'
+        value = next(args)
+        if spec[-1] in 'fgeFGE':
+            value = struct.unpack('<f', struct.pack('<I', value))[0]
+        elif spec[-1] in 'di':
+            value = struct.unpack('<i', struct.pack('<I', value))[0]
+        return spec % value
+
+    return SPEC.sub(convert, fmt)
+
+
+def main():
+    formats = load_formats(HEADER)
+    stream = open(sys.argv[1], 'rb') if len(sys.argv) > 1 else sys.stdin.buffer
+    data = stream.read()
+    pos = 0
+    while pos + FRAME.size <= len(data):
+        magic, fid, tick, *args = FRAME.unpack_from(data, pos)
+        if magic != MAGIC or fid >= len(formats):
+            pos += 1  # Resync on interleaved text output
+            continue
+        pos += FRAME.size
+        _, level, tag, fmt = formats[fid]
+        print(f'{LEVELS.get(level, "?")} ({tick * 1000 // TICK_RATE_HZ}) {tag}: {format_line(fmt, args)}')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""Measure the change detector of main/change_detector.cpp on a recorded trace.
+
+Usage: trace_decode.py trace.bin | change_eval.py [--config main/configs/config.h] [--tick-hz 100]
+
+Runs the same detector as the firmware, with the CHANGE_DETECT_* values of config.h, over the
+raw samples of a trace (CSV of trace_decode.py). PM2.5 samples count only while the fan is ready.
+  - false positives: changes on the trace as recorded. Record a trace without events for this,
+    or pass the events it has with --events, which are not counted.
+  - detection delay: steps are added to the recorded samples at --injections places, held for
+    --hold samples. Reports detected steps and the delay from the step to the change,
+    in samples and seconds.
+Without a recording, trace_synth.py writes a synthetic trace to try the tool on.
+"""
+import argparse
+import copy
+import csv
+import math
+import os
+import re
+import statistics
+import sys
+
+FAN_STATE_READY = 2
+CHANNELS = {
+    # column: (minimum sigma define, default steps)
+    'fine_dust': ('CHANGE_DETECT_MIN_SIGMA_FINE_DUST', (10, 25, 50)),
+    'tvoc': ('CHANGE_DETECT_MIN_SIGMA_TVOC', (100, 250, 500)),
+}
+PARAMS = ('ALPHA', 'K', 'H', 'CLIP', 'WARMUP')
+
+
+def read_config(path):
+    defines = {}
+    with open(path) as f:
+        for match in re.finditer(r'^#define\s+(CHANGE_DETECT_\w+)\s+([\d.]+)f?', f.read(), re.M):
+            defines[match.group(1)] = float(match.group(2))
+    missing = [f'CHANGE_DETECT_{name}' for name in PARAMS if f'CHANGE_DETECT_{name}' not in defines]
+    if missing:
+        sys.exit(f'{path} has no {", ".join(missing)}')
+    return defines
+
+
+class Detector:
+    """Port of ChangeDetector::add()."""
+
+    def __init__(self, config, min_sigma):
+        self.alpha, self.k, self.h = config['CHANGE_DETECT_ALPHA'], config['CHANGE_DETECT_K'], config['CHANGE_DETECT_H']
+        self.clip, self.warmup = config['CHANGE_DETECT_CLIP'], config['CHANGE_DETECT_WARMUP']
+        self.min_sigma = min_sigma
+        self.mean = self.variance = self.cusum = 0.0
+        self.samples = 0
+
+    def add(self, x):
+        self.samples += 1
+        if self.samples == 1:
+            self.mean = x
+            return False
+        deviation = x - self.mean
+        sigma = max(math.sqrt(self.variance), self.min_sigma)
+        z = deviation / sigma
+        if self.samples > self.warmup:
+            self.cusum = max(0.0, self.cusum + z - self.k)
+            if self.cusum > self.h:
+                self.cusum = 0.0
+                self.mean = x
+                return True
+        deviation = max(-self.clip * sigma, min(self.clip * sigma, deviation))
+        self.mean += self.alpha * deviation
+        self.variance = (1 - self.alpha) * (self.variance + self.alpha * deviation * deviation)
+        return False
+
+
+def read_samples(stream):
+    """Returns {column: [(tick, value)]} of valid raw samples."""
+    series = {column: [] for column in CHANNELS}
+    for row in csv.DictReader(stream):
+        if row['type'] != 'sample':
+            continue
+        tick = int(row['tick'])
+        if row['fine_dust'] != '' and int(row['fan']) == FAN_STATE_READY:
+            series['fine_dust'].append((tick, int(row['fine_dust'])))
+        if row['tvoc'] != '':
+            series['tvoc'].append((tick, int(row['tvoc'])))
+    return series
+
+
+def in_events(tick, events):
+    return any(start <= tick <= end for start, end in events)
+
+
+def false_positives(config, column, samples, events):
+    detector = Detector(config, config[CHANNELS[column][0]])
+    return [tick for tick, value in samples if detector.add(value) and not in_events(tick, events)]
+
+
+def injected_delays(config, column, samples, step, injections, hold, tick_hz):
+    """Returns delays of detected steps as (samples, seconds), and the number of steps tried."""
+    min_sigma = config[CHANNELS[column][0]]
+    first = int(config['CHANGE_DETECT_WARMUP']) * 4
+    last = len(samples) - hold
+    if last <= first:
+        return [], 0
+    positions = sorted({first + (last - first) * i // injections for i in range(injections)})
+    delays = []
+    # The detector runs from the start, so that its baseline is the one of the device
+    baseline, done = Detector(config, min_sigma), 0
+    for position in positions:
+        for tick, value in samples[done:position]:
+            baseline.add(value)
+        done = position
+        detector = copy.copy(baseline)
+        for i in range(hold):
+            tick, value = samples[position + i]
+            if detector.add(value + step):
+                # From the last sample before the step, as the step happened in between
+                delays.append((i + 1, (tick - samples[position - 1][0]) / tick_hz))
+                break
+    return delays, len(positions)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser()
+    parser.add_argument('csv', nargs='?', help='output of trace_decode.py, stdin when omitted')
+    parser.add_argument('--config', default=os.path.join(here, '..', 'main', 'configs', 'config.h'))
+    parser.add_argument('--tick-hz', type=int, default=100, help='CONFIG_FREERTOS_HZ')
+    parser.add_argument('--injections', type=int, default=50, help='steps per channel and size')
+    parser.add_argument('--hold', type=int, default=20, help='samples each step lasts')
+    parser.add_argument('--fine-dust-steps', type=int, nargs='+', default=CHANNELS['fine_dust'][1])
+    parser.add_argument('--tvoc-steps', type=int, nargs='+', default=CHANNELS['tvoc'][1])
+    parser.add_argument('--events', nargs='*', default=[], metavar='START:END', help='tick ranges of real events')
+    args = parser.parse_args()
+
+    config = read_config(args.config)
+    events = [tuple(int(tick) for tick in event.split(':')) for event in args.events]
+    stream = open(args.csv, newline='') if args.csv else sys.stdin
+    series = read_samples(stream)
+    steps = {'fine_dust': args.fine_dust_steps, 'tvoc': args.tvoc_steps}
+
+    for column, samples in series.items():
+        if len(samples) < 2:
+            print(f'{column}: no samples')
+            continue
+        hours = (samples[-1][0] - samples[0][0]) / args.tick_hz / 3600
+        changes = false_positives(config, column, samples, events)
+        rate = f'{len(changes) / hours * 24:.2f}/day' if hours > 0 else '-'
+        print(f'{column}: {len(samples)} samples over {hours:.1f}h, {len(changes)} false positives ({rate})')
+        for change in changes:
+            print(f'  at tick {change}')
+        for step in steps[column]:
+            delays, tried = injected_delays(config, column, samples, step, args.injections, args.hold, args.tick_hz)
+            if not delays:
+                print(f'  +{step}: detected 0/{tried}')
+                continue
+            counts = [count for count, _ in delays]
+            seconds = [second for _, second in delays]
+            print(
+                f'  +{step}: detected {len(delays)}/{tried}, '
+                f'delay median {statistics.median(counts):.0f} samples ({statistics.median(seconds):.1f}s), '
+                f'max {max(counts)} samples ({max(seconds):.1f}s)'
+            )
+
+
+if __name__ == '__main__':
+    main()
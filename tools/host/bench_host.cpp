@@ -0,0 +1,92 @@
+// The benchmarks of main/benchmark.cpp on the host.
+//
+// Built with ENABLE_BENCHMARK and CONFIG_HEAP_USE_HOOKS, and malloc(), calloc() and realloc()
+// are wrapped to call esp_heap_trace_alloc_hook() as the heap of ESP-IDF does, so that the
+// allocations per operation are counted. Prints the BENCH rows of benchmark_task(), with 0
+// cycles per operation. tools/bench_compare.py compares them with bench_baseline.csv.
+//
+// fill_strip_pixels() of io.cpp links the drivers of the device. It is the same loop here,
+// over a led_strip_set_pixel() which writes a pixel buffer as the RMT strip does.
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_check.h"
+
+#include "io.h"
+#include "benchmark.h"
+#include "smartthings/st_client.h"
+
+#define STRIP_PIXEL_CNT 8
+
+static uint8_t stripBuffer[STRIP_PIXEL_CNT * 3];
+
+
+extern "C" {
+void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps);
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    if (ptr != NULL)
+        esp_heap_trace_alloc_hook(ptr, size, 0);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    void *ptr = __real_calloc(n, size);
+    if (ptr != NULL)
+        esp_heap_trace_alloc_hook(ptr, n * size, 0);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    ptr = __real_realloc(ptr, size);
+    if (ptr != NULL)
+        esp_heap_trace_alloc_hook(ptr, size, 0);
+    return ptr;
+}
+
+// Unused, the benchmarks only build and parse bodies
+esp_err_t st_client_request(
+    const char *method, const char *url, const char *token,
+    const st_client_chunk *body, int body_cnt, cJSON **response_json, st_client_result *result
+) {
+    return ESP_FAIL;
+}
+
+void log_st_client_stats(void) {}
+}
+
+static esp_err_t _led_strip_set_pixel(uint32_t index, uint32_t red, uint32_t green, uint32_t blue) {
+    if (index >= STRIP_PIXEL_CNT)
+        return ESP_ERR_INVALID_ARG;
+    stripBuffer[index * 3 + 0] = green;  // GRB, as the WS2812 takes it
+    stripBuffer[index * 3 + 1] = red;
+    stripBuffer[index * 3 + 2] = blue;
+    return ESP_OK;
+}
+
+esp_err_t fill_strip_pixels(led_pixel *pixels) {
+    led_pixel pixel;
+    int bright;
+    for (int i = 0; i < STRIP_PIXEL_CNT; i++) {
+        pixel = pixels[i];
+        bright = 8 - pixel.bright;
+        ESP_RETURN_ON_ERROR(_led_strip_set_pixel(
+            i, pixel.r >> bright, pixel.g >> bright, pixel.b >> bright
+        ), "set_strip_pixels", "");
+    }
+    return ESP_OK;
+}
+
+// benchmark_task() ends with vTaskDelete(NULL), which ends the main thread and so the process
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_WARN);
+    benchmark_task(NULL);
+    return 0;
+}
@@ -0,0 +1,83 @@
+// Call site cost of main/binlog.c in deferred mode against a synchronous ESP_LOGI().
+//
+//   - Writes BURST_CNT bursts of BINLOG_RING_SIZE / 2 records, the BL_TEMPHUMI line of
+//     get_temphumi(), and lets the drain task emit each burst before the next. Prints the
+//     time per binlog_write() and checks that nothing is dropped.
+//   - Logs the same line as many times with ESP_LOGI(), formatted in the caller.
+//   - Writes 4 * BINLOG_RING_SIZE records at once and prints how many are dropped.
+// Logs go to stderr, which is /dev/null here, so the synchronous time is formatting and
+// a write() per line, not the blocking on the UART of the device. Checks that the deferred
+// write is cheaper.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "config.h"
+#include "binlog.h"
+#include "check.h"
+
+#define BURST     (BINLOG_RING_SIZE / 2)
+#define BURST_CNT 20
+#define TEMPERATURE 23.4f
+#define HUMIDITY    45
+
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Waits until the drain task emitted the records written so far
+static void _drain(void) {
+    vTaskDelay(pdMS_TO_TICKS(BINLOG_DRAIN_INTERVAL * 3 / 2));
+}
+
+int main(void) {
+    uint64_t start, deferred_ns = 0, sync_ns = 0;
+    binlog_stats stats;
+    uint32_t dropped;
+
+    if (freopen("/dev/null", "w", stderr) == NULL)
+        return 1;
+    esp_log_level_set("*", ESP_LOG_INFO);
+    binlog_init();
+
+    for (int i = 0; i < BURST_CNT; i++) {
+        start = now_ns();
+        for (int j = 0; j < BURST; j++)
+            BINLOG(BL_TEMPHUMI, binlog_float(TEMPERATURE), HUMIDITY);
+        deferred_ns += now_ns() - start;
+        _drain();
+    }
+    binlog_get_stats(&stats);
+    dropped = stats.dropped;
+
+    for (int i = 0; i < BURST_CNT; i++) {
+        start = now_ns();
+        for (int j = 0; j < BURST; j++)
+            ESP_LOGI("IO:get_temphumi", "Temperature: %.01f°C | Humidity: %d%%", TEMPERATURE, HUMIDITY);
+        sync_ns += now_ns() - start;
+    }
+
+    printf(
+        "deferred binlog_write: %" PRIu64 "ns per call, %" PRIu32 " of %d dropped\n",
+        deferred_ns / (BURST * BURST_CNT), dropped, BURST * BURST_CNT
+    );
+    printf("synchronous ESP_LOGI: %" PRIu64 "ns per call\n", sync_ns / (BURST * BURST_CNT));
+    CHECK(dropped == 0, "%" PRIu32 " records of bursts within the ring dropped", dropped);
+    CHECK(deferred_ns < sync_ns, "deferred write is slower");
+
+    for (int i = 0; i < 4 * BINLOG_RING_SIZE; i++)
+        BINLOG(BL_TEMPHUMI, binlog_float(TEMPERATURE), HUMIDITY);
+    binlog_get_stats(&stats);
+    printf("burst of %d: %" PRIu32 " dropped\n", 4 * BINLOG_RING_SIZE, stats.dropped - dropped);
+    _drain();
+
+    return check_result();
+}
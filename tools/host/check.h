@@ -0,0 +1,21 @@
+// Checks of the host tests. A failed CHECK() prints its message and the test goes on,
+// so that one run shows every failure. main() ends with `return check_result();`.
+#pragma once
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(condition, ...) do {                    \
+        if (!(condition)) {                           \
+            printf("FAIL: " __VA_ARGS__);             \
+            printf("\n");                             \
+            failures++;                               \
+        }                                             \
+    } while (0)
+
+// Prints PASS or FAILED. Returns the exit code.
+static inline int check_result(void) {
+    printf(failures == 0 ? "PASS\n" : "FAILED\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+// The cJSON calls of main/smartthings/request.c for host builds which parse real responses.
+// A small recursive descent parser of RFC 8259 JSON. \u escapes outside ASCII become '?',
+// and cJSON_Print() prints nothing useful. Enough for the responses of tools/st_standin.py.
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cJSON.h"
+
+#define CJSON_FALSE  (1 << 0)
+#define CJSON_TRUE   (1 << 1)
+#define CJSON_NULL   (1 << 2)
+#define CJSON_NUMBER (1 << 3)
+#define CJSON_STRING (1 << 4)
+#define CJSON_ARRAY  (1 << 5)
+#define CJSON_OBJECT (1 << 6)
+#define MAX_DEPTH    32
+
+
+static cJSON *_parse_value(const char **p, int depth);
+
+static void _skip(const char **p) {
+    while (isspace((unsigned char)**p))
+        (*p)++;
+}
+
+// Returns a new string without the quotes, or NULL when it is not terminated
+static char *_parse_string(const char **p) {
+    const char *start = ++*p;
+    char *result, *out;
+
+    while (**p != '"') {
+        if (**p == '\0' || (**p == '\\' && (*p)[1] == '\0'))
+            return NULL;
+        *p += **p == '\\' ? 2 : 1;
+    }
+    if ((result = out = malloc(*p - start + 1)) == NULL)
+        return NULL;
+    for (const char *in = start; in < *p; in++) {
+        if (*in != '\\') {
+            *out++ = *in;
+            continue;
+        }
+        switch (*++in) {
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u':
+                if (in + 4 >= *p) {
+                    free(result);
+                    return NULL;
+                }
+                unsigned long code = strtoul((char[5]){in[1], in[2], in[3], in[4], '\0'}, NULL, 16);
+                *out++ = code < 0x80 ? (char)code : '?';
+                in += 4;
+                break;
+            default: *out++ = *in;  // \" \\ \/
+        }
+    }
+    *out = '\0';
+    (*p)++;
+    return result;
+}
+
+// Object members and array elements, as a list of children
+static cJSON *_parse_container(const char **p, cJSON *item, char close, int depth) {
+    cJSON *last = NULL, *child;
+    char *name = NULL;
+
+    (*p)++;
+    _skip(p);
+    if (**p == close) {
+        (*p)++;
+        return item;
+    }
+    while (1) {
+        if (close == '}') {
+            _skip(p);
+            if (**p != '"' || (name = _parse_string(p)) == NULL)
+                return NULL;
+            _skip(p);
+            if (*(*p)++ != ':') {
+                free(name);
+                return NULL;
+            }
+        }
+        if ((child = _parse_value(p, depth + 1)) == NULL) {
+            free(name);
+            return NULL;
+        }
+        child->string = name;
+        name = NULL;
+        child->prev = last;
+        if (last == NULL)
+            item->child = child;
+        else
+            last->next = child;
+        last = child;
+        _skip(p);
+        if (**p == close) {
+            (*p)++;
+            return item;
+        }
+        if (*(*p)++ != ',')
+            return NULL;
+    }
+}
+
+static cJSON *_parse_value(const char **p, int depth) {
+    cJSON *item;
+    char *end;
+
+    _skip(p);
+    if (depth > MAX_DEPTH || (item = calloc(1, sizeof(cJSON))) == NULL)
+        return NULL;
+    if (**p == '{' || **p == '[') {
+        item->type = **p == '{' ? CJSON_OBJECT : CJSON_ARRAY;
+        if (_parse_container(p, item, **p == '{' ? '}' : ']', depth) != NULL)
+            return item;
+    } else if (**p == '"') {
+        item->type = CJSON_STRING;
+        if ((item->valuestring = _parse_string(p)) != NULL)
+            return item;
+    } else if (strncmp(*p, "true", 4) == 0 || strncmp(*p, "false", 5) == 0 || strncmp(*p, "null", 4) == 0) {
+        item->type = **p == 't' ? CJSON_TRUE : **p == 'f' ? CJSON_FALSE : CJSON_NULL;
+        item->valueint = **p == 't';
+        *p += **p == 'f' ? 5 : 4;
+        return item;
+    } else {
+        item->valuedouble = strtod(*p, &end);
+        if (end != *p) {
+            item->type = CJSON_NUMBER;
+            item->valueint = (int)item->valuedouble;
+            *p = end;
+            return item;
+        }
+    }
+    cJSON_Delete(item);
+    return NULL;
+}
+
+cJSON *cJSON_Parse(const char *value) {
+    const char *p = value;
+    cJSON *item = _parse_value(&p, 0);
+
+    if (item != NULL) {
+        _skip(&p);
+        if (*p != '\0') {
+            cJSON_Delete(item);
+            return NULL;
+        }
+    }
+    return item;
+}
+
+cJSON *cJSON_ParseWithLength(const char *value, size_t length) {
+    char *copy = malloc(length + 1);
+    cJSON *item;
+
+    if (copy == NULL)
+        return NULL;
+    memcpy(copy, value, length);
+    copy[length] = '\0';
+    item = cJSON_Parse(copy);
+    free(copy);
+    return item;
+}
+
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *string) {
+    if (object == NULL || object->type != CJSON_OBJECT)
+        return NULL;
+    for (cJSON *child = object->child; child != NULL; child = child->next) {
+        if (child->string != NULL && strcmp(child->string, string) == 0)
+            return child;
+    }
+    return NULL;
+}
+
+char *cJSON_GetStringValue(const cJSON *item) {
+    return item != NULL && item->type == CJSON_STRING ? item->valuestring : NULL;
+}
+
+int cJSON_IsNumber(const cJSON *item) { return item != NULL && item->type == CJSON_NUMBER; }
+int cJSON_IsString(const cJSON *item) { return item != NULL && item->type == CJSON_STRING; }
+int cJSON_IsBool(const cJSON *item) { return item != NULL && (item->type & (CJSON_TRUE | CJSON_FALSE)); }
+int cJSON_IsTrue(const cJSON *item) { return item != NULL && item->type == CJSON_TRUE; }
+
+char *cJSON_Print(const cJSON *item) {
+    return strdup("(not printed on the host)");
+}
+
+void cJSON_Delete(cJSON *item) {
+    cJSON *next;
+
+    while (item != NULL) {
+        next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
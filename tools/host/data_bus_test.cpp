@@ -0,0 +1,149 @@
+// Slow consumers must never block the producer of main/data_bus.cpp.
+//
+// The producer publishes every PUBLISH_PERIOD_US for PUBLISH_CNT snapshots.
+//   - "slow" (depth 1, drop oldest) takes SLOW_WORK_US per snapshot, 20 times the period.
+//   - "stalled" (depth 1, drop newest) holds its first snapshot until the producer is done.
+//   - a latest reader acquires and releases the newest snapshot in a loop.
+// Checks that every publish succeeds in far less than a consumer's work, that the
+// slow consumers lose snapshots by their policy instead, and that no snapshot leaks.
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "config.h"
+#include "data_bus.h"
+#include "check.h"
+
+#define PUBLISH_CNT        2000
+#define PUBLISH_PERIOD_US  1000
+#define SLOW_WORK_US       20000
+#define MAX_PUBLISH_US     5000  // A quarter of SLOW_WORK_US; blocking once would exceed it
+
+
+static int slowId, stalledId;
+static std::atomic<bool> producerDone = false, slowDone = false, latestDone = false;
+static std::atomic<uint32_t> slowOutOfOrder = 0, latestReads = 0;
+
+
+static uint64_t now_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void slow_task(void *) {
+    uint32_t lastSeq = 0;
+    const data_bus_snapshot *snapshot;
+
+    while ((snapshot = data_bus_receive(slowId, pdMS_TO_TICKS(100))) != NULL || !producerDone) {
+        if (snapshot == NULL)
+            continue;
+        if (snapshot->seq <= lastSeq)
+            slowOutOfOrder++;
+        lastSeq = snapshot->seq;
+        usleep(SLOW_WORK_US);
+        data_bus_release(snapshot);
+    }
+    slowDone = true;
+    vTaskDelete(NULL);
+}
+
+static void latest_task(void *) {
+    while (!producerDone) {
+        const data_bus_snapshot *snapshot = data_bus_acquire_latest();
+        if (snapshot != NULL) {
+            latestReads++;
+            data_bus_release(snapshot);
+        }
+        usleep(100);
+    }
+    latestDone = true;
+    vTaskDelete(NULL);
+}
+
+int main() {
+    sensor_values values = {};
+    derived_metrics derived = {};
+    data_bus_subscriber_stats stats;
+    const data_bus_snapshot *held = NULL, *snapshot;
+    uint64_t start, elapsed, worst = 0, total;
+    uint32_t failed = 0;
+
+    esp_log_level_set("*", ESP_LOG_WARN);
+    init_data_bus();
+    slowId    = data_bus_subscribe("slow", 1, DATA_BUS_DROP_OLDEST);
+    stalledId = data_bus_subscribe("stalled", 1, DATA_BUS_DROP_NEWEST);
+    xTaskCreate(slow_task, "slow", 4096, NULL, 5, NULL);
+    xTaskCreate(latest_task, "latest", 4096, NULL, 5, NULL);
+
+    total = now_us();
+    for (int i = 0; i < PUBLISH_CNT; i++) {
+        values.fine_dust = i;
+        start = now_us();
+        if (data_bus_publish(&values, &derived) != ESP_OK)
+            failed++;
+        elapsed = now_us() - start;
+        if (elapsed > worst)
+            worst = elapsed;
+        if (i == 0) {
+            // The stalled consumer takes the first snapshot and never comes back during the run
+            held = data_bus_receive(stalledId, 0);
+            CHECK(held != NULL && held->seq == 1, "stalled consumer did not get the first snapshot");
+        }
+        usleep(PUBLISH_PERIOD_US);
+    }
+    total = now_us() - total;
+    producerDone = true;
+    while (!slowDone || !latestDone)
+        usleep(1000);
+
+    printf(
+        "published %d in %" PRIu64 "ms, worst publish %" PRIu64 "us, failed %" PRIu32 ", latest reads %" PRIu32 "\n",
+        PUBLISH_CNT, total / 1000, worst, failed, latestReads.load()
+    );
+    CHECK(failed == 0, "%" PRIu32 " publishes failed, the pool ran dry", failed);
+    CHECK(worst < MAX_PUBLISH_US, "a publish took %" PRIu64 "us", worst);
+    // Had the producer waited for "slow", the run would take PUBLISH_CNT * SLOW_WORK_US
+    CHECK(total < (uint64_t)PUBLISH_CNT * SLOW_WORK_US / 4, "producer was held back by consumers");
+
+    data_bus_get_stats(slowId, &stats);
+    printf(
+        "slow: delivered %" PRIu32 " dropped %" PRIu32 " max_lag %" PRIu32 " max_latency %" PRIu32 "ms\n",
+        stats.delivered, stats.dropped, stats.max_lag, (uint32_t)pdTICKS_TO_MS(stats.max_latency)
+    );
+    CHECK(slowOutOfOrder == 0, "slow consumer received %" PRIu32 " snapshots out of order", slowOutOfOrder.load());
+    CHECK(stats.dropped > 0, "slow consumer dropped nothing");
+    CHECK(stats.delivered + stats.dropped == PUBLISH_CNT, "slow consumer lost track of snapshots");
+    CHECK(stats.last_seq == PUBLISH_CNT, "drop oldest did not keep the newest snapshot");
+
+    // Drop newest keeps the snapshot queued before the stall, and drops all later ones
+    data_bus_release(held);
+    snapshot = data_bus_receive(stalledId, 0);
+    CHECK(snapshot != NULL && snapshot->seq == 2, "drop newest did not keep the oldest snapshot");
+    if (snapshot != NULL)
+        data_bus_release(snapshot);
+    data_bus_get_stats(stalledId, &stats);
+    printf(
+        "stalled: delivered %" PRIu32 " dropped %" PRIu32 " max_lag %" PRIu32 "\n",
+        stats.delivered, stats.dropped, stats.max_lag
+    );
+    CHECK(stats.dropped == PUBLISH_CNT - 2, "stalled consumer dropped %" PRIu32, stats.dropped);
+    CHECK(stats.max_lag == PUBLISH_CNT - 2, "lag of the stalled consumer is %" PRIu32, stats.max_lag);
+
+    // Both queues are full again after one publish. Publishing more than the pool holds
+    // then only succeeds if every dropped snapshot goes back to the pool.
+    held = data_bus_receive(slowId, 0);
+    CHECK(held == NULL, "slow consumer left a snapshot queued");
+    for (int i = 0; i < 2 * DATA_BUS_POOL_SIZE; i++)
+        CHECK(data_bus_publish(&values, &derived) == ESP_OK, "pool leaked snapshots");
+    log_data_bus_stats();
+
+    return check_result();
+}
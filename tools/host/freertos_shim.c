@@ -0,0 +1,396 @@
+// FreeRTOS, esp_log and a few libc/IDF calls for host builds of firmware modules, on pthreads.
+// Tasks run in parallel instead of by priority, which is the harder case for
+// the code under test. Ticks follow CLOCK_MONOTONIC at configTICK_RATE_HZ.
+
+#define _GNU_SOURCE  // PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+struct shim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t length, itemSize, head, count;
+    uint8_t *items;
+};
+
+struct shim_task {
+    TaskFunction_t code;
+    void *parameters;
+    char name[16];
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t value;
+    bool pending;
+};
+
+static pthread_mutex_t _critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static esp_log_level_t _log_level = ESP_LOG_INFO;
+static _Thread_local struct shim_task *_current = NULL;
+static struct shim_task _main_task = {
+    .name = "main", .lock = PTHREAD_MUTEX_INITIALIZER, .notified = PTHREAD_COND_INITIALIZER
+};
+
+
+static uint64_t _now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Absolute deadline for pthread_cond_timedwait (CLOCK_REALTIME), NULL for portMAX_DELAY
+static struct timespec *_deadline(TickType_t ticks, struct timespec *deadline) {
+    if (ticks == portMAX_DELAY)
+        return NULL;
+    clock_gettime(CLOCK_REALTIME, deadline);
+    uint64_t ns = deadline->tv_nsec + (uint64_t)pdTICKS_TO_MS(ticks) * 1000000;
+    deadline->tv_sec += ns / 1000000000;
+    deadline->tv_nsec = ns % 1000000000;
+    return deadline;
+}
+
+// false on timeout
+static bool _wait(pthread_cond_t *cond, pthread_mutex_t *lock, const struct timespec *deadline) {
+    if (deadline == NULL)
+        return pthread_cond_wait(cond, lock) == 0;
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static struct shim_task *_self(void) {
+    return _current != NULL ? _current : &_main_task;
+}
+
+
+void shim_enter_critical(portMUX_TYPE *mux) {
+    (void)mux;
+    pthread_mutex_lock(&_critical);
+}
+
+void shim_exit_critical(portMUX_TYPE *mux) {
+    (void)mux;
+    pthread_mutex_unlock(&_critical);
+}
+
+
+uint32_t esp_random(void) {
+    return (uint32_t)random();
+}
+
+void esp_fill_random(void *buf, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        ((uint8_t*)buf)[i] = (uint8_t)random();
+}
+
+int64_t esp_timer_get_time(void) {
+    return (int64_t)_now_us();
+}
+
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t copied = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, copied);
+        dst[copied] = '\0';
+    }
+    return len;
+}
+#endif
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_NOT_ALLOWED: return "ESP_ERR_NOT_ALLOWED";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    if (strcmp(tag, "*") == 0)
+        _log_level = level;
+}
+
+esp_log_level_t esp_log_level_get(const char *tag) {
+    (void)tag;
+    return _log_level;
+}
+
+uint32_t esp_log_timestamp(void) {
+    return (uint32_t)(_now_us() / 1000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    static const char letters[] = "NEWIDV";
+    va_list args;
+
+    if (level > _log_level)
+        return;
+    flockfile(stderr);
+    fprintf(stderr, "%c (%" PRIu32 ") %s: ", letters[level], esp_log_timestamp(), tag);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+    funlockfile(stderr);
+}
+
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(_now_us() * configTICK_RATE_HZ / 1000000);
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+    TickType_t wakeTime = xTaskGetTickCount();
+    xTaskDelayUntil(&wakeTime, xTicksToDelay);
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *pxPreviousWakeTime, TickType_t xTimeIncrement) {
+    TickType_t wakeTime = *pxPreviousWakeTime + xTimeIncrement;
+    int32_t remaining = (int32_t)(wakeTime - xTaskGetTickCount());
+    struct timespec delay;
+
+    *pxPreviousWakeTime = wakeTime;
+    if (remaining <= 0)
+        return pdFALSE;
+    // Sleep to the tick boundary, as the device wakes on the tick interrupt
+    uint64_t us = (uint64_t)wakeTime * 1000000 / configTICK_RATE_HZ - _now_us();
+    delay.tv_sec = us / 1000000;
+    delay.tv_nsec = (us % 1000000) * 1000;
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR);
+    return pdTRUE;
+}
+
+static void *_task_entry(void *arg) {
+    _current = (struct shim_task*)arg;
+    _current->code(_current->parameters);
+    fprintf(stderr, "Task %s returned. Tasks must delete themselves.\n", _current->name);
+    abort();
+}
+
+BaseType_t xTaskCreate(
+    TaskFunction_t pxTaskCode, const char *pcName, configSTACK_DEPTH_TYPE usStackDepth,
+    void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask
+) {
+    struct shim_task *task = (struct shim_task*)calloc(1, sizeof(struct shim_task));
+    pthread_attr_t attr;
+
+    (void)uxPriority;
+    if (task == NULL)
+        return pdFAIL;
+    task->code = pxTaskCode;
+    task->parameters = pvParameters;
+    strncpy(task->name, pcName, sizeof(task->name) - 1);
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->notified, NULL);
+    if (pxCreatedTask != NULL)
+        *pxCreatedTask = task;
+
+    // Host frames are larger than the device's, so the stack is only a lower bound
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, usStackDepth * 4 > 65536 ? usStackDepth * 4 : 65536);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&task->thread, &attr, _task_entry, task);
+    pthread_attr_destroy(&attr);
+    return err == 0 ? pdPASS : pdFAIL;
+}
+
+void vTaskDelete(TaskHandle_t xTask) {
+    if (xTask != NULL && xTask != _self()) {
+        fprintf(stderr, "vTaskDelete of another task is not supported on the host.\n");
+        abort();
+    }
+    pthread_exit(NULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return _self();
+}
+
+const char *pcTaskGetName(TaskHandle_t xTask) {
+    return (xTask != NULL ? xTask : _self())->name;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask) {
+    (void)xTask;
+    return 0;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction) {
+    pthread_mutex_lock(&xTaskToNotify->lock);
+    switch (eAction) {
+        case eSetBits: xTaskToNotify->value |= ulValue; break;
+        case eIncrement: xTaskToNotify->value++; break;
+        case eSetValueWithOverwrite: xTaskToNotify->value = ulValue; break;
+        case eNoAction: break;
+    }
+    xTaskToNotify->pending = true;
+    pthread_cond_signal(&xTaskToNotify->notified);
+    pthread_mutex_unlock(&xTaskToNotify->lock);
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+    return xTaskNotify(xTaskToNotify, 0, eIncrement);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+    struct shim_task *self = _self();
+    struct timespec deadline, *until = _deadline(xTicksToWait, &deadline);
+    uint32_t value;
+
+    pthread_mutex_lock(&self->lock);
+    while (self->value == 0 && xTicksToWait != 0 && _wait(&self->notified, &self->lock, until));
+    value = self->value;
+    if (value != 0)
+        self->value = xClearCountOnExit ? 0 : value - 1;
+    self->pending = false;
+    pthread_mutex_unlock(&self->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyWait(
+    uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit,
+    uint32_t *pulNotificationValue, TickType_t xTicksToWait
+) {
+    struct shim_task *self = _self();
+    struct timespec deadline, *until = _deadline(xTicksToWait, &deadline);
+    BaseType_t received;
+
+    pthread_mutex_lock(&self->lock);
+    if (!self->pending)
+        self->value &= ~ulBitsToClearOnEntry;
+    while (!self->pending && xTicksToWait != 0 && _wait(&self->notified, &self->lock, until));
+    if (pulNotificationValue != NULL)
+        *pulNotificationValue = self->value;
+    received = self->pending ? pdTRUE : pdFALSE;
+    if (received)
+        self->value &= ~ulBitsToClearOnExit;
+    self->pending = false;
+    pthread_mutex_unlock(&self->lock);
+    return received;
+}
+
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize) {
+    struct shim_queue *queue = (struct shim_queue*)calloc(1, sizeof(struct shim_queue));
+
+    if (queue == NULL)
+        return NULL;
+    queue->length = uxQueueLength;
+    queue->itemSize = uxItemSize;
+    queue->items = (uint8_t*)calloc(uxQueueLength, uxItemSize > 0 ? uxItemSize : 1);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    return queue;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount) {
+    SemaphoreHandle_t semaphore = xQueueCreate(uxMaxCount, 0);
+
+    if (semaphore != NULL)
+        semaphore->count = uxInitialCount;
+    return semaphore;
+}
+
+void vQueueDelete(QueueHandle_t xQueue) {
+    pthread_mutex_destroy(&xQueue->lock);
+    pthread_cond_destroy(&xQueue->changed);
+    free(xQueue->items);
+    free(xQueue);
+}
+
+static void _push(QueueHandle_t queue, const void *item) {
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    if (queue->itemSize > 0)
+        memcpy(queue->items + tail * queue->itemSize, item, queue->itemSize);
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait) {
+    struct timespec deadline, *until = _deadline(xTicksToWait, &deadline);
+    BaseType_t sent = pdFALSE;
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count >= xQueue->length && xTicksToWait != 0 && _wait(&xQueue->changed, &xQueue->lock, until));
+    if (xQueue->count < xQueue->length) {
+        _push(xQueue, pvItemToQueue);
+        sent = pdTRUE;
+    }
+    pthread_mutex_unlock(&xQueue->lock);
+    return sent;
+}
+
+// Queues of length 1 only, like FreeRTOS
+BaseType_t xQueueOverwrite(QueueHandle_t xQueue, const void *pvItemToQueue) {
+    pthread_mutex_lock(&xQueue->lock);
+    xQueue->count = 0;
+    _push(xQueue, pvItemToQueue);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait) {
+    struct timespec deadline, *until = _deadline(xTicksToWait, &deadline);
+    BaseType_t received = pdFALSE;
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == 0 && xTicksToWait != 0 && _wait(&xQueue->changed, &xQueue->lock, until));
+    if (xQueue->count > 0) {
+        if (xQueue->itemSize > 0)
+            memcpy(pvBuffer, xQueue->items + xQueue->head * xQueue->itemSize, xQueue->itemSize);
+        xQueue->head = (xQueue->head + 1) % xQueue->length;
+        xQueue->count--;
+        pthread_cond_broadcast(&xQueue->changed);
+        received = pdTRUE;
+    }
+    pthread_mutex_unlock(&xQueue->lock);
+    return received;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue) {
+    UBaseType_t count;
+
+    pthread_mutex_lock(&xQueue->lock);
+    count = xQueue->count;
+    pthread_mutex_unlock(&xQueue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue) {
+    UBaseType_t spaces;
+
+    pthread_mutex_lock(&xQueue->lock);
+    spaces = xQueue->length - xQueue->count;
+    pthread_mutex_unlock(&xQueue->lock);
+    return spaces;
+}
@@ -0,0 +1,107 @@
+// Jobs of main/job_executor.cpp on one task, as the status LED and WS2812 loops.
+//
+//   - "timer" delays TIMER_PERIOD ticks TIMER_CNT times, like the status LED loop.
+//   - "bus" waits on a data bus subscription with a timeout, like the WS2812 loop,
+//     while the main thread publishes PUBLISH_CNT snapshots, pauses, and publishes again.
+// Checks that delays resume within a tick of their deadline, apart from a few host
+// scheduling delays, that every snapshot wakes the bus job, and that the pause times out
+// the wait instead. Prints the stats of JobExecutor::logStats().
+
+#include <atomic>
+#include <cstdio>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "config.h"
+#include "data_bus.h"
+#include "job_executor.h"
+#include "check.h"
+
+#define TIMER_PERIOD   10
+#define TIMER_CNT      30  // Done before the last publish
+#define BUS_TIMEOUT    50
+#define PUBLISH_CNT    20
+#define PUBLISH_PERIOD_US 50000
+#define PAUSE_US       1500000  // Three times BUS_TIMEOUT and more
+#define MAX_LATE       5        // Ticks, the jitter bucket of task_monitor above 1
+
+
+static int busId;
+static std::atomic<int> timerDone = 0, timerLate = 0, received = 0, timeouts = 0;
+static std::atomic<TickType_t> timerMaxLate = 0, busMaxLatency = 0;
+
+
+static Job timer_job(JobExecutor *executor) {
+    for (int i = 0; i < TIMER_CNT; i++) {
+        TickType_t start = xTaskGetTickCount();
+        co_await executor->delay(TIMER_PERIOD);
+        TickType_t late = xTaskGetTickCount() - start - TIMER_PERIOD;
+        if (late > 1)
+            timerLate++;
+        if ((int)late > (int)timerMaxLate)
+            timerMaxLate = late;
+    }
+    timerDone = 1;
+}
+
+static Job bus_job(JobExecutor *executor) {
+    while (1) {
+        const data_bus_snapshot *snapshot = data_bus_receive(busId, 0);
+        if (snapshot == NULL) {
+            if (!co_await executor->wait(1, BUS_TIMEOUT))
+                timeouts++;
+            continue;
+        }
+        TickType_t latency = xTaskGetTickCount() - snapshot->tick;
+        if (latency > busMaxLatency)
+            busMaxLatency = latency;
+        data_bus_release(snapshot);
+        received++;
+    }
+}
+
+static void publish(int cnt) {
+    sensor_values values = {42, 21.5f, 50, 21.0f, 1013.2f, 100, FAN_STATE_READY};
+    derived_metrics derived = {117, -12, 95, 2};
+    for (int i = 0; i < cnt; i++) {
+        usleep(PUBLISH_PERIOD_US);
+        CHECK(data_bus_publish(&values, &derived) == ESP_OK, "publish %d failed", i);
+    }
+}
+
+int main() {
+    init_data_bus();
+    busId = data_bus_subscribe("bus", 1, DATA_BUS_DROP_OLDEST);
+
+    JobExecutor *executor = new JobExecutor("jobs", 3072, 10);
+    executor->spawn("timer", timer_job(executor));
+    executor->spawn("bus", bus_job(executor));
+    executor->start();
+    data_bus_notify(busId, executor->getTask(), 1);
+
+    publish(PUBLISH_CNT);
+    int timeoutsBefore = timeouts;
+    usleep(PAUSE_US);
+    int pauseTimeouts = timeouts - timeoutsBefore;
+    publish(PUBLISH_CNT);
+    usleep(PUBLISH_PERIOD_US);
+
+    printf(
+        "timer: %d delays, %d late by more than 1 tick, %d ticks at most\n"
+        "bus: received %d of %d, latency %d ticks at most, %d timeouts in the pause\n",
+        TIMER_CNT, (int)timerLate, (int)timerMaxLate, (int)received, 2 * PUBLISH_CNT, (int)busMaxLatency, pauseTimeouts
+    );
+    executor->logStats();
+
+    CHECK(timerDone, "timer job did not finish");
+    CHECK(timerLate <= TIMER_CNT / 10, "%d of %d delays resumed more than 1 tick late", (int)timerLate, TIMER_CNT);
+    CHECK(timerMaxLate < MAX_LATE, "timer job resumed %d ticks late", (int)timerMaxLate);
+    CHECK(received == 2 * PUBLISH_CNT, "bus job received %d of %d snapshots", (int)received, 2 * PUBLISH_CNT);
+    CHECK(busMaxLatency < MAX_LATE, "bus job woke %d ticks after a publish", (int)busMaxLatency);
+    CHECK(pauseTimeouts >= 2, "bus job timed out %d times in the pause", pauseTimeouts);
+
+    return check_result();
+}
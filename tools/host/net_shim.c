@@ -0,0 +1,94 @@
+// mbedTLS, NVS and the certificate bundle for host builds of main/smartthings/st_client.c.
+// The socket layer runs on POSIX sockets. TLS fails at mbedtls_ssl_config_defaults(), and
+// NVS has nothing stored, so only http:// URLs work, and no TLS session is loaded or saved.
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/sha256.h"
+#include "esp_crt_bundle.h"
+#include "nvs.h"
+
+
+void mbedtls_net_init(mbedtls_net_context *ctx) {
+    ctx->fd = -1;
+}
+
+int mbedtls_net_send(void *ctx, const unsigned char *buf, size_t len) {
+    ssize_t sent = send(((mbedtls_net_context*)ctx)->fd, buf, len, MSG_NOSIGNAL);
+    return sent >= 0 ? (int)sent : -0x004E;  // MBEDTLS_ERR_NET_SEND_FAILED
+}
+
+int mbedtls_net_recv_timeout(void *ctx, unsigned char *buf, size_t len, uint32_t timeout) {
+    struct pollfd fd = {.fd = ((mbedtls_net_context*)ctx)->fd, .events = POLLIN};
+    ssize_t received;
+
+    if (poll(&fd, 1, timeout) == 0)
+        return MBEDTLS_ERR_SSL_TIMEOUT;
+    received = recv(fd.fd, buf, len, 0);
+    return received >= 0 ? (int)received : -0x004C;  // MBEDTLS_ERR_NET_RECV_FAILED
+}
+
+void mbedtls_net_free(mbedtls_net_context *ctx) {
+    if (ctx->fd >= 0)
+        close(ctx->fd);
+    ctx->fd = -1;
+}
+
+
+void mbedtls_ssl_init(mbedtls_ssl_context *ssl) {}
+void mbedtls_ssl_free(mbedtls_ssl_context *ssl) {}
+void mbedtls_ssl_config_init(mbedtls_ssl_config *conf) {}
+void mbedtls_ssl_config_free(mbedtls_ssl_config *conf) {}
+void mbedtls_ssl_session_init(mbedtls_ssl_session *session) {}
+void mbedtls_ssl_session_free(mbedtls_ssl_session *session) {}
+
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf, int endpoint, int transport, int preset) {
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+}
+
+// Not reached without a TLS config
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config *conf, int authmode) {}
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config *conf, int (*f_rng)(void *, unsigned char *, size_t), void *p_rng) {}
+void mbedtls_ssl_conf_read_timeout(mbedtls_ssl_config *conf, uint32_t timeout) {}
+void mbedtls_ssl_conf_max_tls_version(mbedtls_ssl_config *conf, mbedtls_ssl_protocol_version version) {}
+int mbedtls_ssl_setup(mbedtls_ssl_context *ssl, const mbedtls_ssl_config *conf) { return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE; }
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context *ssl, const char *hostname) { return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE; }
+void mbedtls_ssl_set_bio(
+    mbedtls_ssl_context *ssl, void *p_bio,
+    mbedtls_ssl_send_t *f_send, mbedtls_ssl_recv_t *f_recv, mbedtls_ssl_recv_timeout_t *f_recv_timeout
+) {}
+void mbedtls_ssl_set_export_keys_cb(mbedtls_ssl_context *ssl, mbedtls_ssl_export_keys_t *f_export_keys, void *p_export_keys) {}
+int mbedtls_ssl_handshake(mbedtls_ssl_context *ssl) { return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE; }
+int mbedtls_ssl_write(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len) { return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE; }
+int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len) { return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE; }
+int mbedtls_ssl_close_notify(mbedtls_ssl_context *ssl) { return 0; }
+int mbedtls_ssl_set_session(mbedtls_ssl_context *ssl, const mbedtls_ssl_session *session) { return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE; }
+int mbedtls_ssl_get_session(const mbedtls_ssl_context *ssl, mbedtls_ssl_session *session) { return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE; }
+int mbedtls_ssl_session_save(const mbedtls_ssl_session *session, unsigned char *buf, size_t buf_len, size_t *olen) {
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+}
+int mbedtls_ssl_session_load(mbedtls_ssl_session *session, const unsigned char *buf, size_t len) {
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+}
+int mbedtls_sha256(const unsigned char *input, size_t len, unsigned char *output, int is224) {
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+}
+esp_err_t esp_crt_bundle_attach(void *conf) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+// Not reached without a handle
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) { return ESP_ERR_NVS_NOT_FOUND; }
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) { return ESP_ERR_NVS_NOT_FOUND; }
+esp_err_t nvs_commit(nvs_handle_t handle) { return ESP_ERR_NVS_NOT_FOUND; }
+void nvs_close(nvs_handle_t handle) {}
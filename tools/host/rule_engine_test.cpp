@@ -0,0 +1,132 @@
+// Parser and evaluation of main/rule_engine.cpp.
+//
+// Compiles valid and invalid "localRules" sources, and feeds readings through a
+// compiled table to check thresholds, hysteresis, sample counts and outputs.
+
+#include <cfloat>
+#include <climits>
+#include <cstdio>
+
+#include "esp_log.h"
+
+#include "config.h"
+#include "rule_engine.h"
+#include "check.h"
+
+
+static sensor_values reading(int fineDust, int humidity = 50, int tvoc = 100, fan_state fan = FAN_STATE_READY) {
+    return {fineDust, 21.5f, humidity, 21.0f, 1013.2f, tvoc, fan};
+}
+
+static void check_compiles(const char *source, int cnt) {
+    rule_table table;
+    esp_err_t ret = rule_compile(source, &table);
+    CHECK(ret == ESP_OK && table.cnt == cnt, "\"%s\" compiled to %d rules (%s), expected %d", source, table.cnt, esp_err_to_name(ret), cnt);
+}
+
+static void check_rejects(const char *source) {
+    rule_table table;
+    table.cnt = -1;
+    esp_err_t ret = rule_compile(source, &table);
+    CHECK(ret != ESP_OK && table.cnt == 0, "\"%s\" was accepted, or left %d rules", source, table.cnt);
+}
+
+static void test_parser() {
+    rule_table table;
+
+    CHECK(rule_compile("pm>100.5~20x3!:fan=3", &table) == ESP_OK, "full rule rejected");
+    const rule *r = &table.rules[0];
+    CHECK(r->metric == RULE_METRIC_FINE_DUST && r->above, "metric or direction");
+    CHECK(r->enter == 1005 && r->release == 805, "thresholds %d/%d", (int)r->enter, (int)r->release);
+    CHECK(r->samples == 3 && r->overrides_cloud, "samples %d, overrides %d", r->samples, r->overrides_cloud);
+    CHECK(r->action == RULE_ACTION_FAN && r->arg == 3, "action %d arg %d", r->action, r->arg);
+
+    CHECK(rule_compile("temp<-5.5~0.5:notify", &table) == ESP_OK, "negative threshold rejected");
+    r = &table.rules[0];
+    CHECK(r->metric == RULE_METRIC_TEMPERATURE && !r->above, "metric or direction of temp rule");
+    CHECK(r->enter == -55 && r->release == -50 && r->samples == 1, "temp thresholds %d/%d", (int)r->enter, (int)r->release);
+
+    check_compiles("", 0);
+    check_compiles(" ; ;", 0);
+    check_compiles("pm>100~20x3:fan=3;humi>70~5:notify;tvoc>660x2!:led=blink", 3);
+    check_compiles("temp2>30:fan=4;press<990:led=blink", 2);
+    check_compiles("humi>70:fan=0", 1);        // Only pm rules need the fan
+    check_compiles("pm<10:fan=1", 1);
+    check_compiles("humi>1:notify;humi>2:notify;humi>3:notify;humi>4:notify;"
+                   "humi>5:notify;humi>6:notify;humi>7:notify;humi>8:notify", RULE_MAX_CNT);
+
+    check_rejects("pm>100:fan=0");   // Would never release, PM is not read while the fan is off
+    check_rejects("pm<10~5:fan=0");
+    check_rejects("humi>70:notify;pm>100x2!:fan=0");
+    check_rejects("pm>>1:fan=1");
+    check_rejects("pmx>1:fan=1");
+    check_rejects("co2>1:fan=1");
+    check_rejects("pm>:fan=1");
+    check_rejects("pm>1~-2:fan=1");
+    check_rejects("pm>1x0:fan=1");
+    check_rejects("pm>1x256:fan=1");
+    check_rejects("pm>1:fan=5");
+    check_rejects("pm>1:fan=-1");
+    check_rejects("pm>1:fan=");
+    check_rejects("pm>1");
+    check_rejects("pm>1:led=on");
+    check_rejects("pm>1:notify now");
+    check_rejects("humi>1:notify;humi>2:notify;humi>3:notify;humi>4:notify;"
+                  "humi>5:notify;humi>6:notify;humi>7:notify;humi>8:notify;humi>9:notify");
+}
+
+static void test_evaluation() {
+    rule_table table;
+    rule_outputs outputs;
+    sensor_values values;
+
+    CHECK(rule_compile("pm>100~20x2:fan=3;humi>70~5:notify;tvoc>660!:led=blink", &table) == ESP_OK, "table rejected");
+
+    // Activates after two readings above, and releases only below the hysteresis
+    const int fineDust[] = {120, 90, 130, 140, 85, 81, 80, 120};
+    const int expected[] = {RULE_FAN_NONE, RULE_FAN_NONE, RULE_FAN_NONE, 3, 3, 3, RULE_FAN_NONE, RULE_FAN_NONE};
+    for (int i = 0; i < (int)(sizeof(fineDust) / sizeof(fineDust[0])); i++) {
+        values = reading(fineDust[i]);
+        rule_evaluate(&table, &values, &outputs);
+        CHECK(outputs.fan_speed == expected[i], "pm %d: fan %d, expected %d", fineDust[i], outputs.fan_speed, expected[i]);
+    }
+
+    // Invalid readings keep the state: warm-up and off fan, and missing values
+    values = reading(200);
+    rule_evaluate(&table, &values, &outputs);
+    rule_evaluate(&table, &values, &outputs);
+    CHECK(outputs.fan_speed == 3, "pm rule did not activate");
+    values = reading(10, 50, 100, FAN_STATE_WARMUP);
+    rule_evaluate(&table, &values, &outputs);
+    CHECK(outputs.fan_speed == 3, "pm rule released on a warm-up reading");
+    values = reading(INT_MIN);
+    rule_evaluate(&table, &values, &outputs);
+    CHECK(outputs.fan_speed == 3, "pm rule released on an invalid reading");
+    values = reading(10);
+    rule_evaluate(&table, &values, &outputs);
+    CHECK(outputs.fan_speed == RULE_FAN_NONE, "pm rule did not release");
+
+    // Notify fires once per activation
+    values = reading(10, 75);
+    rule_evaluate(&table, &values, &outputs);
+    CHECK(outputs.notify == (1 << 1), "notify bits %#x on activation", (unsigned int)outputs.notify);
+    rule_evaluate(&table, &values, &outputs);
+    CHECK(outputs.notify == 0, "notify fired again while active");
+    values = reading(10, 65);
+    rule_evaluate(&table, &values, &outputs);
+    values = reading(10, 75);
+    rule_evaluate(&table, &values, &outputs);
+    CHECK(outputs.notify == (1 << 1), "notify did not fire after release");
+
+    values = reading(10, 50, 700);
+    rule_evaluate(&table, &values, &outputs);
+    CHECK(outputs.led == RULE_LED_BLINK, "led rule did not activate");
+    CHECK(!outputs.fan_overrides_cloud, "led rule set fan_overrides_cloud");
+}
+
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    test_parser();
+    test_evaluation();
+    return check_result();
+}
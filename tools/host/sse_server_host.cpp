@@ -0,0 +1,54 @@
+// main/sse_server.c on the host, fed by main/data_bus.cpp, for tools/sse_load_test.py.
+//
+//   sse_server_host [interval ms]   serves SSE_PORT on all addresses until killed
+//
+// Publishes an average and a raw sample every interval (100ms by default), as
+// get_sensor_value_task does, and logs the stream stats and the longest producer
+// interval every 50 averages. Slow clients must never stretch that interval.
+// C++, because only one C source may define the LED colors of io.h.
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "config.h"
+#include "data_bus.h"
+#include "sse_server.h"
+
+int main(int argc, char **argv) {
+    int interval = argc > 1 ? atoi(argv[1]) : 100;
+    TickType_t last, now;
+    int max_gap = 0;
+
+    init_data_bus();
+    if (init_sse_server() != ESP_OK)
+        return 1;
+    printf("Serving http://127.0.0.1:%d/events, an average every %dms\n", SSE_PORT, interval);
+    fflush(stdout);
+
+    last = xTaskGetTickCount();
+    for (uint32_t i = 0; ; i++) {
+        usleep(interval * 1000);
+        now = xTaskGetTickCount();
+        if ((int)(now - last) > max_gap)
+            max_gap = now - last;
+        last = now;
+
+        sensor_values sample = {(int)(40 + i % 5), 23.5f, 44, 24.0f, 1013.0f, 118, FAN_STATE_READY};
+        sse_publish_sample(&sample, now);
+
+        sensor_values average = {(int)(42 + i % 7), 23.4f, 45, 23.9f, 1013.25f, i % 3 ? 120 : INT_MIN, FAN_STATE_READY};
+        derived_metrics derived = {117, -12, 95, 2};
+        data_bus_publish(&average, &derived);
+
+        if (i % 50 == 0) {
+            log_sse_stats();
+            ESP_LOGI("SSEServerHost", "Longest producer interval: %d ticks", max_gap);
+        }
+    }
+}
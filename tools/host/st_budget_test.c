@@ -0,0 +1,156 @@
+// Request budget and backoff of main/smartthings/request.c on a simulated tick.
+//
+// xTaskGetTickCount() is wrapped to return the simulated tick, and st_client_request()
+// counts the calls which would reach the network. Checks that
+//   - a burst sends ST_BUDGET_CAPACITY calls, starting just before the tick wraps
+//   - one call per second is held to one per ST_BUDGET_REFILL_INTERVAL
+//   - an outage backs off instead of sending every call, and recovers within ST_BACKOFF_MAX
+//   - 429 waits Retry-After, up to ST_BACKOFF_MAX, and backs off with jitter without one
+//   - 5xx backs off with jitter, and 401, 404 and 422 do not back off
+//   - the bucket is full after 71.6 minutes without a call, where milliseconds * 1000
+//     passes 2^32
+// and prints the calls sent in each.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "cJSON.h"
+
+#include "config.h"
+#include "smartthings/request.h"
+#include "smartthings/st_client.h"
+#include "check.h"
+
+#define CALL_PERIOD     pdMS_TO_TICKS(1000)
+#define OUTAGE_PERIOD   pdMS_TO_TICKS(5000)
+#define OUTAGE_CNT      120  // 10 minutes
+#define LONG_IDLE       429497  // Ticks, 4294970ms
+
+static TickType_t tick = UINT32_MAX - 100;
+static int sent = 0;
+static st_client_result reply = {200, 0};  // Status 0 for a transport error
+
+
+TickType_t __wrap_xTaskGetTickCount(void) {
+    return tick;
+}
+
+esp_err_t st_client_request(
+    const char *method, const char *url, const char *token,
+    const st_client_chunk *body, int body_cnt, cJSON **response_json, st_client_result *result
+) {
+    sent++;
+    *result = reply;
+    if (reply.status == 0)
+        return ESP_FAIL;
+    return reply.status >= 200 && reply.status < 300 ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
+
+void log_st_client_stats(void) {}
+
+// Unused, request.c only parses responses
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *string) { return NULL; }
+char *cJSON_GetStringValue(const cJSON *item) { return NULL; }
+int cJSON_IsNumber(const cJSON *item) { return 0; }
+int cJSON_IsString(const cJSON *item) { return 0; }
+int cJSON_IsBool(const cJSON *item) { return 0; }
+int cJSON_IsTrue(const cJSON *item) { return 0; }
+char *cJSON_Print(const cJSON *item) { return NULL; }
+void cJSON_Delete(cJSON *item) {}
+
+
+// Calls cnt times, period ticks apart. Returns the calls sent.
+static int calls(int cnt, TickType_t period) {
+    int before = sent;
+    for (int i = 0; i < cnt; i++) {
+        tick += period;
+        send_rule_event(1);
+    }
+    return sent - before;
+}
+
+// Fails one call with status, then calls each second with success until one is sent.
+// Returns the seconds until then.
+static int wait_after(int status, uint32_t retry_after) {
+    int seconds;
+
+    tick += pdMS_TO_TICKS(ST_BACKOFF_MAX + ST_BUDGET_CAPACITY * ST_BUDGET_REFILL_INTERVAL);
+    reply = (st_client_result){200, 0};
+    send_rule_event(1);  // Resets the backoff
+    reply = (st_client_result){status, retry_after};
+    send_rule_event(1);
+    reply = (st_client_result){200, 0};
+    for (seconds = 0; seconds <= ST_BACKOFF_MAX / 1000 + 1; seconds++) {
+        if (send_rule_event(1) == ESP_OK)
+            break;
+        tick += CALL_PERIOD;
+    }
+    return seconds;
+}
+
+int main(void) {
+    int cnt, expected, seconds;
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    cnt = calls(20, 0);
+    printf("burst of 20: sent %d\n", cnt);
+    CHECK(cnt == ST_BUDGET_CAPACITY, "burst sent %d, expected %d", cnt, ST_BUDGET_CAPACITY);
+
+    cnt = calls(60, CALL_PERIOD);
+    expected = 60 * 1000 / ST_BUDGET_REFILL_INTERVAL;
+    printf("1 call per second for 60s: sent %d\n", cnt);
+    CHECK(cnt >= expected - 1 && cnt <= expected, "sustained calls sent %d, expected %d", cnt, expected);
+
+    tick += pdMS_TO_TICKS(ST_BUDGET_CAPACITY * ST_BUDGET_REFILL_INTERVAL);
+    reply = (st_client_result){0, 0};
+    cnt = calls(OUTAGE_CNT, OUTAGE_PERIOD);
+    printf("outage, a call every 5s for 10 minutes: sent %d of %d\n", cnt, OUTAGE_CNT);
+    CHECK(cnt > 1 && cnt <= 10, "outage sent %d calls", cnt);
+
+    reply = (st_client_result){200, 0};
+    for (seconds = 5; seconds <= ST_BACKOFF_MAX / 1000 + 5; seconds += 5) {
+        tick += OUTAGE_PERIOD;
+        if (send_rule_event(1) == ESP_OK)
+            break;
+    }
+    printf("recovered %ds after the outage\n", seconds);
+    CHECK(seconds <= ST_BACKOFF_MAX / 1000, "not recovered %ds after the outage", seconds);
+
+    seconds = wait_after(429, 30);
+    printf("429 with Retry-After 30: sent again after %ds\n", seconds);
+    CHECK(seconds == 30, "429 with Retry-After 30 waited %ds", seconds);
+    seconds = wait_after(429, 3600);
+    printf("429 with Retry-After 3600: sent again after %ds\n", seconds);
+    CHECK(seconds == ST_BACKOFF_MAX / 1000, "429 with Retry-After 3600 waited %ds", seconds);
+    seconds = wait_after(429, 0);
+    printf("429 without Retry-After: sent again after %ds\n", seconds);
+    CHECK(
+        seconds >= ST_BACKOFF_MIN / 2000 && seconds <= ST_BACKOFF_MIN / 1000,
+        "429 without Retry-After waited %ds", seconds
+    );
+    seconds = wait_after(503, 0);
+    printf("503: sent again after %ds\n", seconds);
+    CHECK(seconds >= ST_BACKOFF_MIN / 2000 && seconds <= ST_BACKOFF_MIN / 1000, "503 waited %ds", seconds);
+    seconds = wait_after(0, 0);
+    printf("transport error: sent again after %ds\n", seconds);
+    CHECK(seconds >= ST_BACKOFF_MIN / 2000 && seconds <= ST_BACKOFF_MIN / 1000, "transport error waited %ds", seconds);
+    for (int i = 0; i < 3; i++) {
+        int status = (int[]){401, 404, 422}[i];
+        seconds = wait_after(status, 0);
+        printf("%d: sent again after %ds\n", status, seconds);
+        CHECK(seconds == 0, "%d waited %ds", status, seconds);
+    }
+
+    calls(20, 0);
+    tick += LONG_IDLE;
+    cnt = calls(20, 0);
+    printf("burst after %" PRIu32 "ms idle: sent %d\n", (uint32_t)pdTICKS_TO_MS(LONG_IDLE), cnt);
+    CHECK(cnt == ST_BUDGET_CAPACITY, "burst after a long idle sent %d, expected %d", cnt, ST_BUDGET_CAPACITY);
+
+    log_st_request_stats();
+    return check_result();
+}
@@ -0,0 +1,192 @@
+// HTTP of main/smartthings/st_client.c against a canned server on a loopback port.
+//
+// The server thread answers one request per connection, by path:
+//   /length   200 with Content-Length, and a connection kept open after the body
+//   /chunked  200 with a chunked body, the second chunk over several writes
+//   /close    200 without Content-Length, ended by closing the connection
+//   /cut      Content-Length over the body sent before closing
+//   /limited  429 with Retry-After and a JSON error
+//   /events   POST, whose body is kept for the check
+// Checks the result, status and parsed body of each, that a POST arrives as the concatenated
+// chunks, and that a refused connection fails at once.
+
+#define _GNU_SOURCE  // strcasestr()
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "cJSON.h"
+
+#include "config.h"
+#include "smartthings/st_client.h"
+#include "check.h"
+
+#define REQUEST_MAX_LEN 4096
+#define CHUNK_LEN       3000  // Over one read of the client
+
+static int listen_fd, port;
+static char posted[REQUEST_MAX_LEN], parsed[ST_CLIENT_MAX_RESPONSE + 1];
+
+
+// Keeps the body, so that the test can check what the client parsed
+cJSON *cJSON_ParseWithLength(const char *value, size_t length) {
+    static cJSON item;
+
+    memcpy(parsed, value, length);
+    parsed[length] = '\0';
+    return value[0] == '{' ? &item : NULL;
+}
+
+void cJSON_Delete(cJSON *item) {}
+
+
+static void _send(int fd, const char *data) {
+    send(fd, data, strlen(data), MSG_NOSIGNAL);
+}
+
+// Reads the request header and a Content-Length body into buf
+static int _read_request(int fd, char *buf) {
+    int len = 0, ret, body_len = 0;
+    char *header_end = NULL, *content_length;
+
+    while (len < REQUEST_MAX_LEN - 1 && (ret = recv(fd, buf + len, REQUEST_MAX_LEN - 1 - len, 0)) > 0) {
+        len += ret;
+        buf[len] = '\0';
+        if (header_end == NULL && (header_end = strstr(buf, "\r\n\r\n")) != NULL) {
+            content_length = strcasestr(buf, "\r\nContent-Length:");
+            body_len = content_length != NULL && content_length < header_end ? atoi(content_length + 17) : 0;
+        }
+        if (header_end != NULL && len - (header_end + 4 - buf) >= body_len)
+            return len;
+    }
+    return -1;
+}
+
+static void _respond(int fd, const char *request) {
+    static char chunk[CHUNK_LEN + 1];
+    char line[64];
+
+    if (strncmp(request, "GET /length ", 12) == 0) {
+        _send(fd, "HTTP/1.1 200 OK\r\nContent-Length: 16\r\n\r\n{\"length\":true}\n");
+        usleep(200000);  // The client must stop at Content-Length, not wait for the close
+    } else if (strncmp(request, "GET /chunked ", 13) == 0) {
+        memset(chunk, 'x', CHUNK_LEN);
+        _send(fd, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n9\r\n{\"pad\":\"x\r\n");
+        snprintf(line, sizeof(line), "%x\r\n", CHUNK_LEN + 2);
+        _send(fd, line);
+        for (int i = 0; i < CHUNK_LEN; i += CHUNK_LEN / 3) {
+            send(fd, chunk + i, CHUNK_LEN / 3, MSG_NOSIGNAL);
+            usleep(10000);
+        }
+        _send(fd, "\"}\r\n0\r\n\r\n");
+    } else if (strncmp(request, "GET /close ", 11) == 0) {
+        _send(fd, "HTTP/1.1 200 OK\r\n\r\n{\"close\":true}");
+    } else if (strncmp(request, "GET /cut ", 9) == 0) {
+        _send(fd, "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n{\"cut\":");
+    } else if (strncmp(request, "GET /limited ", 13) == 0) {
+        _send(fd, "HTTP/1.1 429 Too Many Requests\r\nRetry-After: 30\r\nContent-Length: 20\r\n\r\n{\"error\":\"limited\"}\n");
+    } else if (strncmp(request, "POST /events ", 13) == 0) {
+        strcpy(posted, strstr(request, "\r\n\r\n") + 4);
+        _send(fd, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+    } else {
+        _send(fd, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+    }
+}
+
+static void *_serve(void *arg) {
+    static char request[REQUEST_MAX_LEN];
+    int fd;
+
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+        if (_read_request(fd, request) > 0)
+            _respond(fd, request);
+        close(fd);
+    }
+    return NULL;
+}
+
+static void _start_server(void) {
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t len = sizeof(addr);
+    pthread_t thread;
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr));
+    listen(listen_fd, 4);
+    getsockname(listen_fd, (struct sockaddr*)&addr, &len);
+    port = ntohs(addr.sin_port);
+    pthread_create(&thread, NULL, _serve, NULL);
+}
+
+static esp_err_t _get(const char *path, cJSON **json, st_client_result *result) {
+    char url[64];
+
+    parsed[0] = '\0';
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d%s", port, path);
+    return st_client_request("GET", url, "token", NULL, 0, json, result);
+}
+
+int main(void) {
+    st_client_chunk chunks[] = {{"{\"deviceEvents\":[", 17}, {"{\"value\":42}", 12}, {"]}", 2}};
+    st_client_result result;
+    cJSON *json;
+    char url[64];
+    esp_err_t err;
+    TickType_t start;
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    init_st_client();
+    _start_server();
+
+    start = xTaskGetTickCount();
+    err = _get("/length", &json, &result);
+    CHECK(err == ESP_OK && strcmp(parsed, "{\"length\":true}\n") == 0, "Content-Length: %d, body %s", err, parsed);
+    CHECK(result.status == 200 && result.retry_after == 0, "Content-Length: status %d", result.status);
+    CHECK(xTaskGetTickCount() - start < pdMS_TO_TICKS(150), "Content-Length: read until the close");
+
+    err = _get("/chunked", &json, NULL);
+    CHECK(
+        err == ESP_OK && strlen(parsed) == CHUNK_LEN + 11 && strncmp(parsed, "{\"pad\":\"xxx", 11) == 0
+            && strcmp(parsed + CHUNK_LEN + 9, "\"}") == 0,
+        "chunked: %d, %zu bytes", err, strlen(parsed)
+    );
+
+    err = _get("/close", &json, NULL);
+    CHECK(err == ESP_OK && strcmp(parsed, "{\"close\":true}") == 0, "close: %d, body %s", err, parsed);
+
+    err = _get("/cut", &json, &result);
+    CHECK(err == ESP_ERR_INVALID_RESPONSE && result.status == 200, "cut off body: %d, status %d", err, result.status);
+
+    err = _get("/limited", &json, &result);
+    CHECK(
+        err == ESP_ERR_INVALID_RESPONSE && result.status == 429 && result.retry_after == 30,
+        "429: %d, status %d, Retry-After %u", err, result.status, (unsigned int)result.retry_after
+    );
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/events", port);
+    err = st_client_request("POST", url, "token", chunks, 3, NULL, NULL);
+    CHECK(
+        err == ESP_OK && strcmp(posted, "{\"deviceEvents\":[{\"value\":42}]}") == 0,
+        "POST: %d, body %s", err, posted
+    );
+
+    shutdown(listen_fd, SHUT_RDWR);  // Also ends accept() of the server thread
+    close(listen_fd);
+    start = xTaskGetTickCount();
+    err = _get("/length", &json, &result);
+    CHECK(err == ESP_FAIL && result.status == 0, "refused connection: %d, status %d", err, result.status);
+    CHECK(xTaskGetTickCount() - start < pdMS_TO_TICKS(1000), "refused connection: not at once");
+
+    log_st_client_stats();
+    return check_result();
+}
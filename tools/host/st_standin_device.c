@@ -0,0 +1,82 @@
+// main/smartthings/request.c and st_client.c on the host, as the device for tools/st_standin.py.
+//
+//   st_standin_device [seconds]   runs for seconds, or until SIGINT or SIGTERM without,
+//                                 then prints the calls and logs the request stats
+//
+// Calls the stand-in at ST_API_BASE_URL on the schedule of device_status_task at the fast
+// poll interval: status every GET_STATUS_INTERVAL, preferences every GET_CONFIG_PER_GET_STATUS
+// and a status upload every UPDATE_STATUS_PER_GET_STATUS polls, through the request budget
+// and backoff. Prints each failed call, and the calls made and failed at the end.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "config.h"
+#include "smartthings/request.h"
+#include "smartthings/st_client.h"
+
+static int calls = 0, failed = 0;
+static volatile sig_atomic_t stop = 0;
+
+
+static void _result(const char *name, esp_err_t ret) {
+    calls++;
+    if (ret == ESP_OK)
+        return;
+    failed++;
+    printf("%ld %s: %s\n", (long)time(NULL), name, esp_err_to_name(ret));
+    fflush(stdout);
+}
+
+static void _stop(int signal) {
+    stop = 1;
+}
+
+int main(int argc, char **argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 0;
+    TickType_t lastTick, end;
+    DeviceConfig config;
+    STStatus status;
+
+    signal(SIGINT, _stop);
+    signal(SIGTERM, _stop);
+    esp_log_level_set("*", ESP_LOG_NONE);
+    init_st_client();
+    printf("Calling %s\n", ST_API_BASE_URL);
+    fflush(stdout);
+
+    lastTick = xTaskGetTickCount();
+    end = lastTick + pdMS_TO_TICKS(seconds * 1000);
+    for (unsigned int i = 0; !stop && (seconds == 0 || (int32_t)(xTaskGetTickCount() - end) < 0); i++) {
+        _result("status", get_device_status(&status));
+        if (!(i % GET_CONFIG_PER_GET_STATUS))
+            _result("preferences", get_device_config(&config));
+        if (!(i % UPDATE_STATUS_PER_GET_STATUS)) {
+            patch_device_status(ST_STATUS_FINE_DUST, 12 + i % 5, 0);
+            patch_device_status(ST_STATUS_TEMPERATURE, 234, 1);
+            patch_device_status(ST_STATUS_HUMIDITY, 45, 0);
+            patch_device_status(ST_STATUS_TVOC, 118, 0);
+            patch_device_status(ST_STATUS_TEMPERATURE2, 239, 1);
+            patch_device_status(ST_STATUS_PRESSURE, 1013, 1);
+#ifdef ENABLE_DERIVED_METRICS_REPORT
+            patch_device_status(ST_STATUS_AQI, 50, 0);
+            patch_device_status(ST_STATUS_DEW_POINT, 112, 1);
+            patch_device_status(ST_STATUS_ABSOLUTE_HUMIDITY, 95, 1);
+            patch_device_status(ST_STATUS_TVOC_INDEX, 2, 0);
+#endif
+            _result("upload", set_device_status());
+        }
+        vTaskDelayUntil(&lastTick, pdMS_TO_TICKS(GET_STATUS_INTERVAL));
+    }
+
+    printf("calls=%d failed=%d\n", calls, failed);
+    esp_log_level_set("*", ESP_LOG_INFO);
+    log_st_request_stats();
+    return 0;
+}
@@ -0,0 +1,252 @@
+// Status body of main/smartthings/request.c against the sprintf builder it replaced.
+//
+//   - Builds REPORT_CNT bodies from the same pseudo random values both ways, where
+//     every value is invalid with a chance of 1 in 8, and prints the time and heap
+//     allocations per body. malloc() is wrapped to count allocations.
+//   - Sends a few bodies with set_device_status() to a recording st_client_request(),
+//     and checks that the streamed chunks are the old body, apart from whitespace.
+//     Prints the bytes each way.
+
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "cJSON.h"
+
+#include "config.h"
+#include "smartthings/request.h"
+#include "smartthings/st_client.h"
+#include "check.h"
+
+#define REPORT_CNT  200000
+#define BASE_EVENTS 6  // Events of the old builder, ST_STATUS_FINE_DUST to ST_STATUS_PRESSURE
+#define SET_DEVICE_STATUS_BUF_SIZE 2048  // Of the old builder
+
+static uint32_t mallocs = 0;
+static size_t malloc_bytes = 0;
+static char sent[SET_DEVICE_STATUS_BUF_SIZE];
+static size_t sent_len;
+static int sent_chunks;
+static volatile uintptr_t sink;  // Keeps the loops from being optimized away
+
+
+void *__real_malloc(size_t size);
+void *__wrap_malloc(size_t size) {
+    mallocs++;
+    malloc_bytes += size;
+    return __real_malloc(size);
+}
+
+// Records the body instead of sending it
+esp_err_t st_client_request(
+    const char *method, const char *url, const char *token,
+    const st_client_chunk *body, int body_cnt, cJSON **response_json, st_client_result *result
+) {
+    sent_len = 0;
+    for (int i = 0; i < body_cnt; i++) {
+        memcpy(sent + sent_len, body[i].data, body[i].len);
+        sent_len += body[i].len;
+    }
+    sent[sent_len] = '\0';
+    sent_chunks = body_cnt;
+    if (result != NULL)
+        *result = (st_client_result){200, 0};
+    return ESP_OK;
+}
+
+void log_st_client_stats(void) {}
+
+// Unused, request.c only parses responses
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *string) { return NULL; }
+char *cJSON_GetStringValue(const cJSON *item) { return NULL; }
+int cJSON_IsNumber(const cJSON *item) { return 0; }
+int cJSON_IsString(const cJSON *item) { return 0; }
+int cJSON_IsBool(const cJSON *item) { return 0; }
+int cJSON_IsTrue(const cJSON *item) { return 0; }
+char *cJSON_Print(const cJSON *item) { return NULL; }
+void cJSON_Delete(cJSON *item) {}
+
+
+// The builder before the compile-time template, without the post()
+typedef struct {
+    char *component;
+    char *capability;
+    char *attribute;
+    char *value;
+    char *unit;
+} st_item;
+
+static esp_err_t _create_request_body(st_item *items, int item_cnt, char *buf, int buf_size) {
+    int buf_pos = 18, item_str_len;
+    strcpy(buf, "{\"deviceEvents\": [");
+    for (int i = 0; i < item_cnt; i++) {
+        if (
+            items[i].value[0] == '\0'
+            || items[i].value == NULL
+            || items[i].component == NULL
+            || items[i].capability == NULL
+            || items[i].attribute == NULL
+            || items[i].unit == NULL
+        ) {
+            ESP_LOGI("ST-REQUEST create_request_body", "Invalid value detected @ item[%d]. Skipping...", i);
+            continue;
+        }
+
+        ESP_LOGD("ST-REQUEST create_request_body", "Formatting item[%d]...", i);
+        item_str_len = snprintf(
+            buf + buf_pos, buf_size - buf_pos - 3,
+            "{\"component\":\"%s\",\"capability\":\"%s\",\"attribute\":\"%s\",\"value\":%s,\"unit\":\"%s\"},",
+            items[i].component, items[i].capability, items[i].attribute, items[i].value, items[i].unit
+        );
+        if (buf_pos + item_str_len > buf_size - 2)
+            return ESP_ERR_NO_MEM;
+        buf_pos += item_str_len;
+    }
+    strcpy(buf + buf_pos - 1, "]}");
+    return ESP_OK;
+}
+
+// Values are in the units of patch_device_status(), tenths for temperatures and pressure.
+// Returns the malloc'd body, which the old set_device_status() freed after the post().
+static char *_old_body(const int values[BASE_EVENTS]) {
+    static const char *formats[BASE_EVENTS] = {"%d", "%.1f", "%d", "%d", "%.1f", "%.1f"};
+    static const int decimals[BASE_EVENTS] = {0, 1, 0, 0, 1, 1};
+    char strs[BASE_EVENTS][12];
+
+    for (int i = 0; i < BASE_EVENTS; i++) {
+        if (values[i] == INT_MIN)
+            strs[i][0] = '\0';
+        else if (decimals[i])
+            sprintf(strs[i], formats[i], values[i] / 10.0f);
+        else
+            sprintf(strs[i], formats[i], values[i]);
+    }
+    st_item items[BASE_EVENTS] = {
+        {"airQuality",  "fineDustSensor",                 "fineDustLevel",       strs[0], "μg/m^3"},
+        {"airQuality",  "temperatureMeasurement",         "temperature",         strs[1], "C"},
+        {"airQuality",  "relativeHumidityMeasurement",    "humidity",            strs[2], "%"},
+        {"airQuality",  "tvocMeasurement",                "tvocLevel",           strs[3], "ppb"},
+        {"airPressure", "temperatureMeasurement",         "temperature",         strs[4], "C"},
+        {"airPressure", "atmosphericPressureMeasurement", "atmosphericPressure", strs[5], "kPa"},
+    };
+
+    char *body = malloc(SET_DEVICE_STATUS_BUF_SIZE);
+    if (body != NULL && _create_request_body(items, BASE_EVENTS, body, SET_DEVICE_STATUS_BUF_SIZE) != ESP_OK) {
+        free(body);
+        body = NULL;
+    }
+    return body;
+}
+
+static void _patch_new(const int values[BASE_EVENTS]) {
+    static const int decimals[BASE_EVENTS] = {0, 1, 0, 0, 1, 1};
+    for (int i = 0; i < BASE_EVENTS; i++)
+        patch_device_status(i, values[i], decimals[i]);
+    for (int i = BASE_EVENTS; i < ST_STATUS_EVENT_CNT; i++)
+        patch_device_status(i, INT_MIN, 0);
+}
+
+static void _random_values(int values[BASE_EVENTS]) {
+    static const int ranges[BASE_EVENTS][2] = {{0, 500}, {-200, 450}, {0, 100}, {0, 3000}, {-200, 450}, {950, 1050}};
+    for (int i = 0; i < BASE_EVENTS; i++)
+        values[i] = rand() % 8 == 0 ? INT_MIN : ranges[i][0] + rand() % (ranges[i][1] - ranges[i][0] + 1);
+}
+
+static void _strip_spaces(const char *src, char *dst) {
+    for (; *src; src++)
+        if (*src != ' ')
+            *dst++ = *src;
+    *dst = '\0';
+}
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Sends one body both ways and compares
+static void _compare(const char *name, const int values[BASE_EVENTS]) {
+    char expected[SET_DEVICE_STATUS_BUF_SIZE], actual[SET_DEVICE_STATUS_BUF_SIZE];
+    char *old = _old_body(values);
+
+    _patch_new(values);
+    sent_len = 0;
+    CHECK(set_device_status() == ESP_OK, "%s: set_device_status failed", name);
+    const char *padded = finish_device_status_body();
+    printf(
+        "%-14s old %4zu bytes, new %4zu bytes in %d chunks (%zu bytes unstreamed)\n",
+        name, strlen(old), sent_len, sent_chunks, strlen(padded)
+    );
+    _strip_spaces(old, expected);
+    _strip_spaces(sent, actual);
+    CHECK(strcmp(expected, actual) == 0, "%s: bodies differ\n  old: %s\n  new: %s", name, old, sent);
+    free(old);
+}
+
+int main(void) {
+    int values[BASE_EVENTS];
+    uint64_t start, old_ns, new_ns;
+    uint32_t old_mallocs, new_mallocs;
+    size_t old_bytes, new_bytes;
+
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    srand(1);
+    mallocs = malloc_bytes = 0;
+    start = now_ns();
+    for (int i = 0; i < REPORT_CNT; i++) {
+        _random_values(values);
+        char *body = _old_body(values);
+        sink += (uintptr_t)body[0];
+        free(body);
+    }
+    old_ns = now_ns() - start;
+    old_mallocs = mallocs;
+    old_bytes = malloc_bytes;
+
+    srand(1);
+    mallocs = malloc_bytes = 0;
+    start = now_ns();
+    for (int i = 0; i < REPORT_CNT; i++) {
+        _random_values(values);
+        _patch_new(values);
+        const char *body = finish_device_status_body();
+        sink += (uintptr_t)(body != NULL ? body[0] : 0);
+    }
+    new_ns = now_ns() - start;
+    new_mallocs = mallocs;
+    new_bytes = malloc_bytes;
+
+    printf(
+        "old: %" PRIu64 "ns per body, %.1f mallocs (%zu bytes) per body\n",
+        old_ns / REPORT_CNT, (double)old_mallocs / REPORT_CNT, old_bytes / REPORT_CNT
+    );
+    printf(
+        "new: %" PRIu64 "ns per body, %.1f mallocs (%zu bytes) per body\n",
+        new_ns / REPORT_CNT, (double)new_mallocs / REPORT_CNT, new_bytes / REPORT_CNT
+    );
+    CHECK(new_mallocs == 0, "new body allocated %" PRIu32 " times", new_mallocs);
+    CHECK(new_ns < old_ns, "new body is slower");
+
+    // Within the request budget, so every set_device_status() is sent
+    const int all_valid[BASE_EVENTS] = {42, 235, 55, 310, 241, 1013};
+    const int first_invalid[BASE_EVENTS] = {INT_MIN, 235, 55, 310, 241, 1013};
+    const int middle_invalid[BASE_EVENTS] = {42, 235, INT_MIN, INT_MIN, 241, 1013};
+    const int negative[BASE_EVENTS] = {0, -5, 100, 0, -123, 1000};
+    _compare("all valid", all_valid);
+    _compare("first invalid", first_invalid);
+    _compare("two invalid", middle_invalid);
+    _compare("negative", negative);
+
+    const int none_valid[BASE_EVENTS] = {INT_MIN, INT_MIN, INT_MIN, INT_MIN, INT_MIN, INT_MIN};
+    _patch_new(none_valid);
+    CHECK(set_device_status() == ESP_ERR_INVALID_STATE, "an empty body was sent");
+
+    return check_result();
+}
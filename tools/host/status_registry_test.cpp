@@ -0,0 +1,136 @@
+// Status body built through the channels of main/include/sensor_registry.h, against
+// the per-value builder that set_device_status() used before the registry.
+//
+// Feeds REPORT_CNT pseudo random readings, where every value is invalid with a chance
+// of 1 in 7 (1 in 5 for derived metrics) and fine dust can be over PM1006_THRESHOLD,
+// and checks that both bodies are the same byte for byte.
+
+#include <cfloat>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#include "esp_log.h"
+#include "cJSON.h"
+
+#include "config.h"
+#include "sensor_registry.h"
+#include "smartthings/st_client.h"
+#include "check.h"
+
+#define REPORT_CNT 20000
+
+
+// Nothing is sent, request.c only parses responses
+extern "C" {
+esp_err_t st_client_request(
+    const char *method, const char *url, const char *token,
+    const st_client_chunk *body, int body_cnt, cJSON **response_json, st_client_result *result
+) {
+    if (result != NULL)
+        *result = st_client_result{0, 0};
+    return ESP_FAIL;
+}
+void log_st_client_stats(void) {}
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *string) { return NULL; }
+char *cJSON_GetStringValue(const cJSON *item) { return NULL; }
+int cJSON_IsNumber(const cJSON *item) { return 0; }
+int cJSON_IsString(const cJSON *item) { return 0; }
+int cJSON_IsBool(const cJSON *item) { return 0; }
+int cJSON_IsTrue(const cJSON *item) { return 0; }
+char *cJSON_Print(const cJSON *item) { return NULL; }
+void cJSON_Delete(cJSON *item) {}
+}
+
+
+// The builder before the registry, on patch_device_status()
+static int _to_tenths(float value) {
+    return (int)(value * 10.0f + (value < 0 ? -0.5f : 0.5f));
+}
+
+static void _patch_float(st_status_event event, float value) {
+    patch_device_status(event, value == FLT_MIN ? INT_MIN : _to_tenths(value), 1);
+}
+
+static const char *_reference_body(const sensor_values *values, const derived_metrics *derived) {
+    patch_device_status(ST_STATUS_FINE_DUST, values->fine_dust, 0);
+    _patch_float(ST_STATUS_TEMPERATURE, values->temperature);
+    patch_device_status(ST_STATUS_HUMIDITY, values->humidity, 0);
+    patch_device_status(ST_STATUS_TVOC, values->tvoc, 0);
+    _patch_float(ST_STATUS_TEMPERATURE2, values->temperature2);
+    _patch_float(ST_STATUS_PRESSURE, values->pressure == FLT_MIN ? FLT_MIN : values->pressure / 10.0f);  // hPa to kPa
+#ifdef ENABLE_DERIVED_METRICS_REPORT
+    patch_device_status(ST_STATUS_AQI, derived->aqi, 0);
+    patch_device_status(ST_STATUS_DEW_POINT, derived->dew_point, 1);
+    patch_device_status(ST_STATUS_ABSOLUTE_HUMIDITY, derived->absolute_humidity, 1);
+    patch_device_status(ST_STATUS_TVOC_INDEX, derived->tvoc_index, 0);
+#endif
+    return finish_device_status_body();
+}
+
+// Disables every slot, so that a channel the registry misses cannot keep the reference value
+static void _clear_body() {
+    for (int i = 0; i < ST_STATUS_EVENT_CNT; i++)
+        patch_device_status((st_status_event)i, INT_MIN, 0);
+}
+
+static void _compare(int i, const sensor_values *values, const derived_metrics *derived) {
+    static char expected[2048];  // Larger than the status template
+
+    _clear_body();
+    const char *body = _reference_body(values, derived);
+    if (body != NULL)
+        strcpy(expected, body);
+    _clear_body();
+    const char *actual = build_status_body(values, derived);
+    CHECK(
+        (body == NULL) == (actual == NULL) && (actual == NULL || strcmp(expected, actual) == 0),
+        "reading %d: bodies differ\n  old: %s\n  new: %s", i, body ? expected : "NULL", actual ? actual : "NULL"
+    );
+}
+
+// Same sequence on every run
+static unsigned int _seed = 12345;
+static int _rand() {
+    _seed = _seed * 1103515245 + 12345;
+    return (_seed >> 8) & 0xffff;
+}
+
+static bool _invalid(int chance) {
+    return _rand() % chance == 0;
+}
+
+static void _random_reading(sensor_values *values, derived_metrics *derived) {
+    values->fine_dust = _invalid(7) ? INT_MIN : _rand() % 1200;
+    if (values->fine_dust > PM1006_THRESHOLD)
+        values->fine_dust = INT_MAX;  // As kept by FineDustChannel
+    values->temperature = _invalid(7) ? FLT_MIN : (_rand() - 32768) / 700.0f;
+    values->humidity = _invalid(7) ? INT_MIN : _rand() % 101;
+    values->tvoc = _invalid(7) ? INT_MIN : _rand() % 5000;
+    values->temperature2 = _invalid(7) ? FLT_MIN : (_rand() - 32768) / 900.0f;
+    values->pressure = _invalid(7) ? FLT_MIN : 900 + _rand() / 300.0f;
+    values->fan = FAN_STATE_READY;
+
+    derived->aqi = _invalid(5) ? INT_MIN : _rand() % 500;
+    derived->dew_point = _invalid(5) ? INT_MIN : _rand() % 300 - 100;
+    derived->absolute_humidity = _invalid(5) ? INT_MIN : _rand() % 300;
+    derived->tvoc_index = _invalid(5) ? INT_MIN : _rand() % 5 + 1;
+}
+
+int main() {
+    sensor_values values;
+    derived_metrics derived;
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    for (int i = 0; i < REPORT_CNT && failures <= 10; i++) {
+        _random_reading(&values, &derived);
+        _compare(i, &values, &derived);
+    }
+
+    values = {INT_MIN, FLT_MIN, INT_MIN, FLT_MIN, FLT_MIN, INT_MIN, FAN_STATE_READY};
+    derived = {INT_MIN, INT_MIN, INT_MIN, INT_MIN};
+    _compare(-1, &values, &derived);
+    CHECK(build_status_body(&values, &derived) == NULL, "body without a valid value");
+
+    return check_result();
+}
@@ -0,0 +1,33 @@
+// Host builds only. Declarations of the cJSON calls the firmware sources make.
+// cjson_shim.c parses for real; tests that parse nothing define them as unused stand-ins.
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct cJSON {
+    struct cJSON *next, *prev, *child;
+    int type;
+    char *valuestring;
+    int valueint;
+    double valuedouble;
+    char *string;
+} cJSON;
+
+cJSON *cJSON_Parse(const char *value);
+cJSON *cJSON_ParseWithLength(const char *value, size_t length);
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *string);
+char *cJSON_GetStringValue(const cJSON *item);
+int cJSON_IsNumber(const cJSON *item);
+int cJSON_IsString(const cJSON *item);
+int cJSON_IsBool(const cJSON *item);
+int cJSON_IsTrue(const cJSON *item);
+char *cJSON_Print(const cJSON *item);
+void cJSON_Delete(cJSON *item);
+
+#ifdef __cplusplus
+}
+#endif
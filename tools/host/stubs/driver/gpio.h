@@ -0,0 +1,8 @@
+// Host builds only. Pin numbers are plain ints.
+#pragma once
+
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+
+#define GPIO_NUM_NC -1
@@ -0,0 +1,10 @@
+// Host builds only. Port numbers for config.h; no bus access.
+#pragma once
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+typedef int i2c_port_t;
+
+#define I2C_NUM_0 0
+#define I2C_NUM_1 1
@@ -0,0 +1,8 @@
+// Host builds only. Tests measure time with clock_gettime() instead.
+#pragma once
+
+#include <stdint.h>
+
+static inline uint32_t esp_cpu_get_cycle_count(void) {
+    return 0;
+}
@@ -0,0 +1,8 @@
+// Host builds only. Nothing of the heap is read; the alloc hook is called by the malloc()
+// wraps of the runner instead.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_DEFAULT (1 << 12)
@@ -0,0 +1,50 @@
+// Host builds only. Types and macros of FreeRTOS as configured for the device
+// (CONFIG_FREERTOS_HZ 100). Implemented on pthreads by tools/host/freertos_shim.c.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t configSTACK_DEPTH_TYPE;
+typedef struct shim_queue *QueueHandle_t;
+typedef struct shim_queue *SemaphoreHandle_t;
+typedef struct shim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  pdTRUE
+#define pdFAIL  pdFALSE
+
+#define portMAX_DELAY          ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ     CONFIG_FREERTOS_HZ
+#define configMAX_PRIORITIES   25
+#define portTICK_PERIOD_MS     ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((uint64_t)(xTimeInMs) * configTICK_RATE_HZ) / 1000U))
+#define pdTICKS_TO_MS(xTicks)    ((TickType_t)((uint64_t)(xTicks) * 1000U / configTICK_RATE_HZ))
+
+// One lock for all critical sections, like a single core device
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void shim_enter_critical(portMUX_TYPE *mux);
+void shim_exit_critical(portMUX_TYPE *mux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define taskENTER_CRITICAL(mux) shim_enter_critical(mux)
+#define taskEXIT_CRITICAL(mux)  shim_exit_critical(mux)
+#define portENTER_CRITICAL(mux) shim_enter_critical(mux)
+#define portEXIT_CRITICAL(mux)  shim_exit_critical(mux)
@@ -0,0 +1,22 @@
+// Host builds only. Semaphores are queues of zero sized items, like in FreeRTOS.
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define xSemaphoreCreateBinary()          xSemaphoreCreateCounting(1, 0)
+#define xSemaphoreCreateMutex()           xSemaphoreCreateCounting(1, 1)
+#define xSemaphoreTake(xSemaphore, xBlockTime) xQueueReceive(xSemaphore, NULL, xBlockTime)
+#define xSemaphoreGive(xSemaphore)        xQueueSend(xSemaphore, NULL, 0)
+#define uxSemaphoreGetCount(xSemaphore)   uxQueueMessagesWaiting(xSemaphore)
+#define vSemaphoreDelete(xSemaphore)      vQueueDelete(xSemaphore)
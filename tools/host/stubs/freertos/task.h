@@ -0,0 +1,42 @@
+// Host builds only. Tasks are threads, notifications are per task condition variables.
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef enum {
+    eNoAction,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite
+} eNotifyAction;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+BaseType_t xTaskCreate(
+    TaskFunction_t pxTaskCode, const char *pcName, configSTACK_DEPTH_TYPE usStackDepth,
+    void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask
+);
+void vTaskDelete(TaskHandle_t xTask);  // NULL only
+void vTaskDelay(TickType_t xTicksToDelay);
+BaseType_t xTaskDelayUntil(TickType_t *pxPreviousWakeTime, TickType_t xTimeIncrement);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+const char *pcTaskGetName(TaskHandle_t xTask);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask);  // Always 0 on the host
+
+BaseType_t xTaskNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction);
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+BaseType_t xTaskNotifyWait(
+    uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit,
+    uint32_t *pulNotificationValue, TickType_t xTicksToWait
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define vTaskDelayUntil(pxPreviousWakeTime, xTimeIncrement) \
+    (void)xTaskDelayUntil(pxPreviousWakeTime, xTimeIncrement)
@@ -0,0 +1,4 @@
+// lwIP name resolution on the one of the host.
+#pragma once
+
+#include <netdb.h>
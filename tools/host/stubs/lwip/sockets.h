@@ -0,0 +1,22 @@
+// lwIP sockets on the POSIX ones of the host. Accepted sockets get the send buffer of
+// lwIP (CONFIG_LWIP_TCP_SND_BUF_DEFAULT), so that slow clients fill up as on the device.
+#pragma once
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define LWIP_TCP_SND_BUF 5744
+
+static inline int lwip_host_accept(int fd, struct sockaddr *addr, socklen_t *addrlen) {
+    int client = accept(fd, addr, addrlen);
+    if (client >= 0) {
+        int size = LWIP_TCP_SND_BUF;
+        setsockopt(client, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+    return client;
+}
+#define accept lwip_host_accept
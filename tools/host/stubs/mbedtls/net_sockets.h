@@ -0,0 +1,24 @@
+// Host builds only. The socket layer of mbedTLS, on the POSIX sockets in net_shim.c.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MBEDTLS_NET_PROTO_TCP 0
+
+typedef struct {
+    int fd;
+} mbedtls_net_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mbedtls_net_init(mbedtls_net_context *ctx);
+int mbedtls_net_send(void *ctx, const unsigned char *buf, size_t len);
+int mbedtls_net_recv_timeout(void *ctx, unsigned char *buf, size_t len, uint32_t timeout);
+void mbedtls_net_free(mbedtls_net_context *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,14 @@
+// Host builds only.
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int mbedtls_sha256(const unsigned char *input, size_t len, unsigned char *output, int is224);
+
+#ifdef __cplusplus
+}
+#endif
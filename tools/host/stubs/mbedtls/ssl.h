@@ -0,0 +1,69 @@
+// Host builds only. TLS is not available: mbedtls_ssl_config_defaults() of net_shim.c fails,
+// so host builds reach only the http:// path of main/smartthings/st_client.c.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE -0x7080
+#define MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY   -0x7880
+#define MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL    -0x6A00
+#define MBEDTLS_ERR_SSL_WANT_READ           -0x6900
+#define MBEDTLS_ERR_SSL_WANT_WRITE          -0x6880
+#define MBEDTLS_ERR_SSL_TIMEOUT             -0x6800
+
+#define MBEDTLS_SSL_IS_CLIENT        0
+#define MBEDTLS_SSL_TRANSPORT_STREAM 0
+#define MBEDTLS_SSL_PRESET_DEFAULT   0
+#define MBEDTLS_SSL_VERIFY_REQUIRED  2
+
+typedef struct { int unused; } mbedtls_ssl_context;
+typedef struct { int unused; } mbedtls_ssl_config;
+typedef struct { int unused; } mbedtls_ssl_session;
+
+typedef enum { MBEDTLS_SSL_KEY_EXPORT_TLS12_MASTER_SECRET = 0 } mbedtls_ssl_key_export_type;
+typedef enum { MBEDTLS_SSL_TLS_PRF_NONE = 0 } mbedtls_tls_prf_types;
+typedef enum { MBEDTLS_SSL_VERSION_TLS1_2 = 0x0303 } mbedtls_ssl_protocol_version;
+
+typedef void mbedtls_ssl_export_keys_t(
+    void *ctx, mbedtls_ssl_key_export_type type, const unsigned char *secret, size_t secret_len,
+    const unsigned char client_random[32], const unsigned char server_random[32], mbedtls_tls_prf_types prf_type
+);
+typedef int mbedtls_ssl_send_t(void *ctx, const unsigned char *buf, size_t len);
+typedef int mbedtls_ssl_recv_t(void *ctx, unsigned char *buf, size_t len);
+typedef int mbedtls_ssl_recv_timeout_t(void *ctx, unsigned char *buf, size_t len, uint32_t timeout);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mbedtls_ssl_init(mbedtls_ssl_context *ssl);
+void mbedtls_ssl_free(mbedtls_ssl_context *ssl);
+void mbedtls_ssl_config_init(mbedtls_ssl_config *conf);
+void mbedtls_ssl_config_free(mbedtls_ssl_config *conf);
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf, int endpoint, int transport, int preset);
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config *conf, int authmode);
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config *conf, int (*f_rng)(void *, unsigned char *, size_t), void *p_rng);
+void mbedtls_ssl_conf_read_timeout(mbedtls_ssl_config *conf, uint32_t timeout);
+void mbedtls_ssl_conf_max_tls_version(mbedtls_ssl_config *conf, mbedtls_ssl_protocol_version version);
+int mbedtls_ssl_setup(mbedtls_ssl_context *ssl, const mbedtls_ssl_config *conf);
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context *ssl, const char *hostname);
+void mbedtls_ssl_set_bio(
+    mbedtls_ssl_context *ssl, void *p_bio,
+    mbedtls_ssl_send_t *f_send, mbedtls_ssl_recv_t *f_recv, mbedtls_ssl_recv_timeout_t *f_recv_timeout
+);
+void mbedtls_ssl_set_export_keys_cb(mbedtls_ssl_context *ssl, mbedtls_ssl_export_keys_t *f_export_keys, void *p_export_keys);
+int mbedtls_ssl_handshake(mbedtls_ssl_context *ssl);
+int mbedtls_ssl_write(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len);
+int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len);
+int mbedtls_ssl_close_notify(mbedtls_ssl_context *ssl);
+void mbedtls_ssl_session_init(mbedtls_ssl_session *session);
+void mbedtls_ssl_session_free(mbedtls_ssl_session *session);
+int mbedtls_ssl_set_session(mbedtls_ssl_context *ssl, const mbedtls_ssl_session *session);
+int mbedtls_ssl_get_session(const mbedtls_ssl_context *ssl, mbedtls_ssl_session *session);
+int mbedtls_ssl_session_save(const mbedtls_ssl_session *session, unsigned char *buf, size_t buf_len, size_t *olen);
+int mbedtls_ssl_session_load(mbedtls_ssl_session *session, const unsigned char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,11 @@
+// Host builds only. Force-included into every source: newlib calls missing from
+// older glibc (strlcpy arrived in 2.38), defined in freertos_shim.c. Includes no libc
+// header, so that sources can still pick their feature macros; the C declaration is
+// compatible with the one of newer glibc.
+#pragma once
+
+#include <stddef.h>
+
+#ifndef __cplusplus
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
@@ -0,0 +1,16 @@
+// Host builds only. Declares the LED classes of io.h without a driver.
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+class PWMLed {
+    public:
+        PWMLed(int gpio, int timer, int channel);
+        esp_err_t begin();
+        esp_err_t setBright(int bright);
+        esp_err_t toggle();
+};
+#else
+typedef struct PWMLed PWMLed;
+#endif
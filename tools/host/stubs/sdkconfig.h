@@ -0,0 +1,5 @@
+// Host builds only. The few options the firmware sources read.
+#pragma once
+
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_LOG_MAXIMUM_LEVEL 3
@@ -0,0 +1,6 @@
+// Host builds only. URLs of the SmartThings REST component.
+#pragma once
+
+#define DEVICE_MAIN_COMPONENT_STATUS_URL(device_id) "https://api.smartthings.com/v1/devices/" device_id "/components/main/status"
+#define DEVICE_PREFERENCES_URL(device_id)           "https://api.smartthings.com/v1/devices/" device_id "/preferences"
+#define VIRTUALDEVICE_EVENT_URL(device_id)          "https://api.smartthings.com/v1/virtualdevices/" device_id "/events"
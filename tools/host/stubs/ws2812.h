@@ -0,0 +1,27 @@
+// Host builds only. Declares the strip class of io.h without a driver.
+#pragma once
+
+#include "esp_err.h"
+
+typedef enum {
+    WS2812_OFF,
+    WS2812_RED,
+    WS2812_GREEN,
+    WS2812_BLUE,
+    WS2812_YELLOW,
+    WS2812_ORANGE,
+    WS2812_WHITE
+} ws2812_color;
+
+#ifdef __cplusplus
+class WS2812Strip {
+    public:
+        WS2812Strip(int gpio, int count);
+        esp_err_t begin();
+        esp_err_t setBright(int bright);
+        esp_err_t setColor(int index, ws2812_color color, bool refresh = true);
+        esp_err_t refresh();
+};
+#else
+typedef struct WS2812Strip WS2812Strip;
+#endif
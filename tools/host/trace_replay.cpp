@@ -0,0 +1,203 @@
+// trace_replay_task of main/main.cpp on the host.
+//
+//   trace_replay <trace> [--record <out>]
+//
+// Reads the trace with trace_read() of main/trace.cpp, whose partition is the file here, and
+// feeds the samples through the windows of sensor_registry.h as write_samples() does. At each
+// recorded average, compares get_averages() bit for bit, publishes it on the data bus and
+// builds the status body. Prints the records, the mismatches and the samples per second, and
+// exits with 1 on a mismatch.
+//
+// Traces of tools/trace_synth.py have samples only. --record takes an average after every
+// sample, as get_sensor_value_task does after startup, and writes the samples, offsets and
+// those averages with trace_write() to out, so that replays of out compare against them:
+//   trace_synth.py > synth.bin
+//   trace_replay synth.bin --record recorded.bin
+//   trace_replay recorded.bin
+// Averages of the input are not compared with --record.
+// C++, because only one C source may define the LED colors of io.h.
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+
+#include "config.h"
+#include "adaptive_sampler.h"
+#include "sensor_registry.h"
+#include "data_bus.h"
+#include "trace.h"
+#include "smartthings/st_client.h"
+
+#define TRACE_FRAME_SIZE 40  // sizeof(_trace_frame) of main/trace.cpp
+#define ERASE_SIZE       4096
+
+static std::vector<uint8_t> flash;
+static esp_partition_t partition = {
+    .type = ESP_PARTITION_TYPE_DATA, .subtype = ESP_PARTITION_SUBTYPE_ANY,
+    .address = 0, .size = 0, .erase_size = ERASE_SIZE, .label = TRACE_PARTITION_LABEL
+};
+
+
+extern "C" {
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label) {
+    return strcmp(label, partition.label) == 0 ? &partition : NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    if (src_offset + size > flash.size())
+        return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, flash.data() + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+    if (dst_offset + size > flash.size())
+        return ESP_ERR_INVALID_SIZE;
+    memcpy(flash.data() + dst_offset, src, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    if (offset + size > flash.size())
+        return ESP_ERR_INVALID_SIZE;
+    memset(flash.data() + offset, 0xff, size);
+    return ESP_OK;
+}
+
+// Unused, the status body is built but not sent
+esp_err_t st_client_request(
+    const char *method, const char *url, const char *token,
+    const st_client_chunk *body, int body_cnt, cJSON **response_json, st_client_result *result
+) {
+    return ESP_FAIL;
+}
+
+void log_st_client_stats(void) {}
+}
+
+// Sets the partition to size bytes of erased flash
+static void _erase_flash(size_t size) {
+    size = (size + ERASE_SIZE - 1) / ERASE_SIZE * ERASE_SIZE;
+    flash.assign(size, 0xff);
+    partition.size = size;
+}
+
+static bool _load(const char *path) {
+    FILE *file = fopen(path, "rb");
+    long size;
+
+    if (file == NULL || fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0) {
+        if (file != NULL)
+            fclose(file);
+        return false;
+    }
+    rewind(file);
+    _erase_flash(size);
+    bool ok = fread(flash.data(), 1, size, file) == (size_t)size;
+    fclose(file);
+    return ok;
+}
+
+// Writes the records to path through trace_write()
+static bool _record(const char *path, const std::vector<trace_entry> &records) {
+    size_t size = records.size() * TRACE_FRAME_SIZE;
+    FILE *file;
+
+    _erase_flash(size);
+    if (init_trace() != ESP_OK)
+        return false;
+    for (const trace_entry &record : records)
+        trace_write(&record);
+    if ((file = fopen(path, "wb")) == NULL)
+        return false;
+    bool ok = fwrite(flash.data(), 1, size, file) == size;
+    return fclose(file) == 0 && ok;
+}
+
+int main(int argc, char **argv) {
+    const char *recordPath = argc == 4 && strcmp(argv[2], "--record") == 0 ? argv[3] : NULL;
+    AdaptiveSampler sampler(GET_SENSOR_TASK_DELAY_MIN, SAMPLING_INTERVAL_MAX);
+    DeviceConfig replayConfig = {};
+    std::vector<trace_entry> recorded;
+    trace_entry record;
+    sensor_values average;
+    derived_metrics derived;
+    uint32_t samples = 0, averages = 0, mismatches = 0, bodies = 0;
+
+    if (argc != 2 && recordPath == NULL) {
+        fprintf(stderr, "Usage: %s <trace> [--record <out>]\n", argv[0]);
+        return 2;
+    }
+    if (!_load(argv[1]) || init_trace() != ESP_OK) {
+        fprintf(stderr, "Can not read %s\n", argv[1]);
+        return 2;
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+    init_data_bus();
+    Sensors::init();
+    Sensors::applyConfig(&replayConfig);
+
+    int64_t startTime = esp_timer_get_time();
+    while (trace_read(&record) == ESP_OK) {
+        if (record.type == TRACE_OFFSETS) {
+            replayConfig.offsets.temperature  = record.values.temperature;
+            replayConfig.offsets.humidity     = record.values.humidity;
+            replayConfig.offsets.tvoc         = record.values.tvoc;
+            replayConfig.offsets.temperature2 = record.values.temperature2;
+            replayConfig.offsets.pressure     = record.values.pressure;
+            Sensors::applyConfig(&replayConfig);
+            if (recordPath != NULL)
+                recorded.push_back(record);
+            continue;
+        }
+        if (record.type == TRACE_SAMPLE) {
+            sample_context context = {.sampler = &sampler, .keepFineDust = record.keepFineDust, .fanWindowSamples = 0};
+            Sensors::writeSamples(&record.values, record.tick, &context);
+            samples++;
+            if (recordPath == NULL)
+                continue;
+            recorded.push_back(record);
+        } else if (recordPath != NULL) {
+            continue;
+        }
+        Sensors::getAverages(&average);
+        average.fan = record.values.fan;
+        if (recordPath != NULL) {
+            record.type   = TRACE_AVERAGE;
+            record.values = average;
+            recorded.push_back(record);
+        } else if (memcmp(&average, &record.values, sizeof(average))) {
+            mismatches++;
+            printf(
+                "Mismatch at tick %" PRIu32 ": PM2.5 %d/%d, TVOC %d/%d\n",
+                (uint32_t)record.tick, average.fine_dust, record.values.fine_dust, average.tvoc, record.values.tvoc
+            );
+        }
+        compute_derived_metrics(average.fine_dust, average.temperature, average.humidity, average.tvoc, &derived);
+        data_bus_publish(&average, &derived);
+        if (build_status_body(&average, &derived) != NULL)
+            bodies++;
+        averages++;
+    }
+    int64_t elapsed = esp_timer_get_time() - startTime;
+
+    printf(
+        "Replayed %" PRIu32 " samples, %" PRIu32 " averages (%" PRIu32 " mismatches, %" PRIu32 " bodies) in %" PRId64 "us (%" PRId64 " samples/s).\n",
+        samples, averages, mismatches, bodies, elapsed, elapsed ? (int64_t)samples * 1000000 / elapsed : 0
+    );
+    if (recordPath != NULL) {
+        if (!_record(recordPath, recorded)) {
+            fprintf(stderr, "Can not write %s\n", recordPath);
+            return 2;
+        }
+        printf("Recorded %zu frames to %s\n", recorded.size(), recordPath);
+    }
+    return mismatches ? 1 : 0;
+}
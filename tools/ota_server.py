@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Local stand-in for the OTA server.
+
+Usage: ota_server.py --version 1.2.0 --image build/Vindriktning.bin [--patch patch.bin] [--port 8070]
+
+Serves /manifest.json, /image.bin and /patch.bin. Point OTA_MANIFEST_URL in
+secrets.h at http://<this host>:<port>/manifest.json.
+
+This is plain, unencrypted HTTP for a trusted local network only. Anyone on the
+path can read the image and replace it together with the hashes of the manifest,
+which the device would accept unless signed images are enabled (See "OTA" of
+main/configs/config.h). Serve real updates from an HTTPS server whose certificate
+is in the ESP-IDF certificate bundle.
+
+Patches are made with the generator of the esp_delta_ota component, e.g.
+    esp_delta_ota_patch_gen.py create_patch --chip esp32s2 \\
+        --base_binary old.bin --new_binary build/Vindriktning.bin --patch_file_name patch.bin
+"""
+import argparse
+import hashlib
+import http.server
+import json
+import os
+
+
+def describe(path, name, host):
+    with open(path, 'rb') as f:
+        data = f.read()
+    return {'url': f'http://{host}/{name}', 'size': len(data), 'sha256': hashlib.sha256(data).hexdigest()}
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--version', required=True, help='version of the new image (PROJECT_VER)')
+    parser.add_argument('--image', required=True)
+    parser.add_argument('--patch')
+    parser.add_argument('--port', type=int, default=8070)
+    args = parser.parse_args()
+
+    files = {'/image.bin': args.image}
+    if args.patch:
+        files['/patch.bin'] = args.patch
+        print(f'Patch is {os.path.getsize(args.patch) * 100 // os.path.getsize(args.image)}% of the image.')
+
+    class Handler(http.server.BaseHTTPRequestHandler):
+        def do_GET(self):
+            host = self.headers.get('Host', f'localhost:{args.port}')
+            if self.path == '/manifest.json':
+                manifest = {'version': args.version, 'image': describe(args.image, 'image.bin', host)}
+                if args.patch:
+                    manifest['patch'] = describe(args.patch, 'patch.bin', host)
+                body = json.dumps(manifest).encode()
+            elif self.path in files:
+                with open(files[self.path], 'rb') as f:
+                    body = f.read()
+            else:
+                self.send_error(404)
+                return
+            self.send_response(200)
+            self.send_header('Content-Length', str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+    print(f'Serving plain HTTP on port {args.port}. Unencrypted, for a trusted local network only.')
+    http.server.ThreadingHTTPServer(('', args.port), Handler).serve_forever()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+"""Load test of the SSE stream (ENABLE_SSE_SERVER).
+
+Usage: sse_load_test.py <device> [--port 8080] [--clients 16] [--slow 2] [--raw] [--duration 60]
+
+Opens --clients reading clients and --slow clients which stop reading after the
+response header. Clients over SSE_MAX_CLIENTS are expected to be refused with 503,
+and retry every --retry seconds. Slow clients are expected to be disconnected by
+the device once their buffer is full, which frees their slots for the others.
+
+Reports per client events, missed averages (gaps in "seq"), and the spread of
+arrival times of the same average across clients. Producer ticks between averages
+show whether slow clients stalled the sensor path.
+Exits with 1 when a reading client missed averages while connected, or when a
+slow client was never disconnected.
+"""
+import argparse
+import asyncio
+import json
+import socket
+import statistics
+import sys
+import time
+
+TICK_MS = 10  # configTICK_RATE_HZ 100
+
+
+class Client:
+    def __init__(self, name, slow):
+        self.name = name
+        self.slow = slow
+        self.events = 0
+        self.samples = 0
+        self.refused = 0
+        self.connects = 0
+        self.dropped = False  # Disconnected by the device
+        self.gaps = 0
+        self.last_seq = None
+        self.arrivals = {}  # seq -> time
+        self.ticks = {}     # seq -> producer tick
+
+
+def parse_event(lines):
+    event, data = 'message', []
+    for line in lines:
+        if line.startswith('event:'):
+            event = line[6:].strip()
+        elif line.startswith('data:'):
+            data.append(line[5:].strip())
+    return event, json.loads('\n'.join(data)) if data else None
+
+
+# A plain socket with a small receive buffer, which is never read after the status line.
+async def run_slow_client(args, client, deadline, request):
+    loop = asyncio.get_running_loop()
+    while time.monotonic() < deadline:
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1024)
+        sock.setblocking(False)
+        try:
+            await loop.sock_connect(sock, (args.device, args.port))
+            await loop.sock_sendall(sock, request)
+            status = await loop.sock_recv(sock, 13)
+        except OSError:
+            sock.close()
+            await asyncio.sleep(args.retry)
+            continue
+        if b' 200' not in status:
+            client.refused += 1
+            sock.close()
+            await asyncio.sleep(args.retry)
+            continue
+        client.connects += 1
+        while time.monotonic() < deadline:
+            await asyncio.sleep(0.5)
+            try:  # Writes to a connection closed by the device fail once it answers with RST
+                sock.send(b'\r\n')
+            except BlockingIOError:
+                pass
+            except OSError:
+                client.dropped = True
+                break
+        sock.close()
+        return
+
+
+async def run_client(args, client, deadline):
+    path = '/events?raw=1' if args.raw else '/events'
+    request = f'GET {path} HTTP/1.1\r\nHost: {args.device}\r\nAccept: text/event-stream\r\n\r\n'.encode()
+    if client.slow:
+        await run_slow_client(args, client, deadline, request)
+        return
+    while time.monotonic() < deadline:
+        try:
+            reader, writer = await asyncio.open_connection(args.device, args.port)
+        except OSError:
+            await asyncio.sleep(args.retry)
+            continue
+        writer.write(request)
+        await writer.drain()
+        status = await reader.readline()
+        if b' 200 ' not in status:
+            client.refused += 1
+            writer.close()
+            await asyncio.sleep(args.retry)
+            continue
+        client.connects += 1
+        client.last_seq = None
+        while (await reader.readline()) not in (b'\r\n', b''):
+            pass
+
+        lines = []
+        try:
+            while time.monotonic() < deadline:
+                line = await asyncio.wait_for(reader.readline(), deadline - time.monotonic())
+                if not line:
+                    client.dropped = True
+                    break
+                line = line.decode().rstrip('\r\n')
+                if line:
+                    lines.append(line)
+                    continue
+                event, data = parse_event(lines)
+                lines = []
+                if event == 'sample':
+                    client.samples += 1
+                elif event == 'average':
+                    client.events += 1
+                    seq = data['seq']
+                    if client.last_seq is not None and seq > client.last_seq + 1:
+                        client.gaps += seq - client.last_seq - 1
+                    client.last_seq = seq
+                    client.arrivals[seq] = time.monotonic()
+                    client.ticks[seq] = data['tick']
+        except asyncio.TimeoutError:
+            pass
+        writer.close()
+        if client.dropped:
+            await asyncio.sleep(args.retry)
+
+
+async def run(args):
+    deadline = time.monotonic() + args.duration
+    # Slow clients first, so that they take slots before the readers
+    clients = [Client(f'slow{i}', True) for i in range(args.slow)]
+    clients += [Client(f'reader{i}', False) for i in range(args.clients)]
+    await asyncio.gather(*(run_client(args, c, deadline) for c in clients))
+    return clients
+
+
+def report(clients):
+    failed = False
+    print(f'{"client":<10} {"connects":>8} {"refused":>8} {"averages":>8} {"samples":>8} {"missed":>6}  dropped')
+    for c in clients:
+        print(f'{c.name:<10} {c.connects:>8} {c.refused:>8} {c.events:>8} {c.samples:>8} {c.gaps:>6}  {c.dropped}')
+        if not c.slow and c.gaps:
+            failed = True
+        if c.slow and c.connects and not c.dropped:
+            failed = True
+
+    arrivals, ticks = {}, {}
+    for c in clients:
+        for seq, t in c.arrivals.items():
+            arrivals.setdefault(seq, []).append(t)
+        ticks.update(c.ticks)
+    spreads = [(max(t) - min(t)) * 1000 for t in arrivals.values() if len(t) > 1]
+    if spreads:
+        print(f'Arrival spread across clients: mean {statistics.mean(spreads):.1f}ms, max {max(spreads):.1f}ms')
+    seqs = sorted(ticks)
+    intervals = [
+        (ticks[b] - ticks[a]) * TICK_MS / (b - a) for a, b in zip(seqs, seqs[1:])
+    ]
+    if intervals:
+        print(
+            f'Producer interval: mean {statistics.mean(intervals):.0f}ms, max {max(intervals):.0f}ms '
+            f'({len(seqs)} averages)'
+        )
+    return failed
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('device', help='host name or IP address of the device')
+    parser.add_argument('--port', type=int, default=8080, help='SSE_PORT')
+    parser.add_argument('--clients', type=int, default=16, help='reading clients')
+    parser.add_argument('--slow', type=int, default=2, help='clients which stop reading')
+    parser.add_argument('--raw', action='store_true', help='subscribe to raw samples too')
+    parser.add_argument('--duration', type=float, default=60, help='seconds')
+    parser.add_argument('--retry', type=float, default=1, help='seconds before reconnecting')
+    args = parser.parse_args()
+
+    clients = asyncio.run(run(args))
+    sys.exit(1 if report(clients) else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,298 @@
+#!/usr/bin/env python3
+"""Local stand-in for the SmartThings API with fault injection.
+
+Usage: st_standin.py [--port 8090] [--scenarios scenarios.json] [--settle 60] [--serve]
+
+Serves the endpoints used by main/smartthings/request.c:
+    GET  /v1/devices/<id>/components/main/status
+    GET  /v1/devices/<id>/preferences
+    POST /v1/virtualdevices/<id>/events
+Set ST_API_BASE_URL in config.h to http://<this host>:<port> and flash the device, or run
+`make -C tools/host st_standin`, which runs request.c and st_client.c on the host over plain
+http against it. st_standin_client.py stands in for the device to check the report.
+
+Waits --settle seconds for the device to report, then runs each scenario: faults for
+"duration" seconds, then an observation window of "recovery" seconds. A command (fanSpeed
+change) is issued at the start of each scenario. Per scenario, reports
+  - staleness: age of the last accepted status upload, sampled every 0.5s (mean/max)
+  - command latency: command to the first clean status response
+  - recovery: end of faults to the first clean upload and status response
+--serve only serves clean responses, e.g. to develop against.
+
+A scenario is an object of
+    name, duration, recovery  Seconds
+    endpoints                 Subset of ["status", "preferences", "events"]. Default all.
+    latency                   Seconds before responding, or [min, max]
+    drop                      Probability of closing the connection without a response
+    error, error_rate         HTTP status (e.g. 503, 429) and its probability
+    retry_after               Retry-After header of errors, seconds
+    truncate                  Probability of closing after half of the body
+    malformed                 Probability of a body which is not valid JSON
+Faults are tried in the order above. Exits with 1 when a scenario does not recover.
+"""
+import argparse
+import datetime
+import http.server
+import json
+import random
+import statistics
+import sys
+import threading
+import time
+
+DEFAULT_SCENARIOS = [
+    {'name': 'baseline', 'duration': 60, 'recovery': 0},
+    {'name': 'latency 3s', 'duration': 120, 'recovery': 60, 'latency': 3},
+    {'name': 'latency 20s', 'duration': 120, 'recovery': 60, 'latency': 20},
+    {'name': 'drop 30%', 'duration': 120, 'recovery': 60, 'drop': 0.3},
+    {'name': '503 outage', 'duration': 120, 'recovery': 60, 'error': 503, 'error_rate': 1},
+    {'name': '500 flaky', 'duration': 120, 'recovery': 60, 'error': 500, 'error_rate': 0.5},
+    {'name': '429 rate limit', 'duration': 120, 'recovery': 60, 'error': 429, 'error_rate': 1, 'retry_after': 30},
+    {'name': 'truncated status', 'duration': 60, 'recovery': 60, 'endpoints': ['status', 'preferences'], 'truncate': 1},
+    {'name': 'malformed JSON', 'duration': 60, 'recovery': 60, 'endpoints': ['status', 'preferences'], 'malformed': 1},
+]
+
+PREFERENCES = {
+    'tempHigh': 27, 'tempLow': 18, 'humiHigh': 60, 'humiLow': 40,
+    'fineDustVeryBad': 150, 'fineDustBad': 100, 'fineDustWarning': 50, 'fineDustNormal': 15,
+    'illuminanceHigh': 5, 'illuminanceLow': 3,
+    'temperatureOffset': 0.0, 'humidityOffset': 0, 'tvocOffset': 0,
+    'temperature2Offset': 0.0, 'pressureOffset': 0.0,
+    'localRules': '',
+}
+
+
+def iso_now():
+    return datetime.datetime.now(datetime.timezone.utc).strftime('%Y-%m-%dT%H:%M:%S.%f')[:-3] + 'Z'
+
+
+class State:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.fault = {}
+        self.switch_level = 50
+        self.fan_speed = 0
+        self.switch_timestamp = self.fan_timestamp = iso_now()
+        self.last_upload = None        # Time of the last clean status upload
+        self.last_status = None        # Time of the last clean status response
+        self.values = {}
+        self.counts = {}
+
+    def count(self, endpoint, outcome):
+        key = (endpoint, outcome)
+        with self.lock:
+            self.counts[key] = self.counts.get(key, 0) + 1
+
+    def command(self):
+        self.fan_speed = (self.fan_speed + 1) % 4
+        self.fan_timestamp = iso_now()
+
+
+def endpoint_of(method, path):
+    parts = path.split('?')[0].strip('/').split('/')
+    if method == 'GET' and len(parts) == 6 and parts[:2] == ['v1', 'devices'] and parts[3:] == ['components', 'main', 'status']:
+        return 'status'
+    if method == 'GET' and len(parts) == 4 and parts[:2] == ['v1', 'devices'] and parts[3] == 'preferences':
+        return 'preferences'
+    if method == 'POST' and len(parts) == 4 and parts[:2] == ['v1', 'virtualdevices'] and parts[3] == 'events':
+        return 'events'
+    return None
+
+
+def make_handler(state, verbose):
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = 'HTTP/1.1'
+
+        def log_message(self, format, *args):
+            if verbose:
+                super().log_message(format, *args)
+
+        def body_of(self, endpoint, request_body):
+            with state.lock:
+                if endpoint == 'status':
+                    return {
+                        'switchLevel': {'level': {'value': state.switch_level, 'timestamp': state.switch_timestamp}},
+                        'fanSpeed': {'fanSpeed': {'value': state.fan_speed, 'timestamp': state.fan_timestamp}},
+                    }
+                if endpoint == 'preferences':
+                    return {'values': {name: {'value': value} for name, value in PREFERENCES.items()}}
+            events = json.loads(request_body)['deviceEvents']
+            with state.lock:
+                for event in events:
+                    state.values[f'{event["component"]}.{event["attribute"]}'] = event['value']
+            return {}
+
+        def respond(self, status, body, headers=()):
+            self.send_response(status)
+            self.send_header('Content-Type', 'application/json')
+            self.send_header('Content-Length', str(len(body)))
+            for name, value in headers:
+                self.send_header(name, value)
+            self.end_headers()
+            self.wfile.write(body)
+
+        def handle_request(self, method):
+            endpoint = endpoint_of(method, self.path)
+            length = int(self.headers.get('Content-Length', 0))
+            request_body = self.rfile.read(length) if length else b''
+            if endpoint is None:
+                self.respond(404, b'{"error":"not found"}')
+                return
+
+            with state.lock:
+                fault = dict(state.fault) if endpoint in state.fault.get('endpoints', [endpoint]) else {}
+            latency = fault.get('latency', 0)
+            if isinstance(latency, list):
+                latency = random.uniform(*latency)
+            if latency:
+                time.sleep(latency)
+
+            if random.random() < fault.get('drop', 0):
+                state.count(endpoint, 'drop')
+                self.close_connection = True
+                return
+            if random.random() < fault.get('error_rate', 0):
+                status = fault.get('error', 503)
+                state.count(endpoint, str(status))
+                headers = [('Retry-After', str(fault['retry_after']))] if fault.get('retry_after') else []
+                self.respond(status, b'{"error":"injected"}', headers)
+                return
+
+            try:
+                body = json.dumps(self.body_of(endpoint, request_body)).encode()
+            except (ValueError, KeyError, TypeError):
+                state.count(endpoint, 'bad request')
+                self.respond(400, b'{"error":"invalid body"}')
+                return
+            if random.random() < fault.get('truncate', 0):
+                state.count(endpoint, 'truncate')
+                self.send_response(200)
+                self.send_header('Content-Length', str(len(body)))
+                self.end_headers()
+                self.wfile.write(body[:len(body) // 2])
+                self.close_connection = True
+                return
+            if random.random() < fault.get('malformed', 0):
+                state.count(endpoint, 'malformed')
+                self.respond(200, body[:-1] + b',}')
+                return
+
+            state.count(endpoint, 'ok')
+            with state.lock:
+                if endpoint == 'events':
+                    state.last_upload = time.monotonic()
+                elif endpoint == 'status':
+                    state.last_status = time.monotonic()
+            self.respond(200, body)
+
+        def do_GET(self):
+            self.handle_request('GET')
+
+        def do_POST(self):
+            self.handle_request('POST')
+
+    return Handler
+
+
+def run_scenario(state, scenario):
+    duration, recovery = scenario['duration'], scenario.get('recovery', 60)
+    with state.lock:
+        state.counts = {}
+        state.fault = {k: v for k, v in scenario.items() if k not in ('name', 'duration', 'recovery')}
+        state.command()
+        command_time = time.monotonic()
+        status_before = state.last_status
+
+    ages, command_latency = [], None
+    start = time.monotonic()
+    fault_end = start + duration
+    upload_recovery = status_recovery = None
+    while time.monotonic() < fault_end + recovery:
+        time.sleep(0.5)
+        now = time.monotonic()
+        with state.lock:
+            if now >= fault_end and state.fault:
+                state.fault = {}
+            last_upload, last_status = state.last_upload, state.last_status
+        if last_upload is not None:
+            ages.append(now - last_upload)
+        if command_latency is None and last_status is not None and last_status != status_before:
+            command_latency = last_status - command_time
+        if now >= fault_end:
+            if upload_recovery is None and last_upload is not None and last_upload >= fault_end:
+                upload_recovery = last_upload - fault_end
+            if status_recovery is None and last_status is not None and last_status >= fault_end:
+                status_recovery = last_status - fault_end
+            if recovery and upload_recovery is not None and status_recovery is not None:
+                break
+    with state.lock:
+        state.fault = {}
+        counts = dict(state.counts)
+    return {
+        'name': scenario['name'],
+        'staleness_mean': statistics.mean(ages) if ages else None,
+        'staleness_max': max(ages) if ages else None,
+        'command_latency': command_latency,
+        'upload_recovery': upload_recovery if recovery else 0,
+        'status_recovery': status_recovery if recovery else 0,
+        'counts': counts,
+    }
+
+
+def seconds(value):
+    return '-' if value is None else f'{value:.1f}s'
+
+
+def report(results):
+    failed = False
+    print(f'{"scenario":<18} {"stale mean":>10} {"stale max":>10} {"command":>8} {"upload":>8} {"status":>8}  requests')
+    for r in results:
+        counts = ' '.join(f'{e}:{o}={n}' for (e, o), n in sorted(r['counts'].items()))
+        print(
+            f'{r["name"]:<18} {seconds(r["staleness_mean"]):>10} {seconds(r["staleness_max"]):>10} '
+            f'{seconds(r["command_latency"]):>8} {seconds(r["upload_recovery"]):>8} {seconds(r["status_recovery"]):>8}  {counts}'
+        )
+        if r['upload_recovery'] is None or r['status_recovery'] is None:
+            failed = True
+    print('command: command to the first clean status response, upload/status: end of faults to the first clean request')
+    return failed
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--port', type=int, default=8090)
+    parser.add_argument('--scenarios', help='JSON list of scenarios, instead of the defaults')
+    parser.add_argument('--settle', type=float, default=60, help='seconds to wait for the first upload')
+    parser.add_argument('--serve', action='store_true', help='serve clean responses only')
+    parser.add_argument('--verbose', action='store_true', help='log every request')
+    args = parser.parse_args()
+
+    state = State()
+    server = http.server.ThreadingHTTPServer(('', args.port), make_handler(state, args.verbose or args.serve))
+    server.daemon_threads = True
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    if args.serve:
+        threading.Event().wait()
+
+    scenarios = DEFAULT_SCENARIOS
+    if args.scenarios:
+        with open(args.scenarios) as f:
+            scenarios = json.load(f)
+
+    deadline = time.monotonic() + args.settle
+    while state.last_upload is None and time.monotonic() < deadline:
+        time.sleep(0.5)
+    if state.last_upload is None:
+        print(f'No status upload in {args.settle:.0f}s. Check ST_API_BASE_URL.')
+        sys.exit(1)
+
+    results = []
+    for scenario in scenarios:
+        print(f'Running {scenario["name"]}...', flush=True)
+        results.append(run_scenario(state, scenario))
+    server.shutdown()
+    sys.exit(1 if report(results) else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""Scripted device for checking st_standin.py without hardware.
+
+Usage: st_standin_client.py [--port 8090] [--poll 1] [--upload 2] [--timeout 5]
+
+Calls the stand-in the way device_status_task does, without its retries and request budget:
+GET status and preferences every --poll seconds, and POST a status body every --upload
+seconds. Each failed request is printed. Runs until interrupted.
+
+For example, with the short scenarios of st_standin_smoke.json (about a minute):
+    st_standin.py --port 8091 --settle 5 --scenarios st_standin_smoke.json &
+    st_standin_client.py --port 8091
+Every scenario should recover, and staleness should follow the fault: up to --upload
+seconds clean, plus the injected latency, drops and errors while faulty.
+"""
+import argparse
+import http.client
+import json
+import threading
+import time
+import urllib.request
+
+DEVICE_ID = 'standin'
+STATUS_BODY = {'deviceEvents': [
+    {'component': 'airQuality', 'capability': 'tvocMeasurement', 'attribute': 'tvocLevel', 'value': 118, 'unit': 'ppb'},
+]}
+
+
+def request(args, method, path, body=None):
+    data = json.dumps(body).encode() if body is not None else None
+    req = urllib.request.Request(f'http://127.0.0.1:{args.port}{path}', data=data, method=method)
+    try:
+        with urllib.request.urlopen(req, timeout=args.timeout) as response:
+            json.loads(response.read())  # Truncated or malformed bodies fail here, as in cJSON_Parse()
+    except (OSError, ValueError, http.client.HTTPException) as e:  # HTTPError is an OSError
+        print(f'{time.strftime("%H:%M:%S")} {method} {path}: {e}', flush=True)
+
+
+def poll(args):
+    while True:
+        request(args, 'GET', f'/v1/devices/{DEVICE_ID}/components/main/status')
+        request(args, 'GET', f'/v1/devices/{DEVICE_ID}/preferences')
+        time.sleep(args.poll)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--port', type=int, default=8090)
+    parser.add_argument('--poll', type=float, default=1, help='seconds between status polls')
+    parser.add_argument('--upload', type=float, default=2, help='seconds between status uploads')
+    parser.add_argument('--timeout', type=float, default=5, help='seconds per request')
+    args = parser.parse_args()
+
+    threading.Thread(target=poll, args=(args,), daemon=True).start()
+    try:
+        while True:
+            request(args, 'POST', f'/v1/virtualdevices/{DEVICE_ID}/events', STATUS_BODY)
+            time.sleep(args.upload)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+"""Convert a sensor trace into CSV.
+
+Usage: trace_decode.py [trace.bin]  (reads stdin when omitted)
+
+The input is either a UART capture (ENABLE_TRACE_RECORD without TRACE_SINK_FLASH),
+or a dump of the trace partition, e.g.
+    parttool.py read_partition --partition-name trace --output trace.bin
+A dump can be written back with `parttool.py write_partition` for ENABLE_TRACE_REPLAY.
+"""
+import csv
+import struct
+import sys
+
+MAGIC = 0x7ACE
+FRAME = struct.Struct('<HBBIififfi4h')  # Must match _trace_frame of main/trace.cpp
+KEEP_FINE_DUST = 0x80
+TYPES = {1: 'sample', 2: 'average', 3: 'offsets'}  # Offsets are in the reading columns
+SENSORS = ('pm1006', 'aht20', 'bmp280', 'ags02ma')
+INT_MIN = -2 ** 31
+FLT_MIN = struct.unpack('<f', struct.pack('<I', 0x00800000))[0]
+
+
+def invalid_as_empty(value):
+    return '' if value in (INT_MIN, FLT_MIN) else value
+
+
+def main():
+    stream = open(sys.argv[1], 'rb') if len(sys.argv) > 1 else sys.stdin.buffer
+    data = stream.read()
+    out = csv.writer(sys.stdout)
+    out.writerow(
+        ('type', 'tick', 'fan', 'keep_fine_dust', 'fine_dust', 'temperature', 'humidity', 'temperature2', 'pressure', 'tvoc')
+        + tuple(f'error_{name}' for name in SENSORS)
+    )
+    pos = 0
+    while pos + FRAME.size <= len(data):
+        magic, kind, fan, tick, *values = FRAME.unpack_from(data, pos)
+        if magic != MAGIC or kind not in TYPES:
+            pos += 1  # Resync on interleaved log output
+            continue
+        pos += FRAME.size
+        readings, errors = values[:6], values[6:]
+        out.writerow(
+            (TYPES[kind], tick, fan & ~KEEP_FINE_DUST, int(bool(fan & KEEP_FINE_DUST)))
+            + tuple(invalid_as_empty(value) for value in readings)
+            + tuple(errors)
+        )
+
+
+if __name__ == '__main__':
+    main()
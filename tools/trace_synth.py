@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+"""Write a synthetic sensor trace, for trying change_eval.py without a recording.
+
+Usage: trace_synth.py [--noisy] [--hours 24] [--seed N] > trace.bin
+
+Writes sample frames of ENABLE_TRACE_RECORD, one every 5s (tick 500 at 100Hz), with the fan
+ready. PM2.5 and TVOC follow a diurnal baseline with AR(1) noise, and PM2.5 has rare
+one-sample glitches. Other readings are constant. The defaults (seed 7) and --noisy (seed 11)
+write the two traces quoted for the change detector:
+    trace_synth.py | trace_decode.py | change_eval.py
+    trace_synth.py --noisy | trace_decode.py | change_eval.py
+make -C tools/host replay runs a trace through the sample windows of the firmware on the host.
+A synthetic trace only checks the tooling and gives rough numbers. Tune CHANGE_DETECT_* on a
+recording of the device.
+"""
+import argparse
+import math
+import random
+import struct
+import sys
+
+MAGIC = 0x7ACE
+FRAME = struct.Struct('<HBBIififfi4h')  # Must match _trace_frame of main/trace.cpp
+TRACE_SAMPLE = 1
+FAN_STATE_READY = 2
+PERIOD = 5        # Seconds per sample
+TICK_HZ = 100
+DAY = 86400
+
+# seed, sigma of PM2.5 noise, sigma of TVOC noise
+PROFILES = {'quiet': (7, 1.0, 4), 'noisy': (11, 1.4, 6)}
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--noisy', action='store_true', help='stronger AR(1) noise')
+    parser.add_argument('--hours', type=float, default=24)
+    parser.add_argument('--seed', type=int, help='instead of the seed of the profile')
+    args = parser.parse_args()
+
+    seed, pm_sigma, tvoc_sigma = PROFILES['noisy' if args.noisy else 'quiet']
+    random.seed(args.seed if args.seed is not None else seed)
+    out = bytearray()
+    pm_noise = tvoc_noise = 0.0
+    for n in range(int(args.hours * 3600 / PERIOD)):
+        t = n * PERIOD
+        pm_noise = 0.9 * pm_noise + random.gauss(0, pm_sigma)
+        pm = max(0, round(12 + 8 * math.sin(2 * math.pi * t / DAY) + 3 * math.sin(2 * math.pi * t / 7200) + pm_noise))
+        if random.random() < 0.002:
+            pm += random.randint(3, 8)  # One-sample glitch
+        tvoc_noise = 0.95 * tvoc_noise + random.gauss(0, tvoc_sigma)
+        tvoc = max(0, round(180 + 60 * math.sin(2 * math.pi * t / DAY + 1) + tvoc_noise))
+        out += FRAME.pack(MAGIC, TRACE_SAMPLE, FAN_STATE_READY, t * TICK_HZ, pm, 23.0, 45, 23.5, 1013.0, tvoc, 0, 0, 0, 0)
+    sys.stdout.buffer.write(out)
+
+
+if __name__ == '__main__':
+    main()